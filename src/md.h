@@ -29,7 +29,7 @@ struct md_pkey_t;
 struct md_result_t;
 struct md_store_t;
 struct md_srv_conf_t;
-struct md_pkey_spec_t;
+struct md_pkeys_spec_t;
 
 #define MD_PKEY_RSA_BITS_MIN       2048
 #define MD_PKEY_RSA_BITS_DEF       2048
@@ -80,7 +80,7 @@ struct md_t {
     md_require_t require_https;     /* Iff https: is required for this MD */
     
     int renew_mode;                 /* mode of obtaining credentials */
-    struct md_pkey_spec_t *pkey_spec;/* specification for generating new private keys */
+    struct md_pkeys_spec_t *pks;    /* specification for generating private keys, one per cert */
     int must_staple;                /* certificates should set the OCSP Must Staple extension */
     md_timeslice_t *renew_window;  /* time before expiration that starts renewal */
     md_timeslice_t *warn_window;   /* time before expiration that warnings are sent out */
@@ -104,6 +104,7 @@ struct md_t {
     unsigned defn_line_number;      /* line number of definition */
     
     const char *configured_name;    /* name this MD was configured with, if different */
+    const char *config_hash;        /* digest of the configuration last saved, see md_config_hash() */
 };
 
 #define MD_KEY_ACCOUNT          "account"
@@ -111,20 +112,25 @@ struct md_t {
 #define MD_KEY_ACTIVATION_DELAY "activation-delay"
 #define MD_KEY_ACTIVITY         "activity"
 #define MD_KEY_AGREEMENT        "agreement"
+#define MD_KEY_ASPECT           "aspect"
 #define MD_KEY_AUTHORIZATIONS   "authorizations"
 #define MD_KEY_BITS             "bits"
 #define MD_KEY_CA               "ca"
 #define MD_KEY_CA_URL           "ca-url"
 #define MD_KEY_CERT             "cert"
+#define MD_KEY_CERTS            "certs"
 #define MD_KEY_CERT_FILE        "cert-file"
 #define MD_KEY_CERTIFICATE      "certificate"
 #define MD_KEY_CHALLENGE        "challenge"
 #define MD_KEY_CHALLENGES       "challenges"
 #define MD_KEY_CMD_DNS01        "cmd-dns-01"
+#define MD_KEY_CMD_DNS01_BATCH  "cmd-dns-01-batch"
 #define MD_KEY_COMPLETE         "complete"
+#define MD_KEY_CONFIG_HASH      "config-hash"
 #define MD_KEY_CONTACT          "contact"
 #define MD_KEY_CONTACTS         "contacts"
 #define MD_KEY_CSR              "csr"
+#define MD_KEY_CURVE            "curve"
 #define MD_KEY_DETAIL           "detail"
 #define MD_KEY_DISABLED         "disabled"
 #define MD_KEY_DIR              "dir"
@@ -135,12 +141,15 @@ struct md_t {
 #define MD_KEY_ERROR            "error"
 #define MD_KEY_ERRORS           "errors"
 #define MD_KEY_EXPIRES          "expires"
+#define MD_KEY_EXPLANATION      "explanation"
 #define MD_KEY_FINALIZE         "finalize"
 #define MD_KEY_FINISHED         "finished"
 #define MD_KEY_FROM             "from"
 #define MD_KEY_GOOD             "good"
+#define MD_KEY_GROUP            "group"
 #define MD_KEY_HTTP             "http"
 #define MD_KEY_HTTPS            "https"
+#define MD_KEY_HTTP_TIMING      "http-timing"
 #define MD_KEY_ID               "id"
 #define MD_KEY_IDENTIFIER       "identifier"
 #define MD_KEY_KEY              "key"
@@ -154,13 +163,18 @@ struct md_t {
 #define MD_KEY_MUST_STAPLE      "must-staple"
 #define MD_KEY_NAME             "name"
 #define MD_KEY_NEXT_RUN         "next-run"
+#define MD_KEY_NEXT_UPDATE      "next-update"
 #define MD_KEY_NOTIFIED         "notified"
 #define MD_KEY_OCSP             "ocsp"
 #define MD_KEY_OCSPS            "ocsps"
+#define MD_KEY_OP               "op"
 #define MD_KEY_ORDERS           "orders"
+#define MD_KEY_OWNER            "owner"
+#define MD_KEY_PER_HOUR         "per-hour"
 #define MD_KEY_PERMANENT        "permanent"
 #define MD_KEY_PKEY             "privkey"
 #define MD_KEY_PKEY_FILE        "pkey-file"
+#define MD_KEY_POLLS            "polls"
 #define MD_KEY_PROBLEM          "problem"
 #define MD_KEY_PROTO            "proto"
 #define MD_KEY_READY            "ready"
@@ -169,11 +183,13 @@ struct md_t {
 #define MD_KEY_RENEW_AT         "renew-at"
 #define MD_KEY_RENEW_MODE       "renew-mode"
 #define MD_KEY_RENEWAL          "renewal"
+#define MD_KEY_RENEWAL_INFO     "renewal-info"
 #define MD_KEY_RENEWING         "renewing"
 #define MD_KEY_RENEW_WINDOW     "renew-window"
 #define MD_KEY_REQUIRE_HTTPS    "require-https"
 #define MD_KEY_RESOURCE         "resource"
 #define MD_KEY_RESPONSE         "response"
+#define MD_KEY_SEQ              "seq"
 #define MD_KEY_REVOKED          "revoked"
 #define MD_KEY_SERIAL           "serial"
 #define MD_KEY_SHA256_FINGERPRINT  "sha256-fingerprint"
@@ -184,6 +200,7 @@ struct md_t {
 #define MD_KEY_SUBPROBLEMS      "subproblems"
 #define MD_KEY_TEMPORARY        "temporary"
 #define MD_KEY_TOKEN            "token"
+#define MD_KEY_TOKENS           "tokens"
 #define MD_KEY_TOTAL            "total"
 #define MD_KEY_TRANSITIVE       "transitive"
 #define MD_KEY_TYPE             "type"
@@ -197,6 +214,7 @@ struct md_t {
 #define MD_KEY_VERSION          "version"
 #define MD_KEY_WATCHED          "watched"
 #define MD_KEY_WHEN             "when"
+#define MD_KEY_WINDOW           "window"
 #define MD_KEY_WARN_WINDOW      "warn-window"
 
 /* Check if a string member of a new MD (n) has 
@@ -279,8 +297,20 @@ md_t *md_copy(apr_pool_t *p, const md_t *src);
 struct md_json_t *md_to_json (const md_t *md, apr_pool_t *p);
 md_t *md_from_json(struct md_json_t *json, apr_pool_t *p);
 
+/**
+ * Get a stable digest (hex sha256) of the configured properties of the MD. This
+ * leaves out the state and anything else that is not set from the configuration.
+ */
+const char *md_config_hash(const md_t *md, apr_pool_t *p);
+
 int md_is_covered_by_alt_names(const md_t *md, const struct apr_array_header_t* alt_names);
 
+/**
+ * The number of certificates the MD has, one for each private key specified
+ * or just one when they are configured as static files.
+ */
+int md_cert_count(const md_t *md);
+
 #define LE_ACMEv1_PROD      "https://acme-v01.api.letsencrypt.org/directory"
 #define LE_ACMEv1_STAGING   "https://acme-staging.api.letsencrypt.org/directory"
 
@@ -301,6 +331,7 @@ typedef struct md_pubcert_t md_pubcert_t;
 struct md_pubcert_t {
     struct apr_array_header_t *certs;     /* chain of const md_cert*, leaf cert first */
     struct apr_array_header_t *alt_names; /* alt-names of leaf cert */
+    const struct md_cert_meta_t *meta;    /* properties of leaf cert */
     const char *cert_file;                /* file path of chain */
     const char *key_file;                 /* file path of key for leaf cert */
 };
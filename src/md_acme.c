@@ -20,7 +20,9 @@
 #include <apr_lib.h>
 #include <apr_strings.h>
 #include <apr_buckets.h>
+#include <apr_date.h>
 #include <apr_hash.h>
+#include <apr_thread_mutex.h>
 #include <apr_uri.h>
 
 #include "md.h"
@@ -31,6 +33,7 @@
 #include "md_log.h"
 #include "md_store.h"
 #include "md_result.h"
+#include "md_time.h"
 #include "md_util.h"
 #include "md_version.h"
 
@@ -86,6 +89,129 @@ static apr_status_t problem_status_get(const char *type) {
     return APR_EGENERAL;
 }
 
+/**************************************************************************************************/
+/* nonce pool */
+
+/* Every response from an ACME server carries a fresh nonce. Collect them per server,
+ * process wide, so that the next POST, from whichever md_acme_t, has one at hand 
+ * and does not need to ask newNonce first. Youngest nonces are used first, old 
+ * ones are dropped as the server may have forgotten them. */
+
+#define MD_ACME_NONCES_MAX      16
+#define MD_ACME_NONCE_MAX_LEN   255
+#define MD_ACME_NONCE_MAX_AGE   apr_time_from_sec(5 * 60)
+#define MD_ACME_NONCE_PREFETCH  4
+
+typedef struct {
+    char value[MD_ACME_NONCE_MAX_LEN + 1];
+    apr_time_t received;
+} nonce_slot_t;
+
+typedef struct {
+    int count;
+    nonce_slot_t slots[MD_ACME_NONCES_MAX];  /* oldest first */
+} nonce_pool_t;
+
+static apr_pool_t *nonce_pools_pool;
+static apr_thread_mutex_t *nonce_pools_mutex;
+static apr_hash_t *nonce_pools;
+
+static apr_status_t nonce_pools_init(void)
+{
+    apr_status_t rv;
+    
+    if (nonce_pools) return APR_SUCCESS;
+    if (APR_SUCCESS != (rv = apr_pool_create(&nonce_pools_pool, NULL))) goto leave;
+    apr_pool_tag(nonce_pools_pool, "md_acme_nonces");
+    rv = apr_thread_mutex_create(&nonce_pools_mutex, APR_THREAD_MUTEX_DEFAULT, nonce_pools_pool);
+    if (APR_SUCCESS != rv) goto leave;
+    nonce_pools = apr_hash_make(nonce_pools_pool);
+leave:
+    return rv;
+}
+
+static void nonce_put(md_acme_t *acme, const char *nonce)
+{
+    nonce_pool_t *np;
+    nonce_slot_t *slot;
+    
+    if (!nonce_pools || strlen(nonce) > MD_ACME_NONCE_MAX_LEN) {
+        acme->nonce = apr_pstrdup(acme->p, nonce);
+        return;
+    }
+    apr_thread_mutex_lock(nonce_pools_mutex);
+    if (!(np = apr_hash_get(nonce_pools, acme->url, APR_HASH_KEY_STRING))) {
+        np = apr_pcalloc(nonce_pools_pool, sizeof(*np));
+        apr_hash_set(nonce_pools, apr_pstrdup(nonce_pools_pool, acme->url), 
+                     APR_HASH_KEY_STRING, np);
+    }
+    if (np->count >= MD_ACME_NONCES_MAX) {
+        memmove(np->slots, np->slots + 1, (MD_ACME_NONCES_MAX - 1) * sizeof(np->slots[0]));
+        np->count = MD_ACME_NONCES_MAX - 1;
+    }
+    slot = &np->slots[np->count++];
+    apr_cpystrn(slot->value, nonce, sizeof(slot->value));
+    slot->received = apr_time_now();
+    apr_thread_mutex_unlock(nonce_pools_mutex);
+}
+
+static const char *nonce_take(md_acme_t *acme, apr_pool_t *p)
+{
+    nonce_pool_t *np;
+    nonce_slot_t *slot;
+    const char *nonce = NULL;
+    apr_time_t now;
+    
+    if (acme->nonce) {
+        nonce = acme->nonce;
+        acme->nonce = NULL;
+        return nonce;
+    }
+    if (!nonce_pools) return NULL;
+    now = apr_time_now();
+    apr_thread_mutex_lock(nonce_pools_mutex);
+    if ((np = apr_hash_get(nonce_pools, acme->url, APR_HASH_KEY_STRING)) && np->count > 0) {
+        slot = &np->slots[--np->count];
+        if (now - slot->received < MD_ACME_NONCE_MAX_AGE) {
+            nonce = apr_pstrdup(p, slot->value);
+        }
+        else {
+            /* the youngest is too old, so are all others */
+            np->count = 0;
+        }
+    }
+    apr_thread_mutex_unlock(nonce_pools_mutex);
+    return nonce;
+}
+
+static void nonce_discard(md_acme_t *acme)
+{
+    nonce_pool_t *np;
+    
+    acme->nonce = NULL;
+    if (!nonce_pools) return;
+    apr_thread_mutex_lock(nonce_pools_mutex);
+    if ((np = apr_hash_get(nonce_pools, acme->url, APR_HASH_KEY_STRING))) {
+        np->count = 0;
+    }
+    apr_thread_mutex_unlock(nonce_pools_mutex);
+}
+
+int md_acme_nonce_count(md_acme_t *acme)
+{
+    nonce_pool_t *np;
+    int count = acme->nonce? 1 : 0;
+    
+    if (nonce_pools) {
+        apr_thread_mutex_lock(nonce_pools_mutex);
+        if ((np = apr_hash_get(nonce_pools, acme->url, APR_HASH_KEY_STRING))) {
+            count += np->count;
+        }
+        apr_thread_mutex_unlock(nonce_pools_mutex);
+    }
+    return count;
+}
+
 /**************************************************************************************************/
 /* acme requests */
 
@@ -94,20 +220,37 @@ static void req_update_nonce(md_acme_t *acme, apr_table_t *hdrs)
     if (hdrs) {
         const char *nonce = apr_table_get(hdrs, "Replay-Nonce");
         if (nonce) {
-            acme->nonce = apr_pstrdup(acme->p, nonce);
+            nonce_put(acme, nonce);
         }
     }
 }
 
+static void req_update_retry_after(md_acme_t *acme, apr_table_t *hdrs)
+{
+    const char *s = hdrs? apr_table_get(hdrs, "Retry-After") : NULL;
+    apr_int64_t secs;
+    
+    /* RFC 7231 ch. 7.1.3: either delay-seconds or a HTTP-date */
+    acme->retry_after = 0;
+    if (s && apr_isdigit(*s)) {
+        secs = apr_atoi64(s);
+        if (secs > 0) acme->retry_after = apr_time_now() + apr_time_from_sec(secs);
+    }
+    else if (s) {
+        acme->retry_after = apr_date_parse_rfc(s);
+    }
+}
+
+apr_interval_time_t md_acme_retry_after(md_acme_t *acme)
+{
+    apr_time_t now = apr_time_now();
+    return (acme->retry_after > now)? acme->retry_after - now : 0;
+}
+
 static apr_status_t http_update_nonce(const md_http_response_t *res, void *data)
 {
     md_acme_t *acme = data;
-    if (res->headers) {
-        const char *nonce = apr_table_get(res->headers, "Replay-Nonce");
-        if (nonce) {
-            acme->nonce = apr_pstrdup(acme->p, nonce);
-        }
-    }
+    req_update_nonce(acme, res->headers);
     return APR_SUCCESS;
 }
 
@@ -147,15 +290,415 @@ static apr_status_t acmev1_new_nonce(md_acme_t *acme)
     return md_http_HEAD_perform(acme->http, acme->api.v1.new_reg, NULL, http_update_nonce, acme);
 }
 
+typedef struct {
+    md_acme_t *acme;
+    int todo;
+} nonce_prefetch_ctx;
+
+static apr_status_t next_nonce_req(md_http_request_t **preq, void *baton, 
+                                   md_http_t *http, int in_flight)
+{
+    nonce_prefetch_ctx *ctx = baton;
+    md_http_request_t *req;
+    apr_status_t rv;
+    
+    (void)in_flight;
+    if (ctx->todo <= 0) return APR_ENOENT;
+    rv = md_http_HEAD_create(&req, http, ctx->acme->api.v2.new_nonce, NULL);
+    if (APR_SUCCESS != rv) return rv;
+    md_http_set_on_response_cb(req, http_update_nonce, ctx->acme);
+    --ctx->todo;
+    *preq = req;
+    return APR_SUCCESS;
+}
+
+static apr_status_t nonce_prefetch(md_acme_t *acme, int count)
+{
+    nonce_prefetch_ctx ctx;
+    apr_status_t rv;
+    
+    ctx.acme = acme;
+    ctx.todo = count;
+    rv = md_http_multi_perform(acme->http, next_nonce_req, &ctx);
+    /* APR_ENOENT: all requests have been performed */
+    if (APR_STATUS_IS_ENOENT(rv)) rv = APR_SUCCESS;
+    return rv;
+}
+
 static apr_status_t acmev2_new_nonce(md_acme_t *acme)
 {
-    return md_http_HEAD_perform(acme->http, acme->api.v2.new_nonce, NULL, http_update_nonce, acme);
+    /* We ran dry. Get several in parallel, as we are likely to need more 
+     * and they cost no more time than a single one. */
+    return nonce_prefetch(acme, MD_ACME_NONCE_PREFETCH);
 }
 
 
+/**************************************************************************************************/
+/* directory cache */
+
+/* The directory of a CA is the same for all md_acme_t talking to it. Keep it 
+ * process wide, so a watchdog run renewing many MDs asks the CA only once. Entries
+ * older than the ttl are revalidated with their ETag, if the CA gave one. */
+
+typedef struct {
+    apr_pool_t *p;
+    const char *etag;
+    const char *body;
+    apr_time_t valid_until;
+} dir_entry_t;
+
+static apr_pool_t *dir_cache_pool;
+static apr_thread_mutex_t *dir_cache_mutex;
+static apr_hash_t *dir_cache;
+static apr_interval_time_t dir_cache_ttl = apr_time_from_sec(MD_SECS_PER_HOUR);
+
+static apr_status_t dir_cache_init(void)
+{
+    apr_status_t rv;
+    
+    if (dir_cache) return APR_SUCCESS;
+    if (APR_SUCCESS != (rv = apr_pool_create(&dir_cache_pool, NULL))) goto leave;
+    apr_pool_tag(dir_cache_pool, "md_acme_dir_cache");
+    rv = apr_thread_mutex_create(&dir_cache_mutex, APR_THREAD_MUTEX_DEFAULT, dir_cache_pool);
+    if (APR_SUCCESS != rv) goto leave;
+    dir_cache = apr_hash_make(dir_cache_pool);
+leave:
+    return rv;
+}
+
+static void dir_cache_get(const char *url, apr_pool_t *p, 
+                          const char **petag, const char **pbody, int *pfresh)
+{
+    dir_entry_t *entry;
+    
+    *petag = *pbody = NULL;
+    *pfresh = 0;
+    if (!dir_cache) return;
+    apr_thread_mutex_lock(dir_cache_mutex);
+    if ((entry = apr_hash_get(dir_cache, url, APR_HASH_KEY_STRING))) {
+        *petag = entry->etag? apr_pstrdup(p, entry->etag) : NULL;
+        *pbody = apr_pstrdup(p, entry->body);
+        *pfresh = (apr_time_now() < entry->valid_until);
+    }
+    apr_thread_mutex_unlock(dir_cache_mutex);
+}
+
+static void dir_cache_put(const char *url, const char *etag, const char *body)
+{
+    dir_entry_t *entry;
+    apr_pool_t *p;
+    
+    if (!dir_cache || dir_cache_ttl <= 0) return;
+    apr_thread_mutex_lock(dir_cache_mutex);
+    if ((entry = apr_hash_get(dir_cache, url, APR_HASH_KEY_STRING))) {
+        apr_hash_set(dir_cache, url, APR_HASH_KEY_STRING, NULL);
+        apr_pool_destroy(entry->p);
+    }
+    if (APR_SUCCESS == apr_pool_create(&p, dir_cache_pool)) {
+        entry = apr_pcalloc(p, sizeof(*entry));
+        entry->p = p;
+        entry->etag = etag? apr_pstrdup(p, etag) : NULL;
+        entry->body = apr_pstrdup(p, body);
+        entry->valid_until = apr_time_now() + dir_cache_ttl;
+        apr_hash_set(dir_cache, apr_pstrdup(p, url), APR_HASH_KEY_STRING, entry);
+    }
+    apr_thread_mutex_unlock(dir_cache_mutex);
+}
+
+static void dir_cache_touch(const char *url)
+{
+    dir_entry_t *entry;
+    
+    if (!dir_cache) return;
+    apr_thread_mutex_lock(dir_cache_mutex);
+    if ((entry = apr_hash_get(dir_cache, url, APR_HASH_KEY_STRING))) {
+        entry->valid_until = apr_time_now() + dir_cache_ttl;
+    }
+    apr_thread_mutex_unlock(dir_cache_mutex);
+}
+
+void md_acme_set_dir_cache_ttl(apr_interval_time_t ttl)
+{
+    dir_cache_ttl = ttl;
+    if (ttl <= 0) md_acme_dir_cache_clear();
+}
+
+void md_acme_dir_cache_clear(void)
+{
+    apr_hash_index_t *hi;
+    dir_entry_t *entry;
+    
+    if (!dir_cache) return;
+    apr_thread_mutex_lock(dir_cache_mutex);
+    while ((hi = apr_hash_first(NULL, dir_cache))) {
+        const void *key;
+        void *val;
+        
+        apr_hash_this(hi, &key, NULL, &val);
+        entry = val;
+        apr_hash_set(dir_cache, key, APR_HASH_KEY_STRING, NULL);
+        apr_pool_destroy(entry->p);
+    }
+    apr_thread_mutex_unlock(dir_cache_mutex);
+}
+
+/**************************************************************************************************/
+/* CA rate limits */
+
+/* CAs limit how many orders, accounts and failed validations they accept in a
+ * period. Budgets configured per hour are kept as token buckets per CA, process 
+ * wide, refilling continuously and holding at most an hour's worth. A rateLimited
+ * answer empties the bucket for what was asked and blocks all new orders and 
+ * accounts at the CA until its Retry-After, or for an hour. 
+ * With a store, buckets are also kept in its 'locks' group, one file per CA. They 
+ * then survive restarts and are shared by all servers using the store. */
+
+#define MD_ACME_LIMIT_BLOCK     apr_time_from_sec(MD_SECS_PER_HOUR)
+#define MD_ACME_LIMITS_NAME     "ratelimits"
+
+typedef struct {
+    double tokens[MD_ACME_LIMIT_COUNT];
+    int per_hour[MD_ACME_LIMIT_COUNT];  /* limits the tokens were counted for */
+    apr_time_t updated;
+    apr_time_t blocked_until;
+} limit_bucket_t;
+
+static const char *limit_names[MD_ACME_LIMIT_COUNT] = { 
+    "orders", "accounts", "failed-authz"
+};
+
+static int limit_per_hour[MD_ACME_LIMIT_COUNT];
+static apr_pool_t *limits_pool;
+static apr_thread_mutex_t *limits_mutex;
+static apr_hash_t *limits;
+static md_store_t *limits_store;
+
+static apr_status_t limits_init(void)
+{
+    apr_status_t rv;
+    
+    if (limits) return APR_SUCCESS;
+    if (APR_SUCCESS != (rv = apr_pool_create(&limits_pool, NULL))) goto leave;
+    apr_pool_tag(limits_pool, "md_acme_limits");
+    rv = apr_thread_mutex_create(&limits_mutex, APR_THREAD_MUTEX_DEFAULT, limits_pool);
+    if (APR_SUCCESS != rv) goto leave;
+    limits = apr_hash_make(limits_pool);
+leave:
+    return rv;
+}
+
+void md_acme_limit_set(md_acme_limit_t limit, int per_hour)
+{
+    limit_per_hour[limit] = (per_hour > 0)? per_hour : 0;
+}
+
+void md_acme_limits_store_set(md_store_t *store)
+{
+    limits_store = store;
+}
+
+/* Lock the buckets, returns a pool for store access or NULL if there is no store */
+static apr_pool_t *limits_lock(void)
+{
+    apr_pool_t *ptemp = NULL;
+    
+    apr_thread_mutex_lock(limits_mutex);
+    if (limits_store && APR_SUCCESS != apr_pool_create(&ptemp, limits_pool)) ptemp = NULL;
+    return ptemp;
+}
+
+static void limits_unlock(apr_pool_t *ptemp)
+{
+    if (ptemp) apr_pool_destroy(ptemp);
+    apr_thread_mutex_unlock(limits_mutex);
+}
+
+static double limit_refill(double tokens, int per_hour, apr_time_t since, apr_time_t now)
+{
+    if (now > since) {
+        tokens += (double)per_hour * (double)(now - since) 
+                  / (double)apr_time_from_sec(MD_SECS_PER_HOUR);
+    }
+    return (tokens > per_hour)? per_hour : tokens;
+}
+
+static const char *limit_fname(const char *url, apr_pool_t *p)
+{
+    char *fname = apr_pstrdup(p, url), *c;
+    
+    for (c = fname; *c; ++c) {
+        if (!apr_isalnum(*c) && '.' != *c && '-' != *c) *c = '_';
+    }
+    return apr_pstrcat(p, fname, ".json", NULL);
+}
+
+/* Take over what other processes and servers have used of the budget */
+static void limit_bucket_load(limit_bucket_t *b, const char *url, apr_time_t now, 
+                              apr_pool_t *ptemp)
+{
+    md_json_t *json;
+    apr_time_t when, until;
+    double tokens;
+    int i;
+    
+    if (!ptemp || APR_SUCCESS != md_store_load_json(limits_store, MD_SG_LOCKS, 
+                                                    MD_ACME_LIMITS_NAME, limit_fname(url, ptemp), 
+                                                    &json, ptemp)) {
+        return;
+    }
+    when = md_json_get_time(json, MD_KEY_WHEN, NULL);
+    for (i = 0; i < MD_ACME_LIMIT_COUNT; ++i) {
+        if (b->per_hour[i] > 0 
+            && b->per_hour[i] == md_json_getl(json, MD_KEY_PER_HOUR, limit_names[i], NULL)) {
+            tokens = limit_refill(md_json_getn(json, MD_KEY_TOKENS, limit_names[i], NULL), 
+                                  b->per_hour[i], when, now);
+            if (tokens < b->tokens[i]) b->tokens[i] = tokens;
+        }
+    }
+    until = md_json_get_time(json, MD_KEY_UNTIL, NULL);
+    if (until > b->blocked_until) b->blocked_until = until;
+}
+
+static void limit_bucket_save(const limit_bucket_t *b, const char *url, apr_pool_t *ptemp)
+{
+    md_json_t *json;
+    apr_status_t rv;
+    int i;
+    
+    if (!ptemp) return;
+    json = md_json_create(ptemp);
+    md_json_sets(url, json, MD_KEY_URL, NULL);
+    md_json_set_time(b->updated, json, MD_KEY_WHEN, NULL);
+    if (b->blocked_until) md_json_set_time(b->blocked_until, json, MD_KEY_UNTIL, NULL);
+    for (i = 0; i < MD_ACME_LIMIT_COUNT; ++i) {
+        md_json_setl(b->per_hour[i], json, MD_KEY_PER_HOUR, limit_names[i], NULL);
+        md_json_setn(b->tokens[i], json, MD_KEY_TOKENS, limit_names[i], NULL);
+    }
+    rv = md_store_save_json(limits_store, ptemp, MD_SG_LOCKS, MD_ACME_LIMITS_NAME, 
+                            limit_fname(url, ptemp), json, 0);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, ptemp, "%s: saving rate limits", url);
+    }
+}
+
+/* call with limits_mutex held */
+static limit_bucket_t *limit_bucket_get(const char *url, apr_time_t now, apr_pool_t *ptemp)
+{
+    limit_bucket_t *b;
+    int i;
+    
+    if (!(b = apr_hash_get(limits, url, APR_HASH_KEY_STRING))) {
+        b = apr_pcalloc(limits_pool, sizeof(*b));
+        b->updated = now;
+        apr_hash_set(limits, apr_pstrdup(limits_pool, url), APR_HASH_KEY_STRING, b);
+    }
+    for (i = 0; i < MD_ACME_LIMIT_COUNT; ++i) {
+        if (b->per_hour[i] != limit_per_hour[i]) {
+            /* new or changed limit, start with a full budget */
+            b->per_hour[i] = limit_per_hour[i];
+            b->tokens[i] = limit_per_hour[i];
+        }
+    }
+    if (now > b->updated) {
+        for (i = 0; i < MD_ACME_LIMIT_COUNT; ++i) {
+            b->tokens[i] = limit_refill(b->tokens[i], limit_per_hour[i], b->updated, now);
+        }
+        b->updated = now;
+    }
+    limit_bucket_load(b, url, now, ptemp);
+    return b;
+}
+
+apr_time_t md_acme_limit_check(md_acme_t *acme, md_acme_limit_t limit, int take)
+{
+    limit_bucket_t *b;
+    apr_pool_t *ptemp;
+    apr_time_t now = apr_time_now(), at = 0;
+    
+    if (!limits) return 0;
+    ptemp = limits_lock();
+    b = limit_bucket_get(acme->url, now, ptemp);
+    if (b->blocked_until > now && MD_ACME_LIMIT_FAILED_AUTHZ != limit) {
+        at = b->blocked_until;
+    }
+    else if (limit_per_hour[limit] > 0) {
+        if (b->tokens[limit] >= 1.0) {
+            if (take) {
+                b->tokens[limit] -= 1.0;
+                limit_bucket_save(b, acme->url, ptemp);
+            }
+        }
+        else {
+            at = now + (apr_time_t)((1.0 - b->tokens[limit]) 
+                                    * (double)apr_time_from_sec(MD_SECS_PER_HOUR) 
+                                    / (double)limit_per_hour[limit]);
+        }
+    }
+    limits_unlock(ptemp);
+    return at;
+}
+
+void md_acme_limit_count(md_acme_t *acme, md_acme_limit_t limit)
+{
+    limit_bucket_t *b;
+    apr_pool_t *ptemp;
+    
+    if (!limits || !limit_per_hour[limit]) return;
+    ptemp = limits_lock();
+    b = limit_bucket_get(acme->url, apr_time_now(), ptemp);
+    b->tokens[limit] = (b->tokens[limit] > 1.0)? b->tokens[limit] - 1.0 : 0.0;
+    limit_bucket_save(b, acme->url, ptemp);
+    limits_unlock(ptemp);
+}
+
+static void limit_learn(md_acme_req_t *req)
+{
+    md_acme_t *acme = req->acme;
+    limit_bucket_t *b;
+    apr_pool_t *ptemp;
+    apr_time_t now = apr_time_now(), until;
+    int limit = -1;
+    
+    if (!limits) return;
+    if (MD_ACME_VERSION_MAJOR(acme->version) > 1) {
+        if (acme->api.v2.new_order && !strcmp(req->url, acme->api.v2.new_order)) {
+            limit = MD_ACME_LIMIT_ORDERS;
+        }
+        else if (acme->api.v2.new_account && !strcmp(req->url, acme->api.v2.new_account)) {
+            limit = MD_ACME_LIMIT_ACCOUNTS;
+        }
+    }
+    ptemp = limits_lock();
+    b = limit_bucket_get(acme->url, now, ptemp);
+    if (limit >= 0) b->tokens[limit] = 0.0;
+    until = (acme->retry_after > now)? acme->retry_after : now + MD_ACME_LIMIT_BLOCK;
+    if (until > b->blocked_until) b->blocked_until = until;
+    limit_bucket_save(b, acme->url, ptemp);
+    limits_unlock(ptemp);
+    md_log_perror(MD_LOG_MARK, MD_LOG_INFO, 0, req->p, 
+                  "%s: rate limited, no new orders or accounts for %s", acme->url, 
+                  md_duration_print(req->p, until - now));
+}
+
+void md_acme_limits_clear(void)
+{
+    if (!limits) return;
+    apr_thread_mutex_lock(limits_mutex);
+    apr_hash_clear(limits);
+    apr_thread_mutex_unlock(limits_mutex);
+}
+
+/**************************************************************************************************/
+/* acme api */
+
 apr_status_t md_acme_init(apr_pool_t *p, const char *base,  int init_ssl)
 {
+    apr_status_t rv;
+    
     base_product = base;
+    if (APR_SUCCESS != (rv = dir_cache_init())) return rv;
+    if (APR_SUCCESS != (rv = nonce_pools_init())) return rv;
+    if (APR_SUCCESS != (rv = limits_init())) return rv;
     return init_ssl? md_crypt_init(p) : APR_SUCCESS;
 }
 
@@ -177,8 +720,20 @@ static apr_status_t inspect_problem(md_acme_req_t *req, const md_http_response_t
             req->rv = problem_status_get(ptype);
             md_result_problem_set(req->result, req->rv, ptype, pdetail,
                                   md_json_getj(problem, MD_KEY_SUBPROBLEMS, NULL));
+            if (req->acme->retry_after) {
+                /* e.g. rate limited, the server tells us when to come back */
+                md_result_delay_set(req->result, req->acme->retry_after);
+            }
             
-            
+            if (ptype && strstr(ptype, "rateLimited")) {
+                limit_learn(req);
+            }
+            if (ptype && strstr(ptype, "badNonce")) {
+                /* the server no longer accepts the nonces we collected, except
+                 * the one it just sent. */
+                nonce_discard(req->acme);
+                req_update_nonce(req->acme, res->headers);
+            }
             
             if (APR_STATUS_IS_EAGAIN(req->rv)) {
                 md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, req->rv, req->p,
@@ -214,7 +769,9 @@ static apr_status_t inspect_problem(md_acme_req_t *req, const md_http_response_t
 
 static apr_status_t acmev1_req_init(md_acme_req_t *req, md_json_t *jpayload)
 {
+    md_jws_key_t *jws;
     md_data_t payload;
+    apr_status_t rv;
     
     if (!req->acme->acct) {
         return APR_EINVAL;
@@ -232,13 +789,15 @@ static apr_status_t acmev1_req_init(md_acme_req_t *req, md_json_t *jpayload)
     payload.len = strlen(payload.data);
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, req->p, 
                   "acme payload(len=%" APR_SIZE_T_FMT "): %s", payload.len, payload.data);
-    return md_jws_sign(&req->req_json, req->p, &payload,
-                       req->prot_hdrs, req->acme->acct_key, NULL);
+    if (APR_SUCCESS != (rv = md_acme_acct_jws_get(&jws, req->acme))) return rv;
+    return md_jws_key_sign(&req->req_json, req->p, &payload, req->prot_hdrs, jws, NULL);
 }
 
 static apr_status_t acmev2_req_init(md_acme_req_t *req, md_json_t *jpayload)
 {
+    md_jws_key_t *jws;
     md_data_t payload;
+    apr_status_t rv;
     
     if (!req->acme->acct) {
         return APR_EINVAL;
@@ -256,8 +815,9 @@ static apr_status_t acmev2_req_init(md_acme_req_t *req, md_json_t *jpayload)
     payload.len = strlen(payload.data);
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, req->p, 
                   "acme payload(len=%" APR_SIZE_T_FMT "): %s", payload.len, payload.data);
-    return md_jws_sign(&req->req_json, req->p, &payload,
-                       req->prot_hdrs, req->acme->acct_key, req->acme->acct->url);
+    if (APR_SUCCESS != (rv = md_acme_acct_jws_get(&jws, req->acme))) return rv;
+    return md_jws_key_sign(&req->req_json, req->p, &payload, req->prot_hdrs, jws, 
+                           req->acme->acct->url);
 }
 
 apr_status_t md_acme_req_body_init(md_acme_req_t *req, md_json_t *payload)
@@ -290,6 +850,7 @@ static apr_status_t on_response(const md_http_response_t *res, void *data)
     
     req->resp_hdrs = apr_table_clone(req->p, res->headers);
     req_update_nonce(req->acme, res->headers);
+    req_update_retry_after(req->acme, res->headers);
     
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, req->p, "response: %d", res->status);
     if (res->status >= 200 && res->status < 300) {
@@ -345,15 +906,17 @@ static apr_status_t acmev2_GET_as_POST_init(md_acme_req_t *req, void *baton)
     return md_acme_req_body_init(req, NULL);
 }
 
-static apr_status_t md_acme_req_send(md_acme_req_t *req)
+static apr_status_t req_prepare(md_acme_req_t *req, md_http_request_t **phreq)
 {
     apr_status_t rv;
     md_acme_t *acme = req->acme;
     md_data_t *body = NULL;
     md_result_t *result;
+    const char *nonce;
 
     assert(acme->url);
     
+    *phreq = NULL;
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, req->p, 
                   "sending req: %s %s", req->method, req->url);
     md_result_reset(req->acme->last);
@@ -383,17 +946,20 @@ static apr_status_t md_acme_req_send(md_acme_req_t *req)
             rv = md_acme_setup(acme, result);
             if (APR_SUCCESS != rv) goto leave;
         }
-        if (!acme->nonce && (APR_SUCCESS != (rv = acme->new_nonce_fn(acme)))) {
-            md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, req->p, 
-                          "error retrieving new nonce from ACME server");
-            goto leave;
+        if (!(nonce = nonce_take(acme, req->p))) {
+            rv = acme->new_nonce_fn(acme);
+            if (APR_SUCCESS == rv && !(nonce = nonce_take(acme, req->p))) rv = APR_EGENERAL;
+            if (APR_SUCCESS != rv) {
+                md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, req->p, 
+                              "error retrieving new nonce from ACME server");
+                goto leave;
+            }
         }
         
-        apr_table_set(req->prot_hdrs, "nonce", acme->nonce);
+        apr_table_set(req->prot_hdrs, "nonce", nonce);
         if (MD_ACME_VERSION_MAJOR(acme->version) > 1) {
             apr_table_set(req->prot_hdrs, "url", req->url);
         }
-        acme->nonce = NULL;
     }
     
     rv = req->on_init? req->on_init(req, req->baton) : APR_SUCCESS;
@@ -418,20 +984,32 @@ static apr_status_t md_acme_req_send(md_acme_req_t *req)
     }
     
     if (!strcmp("GET", req->method)) {
-        rv = md_http_GET_perform(req->acme->http, req->url, NULL, on_response, req);
+        rv = md_http_GET_create(phreq, req->acme->http, req->url, NULL);
     }
     else if (!strcmp("POST", req->method)) {
-        rv = md_http_POSTd_perform(req->acme->http, req->url, NULL, "application/jose+json",  
-                                   body, on_response, req);
+        rv = md_http_POSTd_create(phreq, req->acme->http, req->url, NULL, 
+                                  "application/jose+json", body);
     }
     else if (!strcmp("HEAD", req->method)) {
-        rv = md_http_HEAD_perform(req->acme->http, req->url, NULL, on_response, req);
+        rv = md_http_HEAD_create(phreq, req->acme->http, req->url, NULL);
     }
     else {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, req->p, 
                       "HTTP method %s against: %s", req->method, req->url);
         rv = APR_ENOTIMPL;
     }
+leave:
+    return rv;
+}
+
+static apr_status_t md_acme_req_send(md_acme_req_t *req)
+{
+    md_http_request_t *hreq;
+    apr_status_t rv;
+    
+    if (APR_SUCCESS != (rv = req_prepare(req, &hreq))) goto leave;
+    md_http_set_on_response_cb(hreq, on_response, req);
+    rv = md_http_perform(hreq);
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, req->p, "req sent");
     
     if (APR_EAGAIN == rv && req->max_retries > 0) {
@@ -445,6 +1023,177 @@ leave:
     return rv;
 }
 
+/**************************************************************************************************/
+/* requests in parallel */
+
+typedef struct {
+    md_acme_t *acme;
+    apr_pool_t *p;
+    md_acme_next_req *nextreq;
+    void *baton;
+    apr_array_header_t *resend;    /* requests to send again */
+    int max_parallel;
+    apr_status_t rv;               /* first error encountered */
+} multi_ctx_t;
+
+typedef struct {
+    multi_ctx_t *ctx;
+    md_acme_req_t *req;
+    int responded;
+} multi_req_t;
+
+static void multi_req_failed(multi_ctx_t *ctx, apr_status_t rv)
+{
+    if (APR_SUCCESS == ctx->rv) ctx->rv = rv;
+}
+
+static apr_status_t multi_on_response(const md_http_response_t *res, void *data)
+{
+    multi_req_t *mreq = data;
+    md_acme_req_t *req = mreq->req;
+    apr_status_t rv;
+    
+    mreq->responded = 1;
+    rv = on_response(res, req);
+    if (APR_EAGAIN == rv) {
+        if (req->max_retries > 0) {
+            --req->max_retries;
+            APR_ARRAY_PUSH(mreq->ctx->resend, md_acme_req_t*) = req;
+            return APR_SUCCESS;
+        }
+        md_acme_req_done(req, rv);
+    }
+    if (APR_SUCCESS != rv) multi_req_failed(mreq->ctx, rv);
+    return rv;
+}
+
+static apr_status_t multi_on_status(const md_http_request_t *hreq, apr_status_t status, 
+                                    void *data)
+{
+    multi_req_t *mreq = data;
+
+    (void)hreq;
+    if (!mreq->responded) {
+        /* never got a response, the request ends here */
+        md_acme_req_done(mreq->req, status);
+        multi_req_failed(mreq->ctx, status);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t multi_next(md_http_request_t **phreq, void *baton, 
+                               md_http_t *http, int in_flight)
+{
+    multi_ctx_t *ctx = baton;
+    md_acme_req_t *req;
+    md_http_request_t *hreq;
+    multi_req_t *mreq;
+    apr_status_t rv;
+    
+    (void)http;
+    *phreq = NULL;
+    if (in_flight >= ctx->max_parallel) return APR_ENOENT;
+    while (1) {
+        if (ctx->resend->nelts > 0) {
+            req = APR_ARRAY_IDX(ctx->resend, --ctx->resend->nelts, md_acme_req_t*);
+        }
+        else if (APR_SUCCESS != (rv = ctx->nextreq(&req, ctx->acme, ctx->baton))) {
+            return rv;
+        }
+        if (APR_SUCCESS == (rv = req_prepare(req, &hreq))) break;
+        md_acme_req_done(req, rv);
+        multi_req_failed(ctx, rv);
+    }
+    mreq = apr_pcalloc(ctx->p, sizeof(*mreq));
+    mreq->ctx = ctx;
+    mreq->req = req;
+    md_http_set_on_response_cb(hreq, multi_on_response, mreq);
+    md_http_set_on_status_cb(hreq, multi_on_status, mreq);
+    *phreq = hreq;
+    return APR_SUCCESS;
+}
+
+apr_status_t md_acme_multi_perform(md_acme_t *acme, md_acme_next_req *nextreq, void *baton)
+{
+    multi_ctx_t ctx;
+    apr_pool_t *ptemp;
+    apr_status_t rv;
+    
+    if (APR_SUCCESS != (rv = apr_pool_create(&ptemp, acme->p))) return rv;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.acme = acme;
+    ctx.p = ptemp;
+    ctx.nextreq = nextreq;
+    ctx.baton = baton;
+    ctx.resend = apr_array_make(ptemp, 5, sizeof(md_acme_req_t*));
+    ctx.max_parallel = (acme->max_parallel > 0)? acme->max_parallel : 1;
+    ctx.rv = APR_SUCCESS;
+    
+    if (acme->version == MD_ACME_VERSION_UNKNOWN) {
+        /* set up before we go parallel */
+        rv = md_acme_setup(acme, md_result_make(ptemp, APR_SUCCESS));
+        if (APR_SUCCESS != rv) goto leave;
+    }
+    if (MD_ACME_VERSION_MAJOR(acme->version) > 1 
+        && md_acme_nonce_count(acme) < ctx.max_parallel) {
+        /* have a nonce for each request in flight, responses bring new ones */
+        rv = nonce_prefetch(acme, ctx.max_parallel - md_acme_nonce_count(acme));
+        if (APR_SUCCESS != rv) goto leave;
+    }
+    rv = md_http_multi_perform(acme->http, multi_next, &ctx);
+    /* APR_ENOENT: all requests have been performed */
+    if (APR_STATUS_IS_ENOENT(rv)) rv = APR_SUCCESS;
+    if (APR_SUCCESS == rv) rv = ctx.rv;
+leave:
+    apr_pool_destroy(ptemp);
+    return rv;
+}
+
+static apr_status_t req_make(md_acme_req_t **preq, md_acme_t *acme, 
+                             const char *method, const char *url,
+                             md_acme_req_init_cb *on_init,
+                             md_acme_req_json_cb *on_json,
+                             md_acme_req_res_cb *on_res,
+                             md_acme_req_err_cb *on_err,
+                             void *baton)
+{
+    md_acme_req_t *req;
+    
+    assert(url);
+    assert(on_json || on_res);
+    
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, acme->p, "add acme %s: %s", method, url);
+    req = md_acme_req_create(acme, method, url);
+    if (!req) return APR_ENOMEM;
+    req->on_init = on_init;
+    req->on_json = on_json;
+    req->on_res = on_res;
+    req->on_err = on_err;
+    req->baton = baton;
+    *preq = req;
+    return APR_SUCCESS;
+}
+
+apr_status_t md_acme_req_make_GET(md_acme_req_t **preq, md_acme_t *acme, const char *url,
+                                  md_acme_req_init_cb *on_init,
+                                  md_acme_req_json_cb *on_json,
+                                  md_acme_req_res_cb *on_res,
+                                  md_acme_req_err_cb *on_err,
+                                  void *baton)
+{
+    return req_make(preq, acme, "GET", url, on_init, on_json, on_res, on_err, baton);
+}
+
+apr_status_t md_acme_req_make_POST(md_acme_req_t **preq, md_acme_t *acme, const char *url,
+                                   md_acme_req_init_cb *on_init,
+                                   md_acme_req_json_cb *on_json,
+                                   md_acme_req_res_cb *on_res,
+                                   md_acme_req_err_cb *on_err,
+                                   void *baton)
+{
+    return req_make(preq, acme, "POST", url, on_init, on_json, on_res, on_err, baton);
+}
+
 apr_status_t md_acme_POST(md_acme_t *acme, const char *url,
                           md_acme_req_init_cb *on_init,
                           md_acme_req_json_cb *on_json,
@@ -499,6 +1248,7 @@ void md_acme_report_result(md_acme_t *acme, apr_status_t rv, struct md_result_t
     else {
         md_result_problem_set(result, acme->last->status, acme->last->problem, 
                               acme->last->detail, acme->last->subproblems);
+        if (acme->last->ready_at) md_result_delay_set(result, acme->last->ready_at);
     }
 }
 
@@ -536,6 +1286,74 @@ apr_status_t md_acme_get_json(struct md_json_t **pjson, md_acme_t *acme,
     return rv;
 }
 
+/**************************************************************************************************/
+/* renewal information */
+
+typedef struct {
+    apr_pool_t *p;
+    md_timeperiod_t *window;
+    const char *explanation;
+} renewal_info_ctx;
+
+static apr_status_t renewal_info_init(md_acme_req_t *req, void *baton)
+{
+    /* renewalInfo is fetched with a plain GET, not POST-as-GET */
+    (void)req;
+    (void)baton;
+    return APR_SUCCESS;
+}
+
+static apr_status_t on_got_renewal_info(md_acme_t *acme, apr_pool_t *p, 
+                                        const apr_table_t *headers, 
+                                        md_json_t *jbody, void *baton)
+{
+    renewal_info_ctx *ctx = baton;
+    
+    (void)acme;
+    (void)p;
+    (void)headers;
+    ctx->window->start = md_time_parse_rfc3339(
+        md_json_gets(jbody, "suggestedWindow", "start", NULL));
+    ctx->window->end = md_time_parse_rfc3339(
+        md_json_gets(jbody, "suggestedWindow", "end", NULL));
+    if (!ctx->window->start || ctx->window->end < ctx->window->start) {
+        return APR_EINVAL;
+    }
+    ctx->explanation = md_json_dups(ctx->p, jbody, "explanationURL", NULL);
+    return APR_SUCCESS;
+}
+
+apr_status_t md_acme_get_renewal_info(md_timeperiod_t *pwindow, const char **pexplanation,
+                                      md_acme_t *acme, const md_cert_t *cert, 
+                                      apr_pool_t *p)
+{
+    renewal_info_ctx ctx;
+    const char *id, *base, *sep;
+    apr_status_t rv;
+    
+    *pexplanation = NULL;
+    memset(pwindow, 0, sizeof(*pwindow));
+    if (acme->version == MD_ACME_VERSION_UNKNOWN
+        && APR_SUCCESS != (rv = md_acme_setup(acme, md_result_make(p, APR_SUCCESS)))) {
+        goto leave;
+    }
+    if (MD_ACME_VERSION_MAJOR(acme->version) < 2 || !acme->api.v2.renewal_info) {
+        rv = APR_ENOTIMPL;
+        goto leave;
+    }
+    if (APR_SUCCESS != (rv = md_cert_get_ari_id(&id, cert, p))) goto leave;
+    
+    base = acme->api.v2.renewal_info;
+    sep = (*base && base[strlen(base)-1] == '/')? "" : "/";
+    ctx.p = p;
+    ctx.window = pwindow;
+    ctx.explanation = NULL;
+    rv = md_acme_GET(acme, apr_pstrcat(p, base, sep, id, NULL), renewal_info_init, on_got_renewal_info, NULL, NULL, &ctx);
+    if (APR_SUCCESS == rv) *pexplanation = ctx.explanation;
+leave:
+    return rv;
+}
+
 /**************************************************************************************************/
 /* Generic ACME operations */
 
@@ -544,6 +1362,7 @@ void md_acme_clear_acct(md_acme_t *acme)
     acme->acct_id = NULL;
     acme->acct = NULL;
     acme->acct_key = NULL;
+    acme->acct_jws = NULL;
 }
 
 const char *md_acme_acct_id_get(md_acme_t *acme)
@@ -556,6 +1375,23 @@ const char *md_acme_acct_url_get(md_acme_t *acme)
     return acme->acct? acme->acct->url : NULL;
 }
 
+apr_status_t md_acme_acct_jws_get(md_jws_key_t **pjws, md_acme_t *acme)
+{
+    apr_status_t rv = APR_SUCCESS;
+    
+    *pjws = NULL;
+    if (!acme->acct_key) return APR_EINVAL;
+    /* the account key is replaced in several places, the cache follows it */
+    if (!acme->acct_jws || acme->acct_jws->pkey != acme->acct_key) {
+        if (APR_SUCCESS != (rv = md_jws_key_make(&acme->acct_jws, acme->p, acme->acct_key))) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, acme->p, "no JWK for account key");
+            return rv;
+        }
+    }
+    *pjws = acme->acct_jws;
+    return rv;
+}
+
 apr_status_t md_acme_use_acct(md_acme_t *acme, md_store_t *store,
                               apr_pool_t *p, const char *acct_id)
 {
@@ -644,6 +1480,7 @@ apr_status_t md_acme_create(md_acme_t **pacme, apr_pool_t *p, const char *url,
                                     base_product, MOD_MD_VERSION);
     acme->proxy_url = proxy_url? apr_pstrdup(p, proxy_url) : NULL;
     acme->max_retries = 3;
+    acme->max_parallel = MD_ACME_MAX_PARALLEL;
     
     if (APR_SUCCESS != (rv = apr_uri_parse(p, url, &uri_parsed))) {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "parsing ACME uri: %s", url);
@@ -662,48 +1499,13 @@ apr_status_t md_acme_create(md_acme_t **pacme, apr_pool_t *p, const char *url,
 typedef struct {
     md_acme_t *acme;
     md_result_t *result;
+    const char *cached;      /* the directory we have cached, when revalidating */
 } update_dir_ctx;
 
-static apr_status_t update_directory(const md_http_response_t *res, void *data)
+static apr_status_t apply_directory(md_acme_t *acme, md_json_t *json, md_result_t *result)
 {
-    md_http_request_t *req = res->req;
-    md_acme_t *acme = ((update_dir_ctx *)data)->acme;
-    md_result_t *result = ((update_dir_ctx *)data)->result;
-    apr_status_t rv;
-    md_json_t *json;
     const char *s;
     
-    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, req->pool, "directory lookup response: %d", res->status);
-    if (res->status == 503) {
-        md_result_printf(result, APR_EAGAIN,
-            "The ACME server at <%s> reports that Service is Unavailable (503). This "
-            "may happen during maintenance for short periods of time.", acme->url); 
-        md_result_log(result, MD_LOG_INFO);
-        rv = result->status;
-        goto leave;
-    }
-    else if (res->status < 200 || res->status >= 300) {
-        md_result_printf(result, APR_EAGAIN,
-            "The ACME server at <%s> responded with HTTP status %d. This "
-            "is unusual. Please verify that the URL is correct and that you can indeed "
-            "make request from the server to it by other means, e.g. invoking curl/wget.", 
-            acme->url, res->status);
-        rv = result->status;
-        goto leave;
-    }
-    
-    rv = md_json_read_http(&json, req->pool, res);
-    if (APR_SUCCESS != rv) {
-        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, req->pool, "reading JSON body");
-        goto leave;
-    }
-    
-    if (md_log_is_level(acme->p, MD_LOG_TRACE2)) {
-        s = md_json_writep(json, req->pool, MD_JSON_FMT_INDENT);
-        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, rv, req->pool,
-                      "response: %s", s ? s : "<failed to serialize!>");
-    }
-    
     /* What have we got? */
     if ((s = md_json_dups(acme->p, json, "new-authz", NULL))) {
         acme->api.v1.new_authz = s;
@@ -725,6 +1527,7 @@ static apr_status_t update_directory(const md_http_response_t *res, void *data)
         acme->api.v2.revoke_cert = md_json_dups(acme->p, json, "revokeCert", NULL);
         acme->api.v2.key_change = md_json_dups(acme->p, json, "keyChange", NULL);
         acme->api.v2.new_nonce = md_json_dups(acme->p, json, "newNonce", NULL);
+        acme->api.v2.renewal_info = md_json_dups(acme->p, json, "renewalInfo", NULL);
         if (acme->api.v2.new_account && acme->api.v2.new_order 
             && acme->api.v2.revoke_cert && acme->api.v2.key_change
             && acme->api.v2.new_nonce) {
@@ -741,7 +1544,65 @@ static apr_status_t update_directory(const md_http_response_t *res, void *data)
             "Unable to understand ACME server response from <%s>. "
             "Wrong ACME protocol version or link?", acme->url); 
         md_result_log(result, MD_LOG_WARNING);
+        return result->status;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t update_directory(const md_http_response_t *res, void *data)
+{
+    md_http_request_t *req = res->req;
+    md_acme_t *acme = ((update_dir_ctx *)data)->acme;
+    md_result_t *result = ((update_dir_ctx *)data)->result;
+    const char *cached = ((update_dir_ctx *)data)->cached;
+    apr_status_t rv;
+    md_json_t *json;
+    const char *s;
+    
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, req->pool, "directory lookup response: %d", res->status);
+    req_update_nonce(acme, res->headers);
+    if (res->status == 304 && cached) {
+        /* not modified, our cached copy is good for another while */
+        rv = md_json_readd(&json, req->pool, cached, strlen(cached));
+        if (APR_SUCCESS != rv) goto leave;
+        if (APR_SUCCESS == (rv = apply_directory(acme, json, result))) {
+            dir_cache_touch(acme->url);
+        }
+        goto leave;
+    }
+    else if (res->status == 503) {
+        md_result_printf(result, APR_EAGAIN,
+            "The ACME server at <%s> reports that Service is Unavailable (503). This "
+            "may happen during maintenance for short periods of time.", acme->url); 
+        md_result_log(result, MD_LOG_INFO);
+        rv = result->status;
+        goto leave;
+    }
+    else if (res->status < 200 || res->status >= 300) {
+        md_result_printf(result, APR_EAGAIN,
+            "The ACME server at <%s> responded with HTTP status %d. This "
+            "is unusual. Please verify that the URL is correct and that you can indeed "
+            "make request from the server to it by other means, e.g. invoking curl/wget.", 
+            acme->url, res->status);
         rv = result->status;
+        goto leave;
+    }
+    
+    rv = md_json_read_http(&json, req->pool, res);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, req->pool, "reading JSON body");
+        goto leave;
+    }
+    
+    if (md_log_is_level(acme->p, MD_LOG_TRACE2)) {
+        s = md_json_writep(json, req->pool, MD_JSON_FMT_INDENT);
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, rv, req->pool,
+                      "response: %s", s ? s : "<failed to serialize!>");
+    }
+    
+    if (APR_SUCCESS == (rv = apply_directory(acme, json, result))
+        && (s = md_json_writep(json, req->pool, MD_JSON_FMT_COMPACT))) {
+        dir_cache_put(acme->url, apr_table_get(res->headers, "ETag"), s);
     }
 leave:
     return rv;
@@ -751,6 +1612,10 @@ apr_status_t md_acme_setup(md_acme_t *acme, md_result_t *result)
 {
     apr_status_t rv;
     update_dir_ctx ctx;
+    apr_table_t *headers = NULL;
+    const char *etag;
+    md_json_t *json;
+    int fresh;
    
     assert(acme->url);
     acme->version = MD_ACME_VERSION_UNKNOWN;
@@ -765,12 +1630,28 @@ apr_status_t md_acme_setup(md_acme_t *acme, md_result_t *result)
     md_http_set_timeout_default(acme->http, apr_time_from_sec(10 * 60));
     md_http_set_connect_timeout_default(acme->http, apr_time_from_sec(30));
     md_http_set_stalling_default(acme->http, 10, apr_time_from_sec(30));
-    
-    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, acme->p, "get directory from %s", acme->url);
+    md_http_set_stats_default(acme->http, result->http_stats);
     
     ctx.acme = acme;
     ctx.result = result;
-    rv = md_http_GET_perform(acme->http, acme->url, NULL, update_directory, &ctx);
+    dir_cache_get(acme->url, acme->p, &etag, &ctx.cached, &fresh);
+    if (ctx.cached && fresh) {
+        if (APR_SUCCESS == md_json_readd(&json, acme->p, ctx.cached, strlen(ctx.cached))
+            && APR_SUCCESS == apply_directory(acme, json, result)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, acme->p, 
+                          "using cached directory of %s", acme->url);
+            return APR_SUCCESS;
+        }
+        md_result_set(result, APR_SUCCESS, NULL);
+        etag = NULL;
+    }
+    if (etag) {
+        headers = apr_table_make(acme->p, 1);
+        apr_table_set(headers, "If-None-Match", etag);
+    }
+    
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, acme->p, "get directory from %s", acme->url);
+    rv = md_http_GET_perform(acme->http, acme->url, headers, update_directory, &ctx);
     
     if (APR_SUCCESS != rv && APR_SUCCESS == result->status) {
         /* If the result reports no error, we never got a response from the server */
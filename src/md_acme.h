@@ -24,11 +24,14 @@ struct apr_hash_t;
 struct md_http_t;
 struct md_json_t;
 struct md_pkey_t;
+struct md_jws_key_t;
 struct md_t;
 struct md_acme_acct_t;
 struct md_acmev2_acct_t;
 struct md_store_t;
 struct md_result_t;
+struct md_cert_t;
+struct md_timeperiod_t;
 
 #define MD_PROTO_ACME               "ACME"
 
@@ -39,6 +42,8 @@ struct md_result_t;
 #define MD_ACME_VERSION_1          0x010000
 #define MD_ACME_VERSION_2          0x020000
 
+#define MD_ACME_MAX_PARALLEL       8
+
 #define MD_ACME_VERSION_MAJOR(i)    (((i)&0xFF0000) >> 16)
 
 typedef enum {
@@ -101,6 +106,7 @@ struct md_acme_t {
     const char *acct_id;            /* local storage id account was loaded from or NULL */
     struct md_acme_acct_t *acct;    /* account at ACME server to use for requests */
     struct md_pkey_t *acct_key;     /* private RSA key belonging to account */
+    struct md_jws_key_t *acct_jws;  /* JWK, header and thumbprint of acct_key, see below */
     
     int version;                    /* as detected from the server */
     union {
@@ -117,6 +123,7 @@ struct md_acme_t {
             const char *key_change;
             const char *revoke_cert;
             const char *new_nonce;
+            const char *renewal_info;   /* optional, RFC 9773 */
         } v2;
     } api;
     const char *ca_agreement;
@@ -128,16 +135,77 @@ struct md_acme_t {
     
     struct md_http_t *http;
     
-    const char *nonce;
+    const char *nonce;             /* a nonce not shared with others, see md_acme_nonce_count() */
     int max_retries;
+    int max_parallel;              /* max requests in flight in md_acme_multi_perform() */
+    apr_time_t retry_after;        /* Retry-After given in the last response, or 0 */
+    int polls;                     /* requests made to look for progress at the CA */
     struct md_result_t *last;      /* result of last request */
 };
 
+typedef enum {
+    MD_ACME_LIMIT_ORDERS,           /* new orders */
+    MD_ACME_LIMIT_ACCOUNTS,         /* new accounts */
+    MD_ACME_LIMIT_FAILED_AUTHZ,     /* failed validations */
+    MD_ACME_LIMIT_COUNT
+} md_acme_limit_t;
+
+/**
+ * Set how many of limit a CA is asked for per hour by this process, counted
+ * separately for each CA. 0 for no limit, which is the default.
+ */
+void md_acme_limit_set(md_acme_limit_t limit, int per_hour);
+
+/**
+ * Keep budgets and limits learned from CAs in the store, so they survive a 
+ * restart and are shared by all processes and servers using it. Without a
+ * store, they live in process memory only.
+ */
+void md_acme_limits_store_set(struct md_store_t *store);
+
+/**
+ * Check if the budget for limit at the CA allows one more now, taking it if so 
+ * and take is != 0. Failed validations are not taken here, but counted when 
+ * they happen by md_acme_limit_count().
+ * @return 0 if allowed, otherwise the time when it will be
+ */
+apr_time_t md_acme_limit_check(md_acme_t *acme, md_acme_limit_t limit, int take);
+void md_acme_limit_count(md_acme_t *acme, md_acme_limit_t limit);
+
+/**
+ * Forget all budgets used and limits learned from CAs in process memory.
+ */
+void md_acme_limits_clear(void);
+
+/**
+ * How long the server asked us to wait before looking again, as given in a 
+ * Retry-After header of its last response. 0 if it did not say.
+ */
+apr_interval_time_t md_acme_retry_after(md_acme_t *acme);
+
 /**
  * Global init, call once at start up.
  */
 apr_status_t md_acme_init(apr_pool_t *pool, const char *base_version, int init_ssl);
 
+/**
+ * Set for how long the directory of an ACME server is reused by all instances 
+ * in this process before it is asked for again (revalidated by ETag, if the 
+ * server gave one). A ttl <= 0 disables this cache.
+ */
+void md_acme_set_dir_cache_ttl(apr_interval_time_t ttl);
+
+/**
+ * Forget all cached ACME server directories.
+ */
+void md_acme_dir_cache_clear(void);
+
+/**
+ * Number of unused nonces at hand for the ACME server, collected from 
+ * earlier responses by all instances talking to it.
+ */
+int md_acme_nonce_count(md_acme_t *acme);
+
 /**
  * Create a new ACME server instance. If path is not NULL, will use that directory
  * for persisting information. Will load any information persisted in earlier session.
@@ -182,6 +250,13 @@ apr_status_t md_acme_POST_new_account(md_acme_t *acme,
 const char *md_acme_acct_id_get(md_acme_t *acme);
 const char *md_acme_acct_url_get(md_acme_t *acme);
 
+/**
+ * Get what signing with the account key needs: its JWK, protected header
+ * start and thumbprint. These are computed once for each account key.
+ * @return APR_EINVAL if there is no account key
+ */
+apr_status_t md_acme_acct_jws_get(struct md_jws_key_t **pjws, md_acme_t *acme);
+
 /** 
  * Specify the account to use by name in local store. On success, the account
  * the "current" one used by the acme instance.
@@ -277,12 +352,54 @@ apr_status_t md_acme_POST(md_acme_t *acme, const char *url,
                           md_acme_req_err_cb *on_err,
                           void *baton);
 
+/**
+ * Create a GET/POST request like md_acme_GET()/md_acme_POST(), but do not send
+ * it. Hand it to md_acme_multi_perform() via its md_acme_next_req callback.
+ */
+apr_status_t md_acme_req_make_GET(md_acme_req_t **preq, md_acme_t *acme, const char *url,
+                                  md_acme_req_init_cb *on_init,
+                                  md_acme_req_json_cb *on_json,
+                                  md_acme_req_res_cb *on_res,
+                                  md_acme_req_err_cb *on_err,
+                                  void *baton);
+apr_status_t md_acme_req_make_POST(md_acme_req_t **preq, md_acme_t *acme, const char *url,
+                                   md_acme_req_init_cb *on_init,
+                                   md_acme_req_json_cb *on_json,
+                                   md_acme_req_res_cb *on_res,
+                                   md_acme_req_err_cb *on_err,
+                                   void *baton);
+
+/**
+ * Return the next request to send in *preq on APR_SUCCESS, APR_ENOENT when
+ * there are no more. Anything else is an error.
+ */
+typedef apr_status_t md_acme_next_req(md_acme_req_t **preq, md_acme_t *acme, void *baton);
+
+/**
+ * Send the requests nextreq gives, with at most acme->max_parallel of them in 
+ * flight at a time. Callbacks of the requests are invoked as their responses 
+ * arrive, in no particular order. Retries are handled as with single requests.
+ * Returns the first error any of the requests encountered, after all are done.
+ */
+apr_status_t md_acme_multi_perform(md_acme_t *acme, md_acme_next_req *nextreq, void *baton);
+
 /**
  * Retrieve a JSON resource from the ACME server 
  */
 apr_status_t md_acme_get_json(struct md_json_t **pjson, md_acme_t *acme, 
                               const char *url, apr_pool_t *p);
 
+/**
+ * Retrieve the window the CA suggests for renewing the certificate, using ACME
+ * Renewal Information (RFC 9773). When to ask again is given by 
+ * md_acme_retry_after() afterwards.
+ * @param pexplanation  url of a CA explanation for the window or NULL
+ * @return APR_ENOTIMPL if the CA does not offer it, APR_ENOENT if the certificate
+ *         carries no authority key identifier
+ */
+apr_status_t md_acme_get_renewal_info(struct md_timeperiod_t *pwindow, const char **pexplanation,
+                                      md_acme_t *acme, const struct md_cert_t *cert, 
+                                      apr_pool_t *p);
 
 apr_status_t md_acme_req_body_init(md_acme_req_t *req, struct md_json_t *jpayload);
 
@@ -583,10 +583,17 @@ apr_status_t md_acme_acct_register(md_acme_t *acme, md_store_t *store, apr_pool_
         }
     }
     
-    /* If we still have no key, generate a new one */
+    /* If we still have no key, generate a new one. ACMEv2 servers must support
+     * ES256 (RFC 8555 ch. 6.2), which is much cheaper than RSA. */
     if (!acme->acct_key) {
-        spec.type = MD_PKEY_TYPE_RSA;
-        spec.params.rsa.bits = MD_ACME_ACCT_PKEY_BITS;
+        if (MD_ACME_VERSION_MAJOR(acme->version) > 1) {
+            spec.type = MD_PKEY_TYPE_EC;
+            spec.params.ec.curve = MD_PKEY_EC_CURVE_DEF;
+        }
+        else {
+            spec.type = MD_PKEY_TYPE_RSA;
+            spec.params.rsa.bits = MD_ACME_ACCT_PKEY_BITS;
+        }
         
         if (APR_SUCCESS != (rv = md_pkey_gen(&pkey, acme->p, &spec))) goto out;
         acme->acct_key = pkey;
@@ -50,13 +50,13 @@ md_acme_authz_t *md_acme_authz_create(apr_pool_t *p)
 /**************************************************************************************************/
 /* Register a new authorization */
 
-typedef struct {
+struct md_acme_authz_cha_t {
     size_t index;
     const char *type;
     const char *uri;
     const char *token;
     const char *key_authz;
-} md_acme_authz_cha_t;
+};
 
 typedef struct {
     apr_pool_t *p;
@@ -162,28 +162,20 @@ static int copy_challenge_error(void *baton, size_t index, md_json_t *json)
     return 1;
 }
 
-apr_status_t md_acme_authz_update(md_acme_authz_t *authz, md_acme_t *acme, apr_pool_t *p)
+static apr_status_t authz_update_from(md_acme_authz_t *authz, apr_status_t rv, 
+                                      md_json_t *json, apr_pool_t *p)
 {
-    md_json_t *json;
     const char *s, *err;
     md_log_level_t log_level;
-    apr_status_t rv;
     error_ctx_t ctx;
     
-    assert(acme);
-    assert(acme->http);
-    assert(authz);
-    assert(authz->url);
-
     authz->state = MD_ACME_AUTHZ_S_UNKNOWN;
-    json = NULL;
     authz->error_type = authz->error_detail = NULL;
     authz->error_subproblems = NULL;
     err = "unable to parse response";
     log_level = MD_LOG_ERR;
     
-    if (APR_SUCCESS == (rv = md_acme_get_json(&json, acme, authz->url, p))
-        && (s = md_json_gets(json, MD_KEY_STATUS, NULL))) {
+    if (APR_SUCCESS == rv && json && (s = md_json_gets(json, MD_KEY_STATUS, NULL))) {
             
         authz->domain = md_json_gets(json, MD_KEY_IDENTIFIER, MD_KEY_VALUE, NULL); 
         authz->resource = json;
@@ -220,6 +212,103 @@ apr_status_t md_acme_authz_update(md_acme_authz_t *authz, md_acme_t *acme, apr_p
     return rv;
 }
 
+apr_status_t md_acme_authz_update(md_acme_authz_t *authz, md_acme_t *acme, apr_pool_t *p)
+{
+    md_json_t *json = NULL;
+    apr_status_t rv;
+    
+    assert(acme);
+    assert(acme->http);
+    assert(authz);
+    assert(authz->url);
+
+    rv = md_acme_get_json(&json, acme, authz->url, p);
+    return authz_update_from(authz, rv, json, p);
+}
+
+/**************************************************************************************************/
+/* Update several authorizations in parallel */
+
+typedef struct {
+    apr_pool_t *p;
+    md_acme_authz_t *authz;
+    md_json_t *json;
+    apr_status_t rv;
+} authz_slot_t;
+
+typedef struct {
+    apr_pool_t *p;
+    apr_array_header_t *slots;
+    int next;
+} authz_multi_ctx;
+
+static apr_status_t slot_on_json(md_acme_t *acme, apr_pool_t *p, const apr_table_t *headers, 
+                                 md_json_t *jbody, void *baton)
+{
+    authz_slot_t *slot = baton;
+    
+    (void)acme;
+    (void)p;
+    (void)headers;
+    slot->json = md_json_clone(slot->p, jbody);
+    slot->rv = APR_SUCCESS;
+    return APR_SUCCESS;
+}
+
+static apr_status_t slot_on_err(md_acme_req_t *req, const md_result_t *result, void *baton)
+{
+    authz_slot_t *slot = baton;
+    
+    (void)req;
+    slot->rv = result->status;
+    return APR_SUCCESS;
+}
+
+static apr_status_t next_authz_get(md_acme_req_t **preq, md_acme_t *acme, void *baton)
+{
+    authz_multi_ctx *ctx = baton;
+    authz_slot_t *slot;
+    
+    if (ctx->next >= ctx->slots->nelts) return APR_ENOENT;
+    slot = APR_ARRAY_IDX(ctx->slots, ctx->next++, authz_slot_t*);
+    return md_acme_req_make_GET(preq, acme, slot->authz->url, NULL, 
+                                slot_on_json, NULL, slot_on_err, slot);
+}
+
+apr_status_t md_acme_authz_retrieve_all(apr_array_header_t **pauthzs, md_acme_t *acme, 
+                                        apr_array_header_t *urls, apr_pool_t *p)
+{
+    authz_multi_ctx ctx;
+    authz_slot_t *slot;
+    apr_array_header_t *authzs;
+    apr_status_t rv, rv2;
+    int i;
+    
+    ctx.p = p;
+    ctx.next = 0;
+    ctx.slots = apr_array_make(p, urls->nelts, sizeof(authz_slot_t*));
+    for (i = 0; i < urls->nelts; ++i) {
+        slot = apr_pcalloc(p, sizeof(*slot));
+        slot->p = p;
+        slot->authz = md_acme_authz_create(p);
+        slot->authz->url = apr_pstrdup(p, APR_ARRAY_IDX(urls, i, const char*));
+        slot->rv = APR_EGENERAL;
+        APR_ARRAY_PUSH(ctx.slots, authz_slot_t*) = slot;
+    }
+    
+    rv = md_acme_multi_perform(acme, next_authz_get, &ctx);
+    
+    authzs = apr_array_make(p, urls->nelts, sizeof(md_acme_authz_t*));
+    for (i = 0; i < ctx.slots->nelts; ++i) {
+        slot = APR_ARRAY_IDX(ctx.slots, i, authz_slot_t*);
+        rv2 = authz_update_from(slot->authz, slot->rv, slot->json, p);
+        if (APR_SUCCESS == rv) rv = rv2;
+        APR_ARRAY_PUSH(authzs, md_acme_authz_t*) = slot->authz;
+    }
+    *pauthzs = (APR_SUCCESS == rv)? authzs : NULL;
+    return rv;
+}
+
 /**************************************************************************************************/
 /* response to a challenge */
 
@@ -274,7 +363,8 @@ static apr_status_t authz_http_set(md_acme_t *acme, apr_pool_t *p, const apr_tab
 static apr_status_t setup_key_authz(md_acme_authz_cha_t *cha, md_acme_authz_t *authz,
                                     md_acme_t *acme, apr_pool_t *p, int *pchanged)
 {
-    const char *thumb64, *key_authz;
+    const char *key_authz;
+    md_jws_key_t *jws;
     apr_status_t rv;
     
     (void)authz;
@@ -282,8 +372,8 @@ static apr_status_t setup_key_authz(md_acme_authz_cha_t *cha, md_acme_authz_t *a
     assert(cha->token);
     
     *pchanged = 0;
-    if (APR_SUCCESS == (rv = md_jws_pkey_thumb(&thumb64, p, acme->acct_key))) {
-        key_authz = apr_psprintf(p, "%s.%s", cha->token, thumb64);
+    if (APR_SUCCESS == (rv = md_acme_acct_jws_get(&jws, acme))) {
+        key_authz = apr_psprintf(p, "%s.%s", cha->token, jws->thumb64);
         if (cha->key_authz) {
             if (strcmp(key_authz, cha->key_authz)) {
                 /* Hu? Did the account change key? */
@@ -302,7 +392,7 @@ static apr_status_t cha_http_01_setup(md_acme_authz_cha_t *cha, md_acme_authz_t
                                       md_acme_t *acme, md_store_t *store, 
                                       md_pkey_spec_t *key_spec, 
                                       apr_array_header_t *acme_tls_1_domains, 
-                                      apr_table_t *env, apr_pool_t *p)
+                                      apr_table_t *env, apr_pool_t *p, int *pnotify)
 {
     const char *data;
     apr_status_t rv;
@@ -323,15 +413,9 @@ static apr_status_t cha_http_01_setup(md_acme_authz_cha_t *cha, md_acme_authz_t
         notify_server = 1;
     }
     
-    if (APR_SUCCESS == rv && notify_server) {
-        authz_req_ctx ctx;
-
-        /* challenge is setup or was changed from previous data, tell ACME server
-         * so it may (re)try verification */        
-        authz_req_ctx_init(&ctx, acme, NULL, authz, p);
-        ctx.challenge = cha;
-        rv = md_acme_POST(acme, cha->uri, on_init_authz_resp, authz_http_set, NULL, NULL, &ctx);
-    }
+    /* challenge is setup or was changed from previous data, tell ACME server
+     * so it may (re)try verification */        
+    *pnotify = (APR_SUCCESS == rv && notify_server);
 out:
     return rv;
 }
@@ -340,7 +424,7 @@ static apr_status_t cha_tls_alpn_01_setup(md_acme_authz_cha_t *cha, md_acme_auth
                                           md_acme_t *acme, md_store_t *store, 
                                           md_pkey_spec_t *key_spec,  
                                           apr_array_header_t *acme_tls_1_domains, 
-                                          apr_table_t *env, apr_pool_t *p)
+                                          apr_table_t *env, apr_pool_t *p, int *pnotify)
 {
     md_cert_t *cha_cert;
     md_pkey_t *cha_key;
@@ -399,15 +483,9 @@ static apr_status_t cha_tls_alpn_01_setup(md_acme_authz_cha_t *cha, md_acme_auth
         notify_server = 1;
     }
     
-    if (APR_SUCCESS == rv && notify_server) {
-        authz_req_ctx ctx;
-
-        /* challenge is setup or was changed from previous data, tell ACME server
-         * so it may (re)try verification */        
-        authz_req_ctx_init(&ctx, acme, NULL, authz, p);
-        ctx.challenge = cha;
-        rv = md_acme_POST(acme, cha->uri, on_init_authz_resp, authz_http_set, NULL, NULL, &ctx);
-    }
+    /* challenge is setup or was changed from previous data, tell ACME server
+     * so it may (re)try verification */        
+    *pnotify = (APR_SUCCESS == rv && notify_server);
 out:    
     return rv;
 }
@@ -416,14 +494,13 @@ static apr_status_t cha_dns_01_setup(md_acme_authz_cha_t *cha, md_acme_authz_t *
                                      md_acme_t *acme, md_store_t *store, 
                                      md_pkey_spec_t *key_spec, 
                                      apr_array_header_t *acme_tls_1_domains, 
-                                     apr_table_t *env, apr_pool_t *p)
+                                     apr_table_t *env, apr_pool_t *p, int *pnotify)
 {
     const char *token;
     const char * const *argv;
     const char *cmdline, *dns01_cmd;
     apr_status_t rv;
     int exit_code, notify_server;
-    authz_req_ctx ctx;
     md_data_t data;
     
     (void)store;
@@ -450,6 +527,15 @@ static apr_status_t cha_dns_01_setup(md_acme_authz_cha_t *cha, md_acme_authz_t *
         goto out;
     }
 
+    if (apr_table_get(env, MD_KEY_CMD_DNS01_BATCH)) {
+        /* the command runs once for all domains of the order */
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, 
+                      "%s: dns-01 setup left to batch", authz->domain);
+        authz->dns01_token = token;
+        *pnotify = 1;
+        goto out;
+    }
+    
     cmdline = apr_psprintf(p, "%s setup %s %s", dns01_cmd, authz->domain, token); 
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, 
                   "%s: dns-01 setup command: %s", authz->domain, cmdline);
@@ -468,9 +554,7 @@ static apr_status_t cha_dns_01_setup(md_acme_authz_cha_t *cha, md_acme_authz_t *
     
     /* challenge is setup, tell ACME server so it may (re)try verification */        
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "%s: dns-01 setup succeeded", authz->domain);
-    authz_req_ctx_init(&ctx, acme, NULL, authz, p);
-    ctx.challenge = cha;
-    rv = md_acme_POST(acme, cha->uri, on_init_authz_resp, authz_http_set, NULL, NULL, &ctx);
+    *pnotify = 1;
     
 out:    
     return rv;
@@ -504,6 +588,59 @@ out:
     return rv;
 }
 
+apr_status_t md_acme_authz_setup_dns01_batch(apr_array_header_t *authzs, apr_table_t *env, 
+                                             apr_pool_t *p, md_result_t *result)
+{
+    md_acme_authz_t *authz;
+    const char * const *argv;
+    const char *cmdline, *dns01_cmd;
+    apr_status_t rv = APR_SUCCESS;
+    int i, n = 0, exit_code;
+    
+    dns01_cmd = apr_table_get(env, MD_KEY_CMD_DNS01);
+    cmdline = apr_pstrcat(p, dns01_cmd? dns01_cmd : "", " setup-batch", NULL);
+    for (i = 0; i < authzs->nelts; ++i) {
+        authz = APR_ARRAY_IDX(authzs, i, md_acme_authz_t*);
+        if (authz->dns01_token) {
+            cmdline = apr_pstrcat(p, cmdline, " ", authz->domain, " ", authz->dns01_token, NULL);
+            ++n;
+        }
+    }
+    if (!n) goto leave;
+    if (!dns01_cmd) {
+        rv = APR_ENOTIMPL;
+        md_result_printf(result, rv, "dns-01 command not set");
+        goto leave;
+    }
+    
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, 
+                  "dns-01 batch setup command for %d domains: %s", n, cmdline);
+    apr_tokenize_to_argv(cmdline, (char***)&argv, p);
+    if (APR_SUCCESS != (rv = md_util_exec(p, argv[0], argv, &exit_code))) {
+        md_result_printf(result, rv, "dns-01 batch setup command failed to execute");
+        md_result_log(result, MD_LOG_WARNING);
+        goto leave;
+    }
+    if (exit_code) {
+        rv = APR_EGENERAL;
+        md_result_printf(result, rv, "dns-01 batch setup command returns %d", exit_code);
+        md_result_log(result, MD_LOG_INFO);
+        goto leave;
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "dns-01 batch setup succeeded");
+    
+leave:
+    for (i = 0; i < authzs->nelts; ++i) {
+        authz = APR_ARRAY_IDX(authzs, i, md_acme_authz_t*);
+        if (authz->dns01_token) {
+            /* the server may only look once the records are there */
+            if (APR_SUCCESS != rv) authz->notify = NULL;
+            authz->dns01_token = NULL;
+        }
+    }
+    return rv;
+}
+
 static apr_status_t cha_teardown_dir(md_store_t *store, const char *domain, 
                                      apr_table_t *env, apr_pool_t *p)
 {
@@ -515,7 +652,7 @@ typedef apr_status_t cha_setup(md_acme_authz_cha_t *cha, md_acme_authz_t *authz,
                                md_acme_t *acme, md_store_t *store, 
                                md_pkey_spec_t *key_spec, 
                                apr_array_header_t *acme_tls_1_domains, 
-                               apr_table_t *env, apr_pool_t *p);
+                               apr_table_t *env, apr_pool_t *p, int *pnotify);
                                
 typedef apr_status_t cha_teardown(md_store_t *store, const char *domain, 
                                   apr_table_t *env, apr_pool_t *p);
@@ -564,14 +701,14 @@ static apr_status_t find_type(void *baton, size_t index, md_json_t *json)
     return 1;
 }
 
-apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, md_acme_t *acme, md_store_t *store, 
-                                   apr_array_header_t *challenges, md_pkey_spec_t *key_spec,
-                                   apr_array_header_t *acme_tls_1_domains, 
-                                   apr_table_t *env, apr_pool_t *p, const char **psetup_token,
-                                   md_result_t *result)
+apr_status_t md_acme_authz_setup(md_acme_authz_t *authz, md_acme_t *acme, md_store_t *store, 
+                                 apr_array_header_t *challenges, md_pkey_spec_t *key_spec,
+                                 apr_array_header_t *acme_tls_1_domains, 
+                                 apr_table_t *env, apr_pool_t *p, const char **psetup_token,
+                                 md_result_t *result)
 {
     apr_status_t rv;
-    int i;
+    int i, notify;
     cha_find_ctx fctx;
     const char *challenge_setup;
     
@@ -581,6 +718,7 @@ apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, md_acme_t *acme, md_s
 
     fctx.p = p;
     fctx.accepted = NULL;
+    authz->notify = NULL;
     
     /* Look in the order challenge types are defined:
      * - if they are offered by the CA, try to set it up
@@ -603,9 +741,11 @@ apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, md_acme_t *acme, md_s
                 if (!apr_strnatcasecmp(CHA_TYPES[i].name, fctx.accepted->type)) {
                     md_result_activity_printf(result, "Setting up challenge '%s' for domain %s", 
                                               fctx.accepted->type, authz->domain);
+                    notify = 0;
                     rv = CHA_TYPES[i].setup(fctx.accepted, authz, acme, store, key_spec, 
-                                            acme_tls_1_domains, env, p);
+                                            acme_tls_1_domains, env, p, &notify);
                     if (APR_SUCCESS == rv) {
+                        if (notify) authz->notify = fctx.accepted;
                         md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
                                       "%s: set up challenge '%s'", 
                                       authz->domain, fctx.accepted->type);
@@ -648,6 +788,79 @@ out:
     return rv;
 }
 
+static apr_status_t authz_notify(md_acme_authz_t *authz, md_acme_t *acme, apr_pool_t *p)
+{
+    authz_req_ctx ctx;
+    apr_status_t rv;
+    
+    authz_req_ctx_init(&ctx, acme, NULL, authz, p);
+    ctx.challenge = authz->notify;
+    rv = md_acme_POST(acme, ctx.challenge->uri, on_init_authz_resp, authz_http_set, 
+                      NULL, NULL, &ctx);
+    if (APR_SUCCESS == rv) authz->notify = NULL;
+    return rv;
+}
+
+apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, md_acme_t *acme, md_store_t *store, 
+                                   apr_array_header_t *challenges, md_pkey_spec_t *key_spec,
+                                   apr_array_header_t *acme_tls_1_domains, 
+                                   apr_table_t *env, apr_pool_t *p, const char **psetup_token,
+                                   md_result_t *result)
+{
+    apr_status_t rv;
+    
+    rv = md_acme_authz_setup(authz, acme, store, challenges, key_spec, acme_tls_1_domains,
+                             env, p, psetup_token, result);
+    if (APR_SUCCESS == rv && authz->dns01_token) {
+        apr_array_header_t *authzs = apr_array_make(p, 1, sizeof(md_acme_authz_t*));
+        
+        APR_ARRAY_PUSH(authzs, md_acme_authz_t*) = authz;
+        rv = md_acme_authz_setup_dns01_batch(authzs, env, p, result);
+    }
+    if (APR_SUCCESS == rv && authz->notify) {
+        rv = authz_notify(authz, acme, p);
+    }
+    return rv;
+}
+
+typedef struct {
+    apr_pool_t *p;
+    apr_array_header_t *authzs;
+    int next;
+} notify_multi_ctx;
+
+static apr_status_t next_authz_notify(md_acme_req_t **preq, md_acme_t *acme, void *baton)
+{
+    notify_multi_ctx *ctx = baton;
+    md_acme_authz_t *authz;
+    authz_req_ctx *rctx;
+    
+    while (ctx->next < ctx->authzs->nelts) {
+        authz = APR_ARRAY_IDX(ctx->authzs, ctx->next++, md_acme_authz_t*);
+        if (!authz->notify) continue;
+        
+        rctx = apr_pcalloc(ctx->p, sizeof(*rctx));
+        authz_req_ctx_init(rctx, acme, NULL, authz, ctx->p);
+        rctx->challenge = authz->notify;
+        /* the POST either succeeds, or the whole order setup fails */
+        authz->notify = NULL;
+        return md_acme_req_make_POST(preq, acme, rctx->challenge->uri, on_init_authz_resp, 
+                                     authz_http_set, NULL, NULL, rctx);
+    }
+    return APR_ENOENT;
+}
+
+apr_status_t md_acme_authz_notify_all(md_acme_t *acme, apr_array_header_t *authzs, 
+                                      apr_pool_t *p)
+{
+    notify_multi_ctx ctx;
+    
+    ctx.p = p;
+    ctx.authzs = authzs;
+    ctx.next = 0;
+    return md_acme_multi_perform(acme, next_authz_notify, &ctx);
+}
+
 apr_status_t md_acme_authz_teardown(struct md_store_t *store, 
                                     const char *token, apr_table_t *env, apr_pool_t *p)
 {
@@ -670,3 +883,42 @@ apr_status_t md_acme_authz_teardown(struct md_store_t *store,
     return APR_SUCCESS;
 }
 
+apr_status_t md_acme_authz_teardown_all(struct md_store_t *store, 
+                                        apr_array_header_t *setup_tokens, 
+                                        apr_table_t *env, apr_pool_t *p)
+{
+    apr_array_header_t *domains;
+    const char * const *argv;
+    const char *token, *domain, *cmdline, *dns01_cmd;
+    apr_size_t plen = sizeof(MD_AUTHZ_TYPE_DNS01 ":") - 1;
+    apr_status_t rv;
+    int i, batch, exit_code = 0;
+    
+    dns01_cmd = apr_table_get(env, MD_KEY_CMD_DNS01);
+    batch = dns01_cmd && apr_table_get(env, MD_KEY_CMD_DNS01_BATCH);
+    domains = apr_array_make(p, setup_tokens->nelts, sizeof(const char*));
+    for (i = 0; i < setup_tokens->nelts; ++i) {
+        token = APR_ARRAY_IDX(setup_tokens, i, const char*);
+        if (!token) continue;
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "teardown setup %s", token);
+        if (batch && !strncmp(MD_AUTHZ_TYPE_DNS01 ":", token, plen)) {
+            domain = token + plen;
+            if (md_array_str_index(domains, domain, 0, 0) < 0) {
+                APR_ARRAY_PUSH(domains, const char*) = domain;
+            }
+        }
+        else {
+            md_acme_authz_teardown(store, token, env, p);
+        }
+    }
+    if (apr_is_empty_array(domains)) return APR_SUCCESS;
+    
+    cmdline = apr_psprintf(p, "%s teardown-batch %s", dns01_cmd, 
+                           apr_array_pstrcat(p, domains, ' ')); 
+    apr_tokenize_to_argv(cmdline, (char***)&argv, p);
+    if (APR_SUCCESS != (rv = md_util_exec(p, argv[0], argv, &exit_code)) || exit_code) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, 
+                      "dns-01 batch teardown command failed (exit code=%d)", exit_code);
+    }
+    return rv;
+}
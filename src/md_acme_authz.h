@@ -27,6 +27,7 @@ struct md_pkey_spec_t;
 struct md_result_t;
 
 typedef struct md_acme_challenge_t md_acme_challenge_t;
+typedef struct md_acme_authz_cha_t md_acme_authz_cha_t;
 
 /**************************************************************************************************/
 /* authorization request for a specific domain name */
@@ -53,6 +54,8 @@ struct md_acme_authz_t {
     const char *error_detail;
     const struct md_json_t *error_subproblems;
     struct md_json_t *resource;
+    md_acme_authz_cha_t *notify;    /* challenge set up, the server has not been told yet */
+    const char *dns01_token;        /* dns-01 record to set up in a batch, see below */
 };
 
 #define MD_FN_HTTP01            "acme-http-01.txt"
@@ -72,6 +75,14 @@ apr_status_t md_acme_authz_retrieve(md_acme_t *acme, apr_pool_t *p, const char *
                                     md_acme_authz_t **pauthz);
 apr_status_t md_acme_authz_update(md_acme_authz_t *authz, struct md_acme_t *acme, apr_pool_t *p);
 
+/**
+ * Retrieve the authorizations at the urls in parallel. On success, *pauthzs has 
+ * a md_acme_authz_t* for each url, in the same order. Otherwise, the error is the 
+ * one of the first authorization that failed.
+ */
+apr_status_t md_acme_authz_retrieve_all(apr_array_header_t **pauthzs, struct md_acme_t *acme, 
+                                        apr_array_header_t *urls, apr_pool_t *p);
+
 apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, struct md_acme_t *acme, 
                                    struct md_store_t *store, apr_array_header_t *challenges, 
                                    struct md_pkey_spec_t *key_spec,
@@ -80,7 +91,45 @@ apr_status_t md_acme_authz_respond(md_acme_authz_t *authz, struct md_acme_t *acm
                                    apr_pool_t *p, const char **setup_token,
                                    struct md_result_t *result);
 
+/**
+ * Set up a challenge like md_acme_authz_respond(), but leave it to 
+ * md_acme_authz_notify_all() to tell the server. If it needs telling, 
+ * authz->notify is set.
+ */
+apr_status_t md_acme_authz_setup(md_acme_authz_t *authz, struct md_acme_t *acme, 
+                                 struct md_store_t *store, apr_array_header_t *challenges, 
+                                 struct md_pkey_spec_t *key_spec,
+                                 apr_array_header_t *acme_tls_1_domains, 
+                                 struct apr_table_t *env,
+                                 apr_pool_t *p, const char **setup_token,
+                                 struct md_result_t *result);
+
+/**
+ * When dns-01 challenges are set up in batches (MDChallengeDns01Batch), 
+ * md_acme_authz_setup() only records the token in authz->dns01_token. This then
+ * runs the dns-01 command once with "setup-batch" and all domain/token pairs.
+ * Call it before telling the server.
+ */
+apr_status_t md_acme_authz_setup_dns01_batch(apr_array_header_t *authzs, 
+                                             struct apr_table_t *env, apr_pool_t *p,
+                                             struct md_result_t *result);
+
+/**
+ * Tell the server about all challenges set up with md_acme_authz_setup() that 
+ * need it, with requests in parallel.
+ */
+apr_status_t md_acme_authz_notify_all(struct md_acme_t *acme, apr_array_header_t *authzs, 
+                                      apr_pool_t *p);
+
 apr_status_t md_acme_authz_teardown(struct md_store_t *store, const char *setup_token, 
                                     struct apr_table_t *env, apr_pool_t *p);
 
+/**
+ * Tear down all challenges of the setup tokens, dns-01 ones with a single 
+ * "teardown-batch" command when set up in batches.
+ */
+apr_status_t md_acme_authz_teardown_all(struct md_store_t *store, 
+                                        apr_array_header_t *setup_tokens, 
+                                        struct apr_table_t *env, apr_pool_t *p);
+
 #endif /* md_acme_authz_h */
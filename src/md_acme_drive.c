@@ -32,6 +32,7 @@
 #include "md_result.h"
 #include "md_reg.h"
 #include "md_store.h"
+#include "md_time.h"
 #include "md_util.h"
 
 #include "md_acme.h"
@@ -85,6 +86,7 @@ apr_status_t md_acme_drive_set_acct(md_proto_driver_t *d, md_result_t *result)
     md_t *md = ad->md;
     apr_status_t rv = APR_SUCCESS;
     int update_md = 0, update_acct = 0;
+    apr_time_t at;
     
     md_result_activity_printf(result, "Selecting account to use for %s", d->md->name);
     md_acme_clear_acct(ad->acme);
@@ -154,6 +156,14 @@ apr_status_t md_acme_drive_set_acct(md_proto_driver_t *d, md_result_t *result)
             goto leave;
         }
     
+        if ((at = md_acme_limit_check(ad->acme, MD_ACME_LIMIT_ACCOUNTS, 1))) {
+            rv = APR_EAGAIN;
+            md_result_printf(result, rv, "Rate limit for new accounts at %s reached, "
+                             "next one in %s", ad->acme->url, 
+                             md_duration_print(d->p, at - apr_time_now()));
+            md_result_delay_set(result, at);
+            goto leave;
+        }
         rv = md_acme_acct_register(ad->acme, d->store, d->p, md->contacts, md->ca_agreement);
         if (APR_SUCCESS != rv) {
             if (APR_SUCCESS != ad->acme->last->status) {
@@ -234,15 +244,19 @@ static apr_status_t on_add_cert(md_acme_t *acme, const md_http_response_t *res,
     return rv;
 }
 
-static apr_status_t get_cert(void *baton, int attempt)
+static apr_status_t get_cert(void *baton, int attempt, apr_interval_time_t *pdelay)
 {
     md_proto_driver_t *d = baton;
     md_acme_driver_t *ad = d->baton;
+    apr_status_t rv;
     
     (void)attempt;
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, d->p, "retrieving cert from %s",
                   ad->order->certificate);
-    return md_acme_GET(ad->acme, ad->order->certificate, NULL, NULL, on_add_cert, NULL, d);
+    ++ad->acme->polls;
+    rv = md_acme_GET(ad->acme, ad->order->certificate, NULL, NULL, on_add_cert, NULL, d);
+    *pdelay = md_acme_retry_after(ad->acme);
+    return rv;
 }
 
 apr_status_t md_acme_drive_cert_poll(md_proto_driver_t *d, int only_once)
@@ -256,7 +270,8 @@ apr_status_t md_acme_drive_cert_poll(md_proto_driver_t *d, int only_once)
     assert(ad->order->certificate);
     
     if (only_once) {
-        rv = get_cert(d, 0);
+        apr_interval_time_t delay;
+        rv = get_cert(d, 0, &delay);
     }
     else {
         rv = md_util_try(get_cert, d, 1, ad->cert_poll_timeout, 0, 0, 1);
@@ -342,17 +357,21 @@ static apr_status_t csr_req(md_acme_t *acme, const md_http_response_t *res, void
 apr_status_t md_acme_drive_setup_certificate(md_proto_driver_t *d, md_result_t *result)
 {
     md_acme_driver_t *ad = d->baton;
+    md_pkey_spec_t *spec;
     md_pkey_t *privkey;
     apr_status_t rv;
 
-    md_result_activity_printf(result, "Finalizing order for %s", ad->md->name);
+    spec = md_pkeys_spec_get(d->md->pks, ad->cur_key);
+    md_result_activity_printf(result, "Finalizing order for %s (%s key)", 
+                              ad->md->name, md_pkey_spec_name(spec));
     
-    rv = md_pkey_load(d->store, MD_SG_STAGING, d->md->name, &privkey, d->p);
+    rv = md_pkey_load(d->store, MD_SG_STAGING, d->md->name, spec, &privkey, d->p);
     if (APR_STATUS_IS_ENOENT(rv)) {
-        if (APR_SUCCESS == (rv = md_pkey_gen(&privkey, d->p, d->md->pkey_spec))) {
-            rv = md_pkey_save(d->store, d->p, MD_SG_STAGING, d->md->name, privkey, 1);
+        if (APR_SUCCESS == (rv = md_reg_pkey_get(&privkey, d->reg, spec, d->p))) {
+            rv = md_pkey_save(d->store, d->p, MD_SG_STAGING, d->md->name, spec, privkey, 1);
         }
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, d->p, "%s: generate privkey", d->md->name);
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, d->p, "%s: generate %s privkey", 
+                      d->md->name, md_pkey_spec_name(spec));
     }
     if (APR_SUCCESS != rv) goto leave;
     
@@ -401,7 +420,7 @@ static apr_status_t on_add_chain(md_acme_t *acme, const md_http_response_t *res,
     return rv;
 }
 
-static apr_status_t get_chain(void *baton, int attempt)
+static apr_status_t get_chain(void *baton, int attempt, apr_interval_time_t *pdelay)
 {
     md_proto_driver_t *d = baton;
     md_acme_driver_t *ad = d->baton;
@@ -437,6 +456,7 @@ static apr_status_t get_chain(void *baton, int attempt)
     }
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, d->p, 
                   "got chain with %d certs (%d. attempt)", ad->certs->nelts, attempt);
+    *pdelay = md_acme_retry_after(ad->acme);
     return rv;
 }
 
@@ -584,6 +604,21 @@ leave:
 /**************************************************************************************************/
 /* ACME staging */
 
+/* If STAGING holds a key and certificate chain for all keys of the MD */
+static int staging_complete(md_proto_driver_t *d)
+{
+    const char *keyfile, *certfile;
+    int i;
+    
+    for (i = 0; i < md_pkeys_spec_count(d->md->pks); ++i) {
+        if (APR_SUCCESS != md_reg_get_cred_files(&keyfile, &certfile, d->reg, MD_SG_STAGING, 
+                                                 d->md, i, d->p)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static apr_status_t acme_renew(md_proto_driver_t *d, md_result_t *result)
 {
     md_acme_driver_t *ad = d->baton;
@@ -591,8 +626,9 @@ static apr_status_t acme_renew(md_proto_driver_t *d, md_result_t *result)
     apr_status_t rv = APR_SUCCESS;
     apr_time_t now;
     apr_array_header_t *staged_certs;
+    md_pkey_spec_t *spec;
     char ts[APR_RFC822_DATE_LEN];
-    int first = 0;
+    int i, first = 0;
     
     if (md_log_is_level(d->p, MD_LOG_DEBUG)) {
         md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: staging started, "
@@ -640,21 +676,10 @@ static apr_status_t acme_renew(md_proto_driver_t *d, md_result_t *result)
         goto out;
     }
     
-    if (ad->md) {
-        const char *keyfile, *certfile;
-
-        rv = md_reg_get_cred_files(&keyfile, &certfile, d->reg, MD_SG_STAGING, d->md, d->p);
-        if (APR_SUCCESS == rv) {
-            if (md_array_is_empty(ad->certs)
-                && APR_SUCCESS == md_pubcert_load(d->store, MD_SG_STAGING, d->md->name, &staged_certs, d->p)) {
-                apr_array_cat(ad->certs, staged_certs);
-            }
-            if (!md_array_is_empty(ad->certs)) {
-                md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: all data staged", d->md->name);
-                rv = APR_SUCCESS;
-                goto ready;
-            }
-        }
+    if (ad->md && staging_complete(d)) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: all data staged", d->md->name);
+        rv = APR_SUCCESS;
+        goto ready;
     }
     
     /* Need to renew */
@@ -688,13 +713,21 @@ static apr_status_t acme_renew(md_proto_driver_t *d, md_result_t *result)
         ad->domains = md_dns_make_minimal(d->p, ad->md->domains);
     }
     
-    if (md_array_is_empty(ad->certs)
-        && APR_SUCCESS == md_pubcert_load(d->store, MD_SG_STAGING, d->md->name, &staged_certs, d->p)) {
-        apr_array_cat(ad->certs, staged_certs);
-    }
-    
-    if (md_array_is_empty(ad->certs)) {
-        md_result_activity_printf(result, "Driving ACME protocol for renewal of %s", d->md->name);
+    /* One certificate, and so one order, for each key. The ones already 
+     * staged are done. A renewal that has to wait on the CA resumes with the
+     * first key that has none. */
+    for (i = 0; i < md_pkeys_spec_count(d->md->pks); ++i) {
+        spec = md_pkeys_spec_get(d->md->pks, i);
+        if (APR_SUCCESS == md_pubcert_load(d->store, MD_SG_STAGING, d->md->name, 
+                                           spec, &staged_certs, d->p)) {
+            continue;
+        }
+        ad->cur_key = i;
+        ad->next_up_link = NULL;
+        apr_array_clear(ad->certs);
+        
+        md_result_activity_printf(result, "Driving ACME protocol for renewal of %s (%s key)", 
+                                  d->md->name, md_pkey_spec_name(spec));
         /* The process of setting up challenges and verifying domain
          * names differs between ACME versions. */
         switch (MD_ACME_VERSION_MAJOR(ad->acme->version)) {
@@ -712,45 +745,50 @@ static apr_status_t acme_renew(md_proto_driver_t *d, md_result_t *result)
                 break;
         }
         if (APR_SUCCESS != rv) goto out;
-    }
     
-    if (md_array_is_empty(ad->certs) || ad->next_up_link) {
-        md_result_activity_printf(result, "Retrieving certificate chain for %s", d->md->name);
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, 
-                      "%s: retrieving certificate chain", d->md->name);
-        rv = ad_chain_retrieve(d);
-        if (APR_SUCCESS != rv) {
-            md_result_printf(result, rv, "Unable to retrieve certificate chain.");
-            goto out;
+        if (md_array_is_empty(ad->certs) || ad->next_up_link) {
+            md_result_activity_printf(result, "Retrieving certificate chain for %s", d->md->name);
+            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, 
+                          "%s: retrieving certificate chain", d->md->name);
+            rv = ad_chain_retrieve(d);
+            if (APR_SUCCESS != rv) {
+                md_result_printf(result, rv, "Unable to retrieve certificate chain.");
+                goto out;
+            }
         }
-        
         if (!md_array_is_empty(ad->certs)) {
-            rv = md_pubcert_save(d->store, d->p, MD_SG_STAGING, d->md->name, ad->certs, 0);
+            rv = md_pubcert_save(d->store, d->p, MD_SG_STAGING, d->md->name, spec, ad->certs, 0);
             if (APR_SUCCESS != rv) {
                 md_result_printf(result, rv, "Saving new certificate chain.");
                 goto out;
             }
         }
-    }
     
-    /* As last step, cleanup any order we created so that challenge data
-     * may be removed asap. */
-    md_acme_order_purge(d->store, d->p, MD_SG_STAGING, d->md->name, d->env);
+        /* Cleanup the order we created so that challenge data may be removed asap.
+         * The next key needs an order of its own. */
+        md_acme_order_purge(d->store, d->p, MD_SG_STAGING, d->md->name, d->env);
+        ad->order = NULL;
+    }
     
     /* first time this job ran through */
     first = 1;    
 ready:
     md_result_activity_setn(result, NULL);
-    /* we should have the complete cert chain now */
-    assert(!md_array_is_empty(ad->certs));
-    assert(ad->certs->nelts > 1);
+    /* we should have the complete cert chains now, the primary one decides */
+    rv = md_pubcert_load(d->store, MD_SG_STAGING, d->md->name, 
+                         md_pkeys_spec_get(d->md->pks, 0), &staged_certs, d->p);
+    if (APR_SUCCESS != rv) {
+        md_result_printf(result, rv, "Loading staged certificate chain.");
+        goto out;
+    }
+    assert(staged_certs->nelts > 1);
     
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, d->p, 
                   "%s: certificate ready, activation delay set to %s", 
                   d->md->name, md_duration_format(d->p, d->activation_delay));
     
     /* determine when it should be activated */
-    md_result_delay_set(result, md_cert_get_not_before(APR_ARRAY_IDX(ad->certs, 0, md_cert_t*)));
+    md_result_delay_set(result, md_cert_get_not_before(APR_ARRAY_IDX(staged_certs, 0, md_cert_t*)));
 
     /* If the existing MD is complete and un-expired, delay the activation
      * to 24 hours after new cert is valid (if there is enough time left), so
@@ -762,8 +800,8 @@ ready:
         
         md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, d->p, 
                       "%s: state is COMPLETE, checking existing certificate", d->md->name);
-        if (APR_SUCCESS == md_reg_get_pubcert(&pub, d->reg, d->md, d->p)) {
-            valid_until = md_cert_get_not_after(APR_ARRAY_IDX(pub->certs, 0, const md_cert_t*));
+        if (APR_SUCCESS == md_reg_get_pubcert(&pub, d->reg, d->md, 0, d->p)) {
+            valid_until = pub->meta->not_after;
             if (d->activation_delay < 0) {
                 /* special simulation for test case */
                 if (first) {
@@ -796,6 +834,7 @@ ready:
     }
 
 out:
+    if (ad->acme) result->polls += ad->acme->polls;
     return rv;
 }
 
@@ -817,8 +856,10 @@ static apr_status_t acme_preload(md_proto_driver_t *d, md_store_group_t load_gro
     apr_status_t rv;
     md_pkey_t *privkey, *acct_key;
     md_t *md;
-    apr_array_header_t *pubcert;
+    md_pkey_spec_t *spec;
+    apr_array_header_t *pubcert, *privkeys, *pubcerts;
     struct md_acme_acct_t *acct;
+    int i;
 
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: preload start", name);
     /* Load data from MD_SG_STAGING and save it into "load_group".
@@ -833,13 +874,21 @@ static apr_status_t acme_preload(md_proto_driver_t *d, md_store_group_t load_gro
         md_result_set(result, rv, "loading staged md.json");
         goto leave;
     }
-    if (APR_SUCCESS != (rv = md_pkey_load(d->store, MD_SG_STAGING, name, &privkey, d->p))) {
-        md_result_set(result, rv, "loading staged privkey.pem");
-        goto leave;
-    }
-    if (APR_SUCCESS != (rv = md_pubcert_load(d->store, MD_SG_STAGING, name, &pubcert, d->p))) {
-        md_result_set(result, rv, "loading staged pubcert.pem");
-        goto leave;
+    privkeys = apr_array_make(d->p, 5, sizeof(md_pkey_t*));
+    pubcerts = apr_array_make(d->p, 5, sizeof(apr_array_header_t*));
+    for (i = 0; i < md_pkeys_spec_count(md->pks); ++i) {
+        spec = md_pkeys_spec_get(md->pks, i);
+        if (APR_SUCCESS != (rv = md_pkey_load(d->store, MD_SG_STAGING, name, spec, &privkey, d->p))) {
+            md_result_printf(result, rv, "loading staged %s", md_pkey_filename(spec, d->p));
+            goto leave;
+        }
+        if (APR_SUCCESS != (rv = md_pubcert_load(d->store, MD_SG_STAGING, name, spec, 
+                                                 &pubcert, d->p))) {
+            md_result_printf(result, rv, "loading staged %s", md_chain_filename(spec, d->p));
+            goto leave;
+        }
+        APR_ARRAY_PUSH(privkeys, md_pkey_t*) = privkey;
+        APR_ARRAY_PUSH(pubcerts, apr_array_header_t*) = pubcert;
     }
 
     /* See if staging holds a new or modified account data */
@@ -902,13 +951,20 @@ static apr_status_t acme_preload(md_proto_driver_t *d, md_store_group_t load_gro
         md_result_set(result, rv, "writing md.json");
         goto leave;
     }
-    if (APR_SUCCESS != (rv = md_pubcert_save(d->store, d->p, load_group, name, pubcert, 1))) {
-        md_result_set(result, rv, "writing pubcert.pem");
-        goto leave;
-    }
-    if (APR_SUCCESS != (rv = md_pkey_save(d->store, d->p, load_group, name, privkey, 1))) {
-        md_result_set(result, rv, "writing privkey.pem");
-        goto leave;
+    for (i = 0; i < md_pkeys_spec_count(md->pks); ++i) {
+        spec = md_pkeys_spec_get(md->pks, i);
+        pubcert = APR_ARRAY_IDX(pubcerts, i, apr_array_header_t*);
+        if (APR_SUCCESS != (rv = md_pubcert_save(d->store, d->p, load_group, name, spec, 
+                                                 pubcert, 1))) {
+            md_result_printf(result, rv, "writing %s", md_chain_filename(spec, d->p));
+            goto leave;
+        }
+        privkey = APR_ARRAY_IDX(privkeys, i, md_pkey_t*);
+        if (APR_SUCCESS != (rv = md_pkey_save(d->store, d->p, load_group, name, spec, 
+                                              privkey, 1))) {
+            md_result_printf(result, rv, "writing %s", md_pkey_filename(spec, d->p));
+            goto leave;
+        }
     }
     md_result_set(result, APR_SUCCESS, "saved staged data successfully");
     
@@ -927,9 +983,39 @@ static apr_status_t acme_driver_preload(md_proto_driver_t *d,
     return rv;
 }
 
+/**************************************************************************************************/
+/* ACME renewal information */
+
+static apr_status_t acme_driver_renewal_info(md_proto_driver_t *d, const md_cert_t *cert,
+                                             md_timeperiod_t *pwindow, const char **pexplanation,
+                                             apr_interval_time_t *pnext_update, 
+                                             md_result_t *result)
+{
+    md_acme_t *acme;
+    apr_status_t rv;
+    
+    *pnext_update = 0;
+    if (APR_SUCCESS != (rv = md_acme_create(&acme, d->p, d->md->ca_url, d->proxy_url))) {
+        md_result_set(result, rv, "error setting up acme");
+        goto leave;
+    }
+    rv = md_acme_get_renewal_info(pwindow, pexplanation, acme, cert, d->p);
+    *pnext_update = md_acme_retry_after(acme);
+    if (APR_SUCCESS == rv || APR_STATUS_IS_ENOTIMPL(rv) || APR_STATUS_IS_ENOENT(rv)) {
+        md_result_set(result, rv, NULL);
+    }
+    else {
+        md_acme_report_result(acme, rv, result);
+    }
+leave:
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, d->p, "%s: renewal info", d->md->name);
+    return rv;
+}
+
 static md_proto_t ACME_PROTO = {
     MD_PROTO_ACME, acme_driver_init, acme_driver_renew, 
-    acme_driver_preload_init, acme_driver_preload
+    acme_driver_preload_init, acme_driver_preload,
+    acme_driver_renewal_info
 };
  
 apr_status_t md_acme_protos_add(apr_hash_t *protos, apr_pool_t *p)
@@ -27,6 +27,7 @@ typedef struct md_acme_driver_t {
     int complete;
 
     md_pkey_t *privkey;              /* the new private key */
+    int cur_key;                     /* index of the key spec the certificate is for */
     apr_array_header_t *certs;       /* the certifiacte chain, starting with the new one */
     const char *next_up_link;        /* where the next chain cert is */
     
@@ -57,6 +57,13 @@ md_acme_order_t *md_acme_order_create(apr_pool_t *p)
 /* order conversion */
 
 #define MD_KEY_CHALLENGE_SETUPS   "challenge-setups"
+#define MD_KEY_POLL               "poll"
+#define MD_KEY_SINCE              "since"
+#define MD_KEY_WAIT               "wait"
+#define MD_KEY_DELAY              "delay"
+
+#define MD_ACME_POLL_DELAY_START  apr_time_from_sec(1)
+#define MD_ACME_POLL_DELAY_MAX    apr_time_from_sec(10)
 
 static md_acme_order_st order_st_from_str(const char *s) 
 {
@@ -114,6 +121,13 @@ md_json_t *md_acme_order_to_json(md_acme_order_t *order, apr_pool_t *p)
     if (order->certificate) {
         md_json_sets(order->certificate, json, MD_KEY_CERTIFICATE, NULL);
     }
+    md_json_setb(order->notified, json, MD_KEY_NOTIFIED, NULL);
+    if (MD_ACME_ORDER_WAIT_NONE != order->wait) {
+        md_json_setl(order->wait, json, MD_KEY_POLL, MD_KEY_WAIT, NULL);
+        md_json_set_time(order->wait_since, json, MD_KEY_POLL, MD_KEY_SINCE, NULL);
+        md_json_setl(order->polls, json, MD_KEY_POLL, MD_KEY_POLLS, NULL);
+        md_json_setl((long)apr_time_as_msec(order->delay), json, MD_KEY_POLL, MD_KEY_DELAY, NULL);
+    }
     return json;
 }
 
@@ -135,6 +149,16 @@ static void order_update_from_json(md_acme_order_t *order, md_json_t *json, apr_
     if (md_json_has_key(json, MD_KEY_CERTIFICATE, NULL)) {
         order->certificate = md_json_dups(p, json, MD_KEY_CERTIFICATE, NULL);
     }
+    /* our own bookkeeping, not part of the resource at the CA */
+    if (md_json_has_key(json, MD_KEY_NOTIFIED, NULL)) {
+        order->notified = md_json_getb(json, MD_KEY_NOTIFIED, NULL);
+    }
+    if (md_json_has_key(json, MD_KEY_POLL, NULL)) {
+        order->wait = (md_acme_order_wait_t)md_json_getl(json, MD_KEY_POLL, MD_KEY_WAIT, NULL);
+        order->wait_since = md_json_get_time(json, MD_KEY_POLL, MD_KEY_SINCE, NULL);
+        order->polls = (int)md_json_getl(json, MD_KEY_POLL, MD_KEY_POLLS, NULL);
+        order->delay = apr_time_from_msec(md_json_getl(json, MD_KEY_POLL, MD_KEY_DELAY, NULL));
+    }
 }
 
 md_acme_order_t *md_acme_order_from_json(md_json_t *json, apr_pool_t *p)
@@ -226,9 +250,8 @@ static apr_status_t p_purge(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_li
     md_store_t *store = baton;
     md_acme_order_t *order;
     md_store_group_t group;
-    const char *md_name, *setup_token;
+    const char *md_name;
     apr_table_t *env;
-    int i;
 
     group = (md_store_group_t)va_arg(ap, int);
     md_name = va_arg(ap, const char *);
@@ -236,14 +259,7 @@ static apr_status_t p_purge(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_li
 
     if (APR_SUCCESS == md_acme_order_load(store, group, md_name, &order, p)) {
         md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "order loaded for %s", md_name);
-        for (i = 0; i < order->challenge_setups->nelts; ++i) {
-            setup_token = APR_ARRAY_IDX(order->challenge_setups, i, const char*);
-            if (setup_token) {
-                md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, 
-                              "order teardown setup %s", setup_token);
-                md_acme_authz_teardown(store, setup_token, env, p);
-            }
-        }
+        md_acme_authz_teardown_all(store, order->challenge_setups, env, p);
     }
     return md_store_remove(store, group, md_name, MD_FN_ORDER, ptemp, 1);
 }
@@ -347,14 +363,16 @@ apr_status_t md_acme_order_update(md_acme_order_t *order, md_acme_t *acme,
     return rv;
 }
 
-static apr_status_t await_ready(void *baton, int attempt)
+static apr_status_t await_ready(void *baton, int attempt, apr_interval_time_t *pdelay)
 {
     order_ctx_t *ctx = baton;
     apr_status_t rv = APR_SUCCESS;
     
     (void)attempt;
-    if (APR_SUCCESS != (rv = md_acme_order_update(ctx->order, ctx->acme,
-                                                  ctx->result, ctx->p))) goto out;
+    ++ctx->acme->polls;
+    rv = md_acme_order_update(ctx->order, ctx->acme, ctx->result, ctx->p);
+    *pdelay = md_acme_retry_after(ctx->acme);
+    if (APR_SUCCESS != rv) goto out;
     switch (ctx->order->status) {
         case MD_ACME_ORDER_ST_READY:
         case MD_ACME_ORDER_ST_PROCESSING:
@@ -387,14 +405,16 @@ apr_status_t md_acme_order_await_ready(md_acme_order_t *order, md_acme_t *acme,
     return rv;
 }
 
-static apr_status_t await_valid(void *baton, int attempt)
+static apr_status_t await_valid(void *baton, int attempt, apr_interval_time_t *pdelay)
 {
     order_ctx_t *ctx = baton;
     apr_status_t rv = APR_SUCCESS;
 
     (void)attempt;
-    if (APR_SUCCESS != (rv = md_acme_order_update(ctx->order, ctx->acme, 
-                                                  ctx->result, ctx->p))) goto out;
+    ++ctx->acme->polls;
+    rv = md_acme_order_update(ctx->order, ctx->acme, ctx->result, ctx->p);
+    *pdelay = md_acme_retry_after(ctx->acme);
+    if (APR_SUCCESS != rv) goto out;
     switch (ctx->order->status) {
         case MD_ACME_ORDER_ST_VALID:
             break;
@@ -425,6 +445,59 @@ apr_status_t md_acme_order_await_valid(md_acme_order_t *order, md_acme_t *acme,
     return rv;
 }
 
+apr_status_t md_acme_order_check_ready(md_acme_order_t *order, md_acme_t *acme, 
+                                       const md_t *md, md_result_t *result, apr_pool_t *p)
+{
+    order_ctx_t ctx;
+    apr_interval_time_t delay = 0;
+    
+    assert(MD_ACME_VERSION_MAJOR(acme->version) > 1);
+    ORDER_CTX_INIT(&ctx, p, order, acme, md->name, NULL, result);
+    md_result_activity_setn(result, "Checking if order is ready");
+    return await_ready(&ctx, order->polls, &delay);
+}
+
+apr_status_t md_acme_order_check_valid(md_acme_order_t *order, md_acme_t *acme, 
+                                       const md_t *md, md_result_t *result, apr_pool_t *p)
+{
+    order_ctx_t ctx;
+    apr_interval_time_t delay = 0;
+    
+    assert(MD_ACME_VERSION_MAJOR(acme->version) > 1);
+    ORDER_CTX_INIT(&ctx, p, order, acme, md->name, NULL, result);
+    md_result_activity_setn(result, "Checking if finalized order is valid");
+    return await_valid(&ctx, order->polls, &delay);
+}
+
+apr_status_t md_acme_order_poll_later(md_acme_order_t *order, md_acme_order_wait_t wait,
+                                      apr_interval_time_t timeout, 
+                                      apr_interval_time_t retry_after, apr_time_t *pnext_poll)
+{
+    apr_time_t now = apr_time_now();
+    apr_interval_time_t delay;
+    
+    if (order->wait != wait) {
+        order->wait = wait;
+        order->wait_since = now;
+        order->polls = 0;
+        order->delay = 0;
+    }
+    else if (now > order->wait_since + timeout) {
+        /* start afresh when asked again */
+        order->wait = MD_ACME_ORDER_WAIT_NONE;
+        *pnext_poll = 0;
+        return APR_TIMEUP;
+    }
+    order->delay = order->delay? 
+        md_util_jitter_delay(MD_ACME_POLL_DELAY_START, order->delay, MD_ACME_POLL_DELAY_MAX)
+        : MD_ACME_POLL_DELAY_START;
+    /* the CA knows best when it makes sense to ask again */
+    delay = (retry_after > 0)? retry_after : order->delay;
+    ++order->polls;
+    *pnext_poll = now + delay;
+    return APR_EAGAIN;
+}
+
 /**************************************************************************************************/
 /* processing */
 
@@ -435,29 +508,32 @@ apr_status_t md_acme_order_start_challenges(md_acme_order_t *order, md_acme_t *a
                                             apr_pool_t *p)
 {
     apr_status_t rv = APR_SUCCESS;
+    apr_array_header_t *authzs;
     md_acme_authz_t *authz;
-    const char *url, *setup_token;
+    const char *setup_token;
     int i;
     
     md_result_activity_printf(result, "Starting challenges for domains");
-    for (i = 0; i < order->authz_urls->nelts; ++i) {
-        url = APR_ARRAY_IDX(order->authz_urls, i, const char*);
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "%s: check AUTHZ at %s", md->name, url);
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "%s: check %d AUTHZs", 
+                  md->name, order->authz_urls->nelts);
+    if (APR_SUCCESS != (rv = md_acme_authz_retrieve_all(&authzs, acme, order->authz_urls, p))) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "%s: check authzs", md->name);
+        goto leave;
+    }
+    
+    /* Challenges are set up locally one by one, the server is told about 
+     * them all at once afterwards. */
+    for (i = 0; i < authzs->nelts; ++i) {
+        authz = APR_ARRAY_IDX(authzs, i, md_acme_authz_t*);
         
-        if (APR_SUCCESS != (rv = md_acme_authz_retrieve(acme, p, url, &authz))) {
-            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "%s: check authz for %s",
-                          md->name, authz->domain);
-            goto leave;
-        }
-
         switch (authz->state) {
             case MD_ACME_AUTHZ_S_VALID:
                 break;
                 
             case MD_ACME_AUTHZ_S_PENDING:
-                rv = md_acme_authz_respond(authz, acme, store, challenge_types, 
-                                           md->pkey_spec, md->acme_tls_1_domains,
-                                           env, p, &setup_token, result);
+                rv = md_acme_authz_setup(authz, acme, store, challenge_types, 
+                                         md_pkeys_spec_get(md->pks, 0), md->acme_tls_1_domains,
+                                         env, p, &setup_token, result);
                 if (APR_SUCCESS != rv) {
                     goto leave;
                 }
@@ -480,63 +556,90 @@ apr_status_t md_acme_order_start_challenges(md_acme_order_t *order, md_acme_t *a
                 goto leave;
         }
     }
+    
+    /* dns-01 records set up in one go, before the server looks for any */
+    if (APR_SUCCESS != (rv = md_acme_authz_setup_dns01_batch(authzs, env, p, result))) {
+        goto leave;
+    }
+    if (APR_SUCCESS != (rv = md_acme_authz_notify_all(acme, authzs, p))) {
+        md_result_printf(result, rv, "%s: error telling the ACME server about challenges", 
+                         md->name);
+        md_result_log(result, MD_LOG_ERR);
+        goto leave;
+    }
+    order->notified = 1;
+    md_acme_order_save(store, p, MD_SG_STAGING, md->name, order, 0);
 leave:    
     return rv;
 }
 
-static apr_status_t check_challenges(void *baton, int attempt)
+static apr_status_t check_challenges(void *baton, int attempt, apr_interval_time_t *pdelay)
 {
     order_ctx_t *ctx = baton;
-    const char *url;
+    apr_array_header_t *authzs;
     md_acme_authz_t *authz;
     apr_status_t rv = APR_SUCCESS;
     int i;
     
-    for (i = 0; i < ctx->order->authz_urls->nelts; ++i) {
-        url = APR_ARRAY_IDX(ctx->order->authz_urls, i, const char*);
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ctx->p, "%s: check AUTHZ at %s (attempt %d)", 
-                      ctx->name, url, attempt);
-        
-        rv = md_acme_authz_retrieve(ctx->acme, ctx->p, url, &authz);
-        if (APR_SUCCESS == rv) {
-            switch (authz->state) {
-                case MD_ACME_AUTHZ_S_VALID:
-                    md_result_printf(ctx->result, rv, 
-                                     "domain authorization for %s is valid", authz->domain);
-                    break;
-                case MD_ACME_AUTHZ_S_PENDING:
-                    rv = APR_EAGAIN;
-                    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ctx->p, 
-                                  "%s: status pending at %s", authz->domain, authz->url);
-                    goto leave;
-                case MD_ACME_AUTHZ_S_INVALID:
-                    rv = APR_EINVAL;
-                    if (!authz->error_type) {
-                        md_result_printf(ctx->result, rv, 
-                                         "domain authorization for %s failed, CA consideres "
-                                         "answer to challenge invalid, no error given", 
-                                         authz->domain);
-                    } 
-                    md_result_log(ctx->result, MD_LOG_ERR);
-                    goto leave;
-                default:
-                    rv = APR_EINVAL;
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ctx->p, "%s: check %d AUTHZs (attempt %d)", 
+                  ctx->name, ctx->order->authz_urls->nelts, attempt);
+    ++ctx->acme->polls;
+    rv = md_acme_authz_retrieve_all(&authzs, ctx->acme, ctx->order->authz_urls, ctx->p);
+    *pdelay = md_acme_retry_after(ctx->acme);
+    if (APR_SUCCESS != rv) {
+        md_result_printf(ctx->result, rv, "authorization retrieval failed for %s", ctx->name);
+        goto leave;
+    }
+    for (i = 0; i < authzs->nelts; ++i) {
+        authz = APR_ARRAY_IDX(authzs, i, md_acme_authz_t*);
+        switch (authz->state) {
+            case MD_ACME_AUTHZ_S_VALID:
+                md_result_printf(ctx->result, rv, 
+                                 "domain authorization for %s is valid", authz->domain);
+                break;
+            case MD_ACME_AUTHZ_S_PENDING:
+                rv = APR_EAGAIN;
+                md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ctx->p, 
+                              "%s: status pending at %s", authz->domain, authz->url);
+                goto leave;
+            case MD_ACME_AUTHZ_S_INVALID:
+                rv = APR_EINVAL;
+                if (MD_ACME_ORDER_ST_PENDING == ctx->order->status) {
+                    /* first time we see it, the order turns invalid with it */
+                    md_acme_limit_count(ctx->acme, MD_ACME_LIMIT_FAILED_AUTHZ);
+                }
+                if (!authz->error_type) {
                     md_result_printf(ctx->result, rv, 
-                                     "domain authorization for %s failed with state %d", 
-                                     authz->domain, authz->state);
-                    md_result_log(ctx->result, MD_LOG_ERR);
-                    goto leave;
-            }
-        }
-        else {
-            md_result_printf(ctx->result, rv, "authorization retrieval failed for domain %s", 
-                             authz->domain);
+                                     "domain authorization for %s failed, CA consideres "
+                                     "answer to challenge invalid, no error given", 
+                                     authz->domain);
+                } 
+                md_result_log(ctx->result, MD_LOG_ERR);
+                goto leave;
+            default:
+                rv = APR_EINVAL;
+                md_result_printf(ctx->result, rv, 
+                                 "domain authorization for %s failed with state %d", 
+                                 authz->domain, authz->state);
+                md_result_log(ctx->result, MD_LOG_ERR);
+                goto leave;
         }
     }
 leave:
     return rv;
 }
 
+apr_status_t md_acme_order_check_authzs(md_acme_order_t *order, md_acme_t *acme, 
+                                        const md_t *md, md_result_t *result, apr_pool_t *p)
+{
+    order_ctx_t ctx;
+    apr_interval_time_t delay = 0;
+    
+    ORDER_CTX_INIT(&ctx, p, order, acme, md->name, NULL, result);
+    md_result_activity_printf(result, "Checking challenge status for %s", md->name);
+    return check_challenges(&ctx, order->polls, &delay);
+}
+
 apr_status_t md_acme_order_monitor_authzs(md_acme_order_t *order, md_acme_t *acme, 
                                           const md_t *md, apr_interval_time_t timeout, 
                                           md_result_t *result, apr_pool_t *p)
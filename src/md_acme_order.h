@@ -29,6 +29,14 @@ typedef enum {
     MD_ACME_ORDER_ST_INVALID,
 } md_acme_order_st;
 
+typedef enum {
+    MD_ACME_ORDER_WAIT_NONE,
+    MD_ACME_ORDER_WAIT_AUTHZS,      /* for the CA to verify challenges */
+    MD_ACME_ORDER_WAIT_READY,       /* for the order to become ready */
+    MD_ACME_ORDER_WAIT_VALID,       /* for the finalized order to become valid */
+    MD_ACME_ORDER_WAIT_CERT,        /* for the certificate to be available */
+} md_acme_order_wait_t;
+
 struct md_acme_order_t {
     apr_pool_t *p;
     const char *url;
@@ -38,6 +46,11 @@ struct md_acme_order_t {
     struct md_json_t *json;
     const char *finalize;
     const char *certificate;
+    int notified;                   /* CA has been told about all challenges */
+    md_acme_order_wait_t wait;      /* what we are polling the CA for */
+    apr_time_t wait_since;          /* when polling for it started */
+    int polls;                      /* number of polls so far */
+    apr_interval_time_t delay;      /* delay before the last poll */
 };
 
 #define MD_FN_ORDER             "order.json"
@@ -89,4 +102,32 @@ apr_status_t md_acme_order_await_valid(md_acme_order_t *order, md_acme_t *acme,
                                        const md_t *md, apr_interval_time_t timeout, 
                                        struct md_result_t *result, apr_pool_t *p);
 
+/**
+ * Look once at the order's authorizations, order status or certificate, without
+ * waiting for the CA to get there.
+ * @return APR_SUCCESS when there, APR_EAGAIN when the CA is not done yet or 
+ *         another error
+ */
+apr_status_t md_acme_order_check_authzs(md_acme_order_t *order, md_acme_t *acme, 
+                                        const md_t *md, struct md_result_t *result, 
+                                        apr_pool_t *p);
+apr_status_t md_acme_order_check_ready(md_acme_order_t *order, md_acme_t *acme, 
+                                       const md_t *md, struct md_result_t *result, 
+                                       apr_pool_t *p);
+apr_status_t md_acme_order_check_valid(md_acme_order_t *order, md_acme_t *acme, 
+                                       const md_t *md, struct md_result_t *result, 
+                                       apr_pool_t *p);
+
+/**
+ * Plan the next poll of an order waiting on the CA. Delays start at one second and
+ * grow with jitter up to ten, see md_util_jitter_delay(), unless the CA gave a 
+ * retry_after > 0. Waiting for something new starts afresh.
+ * The caller persists the order and resumes at the time given.
+ * @return APR_EAGAIN with the time of the next poll in pnext_poll, or APR_TIMEUP 
+ *         when the order has been waiting on this longer than timeout
+ */
+apr_status_t md_acme_order_poll_later(md_acme_order_t *order, md_acme_order_wait_t wait,
+                                      apr_interval_time_t timeout, 
+                                      apr_interval_time_t retry_after, apr_time_t *pnext_poll);
+
 #endif /* md_acme_order_h */
@@ -32,6 +32,7 @@
 #include "md_result.h"
 #include "md_reg.h"
 #include "md_store.h"
+#include "md_time.h"
 #include "md_util.h"
 
 #include "md_acme.h"
@@ -56,6 +57,7 @@ static apr_status_t ad_setup_order(md_proto_driver_t *d, md_result_t *result)
     md_acme_driver_t *ad = d->baton;
     apr_status_t rv;
     md_t *md = ad->md;
+    apr_time_t at;
     
     assert(ad->md);
     assert(ad->acme);
@@ -75,6 +77,15 @@ static apr_status_t ad_setup_order(md_proto_driver_t *d, md_result_t *result)
         md_acme_order_purge(d->store, d->p, MD_SG_STAGING, md->name, d->env);
     }
     
+    /* Stay within the CA's limits. Postponed renewals are not failures. */
+    if ((at = md_acme_limit_check(ad->acme, MD_ACME_LIMIT_FAILED_AUTHZ, 0))
+        || (at = md_acme_limit_check(ad->acme, MD_ACME_LIMIT_ORDERS, 1))) {
+        md_result_printf(result, APR_EAGAIN, "Rate limit for new orders at %s reached, "
+                         "next one in %s", ad->acme->url, md_duration_print(d->p, at - apr_time_now()));
+        md_result_delay_set(result, at);
+        return APR_EAGAIN;
+    }
+    
     md_result_activity_setn(result, "Creating new order");
     rv = md_acme_order_register(&ad->order, ad->acme, d->p, d->md->name, ad->domains);
     if (APR_SUCCESS !=rv) goto leave;
@@ -91,6 +102,34 @@ leave:
 /**************************************************************************************************/
 /* ACMEv2 renewal */
 
+/**
+ * The order waits on the CA. Instead of sleeping here, persist how far we got
+ * and have the renewal resumed when the next poll is due.
+ */
+static apr_status_t ad_poll_later(md_proto_driver_t *d, md_acme_order_wait_t wait, 
+                                  apr_interval_time_t timeout, const char *what,
+                                  md_result_t *result)
+{
+    md_acme_driver_t *ad = d->baton;
+    apr_time_t next_poll;
+    apr_status_t rv;
+    
+    rv = md_acme_order_poll_later(ad->order, wait, timeout, md_acme_retry_after(ad->acme), 
+                                  &next_poll);
+    md_acme_order_save(d->store, d->p, MD_SG_STAGING, d->md->name, ad->order, 0);
+    if (APR_STATUS_IS_TIMEUP(rv)) {
+        md_result_printf(result, rv, "%s: gave up after %s", what, 
+                         md_duration_print(d->p, timeout));
+        md_result_log(result, MD_LOG_ERR);
+    }
+    else {
+        md_result_printf(result, rv, "%s, looking again in %s", what,
+                         md_duration_print(d->p, next_poll - apr_time_now()));
+        md_result_delay_set(result, next_poll);
+    }
+    return rv;
+}
+
 apr_status_t md_acmev2_drive_renew(md_acme_driver_t *ad, md_proto_driver_t *d, md_result_t *result)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -107,13 +146,14 @@ apr_status_t md_acmev2_drive_renew(md_acme_driver_t *ad, md_proto_driver_t *d, m
      * 1. load an md_acme_order_t from STAGING, if present
      * 2. if no order found, register a new order at ACME server
      * 3. update the order from the server
-     * 4. Switch order state:
-     *   * PENDING: process authz challenges
+     * 4. Take the order as far as it goes without waiting on the CA:
+     *   * PENDING: set up authz challenges once, check if the CA verified them
      *   * READY: finalize the order
-     *   * PROCESSING: wait and re-assses later
+     *   * PROCESSING: check if it became valid
      *   * VALID: retrieve certificate
-     *   * COMPLETE: all done, return success
-     *   * INVALID and otherwise: fail renewal, delete local order
+     *   * INVALID and otherwise: fail renewal
+     *    When the CA is not there yet, return APR_EAGAIN with the time of the next
+     *    poll in result->ready_at. The order in STAGING has all to resume then.
      */
     if (APR_SUCCESS != (rv = ad_setup_order(d, result))) {
         goto leave;
@@ -134,32 +174,64 @@ apr_status_t md_acmev2_drive_renew(md_acme_driver_t *ad, md_proto_driver_t *d, m
         if (APR_SUCCESS != rv) goto leave;
     }
     
-    rv = md_acme_order_start_challenges(ad->order, ad->acme, ad->ca_challenges,
-                                        d->store, d->md, d->env, result, d->p);
-    if (APR_SUCCESS != rv) goto leave;
-    
-    rv = md_acme_order_monitor_authzs(ad->order, ad->acme, d->md,
-                                      ad->authz_monitor_timeout, result, d->p);
-    if (APR_SUCCESS != rv) goto leave;
-    
-    rv = md_acme_order_await_ready(ad->order, ad->acme, d->md, 
-                                   ad->authz_monitor_timeout, result, d->p);
-    if (APR_SUCCESS != rv) goto leave;
+    if (MD_ACME_ORDER_ST_PENDING == ad->order->status 
+        || MD_ACME_ORDER_ST_INVALID == ad->order->status) {
+        if (!ad->order->notified) {
+            rv = md_acme_order_start_challenges(ad->order, ad->acme, ad->ca_challenges,
+                                                d->store, d->md, d->env, result, d->p);
+            if (APR_SUCCESS != rv) goto leave;
+        }
+        
+        rv = md_acme_order_check_authzs(ad->order, ad->acme, d->md, result, d->p);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            rv = ad_poll_later(d, MD_ACME_ORDER_WAIT_AUTHZS, ad->authz_monitor_timeout, 
+                               "Waiting for the CA to verify the challenges", result);
+            goto leave;
+        }
+        else if (APR_SUCCESS != rv) goto leave;
+        
+        rv = md_acme_order_check_ready(ad->order, ad->acme, d->md, result, d->p);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            rv = ad_poll_later(d, MD_ACME_ORDER_WAIT_READY, ad->authz_monitor_timeout, 
+                               "Waiting for order to become ready", result);
+            goto leave;
+        }
+        else if (APR_SUCCESS != rv) goto leave;
+    }
     
-    rv = md_acme_drive_setup_certificate(d, result);
-    if (APR_SUCCESS != rv) goto leave;
+    if (MD_ACME_ORDER_ST_READY == ad->order->status) {
+        rv = md_acme_drive_setup_certificate(d, result);
+        if (APR_SUCCESS != rv) goto leave;
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: finalized order", d->md->name);
+    }
     
-    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, d->p, "%s: finalized order", d->md->name);
+    if (MD_ACME_ORDER_ST_VALID != ad->order->status || !ad->order->certificate) {
+        rv = md_acme_order_check_valid(ad->order, ad->acme, d->md, result, d->p);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            rv = ad_poll_later(d, MD_ACME_ORDER_WAIT_VALID, ad->authz_monitor_timeout, 
+                               "Waiting for finalized order to become valid", result);
+            goto leave;
+        }
+        else if (APR_SUCCESS != rv) goto leave;
+    }
     
-    rv = md_acme_order_await_valid(ad->order, ad->acme, d->md, 
-                                   ad->authz_monitor_timeout, result, d->p);
-    if (APR_SUCCESS != rv) goto leave;
+    if (!ad->order->certificate) {
+        md_result_set(result, APR_EINVAL, "Order valid, but certifiate url is missing.");
+        rv = result->status;
+        goto leave;
+    }
     
-    if (ad->order->certificate) goto leave;
-    md_result_set(result, APR_EINVAL, "Order valid, but certifiate url is missing.");
+    /* Issuing the certificate may take the CA a moment after the order became valid */
+    rv = md_acme_drive_cert_poll(d, 1);
+    if (APR_SUCCESS != rv) {
+        rv = ad_poll_later(d, MD_ACME_ORDER_WAIT_CERT, ad->cert_poll_timeout, 
+                           "Waiting for the certificate to be issued", result);
+    }
 
 leave:    
+    if (APR_SUCCESS != rv && APR_SUCCESS == result->status) {
+        md_result_set(result, rv, NULL);
+    }
     md_result_log(result, MD_LOG_DEBUG);
     return result->status;
 }
-
@@ -179,6 +179,7 @@ static apr_status_t cmd_process(md_cmd_ctx *ctx, const md_cmd_t *cmd)
             fprintf(stderr, "error %d creating store for: %s\n", rv, ctx->base_dir);
             return APR_EINVAL;
         }
+        md_acme_limits_store_set(ctx->store);
     }
     if (cmd->needs & MD_CTX_REG && !ctx->reg) {
         if (!ctx->store) {
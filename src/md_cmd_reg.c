@@ -251,6 +251,7 @@ static apr_status_t assess_and_drive(md_cmd_ctx *ctx, md_t *md)
     apr_status_t rv = APR_SUCCESS;
     md_result_t *result;
     md_log_level_t level = MD_LOG_INFO;
+    apr_interval_time_t wait_time;
     
     reset = md_cmd_ctx_has_option(ctx, "reset");  
     force = md_cmd_ctx_has_option(ctx, "force");
@@ -261,6 +262,11 @@ static apr_status_t assess_and_drive(md_cmd_ctx *ctx, md_t *md)
               "logs or run this command in very verbose form and check the output.");
         goto out;
     }    
+    if (!force) {
+        /* errors here only mean we go by our own renewal window */
+        md_reg_renewal_info_update(ctx->reg, md, ctx->env, 
+                                   md_result_md_make(ctx->p, md->name), ctx->p);
+    }
     if (!force && !md_reg_should_renew(ctx->reg, md, ctx->p)) {
         md_result_printf(result, APR_SUCCESS, "complete.");
         level = MD_LOG_TRACE1;
@@ -276,6 +282,16 @@ static apr_status_t assess_and_drive(md_cmd_ctx *ctx, md_t *md)
     md_result_log(result, MD_LOG_INFO);
     
     rv = md_reg_renew(ctx->reg, md, ctx->env, reset, result, ctx->p);
+    while (APR_STATUS_IS_EAGAIN(rv) && result->ready_at) {
+        /* The CA is not done yet. We have nothing else to do, so wait for it. */
+        md_result_log(result, MD_LOG_DEBUG);
+        wait_time = result->ready_at - apr_time_now();
+        if (wait_time > 0) {
+            apr_sleep(wait_time);
+        }
+        md_result_delay_set(result, 0);
+        rv = md_reg_renew(ctx->reg, md, ctx->env, 0, result, ctx->p);
+    }
     if (APR_SUCCESS != rv) goto out;
     
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ctx->p, "%s: loading", md->name);
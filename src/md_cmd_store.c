@@ -28,6 +28,7 @@
 #include "md_log.h"
 #include "md_reg.h"
 #include "md_store.h"
+#include "md_store_fs.h"
 #include "md_util.h"
 #include "md_version.h"
 #include "md_cmd.h"
@@ -213,6 +214,279 @@ static md_cmd_t UpdateCmd = {
     "update the managed domain <name> in the store"
 };
 
+/**************************************************************************************************/
+/* command: store changes */
+
+static int print_change(void *baton, const md_store_change_t *change, apr_pool_t *ptemp)
+{
+    md_cmd_ctx *ctx = baton;
+    
+    if (ctx->json_out) {
+        md_json_t *json = md_json_create(ptemp);
+        md_json_setn((double)change->seq, json, MD_KEY_SEQ, NULL);
+        md_json_set_time(change->when, json, MD_KEY_WHEN, NULL);
+        md_json_sets(md_store_op_name(change->op), json, MD_KEY_OP, NULL);
+        md_json_sets(md_store_group_name(change->group), json, MD_KEY_GROUP, NULL);
+        if (change->name) md_json_sets(change->name, json, MD_KEY_NAME, NULL);
+        if (change->aspect) md_json_sets(change->aspect, json, MD_KEY_ASPECT, NULL);
+        md_json_addj(json, ctx->json_out, "output", NULL);
+    }
+    else {
+        fprintf(stdout, "%" APR_UINT64_T_FMT " %s %s/%s/%s\n", change->seq, 
+                md_store_op_name(change->op), md_store_group_name(change->group), 
+                change->name? change->name : "", change->aspect? change->aspect : "");
+    }
+    return 1;
+}
+
+static apr_status_t cmd_changes(md_cmd_ctx *ctx, const md_cmd_t *cmd)
+{
+    apr_uint64_t since = 0, last;
+    apr_status_t rv;
+    
+    if (ctx->argc > 1) {
+        return usage(cmd, "too many arguments");
+    }
+    else if (ctx->argc == 1) {
+        since = (apr_uint64_t)apr_strtoi64(ctx->argv[0], NULL, 10);
+    }
+    
+    rv = md_store_changes(ctx->store, ctx->p, since, print_change, ctx, &last);
+    if (APR_SUCCESS == rv) {
+        if (ctx->json_out) {
+            md_json_setn((double)last, ctx->json_out, "last", NULL);
+        }
+        else {
+            fprintf(stdout, "last: %" APR_UINT64_T_FMT "\n", last);
+        }
+    }
+    else {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, ctx->p, 
+                      "reading store changes since %" APR_UINT64_T_FMT, since);
+    }
+    return rv;
+}
+
+static md_cmd_t ChangesCmd = {
+    "changes", MD_CTX_STORE, 
+    NULL, cmd_changes, MD_NoOptions, NULL,
+    "changes [seq]",
+    "list the changes recorded in the store journal, optionally only those after <seq>"
+};
+
+/**************************************************************************************************/
+/* command: store lease/release */
+
+static void print_lease(md_cmd_ctx *ctx, const md_store_lease_t *lease)
+{
+    if (ctx->json_out) {
+        md_json_t *json = md_json_create(ctx->p);
+        md_json_sets(lease->name, json, MD_KEY_NAME, NULL);
+        md_json_sets(lease->owner, json, MD_KEY_OWNER, NULL);
+        md_json_setn((double)lease->token, json, MD_KEY_TOKEN, NULL);
+        if (lease->expires) md_json_set_time(lease->expires, json, MD_KEY_EXPIRES, NULL);
+        md_json_addj(json, ctx->json_out, "output", NULL);
+    }
+    else {
+        fprintf(stdout, "%s/%s: token %" APR_UINT64_T_FMT " owned by %s\n", 
+                lease->name, lease->purpose, lease->token, lease->owner);
+    }
+}
+
+static apr_status_t cmd_lease(md_cmd_ctx *ctx, const md_cmd_t *cmd)
+{
+    md_store_lease_t *lease;
+    apr_interval_time_t duration = apr_time_from_sec(60);
+    apr_status_t rv;
+    
+    if (ctx->argc < 3 || ctx->argc > 4) {
+        return usage(cmd, "needs name, purpose, owner and optional seconds");
+    }
+    if (ctx->argc > 3) {
+        duration = apr_time_from_sec(apr_atoi64(ctx->argv[3]));
+    }
+    rv = md_store_lease_acquire(&lease, ctx->store, ctx->p, ctx->argv[0], ctx->argv[1], 
+                                ctx->argv[2], duration);
+    if (lease) print_lease(ctx, lease);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, ctx->p, "acquire lease %s/%s", 
+                      ctx->argv[0], ctx->argv[1]);
+    }
+    return rv;
+}
+
+static md_cmd_t LeaseCmd = {
+    "lease", MD_CTX_STORE, 
+    NULL, cmd_lease, MD_NoOptions, NULL,
+    "lease name purpose owner [seconds]",
+    "acquire the lease on <name> for <purpose>, valid for <seconds> (default 60)"
+};
+
+static apr_status_t cmd_release(md_cmd_ctx *ctx, const md_cmd_t *cmd)
+{
+    md_store_lease_t lease;
+    apr_status_t rv;
+    
+    if (ctx->argc != 4) {
+        return usage(cmd, "needs name, purpose, owner and token");
+    }
+    memset(&lease, 0, sizeof(lease));
+    lease.name = ctx->argv[0];
+    lease.purpose = ctx->argv[1];
+    lease.owner = ctx->argv[2];
+    lease.token = (apr_uint64_t)apr_strtoi64(ctx->argv[3], NULL, 10);
+    rv = md_store_lease_release(ctx->store, ctx->p, &lease);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, ctx->p, "release lease %s/%s", 
+                      lease.name, lease.purpose);
+    }
+    return rv;
+}
+
+static md_cmd_t ReleaseCmd = {
+    "release", MD_CTX_STORE, 
+    NULL, cmd_release, MD_NoOptions, NULL,
+    "release name purpose owner token",
+    "give up the lease on <name> for <purpose>, if still held by <owner> with <token>"
+};
+
+/**************************************************************************************************/
+/* command: store export */
+
+static apr_status_t cmd_export(md_cmd_ctx *ctx, const md_cmd_t *cmd)
+{
+    apr_array_header_t *groups;
+    const char *fname, *pattern, *gnames;
+    char *gname, *last;
+    apr_file_t *f;
+    unsigned int g;
+    int count;
+    apr_status_t rv;
+    
+    if (ctx->argc < 1 || ctx->argc > 2) {
+        return usage(cmd, "needs archive file and optional name pattern");
+    }
+    fname = ctx->argv[0];
+    pattern = (ctx->argc > 1)? ctx->argv[1] : "*";
+    
+    groups = apr_array_make(ctx->p, MD_SG_COUNT, sizeof(int));
+    gnames = md_cmd_ctx_get_option(ctx, "groups");
+    if (gnames) {
+        gname = apr_strtok(apr_pstrdup(ctx->p, gnames), ", ", &last);
+        for (; gname; gname = apr_strtok(NULL, ", ", &last)) {
+            for (g = MD_SG_ACCOUNTS; g < MD_SG_COUNT; ++g) {
+                if (!strcmp(gname, md_store_group_name(g))) break;
+            }
+            if (g >= MD_SG_COUNT) {
+                return usage(cmd, apr_psprintf(ctx->p, "unknown store group: %s", gname));
+            }
+            APR_ARRAY_PUSH(groups, int) = (int)g;
+        }
+    }
+    else {
+        /* challenges and tmp data are short-lived, no need to move them */
+        APR_ARRAY_PUSH(groups, int) = MD_SG_ACCOUNTS;
+        APR_ARRAY_PUSH(groups, int) = MD_SG_DOMAINS;
+        APR_ARRAY_PUSH(groups, int) = MD_SG_STAGING;
+        APR_ARRAY_PUSH(groups, int) = MD_SG_ARCHIVE;
+        APR_ARRAY_PUSH(groups, int) = MD_SG_OCSP;
+    }
+    
+    rv = (!strcmp("-", fname))? apr_file_open_stdout(&f, ctx->p) 
+         : apr_file_open(&f, fname, APR_FOPEN_WRITE|APR_FOPEN_CREATE|APR_FOPEN_TRUNCATE
+                         |APR_FOPEN_BINARY|APR_FOPEN_BUFFERED, MD_FPROT_F_UONLY, ctx->p);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, ctx->p, "opening %s", fname);
+        return rv;
+    }
+    rv = md_store_fs_export(ctx->store, f, groups, pattern, &count, ctx->p);
+    apr_file_close(f);
+    if (APR_SUCCESS == rv && ctx->json_out) {
+        md_json_setl(count, ctx->json_out, MD_KEY_ENTRIES, NULL);
+    }
+    return rv;
+}
+
+static apr_status_t opts_export(md_cmd_ctx *ctx, int option, const char *optarg)
+{
+    switch (option) {
+        case 'g':
+            md_cmd_ctx_set_option(ctx, "groups", optarg);
+            break;
+        default:
+            return APR_EINVAL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_getopt_option_t ExportOptions [] = {
+    { "groups",    'g', 1, "comma separated list of store groups to export"},
+    { NULL , 0, 0, NULL }
+};
+
+static md_cmd_t ExportCmd = {
+    "export", MD_CTX_STORE, 
+    opts_export, cmd_export, ExportOptions, NULL,
+    "export [options] file|- [name-pattern]",
+    "write the store, or the selected groups and names, into a single archive"
+};
+
+/**************************************************************************************************/
+/* command: store import */
+
+static apr_status_t cmd_import(md_cmd_ctx *ctx, const md_cmd_t *cmd)
+{
+    const char *fname;
+    apr_file_t *f;
+    int count;
+    apr_status_t rv;
+    
+    if (ctx->argc != 1) {
+        return usage(cmd, "needs archive file");
+    }
+    fname = ctx->argv[0];
+    
+    rv = (!strcmp("-", fname))? apr_file_open_stdin(&f, ctx->p) 
+         : apr_file_open(&f, fname, APR_FOPEN_READ|APR_FOPEN_BINARY|APR_FOPEN_BUFFERED, 
+                         0, ctx->p);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, ctx->p, "opening %s", fname);
+        return rv;
+    }
+    rv = md_store_fs_import(ctx->store, f, md_cmd_ctx_has_option(ctx, "force"), 
+                            &count, ctx->p);
+    apr_file_close(f);
+    if (APR_SUCCESS == rv && ctx->json_out) {
+        md_json_setl(count, ctx->json_out, MD_KEY_ENTRIES, NULL);
+    }
+    return rv;
+}
+
+static apr_status_t opts_import(md_cmd_ctx *ctx, int option, const char *optarg)
+{
+    (void)optarg;
+    switch (option) {
+        case 'f':
+            md_cmd_ctx_set_option(ctx, "force", "1");
+            break;
+        default:
+            return APR_EINVAL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_getopt_option_t ImportOptions [] = {
+    { "force",    'f', 0, "import archive of another store into a non-empty store"},
+    { NULL , 0, 0, NULL }
+};
+
+static md_cmd_t ImportCmd = {
+    "import", MD_CTX_STORE, 
+    opts_import, cmd_import, ImportOptions, NULL,
+    "import [options] file|-",
+    "read a store archive into the store"
+};
+
 /**************************************************************************************************/
 /* command: store */
 
@@ -221,6 +495,11 @@ static const md_cmd_t *StoreSubCmds[] = {
     &RemoveCmd,
     &ListCmd,
     &UpdateCmd,
+    &ChangesCmd,
+    &LeaseCmd,
+    &ReleaseCmd,
+    &ExportCmd,
+    &ImportCmd,
     NULL
 };
 
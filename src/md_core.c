@@ -96,6 +96,13 @@ int md_is_covered_by_alt_names(const md_t *md, const struct apr_array_header_t*
     return 0;
 }
 
+int md_cert_count(const md_t *md)
+{
+    /* static certificates are configured as one file */
+    if (md->cert_file) return 1;
+    return md_pkeys_spec_count(md->pks);
+}
+
 md_t *md_create_empty(apr_pool_t *p)
 {
     md_t *md = apr_pcalloc(p, sizeof(*md));
@@ -223,7 +230,7 @@ md_t *md_clone(apr_pool_t *p, const md_t *src)
         md->must_staple = src->must_staple;
         md->renew_mode = src->renew_mode;
         md->domains = md_array_str_compact(p, src->domains, 0);
-        md->pkey_spec = src->pkey_spec;
+        md->pks = md_pkeys_spec_clone(p, src->pks);
         md->renew_window = src->renew_window;
         md->warn_window = src->warn_window;
         md->contacts = md_array_str_clone(p, src->contacts);
@@ -240,6 +247,7 @@ md_t *md_clone(apr_pool_t *p, const md_t *src)
         md->stapling = src->stapling;
         if (src->cert_file) md->cert_file = apr_pstrdup(p, src->cert_file);
         if (src->pkey_file) md->pkey_file = apr_pstrdup(p, src->pkey_file);
+        if (src->config_hash) md->config_hash = apr_pstrdup(p, src->config_hash);
     }    
     return md;   
 }
@@ -247,6 +255,24 @@ md_t *md_clone(apr_pool_t *p, const md_t *src)
 /**************************************************************************************************/
 /* format conversion */
 
+const char *md_config_hash(const md_t *md, apr_pool_t *p)
+{
+    md_json_t *json;
+    md_data_t data;
+    const char *s, *hash = NULL;
+    
+    /* The JSON keeps the order in which we set the keys, so this is stable */
+    json = md_to_json(md, p);
+    md_json_del(json, MD_KEY_STATE, NULL);
+    md_json_del(json, MD_KEY_CA, MD_KEY_ACCOUNT, NULL);
+    md_json_del(json, MD_KEY_CONFIG_HASH, NULL);
+    if ((s = md_json_writep(json, p, MD_JSON_FMT_COMPACT))) {
+        MD_DATA_SET_STR(&data, s);
+        md_crypt_sha256_digest_hex(&hash, p, &data);
+    }
+    return hash;
+}
+
 md_json_t *md_to_json(const md_t *md, apr_pool_t *p)
 {
     md_json_t *json = md_json_create(p);
@@ -260,8 +286,8 @@ md_json_t *md_to_json(const md_t *md, apr_pool_t *p)
         md_json_sets(md->ca_proto, json, MD_KEY_CA, MD_KEY_PROTO, NULL);
         md_json_sets(md->ca_url, json, MD_KEY_CA, MD_KEY_URL, NULL);
         md_json_sets(md->ca_agreement, json, MD_KEY_CA, MD_KEY_AGREEMENT, NULL);
-        if (md->pkey_spec) {
-            md_json_setj(md_pkey_spec_to_json(md->pkey_spec, p), json, MD_KEY_PKEY, NULL);
+        if (!md_pkeys_spec_is_empty(md->pks)) {
+            md_json_setj(md_pkeys_spec_to_json(md->pks, p), json, MD_KEY_PKEY, NULL);
         }
         md_json_setl(md->state, json, MD_KEY_STATE, NULL);
         md_json_setl(md->renew_mode, json, MD_KEY_RENEW_MODE, NULL);
@@ -289,6 +315,7 @@ md_json_t *md_to_json(const md_t *md, apr_pool_t *p)
         md_json_sets(md->cert_file, json, MD_KEY_CERT_FILE, NULL);
         md_json_sets(md->pkey_file, json, MD_KEY_PKEY_FILE, NULL);
         md_json_setb(md->stapling > 0, json, MD_KEY_STAPLING, NULL);
+        md_json_sets(md->config_hash, json, MD_KEY_CONFIG_HASH, NULL);
         return json;
     }
     return NULL;
@@ -306,8 +333,8 @@ md_t *md_from_json(md_json_t *json, apr_pool_t *p)
         md->ca_proto = md_json_dups(p, json, MD_KEY_CA, MD_KEY_PROTO, NULL);
         md->ca_url = md_json_dups(p, json, MD_KEY_CA, MD_KEY_URL, NULL);
         md->ca_agreement = md_json_dups(p, json, MD_KEY_CA, MD_KEY_AGREEMENT, NULL);
-        if (md_json_has_key(json, MD_KEY_PKEY, MD_KEY_TYPE, NULL)) {
-            md->pkey_spec = md_pkey_spec_from_json(md_json_getj(json, MD_KEY_PKEY, NULL), p);
+        if (md_json_has_key(json, MD_KEY_PKEY, NULL)) {
+            md->pks = md_pkeys_spec_from_json(md_json_getj(json, MD_KEY_PKEY, NULL), p);
         }
         md->state = (md_state_t)md_json_getl(json, MD_KEY_STATE, NULL);
         if (MD_S_EXPIRED_DEPRECATED == md->state) md->state = MD_S_COMPLETE;
@@ -336,6 +363,7 @@ md_t *md_from_json(md_json_t *json, apr_pool_t *p)
         md->cert_file = md_json_dups(p, json, MD_KEY_CERT_FILE, NULL); 
         md->pkey_file = md_json_dups(p, json, MD_KEY_PKEY_FILE, NULL); 
         md->stapling = (int)md_json_getb(json, MD_KEY_STAPLING, NULL);
+        md->config_hash = md_json_dups(p, json, MD_KEY_CONFIG_HASH, NULL); 
         
         return md;
     }
@@ -23,12 +23,17 @@
 #include <apr_file_io.h>
 #include <apr_strings.h>
 
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/rand.h>
 #include <openssl/rsa.h>
 #include <openssl/x509v3.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 
 #include "md.h"
 #include "md_crypt.h"
@@ -276,6 +281,15 @@ md_json_t *md_pkey_spec_to_json(const md_pkey_spec_t *spec, apr_pool_t *p)
                     md_json_setl((long)spec->params.rsa.bits, json, MD_KEY_BITS, NULL);
                 }
                 break;
+            case MD_PKEY_TYPE_EC:
+                md_json_sets("EC", json, MD_KEY_TYPE, NULL);
+                if (spec->params.ec.curve) {
+                    md_json_sets(spec->params.ec.curve, json, MD_KEY_CURVE, NULL);
+                }
+                break;
+            case MD_PKEY_TYPE_ED25519:
+                md_json_sets("Ed25519", json, MD_KEY_TYPE, NULL);
+                break;
             default:
                 md_json_sets("Unsupported", json, MD_KEY_TYPE, NULL);
                 break;
@@ -305,6 +319,17 @@ md_pkey_spec_t *md_pkey_spec_from_json(struct md_json_t *json, apr_pool_t *p)
                 spec->params.rsa.bits = MD_PKEY_RSA_BITS_DEF;
             }
         }
+        else if (!apr_strnatcasecmp("EC", s)) {
+            spec->type = MD_PKEY_TYPE_EC;
+            s = md_json_gets(json, MD_KEY_CURVE, NULL);
+            spec->params.ec.curve = s? md_pkey_ec_curve_name(s) : NULL;
+            if (!spec->params.ec.curve) {
+                spec->params.ec.curve = MD_PKEY_EC_CURVE_DEF;
+            }
+        }
+        else if (!apr_strnatcasecmp("Ed25519", s)) {
+            spec->type = MD_PKEY_TYPE_ED25519;
+        }
     }
     return spec;
 }
@@ -323,11 +348,138 @@ int md_pkey_spec_eq(md_pkey_spec_t *spec1, md_pkey_spec_t *spec2)
                     return 1;
                 }
                 break;
+            case MD_PKEY_TYPE_EC:
+                if (spec1->params.ec.curve && spec2->params.ec.curve
+                    && !strcmp(spec1->params.ec.curve, spec2->params.ec.curve)) {
+                    return 1;
+                }
+                break;
+            case MD_PKEY_TYPE_ED25519:
+                return 1;
         }
     }
     return 0;
 }
 
+md_pkeys_spec_t *md_pkeys_spec_make(apr_pool_t *p)
+{
+    md_pkeys_spec_t *pks;
+    
+    pks = apr_pcalloc(p, sizeof(*pks));
+    pks->p = p;
+    pks->specs = apr_array_make(p, 2, sizeof(md_pkey_spec_t*));
+    return pks;
+}
+
+void md_pkeys_spec_add(md_pkeys_spec_t *pks, md_pkey_spec_t *spec)
+{
+    APR_ARRAY_PUSH(pks->specs, md_pkey_spec_t*) = spec;
+}
+
+int md_pkeys_spec_contains_type(const md_pkeys_spec_t *pks, md_pkey_type_t type)
+{
+    md_pkey_spec_t *spec;
+    int i;
+    
+    for (i = 0; pks && i < pks->specs->nelts; ++i) {
+        spec = APR_ARRAY_IDX(pks->specs, i, md_pkey_spec_t*);
+        if (spec->type == type) return 1;
+        if (MD_PKEY_TYPE_DEFAULT == spec->type && MD_PKEY_TYPE_RSA == type) return 1;
+        if (MD_PKEY_TYPE_RSA == spec->type && MD_PKEY_TYPE_DEFAULT == type) return 1;
+    }
+    return 0;
+}
+
+int md_pkeys_spec_is_empty(const md_pkeys_spec_t *pks)
+{
+    return !pks || apr_is_empty_array(pks->specs);
+}
+
+int md_pkeys_spec_count(const md_pkeys_spec_t *pks)
+{
+    return md_pkeys_spec_is_empty(pks)? 1 : pks->specs->nelts;
+}
+
+md_pkey_spec_t *md_pkeys_spec_get(const md_pkeys_spec_t *pks, int index)
+{
+    if (md_pkeys_spec_is_empty(pks) || index < 0 || index >= pks->specs->nelts) return NULL;
+    return APR_ARRAY_IDX(pks->specs, index, md_pkey_spec_t*);
+}
+
+md_pkeys_spec_t *md_pkeys_spec_clone(apr_pool_t *p, const md_pkeys_spec_t *pks)
+{
+    md_pkeys_spec_t *npks;
+    md_pkey_spec_t *spec;
+    int i;
+    
+    if (!pks) return NULL;
+    npks = md_pkeys_spec_make(p);
+    for (i = 0; i < pks->specs->nelts; ++i) {
+        spec = APR_ARRAY_IDX(pks->specs, i, md_pkey_spec_t*);
+        md_pkeys_spec_add(npks, apr_pmemdup(p, spec, sizeof(*spec)));
+    }
+    return npks;
+}
+
+int md_pkeys_spec_eq(const md_pkeys_spec_t *pks1, const md_pkeys_spec_t *pks2)
+{
+    int i;
+    
+    if (md_pkeys_spec_is_empty(pks1)) return md_pkeys_spec_is_empty(pks2);
+    if (md_pkeys_spec_is_empty(pks2) || pks1->specs->nelts != pks2->specs->nelts) return 0;
+    for (i = 0; i < pks1->specs->nelts; ++i) {
+        if (!md_pkey_spec_eq(APR_ARRAY_IDX(pks1->specs, i, md_pkey_spec_t*),
+                             APR_ARRAY_IDX(pks2->specs, i, md_pkey_spec_t*))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+md_json_t *md_pkeys_spec_to_json(const md_pkeys_spec_t *pks, apr_pool_t *p)
+{
+    md_pkey_spec_t spec;
+    md_json_t *json;
+    int i;
+    
+    if (md_pkeys_spec_is_empty(pks)) {
+        memset(&spec, 0, sizeof(spec));
+        spec.type = MD_PKEY_TYPE_DEFAULT;
+        return md_pkey_spec_to_json(&spec, p);
+    }
+    /* A single spec is written as before, so that older versions can read it */
+    if (pks->specs->nelts == 1) {
+        return md_pkey_spec_to_json(md_pkeys_spec_get(pks, 0), p);
+    }
+    json = md_json_create(p);
+    for (i = 0; i < pks->specs->nelts; ++i) {
+        md_json_addj(md_pkey_spec_to_json(md_pkeys_spec_get(pks, i), p), json, MD_KEY_PKEY, NULL);
+    }
+    return md_json_getj(json, MD_KEY_PKEY, NULL);
+}
+
+static int spec_from_json(void *baton, size_t index, md_json_t *json)
+{
+    md_pkeys_spec_t *pks = baton;
+    
+    (void)index;
+    md_pkeys_spec_add(pks, md_pkey_spec_from_json(json, pks->p));
+    return 1;
+}
+
+md_pkeys_spec_t *md_pkeys_spec_from_json(struct md_json_t *json, apr_pool_t *p)
+{
+    md_pkeys_spec_t *pks = md_pkeys_spec_make(p);
+    
+    if (md_json_is(MD_JSON_TYPE_ARRAY, json, NULL)) {
+        md_json_itera(spec_from_json, pks, json, NULL);
+    }
+    else {
+        md_pkeys_spec_add(pks, md_pkey_spec_from_json(json, p));
+    }
+    return pks;
+}
+
 static md_pkey_t *make_pkey(apr_pool_t *p) 
 {
     md_pkey_t *pkey = apr_pcalloc(p, sizeof(*pkey));
@@ -459,9 +611,9 @@ static apr_status_t gen_rsa(md_pkey_t **ppkey, apr_pool_t *p, unsigned int bits)
     *ppkey = make_pkey(p);
     ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
     if (ctx 
-        && EVP_PKEY_keygen_init(ctx) >= 0
-        && EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, (int)bits) >= 0
-        && EVP_PKEY_keygen(ctx, &(*ppkey)->pkey) >= 0) {
+        && EVP_PKEY_keygen_init(ctx) > 0
+        && EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, (int)bits) > 0
+        && EVP_PKEY_keygen(ctx, &(*ppkey)->pkey) > 0) {
         rv = APR_SUCCESS;
     }
     else {
@@ -476,6 +628,149 @@ static apr_status_t gen_rsa(md_pkey_t **ppkey, apr_pool_t *p, unsigned int bits)
     return rv;
 }
 
+typedef struct {
+    const char *name;       /* as in JWK */
+    int nid;
+    const char *alias1;     /* SEC name */
+    const char *alias2;     /* X9.62 name */
+} ec_curve_t;
+
+static const ec_curve_t EC_CURVES[] = {
+    { "P-256", NID_X9_62_prime256v1, "secp256r1", "prime256v1" },
+    { "P-384", NID_secp384r1, "secp384r1", NULL },
+};
+
+static const ec_curve_t *ec_curve_get(const char *name)
+{
+    size_t i;
+    
+    for (i = 0; name && i < sizeof(EC_CURVES)/sizeof(EC_CURVES[0]); ++i) {
+        if (!apr_strnatcasecmp(name, EC_CURVES[i].name)
+            || !apr_strnatcasecmp(name, EC_CURVES[i].alias1)
+            || (EC_CURVES[i].alias2 && !apr_strnatcasecmp(name, EC_CURVES[i].alias2))) {
+            return &EC_CURVES[i];
+        }
+    }
+    return NULL;
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+static const ec_curve_t *ec_curve_get_nid(int nid)
+{
+    size_t i;
+    
+    for (i = 0; i < sizeof(EC_CURVES)/sizeof(EC_CURVES[0]); ++i) {
+        if (nid == EC_CURVES[i].nid) return &EC_CURVES[i];
+    }
+    return NULL;
+}
+#endif
+
+const char *md_pkey_ec_curve_name(const char *name)
+{
+    const ec_curve_t *curve = ec_curve_get(name);
+    return curve? curve->name : NULL;
+}
+
+const char *md_pkey_spec_name(const md_pkey_spec_t *spec)
+{
+    const ec_curve_t *curve;
+    
+    if (!spec) return "rsa";
+    switch (spec->type) {
+        case MD_PKEY_TYPE_EC:
+            curve = ec_curve_get(spec->params.ec.curve? 
+                                 spec->params.ec.curve : MD_PKEY_EC_CURVE_DEF);
+            return curve? curve->alias1 : "ec";
+        case MD_PKEY_TYPE_ED25519:
+            return "ed25519";
+        default:
+            return "rsa";
+    }
+}
+
+static apr_status_t gen_ec(md_pkey_t **ppkey, apr_pool_t *p, const char *curve_name)
+{
+    const ec_curve_t *curve;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_PKEY_CTX *ctx = NULL;
+#else
+    EC_KEY *eckey = NULL;
+#endif
+    apr_status_t rv = APR_EGENERAL;
+    
+    *ppkey = make_pkey(p);
+    if (!(curve = ec_curve_get(curve_name? curve_name : MD_PKEY_EC_CURVE_DEF))) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, p, "unsupported EC curve %s", curve_name); 
+        rv = APR_ENOTIMPL;
+        goto leave;
+    }
+    /* with a named curve, not the explicit parameters, or no client will accept it */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL))
+        && EVP_PKEY_keygen_init(ctx) > 0
+        && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, curve->nid) > 0
+        && EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE) > 0
+        && EVP_PKEY_keygen(ctx, &(*ppkey)->pkey) > 0) {
+        rv = APR_SUCCESS;
+    }
+#else
+    if ((eckey = EC_KEY_new_by_curve_name(curve->nid))
+        && (EC_KEY_set_asn1_flag(eckey, OPENSSL_EC_NAMED_CURVE), 1)
+        && EC_KEY_generate_key(eckey)
+        && ((*ppkey)->pkey = EVP_PKEY_new())
+        && EVP_PKEY_assign_EC_KEY((*ppkey)->pkey, eckey)) {
+        eckey = NULL; /* owned by pkey now */
+        rv = APR_SUCCESS;
+    }
+#endif
+    else {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, p, "error generate pkey EC %s", 
+                      curve->name); 
+    }
+leave:
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (ctx) EVP_PKEY_CTX_free(ctx);
+#else
+    if (eckey) EC_KEY_free(eckey);
+#endif
+    if (APR_SUCCESS != rv) {
+        if (*ppkey && (*ppkey)->pkey) EVP_PKEY_free((*ppkey)->pkey);
+        *ppkey = NULL;
+    }
+    return rv;
+}
+
+static apr_status_t gen_ed25519(md_pkey_t **ppkey, apr_pool_t *p)
+{
+#ifdef NID_ED25519
+    EVP_PKEY_CTX *ctx = NULL;
+    apr_status_t rv;
+    
+    *ppkey = make_pkey(p);
+    ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, NULL);
+    if (ctx 
+        && EVP_PKEY_keygen_init(ctx) > 0
+        && EVP_PKEY_keygen(ctx, &(*ppkey)->pkey) > 0) {
+        rv = APR_SUCCESS;
+    }
+    else {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, p, "error generate pkey Ed25519"); 
+        *ppkey = NULL;
+        rv = APR_EGENERAL;
+    }
+    
+    if (ctx != NULL) {
+        EVP_PKEY_CTX_free(ctx);
+    }
+    return rv;
+#else
+    *ppkey = NULL;
+    md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, p, "Ed25519 needs OpenSSL 1.1.1 or newer"); 
+    return APR_ENOTIMPL;
+#endif
+}
+
 apr_status_t md_pkey_gen(md_pkey_t **ppkey, apr_pool_t *p, md_pkey_spec_t *spec)
 {
     md_pkey_type_t ptype = spec? spec->type : MD_PKEY_TYPE_DEFAULT;
@@ -484,11 +779,37 @@ apr_status_t md_pkey_gen(md_pkey_t **ppkey, apr_pool_t *p, md_pkey_spec_t *spec)
             return gen_rsa(ppkey, p, MD_PKEY_RSA_BITS_DEF);
         case MD_PKEY_TYPE_RSA:
             return gen_rsa(ppkey, p, spec->params.rsa.bits);
+        case MD_PKEY_TYPE_EC:
+            return gen_ec(ppkey, p, spec->params.ec.curve);
+        case MD_PKEY_TYPE_ED25519:
+            return gen_ed25519(ppkey, p);
         default:
             return APR_ENOTIMPL;
     }
 }
 
+md_pkey_type_t md_pkey_get_type(md_pkey_t *pkey)
+{
+    switch (EVP_PKEY_id(pkey->pkey)) {
+        case EVP_PKEY_RSA:
+            return MD_PKEY_TYPE_RSA;
+        case EVP_PKEY_EC:
+            return MD_PKEY_TYPE_EC;
+#ifdef NID_ED25519
+        case EVP_PKEY_ED25519:
+            return MD_PKEY_TYPE_ED25519;
+#endif
+        default:
+            return MD_PKEY_TYPE_DEFAULT;
+    }
+}
+
+/* The digest to sign certificates and requests with, none for EdDSA. */
+static const EVP_MD *pkey_get_MD(md_pkey_t *pkey)
+{
+    return (MD_PKEY_TYPE_ED25519 == md_pkey_get_type(pkey))? NULL : EVP_sha256();
+}
+
 #if MD_USE_OPENSSL_PRE_1_1_API || (defined(LIBRESSL_VERSION_NUMBER) && \
                                    LIBRESSL_VERSION_NUMBER < 0x2070000f)
 
@@ -507,6 +828,14 @@ static void RSA_get0_key(const RSA *r,
         *d = r->d;
 }
 
+static void ECDSA_SIG_get0(const ECDSA_SIG *sig, const BIGNUM **pr, const BIGNUM **ps)
+{
+    if (pr != NULL)
+        *pr = sig->r;
+    if (ps != NULL)
+        *ps = sig->s;
+}
+
 #endif
 
 static const char *bn64(const BIGNUM *b, apr_pool_t *p) 
@@ -548,30 +877,147 @@ const char *md_pkey_get_rsa_n64(md_pkey_t *pkey, apr_pool_t *p)
     return bn64(n, p);
 }
 
-apr_status_t md_crypt_sign64(const char **psign64, md_pkey_t *pkey, apr_pool_t *p, 
+/* Big endian bytes of b, left padded with zeroes to len. */
+static int bn_bin_padded(const BIGNUM *b, unsigned char *buf, apr_size_t len)
+{
+    apr_size_t blen = (apr_size_t)BN_num_bytes(b);
+    
+    if (blen > len) return 0;
+    memset(buf, 0, len - blen);
+    BN_bn2bin(b, buf + (len - blen));
+    return 1;
+}
+
+static const char *bn64_padded(const BIGNUM *b, apr_size_t len, apr_pool_t *p) 
+{
+    md_data_t buffer;
+
+    buffer.len = len;
+    buffer.data = apr_pcalloc(p, len);
+    if (!bn_bin_padded(b, (unsigned char *)buffer.data, len)) return NULL;
+    return md_util_base64url_encode(&buffer, p);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+
+const char *md_pkey_get_ec_curve(md_pkey_t *pkey)
+{
+    const ec_curve_t *curve = NULL;
+    char name[64];
+    
+    if (EVP_PKEY_EC == EVP_PKEY_get_base_id(pkey->pkey)
+        && EVP_PKEY_get_utf8_string_param(pkey->pkey, OSSL_PKEY_PARAM_GROUP_NAME, 
+                                          name, sizeof(name), NULL)) {
+        curve = ec_curve_get(name);
+    }
+    return curve? curve->name : NULL;
+}
+
+apr_status_t md_pkey_get_ec_xy64(const char **px64, const char **py64, 
+                                 md_pkey_t *pkey, apr_pool_t *p)
+{
+    BIGNUM *x = NULL, *y = NULL;
+    apr_size_t flen;
+    apr_status_t rv = APR_EINVAL;
+    
+    *px64 = *py64 = NULL;
+    if (EVP_PKEY_EC != EVP_PKEY_get_base_id(pkey->pkey)) goto leave;
+    flen = (apr_size_t)(EVP_PKEY_get_bits(pkey->pkey) + 7) / 8;
+    if (EVP_PKEY_get_bn_param(pkey->pkey, OSSL_PKEY_PARAM_EC_PUB_X, &x)
+        && EVP_PKEY_get_bn_param(pkey->pkey, OSSL_PKEY_PARAM_EC_PUB_Y, &y)
+        && (*px64 = bn64_padded(x, flen, p))
+        && (*py64 = bn64_padded(y, flen, p))) {
+        rv = APR_SUCCESS;
+    }
+leave:
+    if (x) BN_free(x);
+    if (y) BN_free(y);
+    return rv;
+}
+
+#else /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+
+const char *md_pkey_get_ec_curve(md_pkey_t *pkey)
+{
+    const ec_curve_t *curve = NULL;
+    EC_KEY *eckey = EVP_PKEY_get1_EC_KEY(pkey->pkey);
+    
+    if (eckey) {
+        curve = ec_curve_get_nid(EC_GROUP_get_curve_name(EC_KEY_get0_group(eckey)));
+        EC_KEY_free(eckey);
+    }
+    return curve? curve->name : NULL;
+}
+
+apr_status_t md_pkey_get_ec_xy64(const char **px64, const char **py64, 
+                                 md_pkey_t *pkey, apr_pool_t *p)
+{
+    EC_KEY *eckey;
+    BIGNUM *x = NULL, *y = NULL;
+    apr_size_t flen;
+    apr_status_t rv = APR_EINVAL;
+    
+    *px64 = *py64 = NULL;
+    if (!(eckey = EVP_PKEY_get1_EC_KEY(pkey->pkey))) goto leave;
+    flen = (apr_size_t)(EC_GROUP_get_degree(EC_KEY_get0_group(eckey)) + 7) / 8;
+    if ((x = BN_new()) && (y = BN_new())
+        && EC_POINT_get_affine_coordinates_GFp(EC_KEY_get0_group(eckey), 
+                                               EC_KEY_get0_public_key(eckey), x, y, NULL)
+        && (*px64 = bn64_padded(x, flen, p))
+        && (*py64 = bn64_padded(y, flen, p))) {
+        rv = APR_SUCCESS;
+    }
+leave:
+    if (x) BN_free(x);
+    if (y) BN_free(y);
+    if (eckey) EC_KEY_free(eckey);
+    return rv;
+}
+
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L, else */
+
+const char *md_pkey_get_ed25519_x64(md_pkey_t *pkey, apr_pool_t *p)
+{
+#ifdef NID_ED25519
+    md_data_t buffer;
+    size_t len = 0;
+    
+    if (EVP_PKEY_ED25519 != EVP_PKEY_id(pkey->pkey)
+        || !EVP_PKEY_get_raw_public_key(pkey->pkey, NULL, &len)) {
+        return NULL;
+    }
+    buffer.data = apr_pcalloc(p, len);
+    if (!EVP_PKEY_get_raw_public_key(pkey->pkey, (unsigned char*)buffer.data, &len)) {
+        return NULL;
+    }
+    buffer.len = len;
+    return md_util_base64url_encode(&buffer, p);
+#else
+    (void)pkey;
+    (void)p;
+    return NULL;
+#endif
+}
+
+static apr_status_t sign_rsa(md_data_t *sig, md_pkey_t *pkey, apr_pool_t *p, 
                              const char *d, size_t dlen)
 {
     EVP_MD_CTX *ctx = NULL;
-    md_data_t buffer;
     unsigned int blen;
-    const char *sign64 = NULL;
     apr_status_t rv = APR_ENOMEM;
     
-    buffer.len = (apr_size_t)EVP_PKEY_size(pkey->pkey);
-    buffer.data = apr_pcalloc(p, buffer.len);
-    if (buffer.data) {
+    sig->len = (apr_size_t)EVP_PKEY_size(pkey->pkey);
+    sig->data = apr_pcalloc(p, sig->len);
+    if (sig->data) {
         ctx = EVP_MD_CTX_create();
         if (ctx) {
             rv = APR_ENOTIMPL;
             if (EVP_SignInit_ex(ctx, EVP_sha256(), NULL)) {
                 rv = APR_EGENERAL;
                 if (EVP_SignUpdate(ctx, d, dlen)) {
-                    if (EVP_SignFinal(ctx, (unsigned char*)buffer.data, &blen, pkey->pkey)) {
-                        buffer.len = blen;
-                        sign64 = md_util_base64url_encode(&buffer, p);
-                        if (sign64) {
-                            rv = APR_SUCCESS;
-                        }
+                    if (EVP_SignFinal(ctx, (unsigned char*)sig->data, &blen, pkey->pkey)) {
+                        sig->len = blen;
+                        rv = APR_SUCCESS;
                     }
                 }
             }
@@ -581,6 +1027,104 @@ apr_status_t md_crypt_sign64(const char **psign64, md_pkey_t *pkey, apr_pool_t *
             EVP_MD_CTX_destroy(ctx);
         }
     }
+    return rv;
+}
+
+static apr_status_t sign_ec(md_data_t *sig, md_pkey_t *pkey, apr_pool_t *p, 
+                            const char *d, size_t dlen)
+{
+    EVP_MD_CTX *ctx = NULL;
+    ECDSA_SIG *ecsig = NULL;
+    const BIGNUM *r, *s;
+    const unsigned char *der;
+    unsigned char *der_buf;
+    size_t der_len;
+    apr_size_t flen;
+    const EVP_MD *digest;
+    apr_status_t rv = APR_EGENERAL;
+    
+    /* ES256 for P-256, ES384 for P-384 */
+    flen = (apr_size_t)(EVP_PKEY_bits(pkey->pkey) + 7) / 8;
+    digest = (flen > 32)? EVP_sha384() : EVP_sha256();
+    der_len = (size_t)EVP_PKEY_size(pkey->pkey);
+    der_buf = apr_pcalloc(p, der_len);
+    
+    if (!(ctx = EVP_MD_CTX_create())
+        || !EVP_DigestSignInit(ctx, NULL, digest, NULL, pkey->pkey)
+        || !EVP_DigestSignUpdate(ctx, d, dlen)
+        || !EVP_DigestSignFinal(ctx, der_buf, &der_len)) {
+        goto leave;
+    }
+    /* JWS wants R and S, each padded to the field size, not the DER sequence */
+    der = der_buf;
+    if (!(ecsig = d2i_ECDSA_SIG(NULL, &der, (long)der_len))) goto leave;
+    ECDSA_SIG_get0(ecsig, &r, &s);
+    sig->len = 2 * flen;
+    sig->data = apr_pcalloc(p, sig->len);
+    if (bn_bin_padded(r, (unsigned char*)sig->data, flen)
+        && bn_bin_padded(s, (unsigned char*)sig->data + flen, flen)) {
+        rv = APR_SUCCESS;
+    }
+leave:
+    if (ecsig) ECDSA_SIG_free(ecsig);
+    if (ctx) EVP_MD_CTX_destroy(ctx);
+    return rv;
+}
+
+static apr_status_t sign_ed25519(md_data_t *sig, md_pkey_t *pkey, apr_pool_t *p, 
+                                 const char *d, size_t dlen)
+{
+#ifdef NID_ED25519
+    EVP_MD_CTX *ctx = NULL;
+    size_t len;
+    apr_status_t rv = APR_EGENERAL;
+    
+    len = (size_t)EVP_PKEY_size(pkey->pkey);
+    sig->data = apr_pcalloc(p, len);
+    /* EdDSA signs the message itself, no digest is given */
+    if ((ctx = EVP_MD_CTX_create())
+        && EVP_DigestSignInit(ctx, NULL, NULL, NULL, pkey->pkey)
+        && EVP_DigestSign(ctx, (unsigned char*)sig->data, &len, 
+                          (const unsigned char*)d, dlen)) {
+        sig->len = len;
+        rv = APR_SUCCESS;
+    }
+    if (ctx) EVP_MD_CTX_destroy(ctx);
+    return rv;
+#else
+    (void)sig;
+    (void)pkey;
+    (void)p;
+    (void)d;
+    (void)dlen;
+    return APR_ENOTIMPL;
+#endif
+}
+
+apr_status_t md_crypt_sign64(const char **psign64, md_pkey_t *pkey, apr_pool_t *p, 
+                             const char *d, size_t dlen)
+{
+    md_data_t buffer;
+    const char *sign64 = NULL;
+    apr_status_t rv;
+    
+    switch (md_pkey_get_type(pkey)) {
+        case MD_PKEY_TYPE_RSA:
+            rv = sign_rsa(&buffer, pkey, p, d, dlen);
+            break;
+        case MD_PKEY_TYPE_EC:
+            rv = sign_ec(&buffer, pkey, p, d, dlen);
+            break;
+        case MD_PKEY_TYPE_ED25519:
+            rv = sign_ed25519(&buffer, pkey, p, d, dlen);
+            break;
+        default:
+            rv = APR_ENOTIMPL;
+            break;
+    }
+    if (APR_SUCCESS == rv && !(sign64 = md_util_base64url_encode(&buffer, p))) {
+        rv = APR_ENOMEM;
+    }
     
     if (rv != APR_SUCCESS) {
         md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "signing"); 
@@ -706,6 +1250,42 @@ const char *md_cert_get_serial_number(const md_cert_t *cert, apr_pool_t *p)
     return s;
 }
 
+apr_status_t md_cert_get_ari_id(const char **pid, const md_cert_t *cert, apr_pool_t *p)
+{
+    AUTHORITY_KEYID *akid;
+    md_data_t keyid, serial;
+    unsigned char *der = NULL;
+    int len, hlen;
+    apr_status_t rv = APR_ENOENT;
+    
+    *pid = NULL;
+    akid = X509_get_ext_d2i(cert->x509, NID_authority_key_identifier, NULL, NULL);
+    if (!akid || !akid->keyid) goto leave;
+    
+    /* the serial's DER bytes without tag and length, keeping a leading 0 */
+    len = i2d_ASN1_INTEGER(X509_get_serialNumber(cert->x509), &der);
+    if (len < 3) {
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    hlen = (der[1] & 0x80)? 2 + (der[1] & 0x7f) : 2;
+    if (hlen >= len) {
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    keyid.data = (const char*)akid->keyid->data;
+    keyid.len = (apr_size_t)akid->keyid->length;
+    serial.data = (const char*)der + hlen;
+    serial.len = (apr_size_t)(len - hlen);
+    *pid = apr_pstrcat(p, md_util_base64url_encode(&keyid, p), ".", 
+                       md_util_base64url_encode(&serial, p), NULL);
+    rv = APR_SUCCESS;
+leave:
+    if (der) OPENSSL_free(der);
+    if (akid) AUTHORITY_KEYID_free(akid);
+    return rv;
+}
+
 int md_cert_is_valid_now(const md_cert_t *cert)
 {
     return ((X509_cmp_current_time(X509_get_notBefore(cert->x509)) < 0)
@@ -1231,6 +1811,38 @@ int md_cert_must_staple(const md_cert_t *cert)
     return ((NID_undef != nid)) && X509_get_ext_by_NID(cert->x509, nid, -1) >= 0;
 }
 
+apr_status_t md_cert_get_meta(const md_cert_meta_t **pmeta, const md_cert_t *cert, apr_pool_t *p)
+{
+    md_cert_meta_t *meta;
+    STACK_OF(OPENSSL_STRING) *ssk;
+    apr_status_t rv;
+    
+    meta = apr_pcalloc(p, sizeof(*meta));
+    meta->not_before = md_cert_get_not_before(cert);
+    meta->not_after = md_cert_get_not_after(cert);
+    meta->serial = md_cert_get_serial_number(cert, p);
+    meta->must_staple = md_cert_must_staple(cert);
+    
+    rv = md_cert_get_alt_names(&meta->alt_names, cert, p);
+    if (APR_STATUS_IS_ENOENT(rv)) {
+        meta->alt_names = apr_array_make(p, 0, sizeof(const char*));
+    }
+    else if (APR_SUCCESS != rv) goto leave;
+    if (!MD_OK(md_cert_to_sha256_fingerprint(&meta->sha256_fingerprint, cert, p))) goto leave;
+    md_cert_get_issuers_uri(&meta->issuer_uri, cert, p);
+    
+    ssk = X509_get1_ocsp(cert->x509);
+    if (ssk) {
+        if (sk_OPENSSL_STRING_num(ssk) > 0) {
+            meta->ocsp_url = apr_pstrdup(p, sk_OPENSSL_STRING_value(ssk, 0));
+        }
+        X509_email_free(ssk);
+    }
+leave:
+    *pmeta = (APR_SUCCESS == rv)? meta : NULL;
+    return rv;
+}
+
 static apr_status_t add_must_staple(STACK_OF(X509_EXTENSION) *exts, const char *name, apr_pool_t *p)
 {
     X509_EXTENSION *x;
@@ -1306,7 +1918,7 @@ apr_status_t md_cert_req_create(const char **pcsr_der_64, const char *name,
         rv = APR_EGENERAL; goto out;
     }
     /* sign, der encode and base64url encode */
-    if (!X509_REQ_sign(csr, pkey->pkey, EVP_sha256())) {
+    if (!X509_REQ_sign(csr, pkey->pkey, pkey_get_MD(pkey))) {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "%s: sign csr", name);
         rv = APR_EGENERAL; goto out;
     }
@@ -1423,7 +2035,7 @@ apr_status_t md_cert_self_sign(md_cert_t **pcert, const char *cn,
     }
 
     /* sign with same key */
-    if (!X509_sign(x, pkey->pkey, EVP_sha256())) {
+    if (!X509_sign(x, pkey->pkey, pkey_get_MD(pkey))) {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "%s: sign x509", cn);
         rv = APR_EGENERAL; goto out;
     }
@@ -1475,7 +2087,7 @@ apr_status_t md_cert_make_tls_alpn_01(md_cert_t **pcert, const char *domain,
     }
 
     /* sign with same key */
-    if (!X509_sign(x, pkey->pkey, EVP_sha256())) {
+    if (!X509_sign(x, pkey->pkey, pkey_get_MD(pkey))) {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "%s: sign x509", domain);
         rv = APR_EGENERAL; goto out;
     }
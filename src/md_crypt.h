@@ -51,27 +51,57 @@ typedef struct md_pkey_t md_pkey_t;
 typedef enum {
     MD_PKEY_TYPE_DEFAULT,
     MD_PKEY_TYPE_RSA,
+    MD_PKEY_TYPE_EC,
+    MD_PKEY_TYPE_ED25519,
 } md_pkey_type_t;
 
 typedef struct md_pkey_rsa_spec_t {
     apr_uint32_t bits;
 } md_pkey_rsa_spec_t;
 
+typedef struct md_pkey_ec_spec_t {
+    const char *curve;      /* "P-256" or "P-384" */
+} md_pkey_ec_spec_t;
+
 typedef struct md_pkey_spec_t {
     md_pkey_type_t type;
     union {
         md_pkey_rsa_spec_t rsa;
+        md_pkey_ec_spec_t ec;
     } params;
 } md_pkey_spec_t;
 
+#define MD_PKEY_EC_CURVE_DEF        "P-256"
+
 apr_status_t md_crypt_init(apr_pool_t *pool);
 
 apr_status_t md_pkey_gen(md_pkey_t **ppkey, apr_pool_t *p, md_pkey_spec_t *spec);
 void md_pkey_free(md_pkey_t *pkey);
 
+md_pkey_type_t md_pkey_get_type(md_pkey_t *pkey);
+
 const char *md_pkey_get_rsa_e64(md_pkey_t *pkey, apr_pool_t *p);
 const char *md_pkey_get_rsa_n64(md_pkey_t *pkey, apr_pool_t *p);
 
+/**
+ * The name of an EC key's curve as used in JWK, e.g. "P-256", or NULL.
+ */
+const char *md_pkey_get_ec_curve(md_pkey_t *pkey);
+/**
+ * Get the coordinates of an EC key's public point, base64url encoded and
+ * padded to the curve's field size.
+ */
+apr_status_t md_pkey_get_ec_xy64(const char **px64, const char **py64, 
+                                 md_pkey_t *pkey, apr_pool_t *p);
+const char *md_pkey_get_ed25519_x64(md_pkey_t *pkey, apr_pool_t *p);
+
+/**
+ * Give the JWK name of a supported EC curve, given its JWK, SEC or
+ * X9.62 name, e.g. "P-256" for "secp256r1" or "prime256v1". NULL if the
+ * curve is not supported.
+ */
+const char *md_pkey_ec_curve_name(const char *name);
+
 apr_status_t md_pkey_fload(md_pkey_t **ppkey, apr_pool_t *p, 
                            const char *pass_phrase, apr_size_t pass_len,
                            const char *fname);
@@ -79,6 +109,11 @@ apr_status_t md_pkey_fsave(md_pkey_t *pkey, apr_pool_t *p,
                            const char *pass_phrase, apr_size_t pass_len, 
                            const char *fname, apr_fileperms_t perms);
 
+/**
+ * Sign the data with the key as JWS (RFC 7518) asks for it: RS256 for RSA keys,
+ * ES256/ES384 for EC keys, the signature being R and S concatenated, and 
+ * EdDSA for Ed25519.
+ */
 apr_status_t md_crypt_sign64(const char **psign64, md_pkey_t *pkey, apr_pool_t *p, 
                              const char *d, size_t dlen);
 
@@ -88,6 +123,41 @@ struct md_json_t *md_pkey_spec_to_json(const md_pkey_spec_t *spec, apr_pool_t *p
 md_pkey_spec_t *md_pkey_spec_from_json(struct md_json_t *json, apr_pool_t *p);
 int md_pkey_spec_eq(md_pkey_spec_t *spec1, md_pkey_spec_t *spec2);
 
+/**
+ * A short, lower case name for the type of keys a spec generates, e.g. "rsa"
+ * or "secp256r1". Used to tell the files of several keys apart.
+ */
+const char *md_pkey_spec_name(const md_pkey_spec_t *spec);
+
+/**
+ * The key specifications of a managed domain. A certificate is obtained for
+ * each one. The first one is the primary, whose certificate is used where only 
+ * one can be considered. An empty or NULL set means a single, default key.
+ */
+typedef struct md_pkeys_spec_t {
+    apr_pool_t *p;
+    struct apr_array_header_t *specs;
+} md_pkeys_spec_t;
+
+md_pkeys_spec_t *md_pkeys_spec_make(apr_pool_t *p);
+void md_pkeys_spec_add(md_pkeys_spec_t *pks, md_pkey_spec_t *spec);
+int md_pkeys_spec_contains_type(const md_pkeys_spec_t *pks, md_pkey_type_t type);
+int md_pkeys_spec_is_empty(const md_pkeys_spec_t *pks);
+
+/**
+ * The number of keys specified, which is 1 for an empty set.
+ */
+int md_pkeys_spec_count(const md_pkeys_spec_t *pks);
+/**
+ * The spec at the index or NULL, if the default key is meant.
+ */
+md_pkey_spec_t *md_pkeys_spec_get(const md_pkeys_spec_t *pks, int index);
+
+md_pkeys_spec_t *md_pkeys_spec_clone(apr_pool_t *p, const md_pkeys_spec_t *pks);
+int md_pkeys_spec_eq(const md_pkeys_spec_t *pks1, const md_pkeys_spec_t *pks2);
+struct md_json_t *md_pkeys_spec_to_json(const md_pkeys_spec_t *pks, apr_pool_t *p);
+md_pkeys_spec_t *md_pkeys_spec_from_json(struct md_json_t *json, apr_pool_t *p);
+
 /**************************************************************************************************/
 /* X509 certificates */
 
@@ -154,6 +224,32 @@ apr_status_t md_cert_to_sha256_fingerprint(const char **pfinger, const md_cert_t
 
 const char *md_cert_get_serial_number(const md_cert_t *cert, apr_pool_t *p);
 
+/**
+ * Get the identifier of the certificate for ACME Renewal Information (RFC 9773):
+ * the base64url of the authority key identifier and of the DER encoded serial 
+ * number, joined by '.'.
+ * @return APR_ENOENT if the certificate carries no authority key identifier.
+ */
+apr_status_t md_cert_get_ari_id(const char **pid, const md_cert_t *cert, apr_pool_t *p);
+
+/**
+ * Properties of a certificate, extracted once. The record is immutable
+ * and lives as long as the pool it was made from.
+ */
+typedef struct md_cert_meta_t md_cert_meta_t;
+struct md_cert_meta_t {
+    apr_time_t not_before;                  /* start of validity */
+    apr_time_t not_after;                   /* end of validity */
+    struct apr_array_header_t *alt_names;   /* subjectAltNames, DNS/URI/IP */
+    const char *serial;                     /* serial number in hex */
+    const char *sha256_fingerprint;         /* hex of the SHA-256 DER digest */
+    const char *issuer_uri;                 /* CA issuers access URI or NULL */
+    const char *ocsp_url;                   /* first OCSP responder URL or NULL */
+    int must_staple;                        /* != 0 iff TLS feature must-staple is set */
+};
+
+apr_status_t md_cert_get_meta(const md_cert_meta_t **pmeta, const md_cert_t *cert, apr_pool_t *p);
+
 apr_status_t md_chain_fload(struct apr_array_header_t **pcerts, 
                             apr_pool_t *p, const char *fname);
 apr_status_t md_chain_fsave(struct apr_array_header_t *certs, 
@@ -21,7 +21,10 @@
 #include <apr_lib.h>
 #include <apr_strings.h>
 #include <apr_buckets.h>
+#include <apr_poll.h>
+#include <apr_portable.h>
 
+#include "md.h"
 #include "md_http.h"
 #include "md_log.h"
 #include "md_util.h"
@@ -50,8 +53,19 @@ static apr_status_t curl_status(unsigned int curl_code)
     }
 }
 
+/* Max number of idle easy handles kept per md_http_t instance */
+#define MD_CURL_MAX_IDLE        16
+
+/* What we keep with a md_http_t instance, so that subsequent requests
+ * reuse DNS results, TLS sessions and open connections. */
+typedef struct {
+    CURLSH *share;
+    apr_array_header_t *idle;       /* easy handles of finished requests */
+} md_curl_http_t;
+
 typedef struct {
     CURL *curl;
+    md_curl_http_t *ch;
     CURLM *curlm;
     struct curl_slist *req_hdrs;
     md_http_response_t *response;
@@ -239,19 +253,89 @@ static int curl_debug_log(CURL *curl, curl_infotype type, char *data, size_t siz
     return 0;
 }
 
+static apr_status_t curl_http_cleanup(void *data)
+{
+    md_curl_http_t *ch = data;
+    int i;
+    
+    for (i = 0; i < ch->idle->nelts; ++i) {
+        curl_easy_cleanup(APR_ARRAY_IDX(ch->idle, i, CURL*));
+    }
+    apr_array_clear(ch->idle);
+    if (ch->share) {
+        curl_share_cleanup(ch->share);
+        ch->share = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static md_curl_http_t *curl_http_get(md_http_t *http)
+{
+    md_curl_http_t *ch;
+    apr_pool_t *p;
+    
+    if (!(ch = md_http_get_impl_data(http))) {
+        p = md_http_get_pool(http);
+        ch = apr_pcalloc(p, sizeof(*ch));
+        ch->idle = apr_array_make(p, 5, sizeof(CURL*));
+        /* A md_http_t is only used by one thread at a time, the share needs no locks. */
+        if ((ch->share = curl_share_init())) {
+            curl_share_setopt(ch->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(ch->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+            curl_share_setopt(ch->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+        }
+        apr_pool_cleanup_register(p, ch, curl_http_cleanup, apr_pool_cleanup_null);
+        md_http_set_impl_data(http, ch);
+    }
+    return ch;
+}
+
+static CURL *curl_http_easy_get(md_curl_http_t *ch)
+{
+    CURL *curl;
+    
+    if (ch->idle->nelts > 0) {
+        curl = APR_ARRAY_IDX(ch->idle, --ch->idle->nelts, CURL*);
+    }
+    else {
+        curl = curl_easy_init();
+    }
+    if (curl && ch->share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, ch->share);
+    }
+    return curl;
+}
+
+static void curl_http_easy_put(md_curl_http_t *ch, CURL *curl)
+{
+    if (ch->idle->nelts < MD_CURL_MAX_IDLE) {
+        /* keeps open connections and caches, but forgets all options */
+        curl_easy_reset(curl);
+        APR_ARRAY_PUSH(ch->idle, CURL*) = curl;
+    }
+    else {
+        curl_easy_cleanup(curl);
+    }
+}
+
 static apr_status_t internals_setup(md_http_request_t *req)
 {
     md_curl_internals_t *internals;
+    md_curl_http_t *ch;
     CURL *curl;
     apr_status_t rv = APR_SUCCESS;
     
-    curl = curl_easy_init();
+    ch = curl_http_get(req->http);
+    curl = curl_http_easy_get(ch);
     if (!curl) {
         rv = APR_EGENERAL;
         goto leave;
     }
     internals = apr_pcalloc(req->pool, sizeof(*internals));
     internals->curl = curl;
+    internals->ch = ch;
         
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
@@ -306,6 +390,17 @@ static apr_status_t internals_setup(md_http_request_t *req)
     if (req->proxy_url) {
         curl_easy_setopt(curl, CURLOPT_PROXY, req->proxy_url);
     }
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    if (req->http2) {
+        /* h2 via ALPN on https: only, curl falls back to HTTP/1.1 where that fails.
+         * In a multi, rather wait for a connection to multiplex on than open another. */
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    else {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+    }
+#endif
     if (!apr_is_empty_table(req->headers)) {
         curlify_hdrs_ctx ctx;
         
@@ -333,6 +428,56 @@ leave:
     return rv;
 }
 
+#if LIBCURL_VERSION_NUM >= 0x073d00
+static apr_interval_time_t get_duration(CURL *curl, CURLINFO info)
+{
+    curl_off_t usec;
+    return (CURLE_OK == curl_easy_getinfo(curl, info, &usec))? (apr_interval_time_t)usec : 0;
+}
+#define MD_CURL_DURATION(c, name)   get_duration((c), CURLINFO_##name##_TIME_T)
+#else
+static apr_interval_time_t get_duration(CURL *curl, CURLINFO info)
+{
+    double sec;
+    return (CURLE_OK == curl_easy_getinfo(curl, info, &sec))? 
+        (apr_interval_time_t)(sec * APR_USEC_PER_SEC) : 0;
+}
+#define MD_CURL_DURATION(c, name)   get_duration((c), CURLINFO_##name##_TIME)
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+static apr_off_t get_size(CURL *curl, CURLINFO info)
+{
+    curl_off_t len;
+    return (CURLE_OK == curl_easy_getinfo(curl, info, &len))? (apr_off_t)len : 0;
+}
+#define MD_CURL_SIZE(c, name)       get_size((c), CURLINFO_SIZE_##name##_T)
+#else
+static apr_off_t get_size(CURL *curl, CURLINFO info)
+{
+    double len;
+    return (CURLE_OK == curl_easy_getinfo(curl, info, &len))? (apr_off_t)len : 0;
+}
+#define MD_CURL_SIZE(c, name)       get_size((c), CURLINFO_SIZE_##name)
+#endif
+
+static void update_timing(md_http_request_t *req)
+{
+    md_curl_internals_t *internals = req->internals;
+    md_http_timing_t *timing;
+    
+    if (internals) {
+        timing = &internals->response->timing;
+        timing->namelookup = MD_CURL_DURATION(internals->curl, NAMELOOKUP);
+        timing->connect = MD_CURL_DURATION(internals->curl, CONNECT);
+        timing->appconnect = MD_CURL_DURATION(internals->curl, APPCONNECT);
+        timing->starttransfer = MD_CURL_DURATION(internals->curl, STARTTRANSFER);
+        timing->total = MD_CURL_DURATION(internals->curl, TOTAL);
+        timing->bytes_sent = MD_CURL_SIZE(internals->curl, UPLOAD);
+        timing->bytes_received = MD_CURL_SIZE(internals->curl, DOWNLOAD);
+    }
+}
+
 static apr_status_t update_status(md_http_request_t *req)
 {
     md_curl_internals_t *internals = req->internals;
@@ -344,6 +489,7 @@ static apr_status_t update_status(md_http_request_t *req)
         if (APR_SUCCESS == rv) {
             internals->response->status = (int)l;
         }
+        update_timing(req);
     }
     return rv;
 }
@@ -357,6 +503,7 @@ static void fire_status(md_http_request_t *req, apr_status_t rv)
         
         md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, rv, req->pool, 
                       "req[%d] fire callbacks", req->id);
+        if (req->stats) md_http_stats_add(req->stats, internals->response, rv);
         if ((APR_SUCCESS == rv) && req->cb.on_response) {
             rv = req->cb.on_response(internals->response, req->cb.on_response_data);
         }
@@ -379,6 +526,7 @@ static apr_status_t md_curl_perform(md_http_request_t *req)
     internals = req->internals;
     
     curle = curl_easy_perform(internals->curl);
+    update_timing(req);
     
     rv = curl_status(curle);
     if (APR_SUCCESS != rv) {
@@ -441,26 +589,223 @@ static void remove_from_curlm(md_http_request_t *req, CURLM *curlm)
     }
 }
     
+/* Upper bound on how long we wait for socket activity when curl has no timer for us */
+#define MD_CURL_POLL_MAX        apr_time_from_sec(1)
+#define MD_CURL_POLLSET_SIZE    64
+
+typedef struct md_curl_sock_t md_curl_sock_t;
+struct md_curl_sock_t {
+    md_curl_sock_t *next;           /* in free/zombie list */
+    curl_socket_t fd;
+    apr_pollfd_t pfd;
+    int idx;                        /* index in active or -1 */
+};
+
+typedef struct {
+    apr_pool_t *p;
+    CURLM *curlm;
+    apr_pollset_t *pollset;
+    apr_uint32_t pollset_size;
+    apr_array_header_t *active;     /* md_curl_sock_t* in the pollset */
+    md_curl_sock_t *zombies;        /* removed during this round of poll results */
+    md_curl_sock_t *free;           /* for reuse */
+    apr_time_t timer_at;            /* when curl wants to be called on timeout, 0 for never */
+    apr_status_t rv;
+} md_curl_multi_t;
+
+static apr_status_t poll_grow(md_curl_multi_t *cm)
+{
+    apr_pollset_t *pollset;
+    md_curl_sock_t *sock;
+    apr_status_t rv;
+    int i;
+    
+    /* pollsets have a fixed size on some platforms, make a larger one and move everything */
+    if (!MD_OK(apr_pollset_create(&pollset, cm->pollset_size * 2, cm->p, APR_POLLSET_NOCOPY))) {
+        goto leave;
+    }
+    for (i = 0; i < cm->active->nelts; ++i) {
+        sock = APR_ARRAY_IDX(cm->active, i, md_curl_sock_t*);
+        if (!MD_OK(apr_pollset_add(pollset, &sock->pfd))) goto leave;
+    }
+    apr_pollset_destroy(cm->pollset);
+    cm->pollset = pollset;
+    cm->pollset_size *= 2;
+leave:
+    return rv;
+}
+
+static apr_status_t poll_add(md_curl_multi_t *cm, md_curl_sock_t *sock)
+{
+    apr_status_t rv;
+    
+    rv = apr_pollset_add(cm->pollset, &sock->pfd);
+    if (APR_STATUS_IS_ENOMEM(rv) && MD_OK(poll_grow(cm))) {
+        rv = apr_pollset_add(cm->pollset, &sock->pfd);
+    }
+    if (APR_SUCCESS == rv) {
+        sock->idx = cm->active->nelts;
+        APR_ARRAY_PUSH(cm->active, md_curl_sock_t*) = sock;
+    }
+    return rv;
+}
+
+static void poll_remove(md_curl_multi_t *cm, md_curl_sock_t *sock)
+{
+    md_curl_sock_t *last;
+    
+    if (sock->idx >= 0) {
+        apr_pollset_remove(cm->pollset, &sock->pfd);
+        last = APR_ARRAY_IDX(cm->active, cm->active->nelts - 1, md_curl_sock_t*);
+        APR_ARRAY_IDX(cm->active, sock->idx, md_curl_sock_t*) = last;
+        last->idx = sock->idx;
+        --cm->active->nelts;
+        sock->idx = -1;
+    }
+}
+
+static int multi_sock_cb(CURL *curl, curl_socket_t s, int what, void *baton, void *socketp)
+{
+    md_curl_multi_t *cm = baton;
+    md_curl_sock_t *sock = socketp;
+    apr_os_sock_t fd;
+    apr_status_t rv;
+    
+    (void)curl;
+    if (CURL_POLL_REMOVE == what) {
+        if (sock) {
+            poll_remove(cm, sock);
+            curl_multi_assign(cm->curlm, s, NULL);
+            /* poll results of this round may still point to it */
+            sock->next = cm->zombies;
+            cm->zombies = sock;
+        }
+        return 0;
+    }
+    
+    if (sock) {
+        poll_remove(cm, sock);
+    }
+    else {
+        if (cm->free) {
+            sock = cm->free;
+            cm->free = sock->next;
+        }
+        else {
+            sock = apr_pcalloc(cm->p, sizeof(*sock));
+        }
+        sock->next = NULL;
+        sock->fd = s;
+        sock->idx = -1;
+        fd = (apr_os_sock_t)s;
+        if (!MD_OK(apr_os_sock_put(&sock->pfd.desc.s, &fd, cm->p))) goto leave;
+        sock->pfd.p = cm->p;
+        sock->pfd.desc_type = APR_POLL_SOCKET;
+        sock->pfd.client_data = sock;
+        curl_multi_assign(cm->curlm, s, sock);
+    }
+    sock->pfd.reqevents = ((what & CURL_POLL_IN)? APR_POLLIN : 0) 
+                          | ((what & CURL_POLL_OUT)? APR_POLLOUT : 0);
+    rv = poll_add(cm, sock);
+leave:
+    if (APR_SUCCESS != rv) {
+        cm->rv = rv;
+        return -1;
+    }
+    return 0;
+}
+
+static int multi_timer_cb(CURLM *curlm, long timeout_ms, void *baton)
+{
+    md_curl_multi_t *cm = baton;
+    
+    (void)curlm;
+    cm->timer_at = (timeout_ms < 0)? 0 : apr_time_now() + apr_time_from_msec(timeout_ms);
+    return 0;
+}
+
+static CURLMcode multi_poll(md_curl_multi_t *cm, int *prunning)
+{
+    const apr_pollfd_t *pfds;
+    const md_curl_sock_t *sock;
+    apr_interval_time_t timeout;
+    apr_int32_t i, npfds;
+    apr_time_t now;
+    CURLMcode mc = CURLM_OK;
+    apr_status_t rv;
+    int ev;
+    
+    now = apr_time_now();
+    timeout = MD_CURL_POLL_MAX;
+    if (cm->timer_at) {
+        timeout = (cm->timer_at > now)? cm->timer_at - now : 0;
+        if (timeout > MD_CURL_POLL_MAX) timeout = MD_CURL_POLL_MAX;
+    }
+    
+    rv = apr_pollset_poll(cm->pollset, timeout, &npfds, &pfds);
+    if (APR_SUCCESS == rv) {
+        for (i = 0; i < npfds && CURLM_OK == mc; ++i) {
+            sock = pfds[i].client_data;
+            if (sock->idx < 0) continue; /* removed meanwhile */
+            ev = 0;
+            if (pfds[i].rtnevents & APR_POLLIN) ev |= CURL_CSELECT_IN;
+            if (pfds[i].rtnevents & APR_POLLOUT) ev |= CURL_CSELECT_OUT;
+            if (pfds[i].rtnevents & (APR_POLLERR|APR_POLLHUP)) ev |= CURL_CSELECT_ERR;
+            mc = curl_multi_socket_action(cm->curlm, sock->fd, ev, prunning);
+        }
+    }
+    else if (!APR_STATUS_IS_TIMEUP(rv) && !APR_STATUS_IS_EINTR(rv)) {
+        cm->rv = rv;
+        return CURLM_INTERNAL_ERROR;
+    }
+    /* sockets removed during this round may now be reused */
+    while (cm->zombies) {
+        md_curl_sock_t *zombie = cm->zombies;
+        cm->zombies = zombie->next;
+        zombie->next = cm->free;
+        cm->free = zombie;
+    }
+    if (CURLM_OK == mc && cm->timer_at && apr_time_now() >= cm->timer_at) {
+        cm->timer_at = 0;
+        mc = curl_multi_socket_action(cm->curlm, CURL_SOCKET_TIMEOUT, 0, prunning);
+    }
+    return mc;
+}
+
 static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
                                           md_http_next_req *nextreq, void *baton)
 {
     md_http_request_t *req;
-    CURLM *curlm = NULL;
+    md_curl_multi_t cm;
     CURLMcode mc;
     struct CURLMsg *curlmsg;
     apr_array_header_t *requests;
-    int i, running, numfds, slowdown, msgcount;
+    int i, running, msgcount;
     apr_status_t rv;
     
     requests = apr_array_make(p, 10, sizeof(md_http_request_t*));
-    curlm = curl_multi_init();
-    if (!curlm) {
+    memset(&cm, 0, sizeof(cm));
+    cm.p = p;
+    cm.active = apr_array_make(p, MD_CURL_POLLSET_SIZE, sizeof(md_curl_sock_t*));
+    cm.pollset_size = MD_CURL_POLLSET_SIZE;
+    if (!MD_OK(apr_pollset_create(&cm.pollset, cm.pollset_size, p, APR_POLLSET_NOCOPY))) {
+        goto leave;
+    }
+    cm.curlm = curl_multi_init();
+    if (!cm.curlm) {
         rv = APR_ENOMEM;
         goto leave;
     }
+    curl_multi_setopt(cm.curlm, CURLMOPT_SOCKETFUNCTION, multi_sock_cb);
+    curl_multi_setopt(cm.curlm, CURLMOPT_SOCKETDATA, &cm);
+    curl_multi_setopt(cm.curlm, CURLMOPT_TIMERFUNCTION, multi_timer_cb);
+    curl_multi_setopt(cm.curlm, CURLMOPT_TIMERDATA, &cm);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_multi_setopt(cm.curlm, CURLMOPT_PIPELINING, 
+                      md_http_get_http2(http)? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#endif
     
-    running = 1;
-    slowdown = 0;
+    running = 0;
     while(1) {
         while (1) {
             /* fetch as many requests as nextreq gives us */
@@ -474,7 +819,7 @@ static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
                 }
                 else {
                     APR_ARRAY_PUSH(requests, md_http_request_t*) = req;
-                    add_to_curlm(req, curlm);
+                    add_to_curlm(req, cm.curlm);
                     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, rv, p, 
                                   "multi_perform[%d reqs]: added request", requests->nelts);
                 }
@@ -483,7 +828,7 @@ static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
             else if (APR_STATUS_IS_ENOENT(rv)) {
                 md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, p, 
                               "multi_perform[%d reqs]: no more requests", requests->nelts);
-                if (!running) {
+                if (!requests->nelts) {
                     goto leave;
                 }
                 break;
@@ -495,29 +840,19 @@ static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
             }
         }
     
-        mc = curl_multi_perform(curlm, &running);
-        if (CURLM_OK == mc) {
-            mc = curl_multi_wait(curlm, NULL, 0, 1000, &numfds);
-            if (numfds) slowdown = 0;
-        }
+        /* wait for activity on the sockets or for curl's timer to expire */
+        mc = multi_poll(&cm, &running);
         if (CURLM_OK != mc) {
-            rv = APR_ECONNABORTED;
+            rv = (APR_SUCCESS != cm.rv)? cm.rv : APR_ECONNABORTED;
             md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
                           "multi_perform[%d reqs] failed(%d): %s", 
                           requests->nelts, mc, curl_multi_strerror(mc));
             goto leave;
         }
-        if (!numfds) {
-            /* no activity on any connection, timeout */
-            md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, p, 
-                          "multi_perform[%d reqs]: slowdown %d", requests->nelts, slowdown);
-            if (slowdown) apr_sleep(apr_time_from_msec(100));
-            ++slowdown;
-        }
 
         /* process status messages, e.g. that a request is done */
         while (1) {
-            curlmsg = curl_multi_info_read(curlm, &msgcount);
+            curlmsg = curl_multi_info_read(cm.curlm, &msgcount);
             if (!curlmsg) break;
             if (curlmsg->msg == CURLMSG_DONE) {
                 req = find_curl_request(requests, curlmsg->easy_handle);
@@ -527,7 +862,7 @@ static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
                                   requests->nelts, req->id);
                     update_status(req);
                     fire_status(req, curl_status(curlmsg->data.result));
-                    remove_from_curlm(req, curlm);
+                    remove_from_curlm(req, cm.curlm);
                     md_array_remove(requests, req);
                     md_http_req_destroy(req);
                 }
@@ -538,7 +873,6 @@ static apr_status_t md_curl_multi_perform(md_http_t *http, apr_pool_t *p,
                 }
             }
         }
-        assert(running == requests->nelts);
     };
 
 leave:
@@ -547,10 +881,11 @@ leave:
     for (i = 0; i < requests->nelts; ++i) {
         req = APR_ARRAY_IDX(requests, i, md_http_request_t*);
         fire_status(req, APR_SUCCESS);
-        remove_from_curlm(req, curlm);
+        remove_from_curlm(req, cm.curlm);
         md_http_req_destroy(req);
     }
-    if (curlm) curl_multi_cleanup(curlm);
+    if (cm.curlm) curl_multi_cleanup(cm.curlm);
+    if (cm.pollset) apr_pollset_destroy(cm.pollset);
     return rv;
 }
 
@@ -568,7 +903,7 @@ static void md_curl_req_cleanup(md_http_request_t *req)
 {
     md_curl_internals_t *internals = req->internals;
     if (internals) {
-        if (internals->curl) curl_easy_cleanup(internals->curl);
+        if (internals->curl) curl_http_easy_put(internals->ch, internals->curl);
         if (internals->req_hdrs) curl_slist_free_all(internals->req_hdrs);
         req->internals = NULL;
     }
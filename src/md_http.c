@@ -15,12 +15,17 @@
  */
  
 #include <assert.h>
+#include <stdlib.h>
 
 #include <apr_lib.h>
 #include <apr_strings.h>
 #include <apr_buckets.h>
+#include <apr_hash.h>
+#include <apr_uri.h>
 
+#include "md.h"
 #include "md_http.h"
+#include "md_json.h"
 #include "md_log.h"
 #include "md_util.h"
 
@@ -33,10 +38,14 @@ struct md_http_t {
     const char *user_agent;
     const char *proxy_url;
     md_http_timeouts_t timeout;
+    int http2;
+    md_http_stats_t *stats;
+    void *impl_data;
 };
 
 static md_http_impl_t *cur_impl;
 static int cur_init_done;
+static int def_http2 = 1;
 
 void md_http_use_implementation(md_http_impl_t *impl)
 {
@@ -71,6 +80,7 @@ apr_status_t md_http_create(md_http_t **phttp, apr_pool_t *p, const char *user_a
     http->impl = cur_impl;
     http->user_agent = apr_pstrdup(p, user_agent);
     http->proxy_url = proxy_url? apr_pstrdup(p, proxy_url) : NULL;
+    http->http2 = def_http2;
     http->bucket_alloc = apr_bucket_alloc_create(p);
     if (!http->bucket_alloc) {
         return APR_EGENERAL;
@@ -79,6 +89,36 @@ apr_status_t md_http_create(md_http_t **phttp, apr_pool_t *p, const char *user_a
     return APR_SUCCESS;
 }
 
+void md_http_set_http2_default(int enabled)
+{
+    def_http2 = enabled;
+}
+
+void md_http_set_http2(md_http_t *http, int enabled)
+{
+    http->http2 = enabled;
+}
+
+int md_http_get_http2(md_http_t *http)
+{
+    return http->http2;
+}
+
+apr_pool_t *md_http_get_pool(md_http_t *http)
+{
+    return http->pool;
+}
+
+void *md_http_get_impl_data(md_http_t *http)
+{
+    return http->impl_data;
+}
+
+void md_http_set_impl_data(md_http_t *http, void *data)
+{
+    http->impl_data = data;
+}
+
 void md_http_set_response_limit(md_http_t *http, apr_off_t resp_limit)
 {
     http->resp_limit = resp_limit;
@@ -116,6 +156,160 @@ void md_http_set_stalling(md_http_request_t *req, long bytes_per_sec, apr_time_t
     req->timeout.stalled = timeout;
 }
 
+void md_http_set_stats_default(md_http_t *http, md_http_stats_t *stats)
+{
+    http->stats = stats;
+}
+
+void md_http_set_stats(md_http_request_t *req, md_http_stats_t *stats)
+{
+    req->stats = stats;
+}
+
+/**************************************************************************************************/
+/* request timing statistics */
+
+/* Number of most recent request durations kept per endpoint for percentiles */
+#define MD_HTTP_STATS_SAMPLES   256
+
+typedef struct {
+    const char *endpoint;
+    int requests;
+    int errors;
+    apr_off_t bytes_sent;
+    apr_off_t bytes_received;
+    md_http_timing_t sum;
+    apr_array_header_t *totals;     /* apr_interval_time_t */
+    int next_total;
+} endpoint_stats_t;
+
+struct md_http_stats_t {
+    apr_pool_t *p;
+    apr_hash_t *endpoints;
+    int count;
+};
+
+md_http_stats_t *md_http_stats_create(apr_pool_t *p)
+{
+    md_http_stats_t *stats;
+    
+    stats = apr_pcalloc(p, sizeof(*stats));
+    stats->p = p;
+    stats->endpoints = apr_hash_make(p);
+    return stats;
+}
+
+static const char *endpoint_of(const char *url, apr_pool_t *p)
+{
+    apr_uri_t uri;
+    
+    if (APR_SUCCESS == apr_uri_parse(p, url, &uri) && uri.scheme && uri.hostinfo) {
+        return apr_psprintf(p, "%s://%s", uri.scheme, uri.hostinfo);
+    }
+    return url;
+}
+
+void md_http_stats_add(md_http_stats_t *stats, const md_http_response_t *res, apr_status_t rv)
+{
+    endpoint_stats_t *es;
+    const char *endpoint;
+    
+    endpoint = endpoint_of(res->req->url, res->req->pool);
+    es = apr_hash_get(stats->endpoints, endpoint, APR_HASH_KEY_STRING);
+    if (!es) {
+        es = apr_pcalloc(stats->p, sizeof(*es));
+        es->endpoint = apr_pstrdup(stats->p, endpoint);
+        es->totals = apr_array_make(stats->p, 10, sizeof(apr_interval_time_t));
+        apr_hash_set(stats->endpoints, es->endpoint, APR_HASH_KEY_STRING, es);
+    }
+    ++stats->count;
+    ++es->requests;
+    if (APR_SUCCESS != rv) ++es->errors;
+    es->bytes_sent += res->timing.bytes_sent;
+    es->bytes_received += res->timing.bytes_received;
+    es->sum.namelookup += res->timing.namelookup;
+    es->sum.connect += res->timing.connect;
+    es->sum.appconnect += res->timing.appconnect;
+    es->sum.starttransfer += res->timing.starttransfer;
+    es->sum.total += res->timing.total;
+    if (es->totals->nelts < MD_HTTP_STATS_SAMPLES) {
+        APR_ARRAY_PUSH(es->totals, apr_interval_time_t) = res->timing.total;
+    }
+    else {
+        APR_ARRAY_IDX(es->totals, es->next_total, apr_interval_time_t) = res->timing.total;
+        es->next_total = (es->next_total + 1) % MD_HTTP_STATS_SAMPLES;
+    }
+}
+
+int md_http_stats_count(const md_http_stats_t *stats)
+{
+    return stats->count;
+}
+
+static int cmp_interval(const void *a, const void *b)
+{
+    apr_interval_time_t ta = *(const apr_interval_time_t*)a;
+    apr_interval_time_t tb = *(const apr_interval_time_t*)b;
+    return (ta < tb)? -1 : ((ta > tb)? 1 : 0);
+}
+
+static double msec(apr_interval_time_t t)
+{
+    return (double)t / 1000.0;
+}
+
+typedef struct {
+    apr_pool_t *p;
+    md_json_t *json;
+} stats_json_ctx;
+
+static int endpoint_to_json(void *baton, const void *key, apr_ssize_t klen, const void *val)
+{
+    stats_json_ctx *ctx = baton;
+    md_json_t *ej;
+    const endpoint_stats_t *es = val;
+    apr_array_header_t *totals;
+    apr_interval_time_t *t;
+    int n;
+    
+    (void)key;
+    (void)klen;
+    ej = md_json_create(ctx->p);
+    md_json_setl(es->requests, ej, "requests", NULL);
+    md_json_setl(es->errors, ej, MD_KEY_ERRORS, NULL);
+    md_json_setl((long)es->bytes_sent, ej, "bytes-sent", NULL);
+    md_json_setl((long)es->bytes_received, ej, "bytes-received", NULL);
+    if (es->requests > 0) {
+        md_json_setn(msec(es->sum.namelookup / es->requests), ej, "avg-ms", "namelookup", NULL);
+        md_json_setn(msec(es->sum.connect / es->requests), ej, "avg-ms", "connect", NULL);
+        md_json_setn(msec(es->sum.appconnect / es->requests), ej, "avg-ms", "appconnect", NULL);
+        md_json_setn(msec(es->sum.starttransfer / es->requests), ej, 
+                     "avg-ms", "starttransfer", NULL);
+        md_json_setn(msec(es->sum.total / es->requests), ej, "avg-ms", "total", NULL);
+    }
+    if ((n = es->totals->nelts) > 0) {
+        totals = apr_array_copy(ctx->p, es->totals);
+        t = (apr_interval_time_t*)totals->elts;
+        qsort(t, (size_t)n, sizeof(*t), cmp_interval);
+        md_json_setn(msec(t[(n-1) * 50 / 100]), ej, "total-ms", "p50", NULL);
+        md_json_setn(msec(t[(n-1) * 90 / 100]), ej, "total-ms", "p90", NULL);
+        md_json_setn(msec(t[(n-1) * 99 / 100]), ej, "total-ms", "p99", NULL);
+        md_json_setn(msec(t[n-1]), ej, "total-ms", "max", NULL);
+    }
+    md_json_setj(ej, ctx->json, es->endpoint, NULL);
+    return 1;
+}
+
+md_json_t *md_http_stats_to_json(const md_http_stats_t *stats, apr_pool_t *p)
+{
+    stats_json_ctx ctx;
+    
+    ctx.p = p;
+    ctx.json = md_json_create(p);
+    apr_hash_do(endpoint_to_json, &ctx, stats->endpoints);
+    return ctx.json;
+}
+
 static apr_status_t req_set_body(md_http_request_t *req, const char *content_type,
                                  apr_bucket_brigade *body, apr_off_t body_len,
                                  int detect_len)
@@ -181,6 +375,8 @@ static apr_status_t req_create(md_http_request_t **preq, md_http_t *http,
     req->resp_limit = http->resp_limit;
     req->user_agent = http->user_agent;
     req->proxy_url = http->proxy_url;
+    req->http2 = http->http2;
+    req->stats = http->stats;
     req->timeout = http->timeout;
     *preq = req;
     return rv;
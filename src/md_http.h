@@ -21,8 +21,10 @@ struct apr_table_t;
 struct apr_bucket_brigade;
 struct apr_bucket_alloc_t;
 struct md_data_t;
+struct md_json_t;
 
 typedef struct md_http_t md_http_t;
+typedef struct md_http_stats_t md_http_stats_t;
 
 typedef struct md_http_request_t md_http_request_t;
 typedef struct md_http_response_t md_http_response_t;
@@ -55,6 +57,21 @@ struct md_http_timeouts_t {
     apr_time_t stalled;
 };
 
+/**
+ * Timings of a request, as in curl: all durations count from the start of 
+ * the request, so name lookup <= connect <= appconnect <= starttransfer <= total.
+ */
+typedef struct md_http_timing_t md_http_timing_t;
+struct md_http_timing_t {
+    apr_interval_time_t namelookup;     /* until the name was resolved */
+    apr_interval_time_t connect;        /* until the TCP connection was up */
+    apr_interval_time_t appconnect;     /* until the TLS handshake was done */
+    apr_interval_time_t starttransfer;  /* until the first response byte arrived */
+    apr_interval_time_t total;          /* until the response was complete */
+    apr_off_t bytes_sent;
+    apr_off_t bytes_received;
+};
+
 struct md_http_request_t {
     md_http_t *http;
     apr_pool_t *pool;
@@ -64,12 +81,14 @@ struct md_http_request_t {
     const char *url;
     const char *user_agent;
     const char *proxy_url;
+    int http2;
     apr_table_t *headers;
     struct apr_bucket_brigade *body;
     apr_off_t body_len;
     apr_off_t resp_limit;
     md_http_timeouts_t timeout;
     md_http_callbacks_t cb;
+    md_http_stats_t *stats;
     void *internals;
 };
 
@@ -78,6 +97,7 @@ struct md_http_response_t {
     int status;
     apr_table_t *headers;
     struct apr_bucket_brigade *body;
+    md_http_timing_t timing;
 };
 
 apr_status_t md_http_create(md_http_t **phttp, apr_pool_t *p, const char *user_agent,
@@ -85,6 +105,15 @@ apr_status_t md_http_create(md_http_t **phttp, apr_pool_t *p, const char *user_a
 
 void md_http_set_response_limit(md_http_t *http, apr_off_t resp_limit);
 
+/**
+ * Set if HTTP/2 shall be used with servers that support it, so that requests to 
+ * the same host share one multiplexed connection. The default applies to all 
+ * instances created afterwards and is on.
+ */
+void md_http_set_http2_default(int enabled);
+void md_http_set_http2(md_http_t *http, int enabled);
+int md_http_get_http2(md_http_t *http);
+
 /**
  * Set the timeout for the complete reqest. This needs to take everything from
  * DNS looksups, to conntects, to transfer of all data into account and should
@@ -109,6 +138,34 @@ void md_http_set_connect_timeout(md_http_request_t *req, apr_time_t timeout);
 void md_http_set_stalling_default(md_http_t *http, long bytes_per_sec, apr_time_t timeout);
 void md_http_set_stalling(md_http_request_t *req, long bytes_per_sec, apr_time_t timeout);
 
+/**
+ * Collect the timings of requests, when they are done. The default applies
+ * to all requests created afterwards. NULL to not collect them.
+ */
+void md_http_set_stats_default(md_http_t *http, md_http_stats_t *stats);
+void md_http_set_stats(md_http_request_t *req, md_http_stats_t *stats);
+
+/**
+ * Create a collection of request timings, summarized per endpoint (scheme://host:port).
+ */
+md_http_stats_t *md_http_stats_create(apr_pool_t *p);
+
+/**
+ * Add the timings of a finished request, failed when rv is not APR_SUCCESS.
+ */
+void md_http_stats_add(md_http_stats_t *stats, const md_http_response_t *res, apr_status_t rv);
+
+/**
+ * Number of requests added to the collection.
+ */
+int md_http_stats_count(const md_http_stats_t *stats);
+
+/**
+ * Summary per endpoint: number of requests, errors and bytes, the average 
+ * of the timings and percentiles of the total duration, all in milliseconds.
+ */
+struct md_json_t *md_http_stats_to_json(const md_http_stats_t *stats, apr_pool_t *p);
+
 /**
  * Perform the request. Then this function returns, the request and
  * all its memory has been freed and must no longer be used.
@@ -237,6 +294,15 @@ struct md_http_impl_t {
 
 void md_http_use_implementation(md_http_impl_t *impl);
 
+/**
+ * Implementations may keep their own data with a md_http_t instance, e.g. connections
+ * to reuse for subsequent requests. Such data should be allocated from, and have a
+ * cleanup registered at, the instance's pool.
+ */
+apr_pool_t *md_http_get_pool(md_http_t *http);
+void *md_http_get_impl_data(md_http_t *http);
+void md_http_set_impl_data(md_http_t *http, void *data);
+
 
 
 #endif /* md_http_h */
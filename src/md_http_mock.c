@@ -0,0 +1,399 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+ 
+#include <assert.h>
+
+#include <apr_lib.h>
+#include <apr_strings.h>
+#include <apr_buckets.h>
+
+#include "md.h"
+#include "md_http.h"
+#include "md_json.h"
+#include "md_log.h"
+#include "md_util.h"
+#include "md_http_mock.h"
+
+/**************************************************************************************************/
+/* md_http in-memory implementation */
+
+typedef struct {
+    int status;
+    apr_status_t rv;
+    apr_table_t *headers;
+    const char *body;
+    apr_size_t body_len;
+    md_http_mock_cb *cb;
+    void *baton;
+} mock_step_t;
+
+typedef struct {
+    const char *method;
+    const char *url;
+    apr_size_t prefix_len;          /* > 0 iff url is a prefix */
+    apr_array_header_t *steps;      /* mock_step_t* given out in order */
+    int next;
+} mock_rule_t;
+
+struct md_http_mock_t {
+    apr_pool_t *p;
+    apr_array_header_t *rules;      /* mock_rule_t* */
+    apr_interval_time_t latency;
+    int fail_every;
+    apr_status_t fail_rv;
+    int nonces;
+    int count;
+};
+
+typedef struct {
+    md_http_response_t *response;
+    apr_status_t rv;
+    apr_time_t start;
+    apr_time_t due;
+} mock_internals_t;
+
+static md_http_mock_t *cur_mock;
+
+apr_status_t md_http_mock_create(md_http_mock_t **pmock, apr_pool_t *p)
+{
+    md_http_mock_t *mock;
+    
+    mock = apr_pcalloc(p, sizeof(*mock));
+    mock->p = p;
+    mock->rules = apr_array_make(p, 10, sizeof(mock_rule_t*));
+    *pmock = mock;
+    return APR_SUCCESS;
+}
+
+static mock_rule_t *rule_get(md_http_mock_t *mock, const char *method, const char *url)
+{
+    mock_rule_t *rule;
+    apr_size_t len;
+    int i;
+    
+    for (i = 0; i < mock->rules->nelts; ++i) {
+        rule = APR_ARRAY_IDX(mock->rules, i, mock_rule_t*);
+        if (!apr_strnatcasecmp(method, rule->method) && !strcmp(url, rule->url)) {
+            return rule;
+        }
+    }
+    rule = apr_pcalloc(mock->p, sizeof(*rule));
+    rule->method = apr_pstrdup(mock->p, method);
+    rule->url = apr_pstrdup(mock->p, url);
+    len = strlen(url);
+    if (len > 0 && url[len-1] == '*') rule->prefix_len = len - 1;
+    rule->steps = apr_array_make(mock->p, 3, sizeof(mock_step_t*));
+    APR_ARRAY_PUSH(mock->rules, mock_rule_t*) = rule;
+    return rule;
+}
+
+static mock_step_t *step_add(md_http_mock_t *mock, const char *method, const char *url)
+{
+    mock_rule_t *rule = rule_get(mock, method, url);
+    mock_step_t *step;
+    
+    step = apr_pcalloc(mock->p, sizeof(*step));
+    APR_ARRAY_PUSH(rule->steps, mock_step_t*) = step;
+    return step;
+}
+
+apr_status_t md_http_mock_add(md_http_mock_t *mock, const char *method, const char *url,
+                              int status, struct apr_table_t *headers, 
+                              const char *body, apr_size_t body_len)
+{
+    mock_step_t *step = step_add(mock, method, url);
+    
+    step->status = status;
+    step->headers = headers? apr_table_copy(mock->p, headers) : apr_table_make(mock->p, 1);
+    if (body) {
+        step->body = apr_pmemdup(mock->p, body, body_len);
+        step->body_len = body_len;
+    }
+    return APR_SUCCESS;
+}
+
+apr_status_t md_http_mock_add_error(md_http_mock_t *mock, const char *method, 
+                                    const char *url, apr_status_t rv)
+{
+    mock_step_t *step = step_add(mock, method, url);
+    
+    step->rv = (APR_SUCCESS == rv)? APR_EGENERAL : rv;
+    return APR_SUCCESS;
+}
+
+apr_status_t md_http_mock_add_cb(md_http_mock_t *mock, const char *method, const char *url,
+                                 md_http_mock_cb *cb, void *baton)
+{
+    mock_step_t *step = step_add(mock, method, url);
+    
+    step->cb = cb;
+    step->baton = baton;
+    return APR_SUCCESS;
+}
+
+typedef struct {
+    md_http_mock_t *mock;
+    apr_pool_t *p;
+    apr_status_t rv;
+} load_ctx_t;
+
+static int load_response(void *baton, size_t index, md_json_t *json)
+{
+    load_ctx_t *ctx = baton;
+    const char *method, *url, *body;
+    apr_table_t *headers;
+    
+    method = md_json_gets(json, "method", NULL);
+    url = md_json_gets(json, MD_KEY_URL, NULL);
+    if (!url) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, APR_EINVAL, ctx->p, 
+                      "mock response #%d without url", (int)index);
+        ctx->rv = APR_EINVAL;
+        return 0;
+    }
+    headers = apr_table_make(ctx->p, 5);
+    if (md_json_has_key(json, "headers", NULL)) {
+        md_json_gets_dict(headers, json, "headers", NULL);
+    }
+    body = md_json_gets(json, "body", NULL);
+    md_http_mock_add(ctx->mock, method? method : "GET", url, 
+                     md_json_has_key(json, MD_KEY_STATUS, NULL)? 
+                        (int)md_json_getl(json, MD_KEY_STATUS, NULL) : 200, 
+                     headers, body, body? strlen(body) : 0);
+    return 1;
+}
+
+apr_status_t md_http_mock_load(md_http_mock_t *mock, const char *fpath, apr_pool_t *p)
+{
+    md_json_t *json;
+    load_ctx_t ctx;
+    apr_status_t rv;
+    
+    if (APR_SUCCESS != (rv = md_json_readf(&json, p, fpath))) goto leave;
+    ctx.mock = mock;
+    ctx.p = p;
+    ctx.rv = APR_SUCCESS;
+    md_json_itera(load_response, &ctx, json, "responses", NULL);
+    rv = ctx.rv;
+leave:
+    return rv;
+}
+
+void md_http_mock_set_latency(md_http_mock_t *mock, apr_interval_time_t latency)
+{
+    mock->latency = latency;
+}
+
+void md_http_mock_set_failures(md_http_mock_t *mock, int every_nth, apr_status_t rv)
+{
+    mock->fail_every = every_nth;
+    mock->fail_rv = (APR_SUCCESS == rv)? APR_EGENERAL : rv;
+}
+
+void md_http_mock_set_nonces(md_http_mock_t *mock, int enabled)
+{
+    mock->nonces = enabled;
+}
+
+int md_http_mock_count(md_http_mock_t *mock)
+{
+    return mock->count;
+}
+
+static mock_rule_t *rule_find(md_http_mock_t *mock, md_http_request_t *req)
+{
+    mock_rule_t *rule, *best = NULL;
+    int i;
+    
+    for (i = 0; i < mock->rules->nelts; ++i) {
+        rule = APR_ARRAY_IDX(mock->rules, i, mock_rule_t*);
+        if (apr_strnatcasecmp(req->method, rule->method)) continue;
+        if (!rule->prefix_len) {
+            if (!strcmp(req->url, rule->url)) return rule;
+        }
+        else if (!strncmp(req->url, rule->url, rule->prefix_len)
+                 && (!best || best->prefix_len < rule->prefix_len)) {
+            best = rule;
+        }
+    }
+    return best;
+}
+
+static apr_status_t mock_respond(md_http_mock_t *mock, md_http_request_t *req)
+{
+    mock_internals_t *internals;
+    md_http_response_t *res;
+    mock_rule_t *rule;
+    mock_step_t *step;
+    apr_status_t rv = APR_SUCCESS;
+    
+    internals = apr_pcalloc(req->pool, sizeof(*internals));
+    res = internals->response = apr_pcalloc(req->pool, sizeof(*res));
+    res->req = req;
+    res->status = 400;
+    res->headers = apr_table_make(req->pool, 5);
+    res->body = apr_brigade_create(req->pool, req->bucket_alloc);
+    internals->start = apr_time_now();
+    internals->due = internals->start + mock->latency;
+    req->internals = internals;
+    
+    ++mock->count;
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, req->pool, 
+                  "req[%d]: %s %s (mock)", req->id, req->method, req->url);
+    if (mock->fail_every > 0 && (mock->count % mock->fail_every) == 0) {
+        rv = mock->fail_rv;
+        goto leave;
+    }
+    if (!(rule = rule_find(mock, req)) || apr_is_empty_array(rule->steps)) {
+        res->status = 404;
+        goto leave;
+    }
+    step = APR_ARRAY_IDX(rule->steps, rule->next, mock_step_t*);
+    if (rule->next + 1 < rule->steps->nelts) ++rule->next;
+    
+    if (step->rv != APR_SUCCESS) {
+        rv = step->rv;
+    }
+    else if (step->cb) {
+        rv = step->cb(res, req, step->baton);
+    }
+    else {
+        res->status = step->status;
+        apr_table_overlap(res->headers, step->headers, APR_OVERLAP_TABLES_SET);
+        if (step->body_len > 0) {
+            if (req->resp_limit && (apr_off_t)step->body_len > req->resp_limit) {
+                /* curl fails the transfer the same way */
+                rv = APR_EGENERAL;
+                goto leave;
+            }
+            rv = apr_brigade_write(res->body, NULL, NULL, step->body, step->body_len);
+        }
+    }
+    res->timing.bytes_sent = (req->body_len > 0)? req->body_len : 0;
+    apr_brigade_length(res->body, 0, &res->timing.bytes_received);
+    if (APR_SUCCESS == rv && mock->nonces && !apr_table_get(res->headers, "Replay-Nonce")) {
+        apr_table_setn(res->headers, "Replay-Nonce", 
+                       apr_psprintf(req->pool, "mock-nonce-%d", mock->count));
+    }
+leave:
+    internals->rv = rv;
+    return rv;
+}
+
+static void mock_fire_status(md_http_request_t *req)
+{
+    mock_internals_t *internals = req->internals;
+    apr_status_t rv = internals->rv;
+    
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, req->pool, "request <-- %d (mock)", 
+                  internals->response->status);
+    /* no network, all the time is spent waiting for the response */
+    internals->response->timing.total = apr_time_now() - internals->start;
+    internals->response->timing.starttransfer = internals->response->timing.total;
+    if (req->stats) md_http_stats_add(req->stats, internals->response, rv);
+    if (APR_SUCCESS == rv && req->cb.on_response) {
+        rv = req->cb.on_response(internals->response, req->cb.on_response_data);
+    }
+    internals->rv = rv;
+    if (req->cb.on_status) {
+        req->cb.on_status(req, rv, req->cb.on_status_data);
+    }
+}
+
+static apr_status_t mock_init(void) 
+{
+    return APR_SUCCESS;
+}
+
+static void mock_req_cleanup(md_http_request_t *req) 
+{
+    req->internals = NULL;
+}
+
+static apr_status_t mock_perform(md_http_request_t *req)
+{
+    mock_internals_t *internals;
+    apr_time_t now;
+    apr_status_t rv;
+    
+    assert(cur_mock);
+    mock_respond(cur_mock, req);
+    internals = req->internals;
+    now = apr_time_now();
+    if (internals->due > now) apr_sleep(internals->due - now);
+    mock_fire_status(req);
+    rv = internals->rv;
+    md_http_req_destroy(req);
+    return rv;
+}
+
+static apr_status_t mock_multi_perform(md_http_t *http, apr_pool_t *p,
+                                       md_http_next_req *nextreq, void *baton)
+{
+    md_http_request_t *req, *first;
+    mock_internals_t *internals;
+    apr_array_header_t *requests;
+    apr_time_t now;
+    apr_status_t rv;
+    int i;
+    
+    assert(cur_mock);
+    requests = apr_array_make(p, 10, sizeof(md_http_request_t*));
+    while (1) {
+        /* fetch as many requests as nextreq gives us */
+        while (APR_SUCCESS == (rv = nextreq(&req, baton, http, requests->nelts))) {
+            mock_respond(cur_mock, req);
+            APR_ARRAY_PUSH(requests, md_http_request_t*) = req;
+        }
+        if (!APR_STATUS_IS_ENOENT(rv) || !requests->nelts) goto leave;
+        
+        /* finish the request that is due first, waiting for it if need be */
+        first = APR_ARRAY_IDX(requests, 0, md_http_request_t*);
+        for (i = 1; i < requests->nelts; ++i) {
+            req = APR_ARRAY_IDX(requests, i, md_http_request_t*);
+            if (((mock_internals_t*)req->internals)->due 
+                < ((mock_internals_t*)first->internals)->due) {
+                first = req;
+            }
+        }
+        internals = first->internals;
+        now = apr_time_now();
+        if (internals->due > now) apr_sleep(internals->due - now);
+        mock_fire_status(first);
+        md_array_remove(requests, first);
+        md_http_req_destroy(first);
+    }
+leave:
+    for (i = 0; i < requests->nelts; ++i) {
+        req = APR_ARRAY_IDX(requests, i, md_http_request_t*);
+        mock_fire_status(req);
+        md_http_req_destroy(req);
+    }
+    return rv;
+}
+
+static md_http_impl_t impl = {
+    mock_init,
+    mock_req_cleanup,
+    mock_perform,
+    mock_multi_perform,
+};
+
+md_http_impl_t *md_http_mock_get_impl(md_http_mock_t *mock)
+{
+    cur_mock = mock;
+    return &impl;
+}
@@ -0,0 +1,102 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef md_http_mock_h
+#define md_http_mock_h
+
+struct apr_table_t;
+struct md_http_impl_t;
+struct md_http_request_t;
+struct md_http_response_t;
+
+/**
+ * An md_http implementation that answers requests from responses held in memory,
+ * without any network traffic. Responses can be scripted, loaded from a recording
+ * or produced by a callback. Latency and transport failures can be injected, 
+ * which makes ACME and OCSP runs reproducible for tests and benchmarks.
+ */
+typedef struct md_http_mock_t md_http_mock_t;
+
+/**
+ * Callback producing a response. It sets status, headers and body of res.
+ */
+typedef apr_status_t md_http_mock_cb(struct md_http_response_t *res, 
+                                     const struct md_http_request_t *req, void *baton);
+
+apr_status_t md_http_mock_create(md_http_mock_t **pmock, apr_pool_t *p);
+
+/**
+ * Add a response for requests with method and url. An url ending in '*' matches all
+ * urls with that prefix, exact matches and longer prefixes win. Responses added 
+ * for the same method and url are given out in order, the last one repeats.
+ * @param status    the HTTP status of the response
+ * @param headers   response headers or NULL
+ * @param body      response body or NULL
+ * @param body_len  length of the body
+ */
+apr_status_t md_http_mock_add(md_http_mock_t *mock, const char *method, const char *url,
+                              int status, struct apr_table_t *headers, 
+                              const char *body, apr_size_t body_len);
+
+/**
+ * Add a transport failure for requests with method and url, as when the
+ * host could not be reached.
+ */
+apr_status_t md_http_mock_add_error(md_http_mock_t *mock, const char *method, 
+                                    const char *url, apr_status_t rv);
+
+/**
+ * Add a callback that produces the response for requests with method and url.
+ */
+apr_status_t md_http_mock_add_cb(md_http_mock_t *mock, const char *method, const char *url,
+                                 md_http_mock_cb *cb, void *baton);
+
+/**
+ * Add the responses recorded in a JSON file of the form
+ * { "responses": [ { "method": "GET", "url": "https://...", "status": 200,
+ *                    "headers": { "name": "value", ... }, "body": "..." }, ... ] }
+ */
+apr_status_t md_http_mock_load(md_http_mock_t *mock, const char *fpath, apr_pool_t *p);
+
+/**
+ * Delay every response by the given amount. Requests in a multi perform are
+ * delayed in parallel, as they would be on the network.
+ */
+void md_http_mock_set_latency(md_http_mock_t *mock, apr_interval_time_t latency);
+
+/**
+ * Fail every nth request with rv before it gets a response. 0 disables this.
+ */
+void md_http_mock_set_failures(md_http_mock_t *mock, int every_nth, apr_status_t rv);
+
+/**
+ * Add a fresh "Replay-Nonce" header to every response that has none, the way an 
+ * ACME server does.
+ */
+void md_http_mock_set_nonces(md_http_mock_t *mock, int enabled);
+
+/**
+ * Number of requests the mock has handled so far.
+ */
+int md_http_mock_count(md_http_mock_t *mock);
+
+/**
+ * Get the implementation to hand to md_http_use_implementation(). Since that is
+ * process wide, the mock given here is the one all md_http instances use.
+ */
+struct md_http_impl_t *md_http_mock_get_impl(md_http_mock_t *mock);
+
+#endif /* md_http_mock_h */
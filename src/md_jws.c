@@ -25,86 +25,191 @@
 #include "md_log.h"
 #include "md_util.h"
 
-static int header_set(void *data, const char *key, const char *val)
+/* s as JSON string, quotes included */
+static const char *json_quote(apr_pool_t *p, const char *s)
 {
-    md_json_sets(val, (md_json_t *)data, key, NULL);
-    return 1;
+    apr_size_t i, len = 2;
+    char *q, *d;
+    
+    for (i = 0; s[i]; ++i) {
+        len += (s[i] == '"' || s[i] == '\\')? 2 : (((unsigned char)s[i] < 0x20)? 6 : 1);
+    }
+    q = d = apr_palloc(p, len + 1);
+    *d++ = '"';
+    for (i = 0; s[i]; ++i) {
+        if (s[i] == '"' || s[i] == '\\') {
+            *d++ = '\\';
+            *d++ = s[i];
+        }
+        else if ((unsigned char)s[i] < 0x20) {
+            apr_snprintf(d, 7, "\\u%04x", (unsigned char)s[i]);
+            d += 6;
+        }
+        else {
+            *d++ = s[i];
+        }
+    }
+    *d++ = '"';
+    *d = '\0';
+    return q;
 }
 
-apr_status_t md_jws_sign(md_json_t **pmsg, apr_pool_t *p,
-                         md_data_t *payload, struct apr_table_t *protected, 
-                         struct md_pkey_t *pkey, const char *key_id)
+static int header_add(void *data, const char *key, const char *val)
 {
-    md_json_t *msg, *jprotected;
-    const char *prot64, *pay64, *sign64, *sign, *prot;
-    apr_status_t rv = APR_SUCCESS;
-    md_data_t data;
-
-    *pmsg = NULL;
+    apr_array_header_t *parts = data;
     
-    msg = md_json_create(p);
+    APR_ARRAY_PUSH(parts, const char*) = ",";
+    APR_ARRAY_PUSH(parts, const char*) = json_quote(parts->pool, key);
+    APR_ARRAY_PUSH(parts, const char*) = ":";
+    APR_ARRAY_PUSH(parts, const char*) = json_quote(parts->pool, val);
+    return 1;
+}
 
-    jprotected = md_json_create(p);
-    md_json_sets("RS256", jprotected, "alg", NULL);
-    if (key_id) {
-        md_json_sets(key_id, jprotected, "kid", NULL);
-    }
-    else {
-        md_json_sets(md_pkey_get_rsa_e64(pkey, p), jprotected, "jwk", "e", NULL);
-        md_json_sets("RSA", jprotected, "jwk", "kty", NULL);
-        md_json_sets(md_pkey_get_rsa_n64(pkey, p), jprotected, "jwk", "n", NULL);
+/* The public JWK (RFC 7517) of the key and the JWS "alg" to sign with it. Members 
+ * are in lexicographic order, as RFC 7638 needs for the thumbprint. */
+static apr_status_t jwk_get(md_json_t **pjwk, const char **palg, 
+                            struct md_pkey_t *pkey, apr_pool_t *p)
+{
+    md_json_t *jwk = md_json_create(p);
+    const char *s1, *s2, *curve;
+    apr_status_t rv = APR_EINVAL;
+    
+    *pjwk = NULL;
+    *palg = NULL;
+    switch (md_pkey_get_type(pkey)) {
+        case MD_PKEY_TYPE_RSA:
+            s1 = md_pkey_get_rsa_e64(pkey, p);
+            s2 = md_pkey_get_rsa_n64(pkey, p);
+            if (!s1 || !s2) goto leave;
+            md_json_sets(s1, jwk, "e", NULL);
+            md_json_sets("RSA", jwk, "kty", NULL);
+            md_json_sets(s2, jwk, "n", NULL);
+            *palg = "RS256";
+            break;
+        case MD_PKEY_TYPE_EC:
+            if (!(curve = md_pkey_get_ec_curve(pkey))
+                || APR_SUCCESS != md_pkey_get_ec_xy64(&s1, &s2, pkey, p)) goto leave;
+            md_json_sets(curve, jwk, "crv", NULL);
+            md_json_sets("EC", jwk, "kty", NULL);
+            md_json_sets(s1, jwk, "x", NULL);
+            md_json_sets(s2, jwk, "y", NULL);
+            *palg = strcmp("P-256", curve)? "ES384" : "ES256";
+            break;
+        case MD_PKEY_TYPE_ED25519:
+            if (!(s1 = md_pkey_get_ed25519_x64(pkey, p))) goto leave;
+            md_json_sets("Ed25519", jwk, "crv", NULL);
+            md_json_sets("OKP", jwk, "kty", NULL);
+            md_json_sets(s1, jwk, "x", NULL);
+            *palg = "EdDSA";
+            break;
+        default:
+            rv = APR_ENOTIMPL;
+            goto leave;
     }
-    apr_table_do(header_set, jprotected, protected, NULL);
-    prot = md_json_writep(jprotected, p, MD_JSON_FMT_COMPACT);
-    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE4, 0, p, "protected: %s",
-                  prot ? prot : "<failed to serialize!>");
+    *pjwk = jwk;
+    rv = APR_SUCCESS;
+leave:
+    return rv;
+}
 
-    if (!prot) {
+apr_status_t md_jws_key_make(md_jws_key_t **pjws, apr_pool_t *p, struct md_pkey_t *pkey)
+{
+    md_jws_key_t *key;
+    md_json_t *jwk;
+    const char *alg;
+    md_data_t data;
+    apr_status_t rv;
+    
+    *pjws = NULL;
+    if (APR_SUCCESS != (rv = jwk_get(&jwk, &alg, pkey, p))) goto leave;
+    
+    key = apr_pcalloc(p, sizeof(*key));
+    key->p = p;
+    key->pkey = pkey;
+    key->alg = alg;
+    /* whitespace and order is relevant, since we hand out a digest of this */
+    if (!(key->jwk = md_json_writep(jwk, p, MD_JSON_FMT_COMPACT))) {
         rv = APR_EINVAL;
+        goto leave;
     }
-    
-    if (rv == APR_SUCCESS) {
-        data.data = prot;
-        data.len = strlen(prot);
-        prot64 = md_util_base64url_encode(&data, p);
-        md_json_sets(prot64, msg, "protected", NULL);
-        pay64 = md_util_base64url_encode(payload, p);
+    MD_DATA_SET_STR(&data, key->jwk);
+    if (APR_SUCCESS != (rv = md_crypt_sha256_digest64(&key->thumb64, p, &data))) goto leave;
+    key->hdr_jwk = apr_psprintf(p, "{\"alg\":\"%s\",\"jwk\":%s", alg, key->jwk);
+    *pjws = key;
+leave:
+    return rv;
+}
 
-        md_json_sets(pay64, msg, "payload", NULL);
-        sign = apr_psprintf(p, "%s.%s", prot64, pay64);
+apr_status_t md_jws_key_sign(md_json_t **pmsg, apr_pool_t *p,
+                             md_data_t *payload, struct apr_table_t *protected, 
+                             md_jws_key_t *key, const char *key_id)
+{
+    md_json_t *msg;
+    apr_array_header_t *parts;
+    const char *prot64, *pay64, *sign64, *sign, *prot;
+    apr_status_t rv;
+    md_data_t data;
 
-        rv = md_crypt_sign64(&sign64, pkey, p, sign, strlen(sign));
+    *pmsg = NULL;
+    
+    if (key_id && (!key->kid || strcmp(key_id, key->kid))) {
+        key->kid = apr_pstrdup(key->p, key_id);
+        key->hdr_kid = apr_psprintf(key->p, "{\"alg\":\"%s\",\"kid\":%s", 
+                                    key->alg, json_quote(key->p, key_id));
     }
+    /* Only the per request members, e.g. nonce and url, are added here. */
+    parts = apr_array_make(p, 10, sizeof(const char*));
+    APR_ARRAY_PUSH(parts, const char*) = key_id? key->hdr_kid : key->hdr_jwk;
+    apr_table_do(header_add, parts, protected, NULL);
+    APR_ARRAY_PUSH(parts, const char*) = "}";
+    prot = apr_array_pstrcat(p, parts, 0);
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE4, 0, p, "protected: %s", prot);
 
-    if (rv == APR_SUCCESS) {
-        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, p, 
-                      "jws pay64=%s\nprot64=%s\nsign64=%s", pay64, prot64, sign64);
+    data.data = prot;
+    data.len = strlen(prot);
+    prot64 = md_util_base64url_encode(&data, p);
+    pay64 = md_util_base64url_encode(payload, p);
+    sign = apr_psprintf(p, "%s.%s", prot64, pay64);
+
+    rv = md_crypt_sign64(&sign64, key->pkey, p, sign, strlen(sign));
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "jwk signed message");
+        return rv;
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, p, 
+                  "jws pay64=%s\nprot64=%s\nsign64=%s", pay64, prot64, sign64);
         
-        md_json_sets(sign64, msg, "signature", NULL);
+    msg = md_json_create(p);
+    md_json_sets(prot64, msg, "protected", NULL);
+    md_json_sets(pay64, msg, "payload", NULL);
+    md_json_sets(sign64, msg, "signature", NULL);
+    *pmsg = msg;
+    return APR_SUCCESS;
+}
+
+apr_status_t md_jws_sign(md_json_t **pmsg, apr_pool_t *p,
+                         md_data_t *payload, struct apr_table_t *protected, 
+                         struct md_pkey_t *pkey, const char *key_id)
+{
+    md_jws_key_t *key;
+    apr_status_t rv;
+
+    *pmsg = NULL;
+    if (APR_SUCCESS != (rv = md_jws_key_make(&key, p, pkey))) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "no JWK for this key type");
+        return rv;
     }
-    else {
-        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "jwk signed message");
-    } 
-    
-    *pmsg = (APR_SUCCESS == rv)? msg : NULL;
-    return rv;
+    return md_jws_key_sign(pmsg, p, payload, protected, key, key_id);
 }
 
 apr_status_t md_jws_pkey_thumb(const char **pthumb, apr_pool_t *p, struct md_pkey_t *pkey)
 {
-    const char *e64, *n64, *s;
-    md_data_t data;
+    md_jws_key_t *key;
     apr_status_t rv;
     
-    e64 = md_pkey_get_rsa_e64(pkey, p);
-    n64 = md_pkey_get_rsa_n64(pkey, p);
-    if (!e64 || !n64) {
-        return APR_EINVAL;
+    *pthumb = NULL;
+    if (APR_SUCCESS == (rv = md_jws_key_make(&key, p, pkey))) {
+        *pthumb = key->thumb64;
     }
-
-    /* whitespace and order is relevant, since we hand out a digest of this */
-    s = apr_psprintf(p, "{\"e\":\"%s\",\"kty\":\"RSA\",\"n\":\"%s\"}", e64, n64);
-    MD_DATA_SET_STR(&data, s);
-    rv = md_crypt_sha256_digest64(pthumb, p, &data);
     return rv;
 }
@@ -22,6 +22,37 @@ struct md_json_t;
 struct md_pkey_t;
 struct md_data_t;
 
+/**
+ * What signing with a key needs from it, computed once for the key: the JWS
+ * algorithm, the public JWK and its thumbprint. The start of protected headers
+ * is kept as well, so that a signature only adds the per request members.
+ */
+typedef struct md_jws_key_t md_jws_key_t;
+struct md_jws_key_t {
+    apr_pool_t *p;
+    struct md_pkey_t *pkey;         /* the private key to sign with */
+    const char *alg;                /* JWS "alg" to sign with, e.g. "ES256" */
+    const char *jwk;                /* public JWK in compact JSON, RFC 7638 member order */
+    const char *thumb64;            /* base64url of the JWK thumbprint (RFC 7638) */
+    const char *hdr_jwk;            /* protected header start, carrying the JWK */
+    const char *kid;                /* key id hdr_kid was made for, or NULL */
+    const char *hdr_kid;            /* protected header start, carrying the kid */
+};
+
+/**
+ * Compute the JWS data of a key, allocated from pool p.
+ * @return APR_ENOTIMPL if the key type has no JWK
+ */
+apr_status_t md_jws_key_make(md_jws_key_t **pjws, apr_pool_t *p, struct md_pkey_t *pkey);
+
+/**
+ * Sign the payload with the key in flattened JSON serialization. The protected
+ * header names the key by key_id or, if that is NULL, carries its JWK.
+ */
+apr_status_t md_jws_key_sign(md_json_t **pmsg, apr_pool_t *p,
+                             struct md_data_t *payload, struct apr_table_t *protected, 
+                             md_jws_key_t *key, const char *key_id);
+
 apr_status_t md_jws_sign(md_json_t **pmsg, apr_pool_t *p,
                          struct md_data_t *payload, struct apr_table_t *protected, 
                          struct md_pkey_t *pkey, const char *key_id);
@@ -52,6 +52,9 @@
 #include "md_ocsp.h"
 
 #define MD_OCSP_ID_LENGTH   SHA_DIGEST_LENGTH
+
+/* How long a server may take to update a response before others sharing the store do it. */
+#define MD_OCSP_LEASE_DURATION  apr_time_from_sec(5 * 60)
    
 struct md_ocsp_reg_t {
     apr_pool_t *p;
@@ -63,6 +66,7 @@ struct md_ocsp_reg_t {
     md_timeslice_t renew_window;
     md_job_notify_cb *notify;
     void *notify_ctx;
+    const char *lease_owner;
 };
 
 typedef struct md_ocsp_status_t md_ocsp_status_t; 
@@ -304,6 +308,7 @@ apr_status_t md_ocsp_reg_make(md_ocsp_reg_t **preg, apr_pool_t *p, md_store_t *s
     reg->proxy_url = proxy_url;
     reg->hash = apr_hash_make(p);
     reg->renew_window = *renew_window;
+    reg->lease_owner = md_store_lease_owner(p);
     
     rv = apr_thread_mutex_create(&reg->mutex, APR_THREAD_MUTEX_NESTED, p);
     if (APR_SUCCESS != rv) goto leave;
@@ -593,6 +598,7 @@ typedef struct {
     md_ocsp_status_t *ostat;
     md_result_t *result;
     md_job_t *job;
+    md_store_lease_t *lease;
 } md_ocsp_update_t;
 
 static apr_status_t ostat_on_resp(const md_http_response_t *resp, void *baton)
@@ -758,6 +764,9 @@ static apr_status_t ostat_on_req_status(const md_http_request_t *req, apr_status
 
 leave:
     md_job_save(update->job, update->result, update->p);
+    if (update->lease) {
+        md_store_lease_release(ostat->reg->store, update->p, update->lease);
+    }
     ostat_req_cleanup(ostat);
     return APR_SUCCESS;
 }
@@ -815,6 +824,7 @@ static apr_status_t next_todo(md_http_request_t **preq, void *baton,
             if (APR_SUCCESS != rv) goto leave;
             md_http_set_on_status_cb(req, ostat_on_req_status, update);
             md_http_set_on_response_cb(req, ostat_on_resp, update);
+            md_http_set_stats(req, update->result->http_stats);
             rv = APR_SUCCESS;
         }
     }
@@ -829,17 +839,38 @@ static int select_updates(void *baton, const void *key, apr_ssize_t klen, const
     md_ocsp_todo_ctx_t *ctx = baton;
     md_ocsp_status_t *ostat = (md_ocsp_status_t *)val;
     md_ocsp_update_t *update;
+    md_store_lease_t *lease;
+    apr_status_t rv;
     
     (void)key;
     (void)klen;
     if (ostat->next_run <= ctx->time) {
+        /* Another server sharing our store may have updated the response already */
+        apr_thread_mutex_lock(ctx->reg->mutex);
+        ocsp_status_refresh(ostat, ctx->ptemp);
+        apr_thread_mutex_unlock(ctx->reg->mutex);
+        if (ostat->next_run > ctx->time) goto leave;
+        
+        rv = md_store_lease_acquire(&lease, ctx->reg->store, ctx->ptemp, ostat->md_name, 
+                                    apr_pstrcat(ctx->ptemp, "ocsp-", ostat->hexid, NULL), 
+                                    ctx->reg->lease_owner, MD_OCSP_LEASE_DURATION);
+        if (APR_STATUS_IS_EBUSY(rv)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, ctx->ptemp, 
+                          "md[%s]: OCSP update of %s done by %s", 
+                          ostat->md_name, ostat->hexid, lease->owner);
+            ostat->next_run = lease->expires;
+            goto leave;
+        }
+        
         update = apr_pcalloc(ctx->ptemp, sizeof(*update));
         update->p = ctx->ptemp;
         update->ostat = ostat;
         update->result = md_result_md_make(update->p, ostat->md_name);
         update->job = NULL;
+        update->lease = (APR_SUCCESS == rv)? lease : NULL;
         APR_ARRAY_PUSH(ctx->todos, md_ocsp_update_t*) = update;
     }
+leave:
     return 1;
 }
 
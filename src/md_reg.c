@@ -20,9 +20,15 @@
 #include <stdlib.h>
 
 #include <apr_lib.h>
+#include <apr_file_info.h>
 #include <apr_hash.h>
 #include <apr_strings.h>
 #include <apr_uri.h>
+#if APR_HAS_THREADS
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_pool.h>
+#endif
 
 #include "md.h"
 #include "md_crypt.h"
@@ -42,6 +48,8 @@ struct md_reg_t {
     struct md_store_t *store;
     struct apr_hash_t *protos;
     struct apr_hash_t *certs;
+    apr_uint64_t certs_seq;         /* last store change seen for the certs cache */
+    struct apr_hash_t *certs_stamps; /* cert_stamp_t of cached certs, by the same key */
     int can_http;
     int can_https;
     const char *proxy_url;
@@ -50,6 +58,26 @@ struct md_reg_t {
     md_timeslice_t *warn_window;
     md_job_notify_cb *notify;
     void *notify_ctx;
+    md_reg_memo_t *memo;
+};
+
+typedef struct {
+    apr_pool_t *p;                  /* owns the entry and its sub pools */
+    apr_pool_t *md_pool;            /* holds md */
+    md_t *md;                       /* MD as last seen in the store, or NULL */
+    apr_time_t md_mtime;            /* modification time of md.json when seen */
+    apr_time_t md_seen;             /* when md_mtime was taken */
+    const char *config_hash;        /* config hash of the MD when seen */
+    apr_pool_t *cert_pool;          /* holds pubcert */
+    const md_pubcert_t *pubcert;    /* loaded certificates of the primary key or NULL */
+    const char *cert_fname;         /* file the pubcert was loaded from */
+    apr_time_t cert_mtime;          /* modification time of that file when loaded */
+    apr_time_t cert_seen;           /* when cert_mtime was taken */
+} memo_entry_t;
+
+struct md_reg_memo_t {
+    apr_pool_t *p;
+    apr_hash_t *entries;            /* memo_entry_t by MD name */
 };
 
 /**************************************************************************************************/
@@ -87,6 +115,7 @@ apr_status_t md_reg_create(md_reg_t **preg, apr_pool_t *p, struct md_store_t *st
     reg->store = store;
     reg->protos = apr_hash_make(p);
     reg->certs = apr_hash_make(p);
+    reg->certs_stamps = apr_hash_make(p);
     reg->can_http = 1;
     reg->can_https = 1;
     reg->proxy_url = proxy_url? apr_pstrdup(p, proxy_url) : NULL;
@@ -107,6 +136,110 @@ struct md_store_t *md_reg_store_get(md_reg_t *reg)
     return reg->store;
 }
 
+/**************************************************************************************************/
+/* memo */
+
+apr_status_t md_reg_memo_create(md_reg_memo_t **pmemo, apr_pool_t *p)
+{
+    md_reg_memo_t *memo;
+    
+    memo = apr_pcalloc(p, sizeof(*memo));
+    memo->p = p;
+    memo->entries = apr_hash_make(p);
+    *pmemo = memo;
+    return APR_SUCCESS;
+}
+
+void md_reg_set_memo(md_reg_t *reg, md_reg_memo_t *memo)
+{
+    reg->memo = memo;
+}
+
+static memo_entry_t *memo_get(md_reg_t *reg, const char *name)
+{
+    return reg->memo? apr_hash_get(reg->memo->entries, name, APR_HASH_KEY_STRING) : NULL;
+}
+
+static memo_entry_t *memo_obtain(md_reg_t *reg, const char *name)
+{
+    memo_entry_t *entry;
+    apr_pool_t *p;
+    
+    if (!reg->memo) return NULL;
+    if (!(entry = memo_get(reg, name))) {
+        if (APR_SUCCESS != apr_pool_create(&p, reg->memo->p)) return NULL;
+        entry = apr_pcalloc(p, sizeof(*entry));
+        entry->p = p;
+        name = apr_pstrdup(p, name);
+        apr_hash_set(reg->memo->entries, name, APR_HASH_KEY_STRING, entry);
+    }
+    return entry;
+}
+
+/* File systems with coarse timestamps give a write in the same tick as our look 
+ * the same modification time. Only trust an unchanged mtime when the file was 
+ * already older than that when we looked. */
+#define MEMO_MTIME_SLACK        apr_time_from_sec(2)
+
+static int memo_mtime_same(apr_time_t mtime, apr_time_t seen_mtime, apr_time_t seen)
+{
+    return mtime && mtime == seen_mtime && mtime + MEMO_MTIME_SLACK < seen;
+}
+
+static void memo_set_md(memo_entry_t *entry, const md_t *md, const char *config_hash,
+                        apr_time_t mtime, apr_pool_t *ptemp)
+{
+    if (entry->md_pool) apr_pool_destroy(entry->md_pool);
+    entry->md_pool = NULL;
+    entry->md = NULL;
+    if (mtime && config_hash && APR_SUCCESS == apr_pool_create(&entry->md_pool, entry->p)) {
+        /* a deep copy, md_clone() shares some parts */
+        entry->md = md_from_json(md_to_json(md, ptemp), entry->md_pool);
+        entry->config_hash = apr_pstrdup(entry->md_pool, config_hash);
+        entry->md_mtime = mtime;
+        entry->md_seen = apr_time_now();
+    }
+}
+
+static void memo_set_pubcert(memo_entry_t *entry, apr_pool_t *cert_pool, 
+                             const md_pubcert_t *pubcert, const char *fname, apr_time_t mtime)
+{
+    if (entry->cert_pool) apr_pool_destroy(entry->cert_pool);
+    entry->cert_pool = cert_pool;
+    entry->pubcert = pubcert;
+    entry->cert_fname = apr_pstrdup(cert_pool, fname);
+    entry->cert_mtime = mtime;
+    entry->cert_seen = apr_time_now();
+}
+
+static void memo_prune(md_reg_t *reg, apr_array_header_t *mds, apr_pool_t *p)
+{
+    apr_hash_t *keep;
+    apr_hash_index_t *hi;
+    const void *key;
+    void *val;
+    memo_entry_t *entry;
+    const char *name;
+    const md_t *md;
+    int i;
+    
+    if (!reg->memo) return;
+    keep = apr_hash_make(p);
+    for (i = 0; i < mds->nelts; ++i) {
+        md = APR_ARRAY_IDX(mds, i, const md_t*);
+        apr_hash_set(keep, md->name, APR_HASH_KEY_STRING, md);
+    }
+    for (hi = apr_hash_first(p, reg->memo->entries); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, NULL, &val);
+        name = key;
+        if (!apr_hash_get(keep, name, APR_HASH_KEY_STRING)) {
+            entry = val;
+            apr_hash_set(reg->memo->entries, name, APR_HASH_KEY_STRING, NULL);
+            apr_pool_destroy(entry->p);
+        }
+    }
+}
+
 /**************************************************************************************************/
 /* checks */
 
@@ -196,40 +329,45 @@ static apr_status_t state_init(md_reg_t *reg, apr_pool_t *p, md_t *md)
 {
     md_state_t state = MD_S_UNKNOWN;
     const md_pubcert_t *pub;
-    const md_cert_t *cert;
-    apr_status_t rv;
+    apr_status_t rv = APR_SUCCESS;
+    int i;
 
     if (md->renew_window == NULL) md->renew_window = reg->renew_window;
     if (md->warn_window == NULL) md->warn_window = reg->warn_window;
 
-    if (APR_SUCCESS == (rv = md_reg_get_pubcert(&pub, reg, md, p))) {
-        cert = APR_ARRAY_IDX(pub->certs, 0, const md_cert_t*);
-        if (!md_is_covered_by_alt_names(md, pub->alt_names)) {
+    /* Complete only when there is a fitting certificate for each key */
+    for (i = 0; i < md_cert_count(md); ++i) {
+        if (APR_SUCCESS == (rv = md_reg_get_pubcert(&pub, reg, md, i, p))) {
+            if (!md_is_covered_by_alt_names(md, pub->alt_names)) {
+                state = MD_S_INCOMPLETE;
+                md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
+                              "md{%s}: incomplete, cert no longer covers all domains, "
+                              "needs sign up for a new certificate", md->name);
+                goto out;
+            }
+            if (!md->must_staple != !pub->meta->must_staple) {
+                state = MD_S_INCOMPLETE;
+                md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
+                              "md{%s}: OCSP Stapling is%s requested, but certificate "
+                              "has it%s enabled. Need to get a new certificate.", md->name,
+                              md->must_staple? "" : " not", 
+                              !md->must_staple? "" : " not");
+                goto out;
+            }
+        }
+        else if (APR_STATUS_IS_ENOENT(rv)) {
             state = MD_S_INCOMPLETE;
+            rv = APR_SUCCESS;
             md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
-                          "md{%s}: incomplete, cert no longer covers all domains, "
-                          "needs sign up for a new certificate", md->name);
+                          "md{%s}: incomplete, credentials not all there", md->name);
             goto out;
         }
-        if (!md->must_staple != !md_cert_must_staple(cert)) {
-            state = MD_S_INCOMPLETE;
-            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
-                          "md{%s}: OCSP Stapling is%s requested, but certificate "
-                          "has it%s enabled. Need to get a new certificate.", md->name,
-                          md->must_staple? "" : " not", 
-                          !md->must_staple? "" : " not");
+        else {
             goto out;
         }
-        
-        state = MD_S_COMPLETE;
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "md{%s}: is complete", md->name);
-    }
-    else if (APR_STATUS_IS_ENOENT(rv)) {
-        state = MD_S_INCOMPLETE;
-        rv = APR_SUCCESS;
-        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, 
-                      "md{%s}: incomplete, credentials not all there", md->name);
     }
+    state = MD_S_COMPLETE;
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "md{%s}: is complete", md->name);
 
 out:    
     if (APR_SUCCESS != rv) {
@@ -465,10 +603,7 @@ static apr_status_t p_md_update(void *baton, apr_pool_t *p, apr_pool_t *ptemp, v
     }
     if (MD_UPD_PKEY_SPEC & fields) {
         md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, ptemp, "update pkey spec: %s", name);
-        nmd->pkey_spec = NULL;
-        if (updates->pkey_spec) {
-            nmd->pkey_spec = apr_pmemdup(p, updates->pkey_spec, sizeof(md_pkey_spec_t));
-        }
+        nmd->pks = md_pkeys_spec_clone(p, updates->pks);
     }
     if (MD_UPD_REQUIRE_HTTPS & fields) {
         md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, ptemp, "update require-https: %s", name);
@@ -527,24 +662,28 @@ static apr_status_t pubcert_load(void *baton, apr_pool_t *p, apr_pool_t *ptemp,
     const md_cert_t *cert;
     md_cert_state_t cert_state;
     md_store_group_t group;
+    int i;
     apr_status_t rv;
     
     ppubcert = va_arg(ap, md_pubcert_t **);
     group = (md_store_group_t)va_arg(ap, int);
     md = va_arg(ap, const md_t *);
+    i = va_arg(ap, int);
     
     if (md->cert_file) {
-        rv = md_chain_fload(&certs, p, md->cert_file);
+        rv = (i == 0)? md_chain_fload(&certs, p, md->cert_file) : APR_ENOENT;
     }
     else {
-        rv = md_pubcert_load(reg->store, group, md->name, &certs, p);
+        rv = md_pubcert_load(reg->store, group, md->name, md_pkeys_spec_get(md->pks, i), 
+                             &certs, p);
     }
     if (APR_SUCCESS != rv) goto leave;
             
     pubcert = apr_pcalloc(p, sizeof(*pubcert));
     pubcert->certs = certs;
     cert = APR_ARRAY_IDX(certs, 0, const md_cert_t *);
-    if (APR_SUCCESS != (rv = md_cert_get_alt_names(&pubcert->alt_names, cert, p))) goto leave;
+    if (APR_SUCCESS != (rv = md_cert_get_meta(&pubcert->meta, cert, p))) goto leave;
+    pubcert->alt_names = pubcert->meta->alt_names;
     switch ((cert_state = md_cert_state_get(cert))) {
         case MD_CERT_VALID:
         case MD_CERT_EXPIRED:
@@ -560,23 +699,145 @@ leave:
     return rv;
 }
 
+/* The key of an MD's certificate in the cache. The primary one goes by the 
+ * MD's name, further ones have their index appended. */
+static const char *cert_key(const md_t *md, int i, apr_pool_t *p)
+{
+    return (i == 0)? md->name : apr_psprintf(p, "%s/%d", md->name, i);
+}
+
+/* Where a cached certificate came from and when it was last modified there.
+ * Only consulted when the store journal cannot tell us about changes. */
+typedef struct {
+    const char *fpath;
+    apr_time_t mtime;
+} cert_stamp_t;
+
+static apr_time_t cert_fmtime(const char *fpath, apr_pool_t *p)
+{
+    apr_finfo_t info;
+    
+    return (APR_SUCCESS == apr_stat(&info, fpath, APR_FINFO_MTIME, p))? info.mtime : 0;
+}
+
+static void certs_set(md_reg_t *reg, const char *key, const md_pubcert_t *pubcert, 
+                      const md_t *md, int i, apr_pool_t *p)
+{
+    cert_stamp_t *stamp;
+    const char *fpath = md->cert_file, *aspect;
+    
+    apr_hash_set(reg->certs, key, APR_HASH_KEY_STRING, pubcert);
+    if (!fpath) {
+        aspect = md_chain_filename(md_pkeys_spec_get(md->pks, i), p);
+        if (APR_SUCCESS != md_store_get_fname(&fpath, reg->store, MD_SG_DOMAINS, 
+                                              md->name, aspect, p)) {
+            apr_hash_set(reg->certs_stamps, key, APR_HASH_KEY_STRING, NULL);
+            return;
+        }
+    }
+    stamp = apr_hash_get(reg->certs_stamps, key, APR_HASH_KEY_STRING);
+    if (!stamp || strcmp(fpath, stamp->fpath)) {
+        stamp = apr_pcalloc(reg->p, sizeof(*stamp));
+        stamp->fpath = apr_pstrdup(reg->p, fpath);
+        apr_hash_set(reg->certs_stamps, apr_pstrdup(reg->p, key), APR_HASH_KEY_STRING, stamp);
+    }
+    stamp->mtime = cert_fmtime(fpath, p);
+}
+
+static void certs_clear(md_reg_t *reg)
+{
+    apr_hash_clear(reg->certs);
+    apr_hash_clear(reg->certs_stamps);
+}
+
+static void certs_drop(md_reg_t *reg, const char *name, apr_pool_t *p)
+{
+    apr_hash_index_t *hi;
+    const void *key;
+    apr_size_t len = strlen(name);
+    
+    apr_hash_set(reg->certs, name, APR_HASH_KEY_STRING, NULL);
+    apr_hash_set(reg->certs_stamps, name, APR_HASH_KEY_STRING, NULL);
+    for (hi = apr_hash_first(p, reg->certs); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, NULL, NULL);
+        if (!strncmp(key, name, len) && '/' == ((const char*)key)[len]) {
+            apr_hash_set(reg->certs_stamps, key, APR_HASH_KEY_STRING, NULL);
+            apr_hash_set(reg->certs, key, APR_HASH_KEY_STRING, NULL);
+        }
+    }
+}
+
+static int certs_invalidate(void *baton, const md_store_change_t *change, apr_pool_t *ptemp)
+{
+    md_reg_t *reg = baton;
+    
+    if (MD_SG_DOMAINS == change->group 
+        && (!change->aspect || md_is_chain_filename(change->aspect))) {
+        if (change->name) {
+            certs_drop(reg, change->name, ptemp);
+        }
+        else {
+            certs_clear(reg);
+        }
+    }
+    return 1;
+}
+
+static void certs_check_mtimes(md_reg_t *reg, apr_pool_t *p)
+{
+    apr_hash_index_t *hi;
+    const void *key;
+    cert_stamp_t *stamp;
+    
+    for (hi = apr_hash_first(p, reg->certs); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, NULL, NULL);
+        stamp = apr_hash_get(reg->certs_stamps, key, APR_HASH_KEY_STRING);
+        if (!stamp || stamp->mtime != cert_fmtime(stamp->fpath, p)) {
+            apr_hash_set(reg->certs_stamps, key, APR_HASH_KEY_STRING, NULL);
+            apr_hash_set(reg->certs, key, APR_HASH_KEY_STRING, NULL);
+        }
+    }
+}
+
+static void certs_sync(md_reg_t *reg, apr_pool_t *p)
+{
+    apr_status_t rv;
+    
+    /* Drop cached certificates that have been changed in the store since we last looked. */
+    rv = md_store_changes(reg->store, p, reg->certs_seq, certs_invalidate, reg, &reg->certs_seq);
+    if (APR_STATUS_IS_EINVAL(rv)) {
+        /* our position is no longer in the journal, start afresh */
+        certs_clear(reg);
+        reg->certs_seq = 0;
+        rv = md_store_changes(reg->store, p, 0, certs_invalidate, reg, &reg->certs_seq);
+    }
+    if (APR_SUCCESS != rv) {
+        /* no usable journal, look at the files themselves */
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, p, 
+                      "no store journal, checking certificate files");
+        certs_check_mtimes(reg, p);
+    }
+}
+
 apr_status_t md_reg_get_pubcert(const md_pubcert_t **ppubcert, md_reg_t *reg, 
-                                const md_t *md, apr_pool_t *p)
+                                const md_t *md, int i, apr_pool_t *p)
 {
     apr_status_t rv = APR_SUCCESS;
     const md_pubcert_t *pubcert;
-    const char *name;
+    const char *key;
 
-    pubcert = apr_hash_get(reg->certs, md->name, (apr_ssize_t)strlen(md->name));
+    if (!reg->domains_frozen) certs_sync(reg, p);
+    key = cert_key(md, i, p);
+    pubcert = apr_hash_get(reg->certs, key, APR_HASH_KEY_STRING);
     if (!pubcert && !reg->domains_frozen) {
-        rv = md_util_pool_vdo(pubcert_load, reg, reg->p, &pubcert, MD_SG_DOMAINS, md, NULL);
+        rv = md_util_pool_vdo(pubcert_load, reg, reg->p, &pubcert, MD_SG_DOMAINS, md, i, NULL);
         if (APR_STATUS_IS_ENOENT(rv)) {
             /* We cache it missing with an empty record */
             pubcert = apr_pcalloc(reg->p, sizeof(*pubcert));
         }
         else if (APR_SUCCESS != rv) goto leave;
-        name = (p != reg->p)? apr_pstrdup(reg->p, md->name) : md->name;
-        apr_hash_set(reg->certs, name, (apr_ssize_t)strlen(name), pubcert);
+        key = apr_pstrdup(reg->p, key);
+        certs_set(reg, key, pubcert, md, i, p);
     }
 leave:
     if (APR_SUCCESS == rv && (!pubcert || !pubcert->certs)) {
@@ -586,52 +847,265 @@ leave:
     return rv;
 }
 
+typedef struct {
+    md_reg_t *reg;
+    const md_t *md;
+    int index;
+    apr_pool_t *p;
+    const md_pubcert_t *pubcert;
+    apr_status_t rv;
+    memo_entry_t *entry;
+    const char *fname;
+    apr_time_t mtime;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *done;
+    int *pending;
+#endif
+} pubcert_task_t;
+
+static void pubcert_task_run(pubcert_task_t *task)
+{
+    task->rv = md_util_pool_vdo(pubcert_load, task->reg, task->p, 
+                                &task->pubcert, MD_SG_DOMAINS, task->md, task->index, NULL);
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC pubcert_task_exec(apr_thread_t *thread, void *data)
+{
+    pubcert_task_t *task = data;
+    
+    (void)thread;
+    pubcert_task_run(task);
+    apr_thread_mutex_lock(task->mutex);
+    if (--(*task->pending) == 0) {
+        apr_thread_cond_signal(task->done);
+    }
+    apr_thread_mutex_unlock(task->mutex);
+    return NULL;
+}
+#endif
+
+apr_status_t md_reg_load_pubcerts(md_reg_t *reg, apr_array_header_t *mds, int max_threads, 
+                                  apr_pool_t *p)
+{
+    apr_array_header_t *tasks;
+    apr_allocator_t *allocator;
+    pubcert_task_t *task;
+    memo_entry_t *entry;
+    apr_time_t mtime;
+    const md_t *md;
+    const char *key, *fname;
+    int i, j, threaded = 0, reused = 0;
+    apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+    apr_thread_pool_t *tpool = NULL;
+    apr_thread_mutex_t *mutex = NULL;
+    apr_thread_cond_t *done = NULL;
+    int pending = 0;
+#endif
+
+    if (reg->domains_frozen) return APR_EACCES;
+    certs_sync(reg, p);
+    
+    /* Tasks get their own pool with its own allocator, created here as pools 
+     * are not thread-safe. Loaded pubcerts remain in there, so it needs to live
+     * as long as the registry, or the memo when we have one. */
+    tasks = apr_array_make(p, mds->nelts, sizeof(pubcert_task_t));
+    for (i = 0; i < mds->nelts; ++i) {
+        md = APR_ARRAY_IDX(mds, i, const md_t*);
+        for (j = 0; j < md_cert_count(md); ++j) {
+            if (apr_hash_get(reg->certs, cert_key(md, j, p), APR_HASH_KEY_STRING)) continue;
+            entry = NULL;
+            fname = NULL;
+            mtime = 0;
+            /* the memo keeps the primary certificate only */
+            if (!md->cert_file && j == 0 && (entry = memo_obtain(reg, md->name))) {
+                fname = md_chain_filename(md_pkeys_spec_get(md->pks, j), p);
+                mtime = md_store_get_modified(reg->store, MD_SG_DOMAINS, md->name, fname, p);
+                if (entry->pubcert && memo_mtime_same(mtime, entry->cert_mtime, entry->cert_seen)
+                    && entry->cert_fname && !strcmp(fname, entry->cert_fname)) {
+                    /* unchanged since a previous registry loaded it */
+                    key = apr_pstrdup(reg->p, md->name);
+                    certs_set(reg, key, entry->pubcert, md, j, p);
+                    ++reused;
+                    continue;
+                }
+            }
+            task = (pubcert_task_t*)apr_array_push(tasks);
+            memset(task, 0, sizeof(*task));
+            task->reg = reg;
+            task->md = md;
+            task->index = j;
+            task->entry = entry;
+            task->fname = fname;
+            task->mtime = mtime;
+            if (!MD_OK(apr_allocator_create(&allocator))) goto leave;
+            if (!MD_OK(apr_pool_create_ex(&task->p, entry? entry->p : reg->p, NULL, allocator))) {
+                apr_allocator_destroy(allocator);
+                goto leave;
+            }
+            apr_allocator_owner_set(allocator, task->p);
+        }
+    }
+    
+#if APR_HAS_THREADS
+    if (max_threads > 1 && tasks->nelts > 1
+        && MD_OK(apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p))
+        && MD_OK(apr_thread_cond_create(&done, p))
+        && MD_OK(apr_thread_pool_create(&tpool, 0, (apr_size_t)max_threads, p))) {
+        apr_thread_mutex_lock(mutex);
+        for (i = 0; i < tasks->nelts; ++i) {
+            task = &APR_ARRAY_IDX(tasks, i, pubcert_task_t);
+            task->mutex = mutex;
+            task->done = done;
+            task->pending = &pending;
+            if (APR_SUCCESS != apr_thread_pool_push(tpool, pubcert_task_exec, task, 
+                                                    APR_THREAD_TASK_PRIORITY_NORMAL, NULL)) {
+                break;
+            }
+            ++pending;
+        }
+        while (pending > 0) {
+            apr_thread_cond_wait(done, mutex);
+        }
+        apr_thread_mutex_unlock(mutex);
+        apr_thread_pool_destroy(tpool);
+        /* tasks that could not be pushed are run below */
+        threaded = i;
+    }
+    rv = APR_SUCCESS;
+#endif
+    for (i = threaded; i < tasks->nelts; ++i) {
+        pubcert_task_run(&APR_ARRAY_IDX(tasks, i, pubcert_task_t));
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "loaded %d pubcerts, %d in parallel, "
+                  "%d unchanged", tasks->nelts, threaded, reused);
+    
+    /* Merge in the order of the MDs, the same as md_reg_get_pubcert() would */
+    for (i = 0; i < tasks->nelts; ++i) {
+        task = &APR_ARRAY_IDX(tasks, i, pubcert_task_t);
+        if (APR_STATUS_IS_ENOENT(task->rv)) {
+            /* We cache it missing with an empty record */
+            task->pubcert = apr_pcalloc(task->p, sizeof(*task->pubcert));
+        }
+        else if (APR_SUCCESS != task->rv) {
+            /* leave it to md_reg_get_pubcert() to try again and report */
+            apr_pool_destroy(task->p);
+            continue;
+        }
+        key = apr_pstrdup(task->p, cert_key(task->md, task->index, p));
+        certs_set(reg, key, task->pubcert, task->md, task->index, p);
+        if (task->entry) {
+            /* the memo takes over the pool, dropping what it had before */
+            memo_set_pubcert(task->entry, task->p, task->pubcert->certs? task->pubcert : NULL, 
+                             task->fname, task->mtime);
+        }
+    }
+    memo_prune(reg, mds, p);
+leave:
+    return rv;
+}
+
 apr_status_t md_reg_get_cred_files(const char **pkeyfile, const char **pcertfile,
                                    md_reg_t *reg, md_store_group_t group, 
-                                   const md_t *md, apr_pool_t *p)
+                                   const md_t *md, int i, apr_pool_t *p)
 {
+    md_pkey_spec_t *spec;
     apr_status_t rv;
     
     if (md->cert_file) {
         /* With fixed files configured, we use those without further checking them ourself */
+        if (i != 0) return APR_ENOENT;
         *pcertfile = md->cert_file;
         *pkeyfile = md->pkey_file;
         return APR_SUCCESS;
     }
-    rv = md_store_get_fname(pkeyfile, reg->store, group, md->name, MD_FN_PRIVKEY, p);
+    spec = md_pkeys_spec_get(md->pks, i);
+    rv = md_store_get_fname(pkeyfile, reg->store, group, md->name, 
+                            md_pkey_filename(spec, p), p);
     if (APR_SUCCESS != rv) return rv;
     if (!md_file_exists(*pkeyfile, p)) return APR_ENOENT;
-    rv = md_store_get_fname(pcertfile, reg->store, group, md->name, MD_FN_PUBCERT, p);
+    rv = md_store_get_fname(pcertfile, reg->store, group, md->name, 
+                            md_chain_filename(spec, p), p);
     if (APR_SUCCESS != rv) return rv;
     if (!md_file_exists(*pcertfile, p)) return APR_ENOENT;
     return APR_SUCCESS;
 }
 
-apr_time_t md_reg_renew_at(md_reg_t *reg, const md_t *md, apr_pool_t *p)
+/* The renewal information stored for the current certificate of the MD, NULL if
+ * there is none or it was retrieved for another certificate. */
+static md_json_t *renewal_info_get(md_reg_t *reg, const md_t *md, 
+                                   const md_pubcert_t *pub, apr_pool_t *p)
+{
+    md_json_t *json;
+    const char *serial;
+    
+    if (APR_SUCCESS != md_store_load_json(reg->store, MD_SG_ARI, md->name, 
+                                          MD_FN_RENEWAL_INFO, &json, p)) {
+        return NULL;
+    }
+    serial = md_json_gets(json, MD_KEY_SERIAL, NULL);
+    if (!serial || !pub->meta->serial || strcmp(serial, pub->meta->serial)) return NULL;
+    return json;
+}
+
+md_json_t *md_reg_get_renewal_info(md_reg_t *reg, const md_t *md, apr_pool_t *p)
 {
     const md_pubcert_t *pub;
-    const md_cert_t *cert;
+    
+    if (APR_SUCCESS != md_reg_get_pubcert(&pub, reg, md, 0, p)) return NULL;
+    return renewal_info_get(reg, md, pub, p);
+}
+
+static apr_time_t cert_renew_at(md_reg_t *reg, const md_t *md, 
+                                const md_pubcert_t *pub, apr_pool_t *p)
+{
     md_timeperiod_t certlife, renewal;
+    md_json_t *info;
+    apr_time_t ca_renew_at;
+    
+    certlife.start = pub->meta->not_before;
+    certlife.end = pub->meta->not_after;
+
+    /* A window suggested by the CA takes precedence over our own. */
+    if ((info = renewal_info_get(reg, md, pub, p))
+        && (ca_renew_at = md_json_get_time(info, MD_KEY_RENEW_AT, NULL))
+        && ca_renew_at < certlife.end) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, 
+                      "md[%s]: renewal at %s as suggested by CA", md->name,
+                      md_json_gets(info, MD_KEY_RENEW_AT, NULL));
+        return ca_renew_at;
+    }
+
+    renewal = md_timeperiod_slice_before_end(&certlife, md->renew_window);
+    if (md_log_is_level(p, MD_LOG_TRACE1)) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, 
+                      "md[%s]: cert-life[%s] renewal[%s]", md->name, 
+                      md_timeperiod_print(p, &certlife),
+                      md_timeperiod_print(p, &renewal));
+    }
+    return renewal.start;
+}
+
+apr_time_t md_reg_renew_at(md_reg_t *reg, const md_t *md, apr_pool_t *p)
+{
+    const md_pubcert_t *pub;
+    apr_time_t renew_at = 0, at;
     apr_status_t rv;
+    int i;
     
     if (md->state == MD_S_INCOMPLETE) return apr_time_now();
-    rv = md_reg_get_pubcert(&pub, reg, md, p);
-    if (APR_STATUS_IS_ENOENT(rv)) return apr_time_now();
-    if (APR_SUCCESS == rv) {
-        cert = APR_ARRAY_IDX(pub->certs, 0, const md_cert_t*);
-        certlife.start = md_cert_get_not_before(cert);
-        certlife.end = md_cert_get_not_after(cert);
-
-        renewal = md_timeperiod_slice_before_end(&certlife, md->renew_window);
-        if (md_log_is_level(p, MD_LOG_TRACE1)) {
-            md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, 
-                          "md[%s]: cert-life[%s] renewal[%s]", md->name, 
-                          md_timeperiod_print(p, &certlife),
-                          md_timeperiod_print(p, &renewal));
+    /* All certificates are renewed together, when the first one is due. */
+    for (i = 0; i < md_cert_count(md); ++i) {
+        rv = md_reg_get_pubcert(&pub, reg, md, i, p);
+        if (APR_STATUS_IS_ENOENT(rv)) return apr_time_now();
+        if (APR_SUCCESS == rv) {
+            at = cert_renew_at(reg, md, pub, p);
+            if (!renew_at || at < renew_at) renew_at = at;
         }
-        return renewal.start;
     }
-    return 0;
+    return renew_at;
 }
 
 int md_reg_should_renew(md_reg_t *reg, const md_t *md, apr_pool_t *p) 
@@ -645,26 +1119,27 @@ int md_reg_should_renew(md_reg_t *reg, const md_t *md, apr_pool_t *p)
 int md_reg_should_warn(md_reg_t *reg, const md_t *md, apr_pool_t *p)
 {
     const md_pubcert_t *pub;
-    const md_cert_t *cert;
     md_timeperiod_t certlife, warn;
     apr_status_t rv;
+    int i;
     
     if (md->state == MD_S_INCOMPLETE) return 0;
-    rv = md_reg_get_pubcert(&pub, reg, md, p);
-    if (APR_STATUS_IS_ENOENT(rv)) return 0;
-    if (APR_SUCCESS == rv) {
-        cert = APR_ARRAY_IDX(pub->certs, 0, const md_cert_t*);
-        certlife.start = md_cert_get_not_before(cert);
-        certlife.end = md_cert_get_not_after(cert);
-
-        warn = md_timeperiod_slice_before_end(&certlife, md->warn_window);
-        if (md_log_is_level(p, MD_LOG_TRACE1)) {
-            md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, 
-                          "md[%s]: cert-life[%s] warn[%s]", md->name, 
-                          md_timeperiod_print(p, &certlife),
-                          md_timeperiod_print(p, &warn));
+    for (i = 0; i < md_cert_count(md); ++i) {
+        rv = md_reg_get_pubcert(&pub, reg, md, i, p);
+        if (APR_STATUS_IS_ENOENT(rv)) return 0;
+        if (APR_SUCCESS == rv) {
+            certlife.start = pub->meta->not_before;
+            certlife.end = pub->meta->not_after;
+
+            warn = md_timeperiod_slice_before_end(&certlife, md->warn_window);
+            if (md_log_is_level(p, MD_LOG_TRACE1)) {
+                md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, 
+                              "md[%s]: cert-life[%s] warn[%s]", md->name, 
+                              md_timeperiod_print(p, &certlife),
+                              md_timeperiod_print(p, &warn));
+            }
+            if (md_timeperiod_has_started(&warn, apr_time_now())) return 1;
         }
-        return md_timeperiod_has_started(&warn, apr_time_now());
     }
     return 0;
 }
@@ -842,7 +1317,10 @@ leave:
  */
 apr_status_t md_reg_sync_finish(md_reg_t *reg, md_t *md, apr_pool_t *p, apr_pool_t *ptemp)
 {
-    md_t *old;
+    md_t *old = NULL;
+    memo_entry_t *entry;
+    const char *config_hash;
+    apr_time_t mtime;
     apr_status_t rv;
     int changed = 1;
     
@@ -852,11 +1330,26 @@ apr_status_t md_reg_sync_finish(md_reg_t *reg, md_t *md, apr_pool_t *p, apr_pool
         md->ca_url = MD_ACME_DEF_URL;
         md->ca_proto = MD_PROTO_ACME; 
     }
+    /* digest what was configured, before anything is taken over from the store */
+    config_hash = md_config_hash(md, p);
     
     rv = state_init(reg, ptemp, md);
     if (APR_SUCCESS != rv) goto leave;
     
-    if (APR_SUCCESS == md_load(reg->store, MD_SG_DOMAINS, md->name, &old, ptemp)) {
+    mtime = md_store_get_modified(reg->store, MD_SG_DOMAINS, md->name, MD_FN_MD, ptemp);
+    entry = memo_obtain(reg, md->name);
+    if (entry && entry->md && memo_mtime_same(mtime, entry->md_mtime, entry->md_seen)
+        && config_hash && !strcmp(config_hash, entry->config_hash)) {
+        /* Same configuration as last time and nobody touched it in the store since */
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, 0, ptemp, "%s: unchanged", md->name);
+        old = entry->md;
+    }
+    else if (APR_SUCCESS != md_load(reg->store, MD_SG_DOMAINS, md->name, &old, ptemp)) {
+        old = NULL;
+    }
+    md->config_hash = config_hash;
+    
+    if (old) {
         /* Some parts are kept from old, lacking new values */
         if ((!md->contacts || apr_is_empty_array(md->contacts)) && old->contacts) {
             md->contacts = md_array_str_clone(p, old->contacts);
@@ -880,18 +1373,25 @@ apr_status_t md_reg_sync_finish(md_reg_t *reg, md_t *md, apr_pool_t *p, apr_pool
             && !MD_VAL_UPDATE(md, old, renew_mode)
             && md_timeslice_eq(md->renew_window, old->renew_window)
             && md_timeslice_eq(md->warn_window, old->warn_window)
-            && md_pkey_spec_eq(md->pkey_spec, old->pkey_spec)
+            && md_pkeys_spec_eq(md->pks, old->pks)
             && !MD_VAL_UPDATE(md, old, require_https)
             && !MD_VAL_UPDATE(md, old, must_staple)
             && md_array_str_eq(md->acme_tls_1_domains, old->acme_tls_1_domains, 0)
             && !MD_VAL_UPDATE(md, old, stapling)
             && md_array_str_eq(md->contacts, old->contacts, 0)
-            && md_array_str_eq(md->ca_challenges, old->ca_challenges, 0)) {
+            && md_array_str_eq(md->ca_challenges, old->ca_challenges, 0)
+            && !MD_SVAL_UPDATE(md, old, config_hash)) {
             changed = 0;
         }
     }
     if (changed) {
         rv = md_save(reg->store, ptemp, MD_SG_DOMAINS, md, 0);
+        if (APR_SUCCESS != rv) goto leave;
+        mtime = md_store_get_modified(reg->store, MD_SG_DOMAINS, md->name, MD_FN_MD, ptemp);
+    }
+    if (entry && (changed || old != entry->md)) {
+        /* remember what is in the store now */
+        memo_set_md(entry, changed? md : old, config_hash, mtime, ptemp);
     }
 leave:
     md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ptemp, "sync MDs, finish done");
@@ -1075,6 +1575,90 @@ apr_status_t md_reg_renew(md_reg_t *reg, const md_t *md, apr_table_t *env,
     return md_util_pool_vdo(run_renew, reg, p, md, env, reset, result, NULL);
 }
 
+/* How long until we ask the CA again, unless it tells us */
+#define MD_RENEWAL_INFO_UPDATE_DEF      apr_time_from_sec(6 * MD_SECS_PER_HOUR)
+#define MD_RENEWAL_INFO_UPDATE_MIN      apr_time_from_sec(MD_SECS_PER_HOUR)
+#define MD_RENEWAL_INFO_UPDATE_MAX      apr_time_from_sec(MD_SECS_PER_DAY)
+
+static apr_status_t run_renewal_info_update(void *baton, apr_pool_t *p, apr_pool_t *ptemp, 
+                                            va_list ap)
+{
+    md_reg_t *reg = baton;
+    const md_t *md;
+    apr_table_t *env;
+    md_result_t *result;
+    const md_pubcert_t *pub;
+    md_proto_driver_t *driver;
+    md_json_t *json, *prev;
+    md_timeperiod_t window, prev_window;
+    const char *explanation = NULL;
+    apr_interval_time_t next_update = 0;
+    apr_time_t now = apr_time_now(), renew_at;
+    apr_status_t rv;
+    
+    (void)p;
+    md = va_arg(ap, const md_t*);
+    env = va_arg(ap, apr_table_t*);
+    result = va_arg(ap, md_result_t*);
+    
+    /* The CA is asked about the primary certificate, the others are renewed with it */
+    if (APR_SUCCESS != (rv = md_reg_get_pubcert(&pub, reg, md, 0, ptemp))) goto leave;
+    prev = renewal_info_get(reg, md, pub, ptemp);
+    if (prev && now < md_json_get_time(prev, MD_KEY_NEXT_UPDATE, NULL)) goto leave;
+    
+    if (APR_SUCCESS != (rv = run_init(reg, ptemp, &driver, md, 1, env, result, NULL))) {
+        goto leave;
+    }
+    rv = APR_ENOTIMPL;
+    if (driver->proto->renewal_info) {
+        rv = driver->proto->renewal_info(driver, APR_ARRAY_IDX(pub->certs, 0, const md_cert_t*),
+                                         &window, &explanation, &next_update, result);
+    }
+    
+    json = md_json_create(ptemp);
+    md_json_sets(pub->meta->serial, json, MD_KEY_SERIAL, NULL);
+    if (APR_SUCCESS == rv) {
+        /* Renew at a random time inside the window, as the CA intends to spread
+         * the load. Keep the time picked as long as the window stays the same. */
+        renew_at = window.start + md_util_random_duration(md_timeperiod_length(&window));
+        if (prev && APR_SUCCESS == md_json_get_timeperiod(&prev_window, prev, MD_KEY_WINDOW, NULL)
+            && apr_time_sec(prev_window.start) == apr_time_sec(window.start)
+            && apr_time_sec(prev_window.end) == apr_time_sec(window.end)
+            && md_json_get_time(prev, MD_KEY_RENEW_AT, NULL)) {
+            renew_at = md_json_get_time(prev, MD_KEY_RENEW_AT, NULL);
+        }
+        md_json_set_timeperiod(&window, json, MD_KEY_WINDOW, NULL);
+        md_json_set_time(renew_at, json, MD_KEY_RENEW_AT, NULL);
+        if (explanation) md_json_sets(explanation, json, MD_KEY_EXPLANATION, NULL);
+        if (next_update <= 0) next_update = MD_RENEWAL_INFO_UPDATE_DEF;
+        if (next_update < MD_RENEWAL_INFO_UPDATE_MIN) next_update = MD_RENEWAL_INFO_UPDATE_MIN;
+        if (next_update > MD_RENEWAL_INFO_UPDATE_MAX) next_update = MD_RENEWAL_INFO_UPDATE_MAX;
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, ptemp, 
+                      "md[%s]: CA suggests renewal in %s, picked %s", md->name,
+                      md_timeperiod_print(ptemp, &window), 
+                      md_json_gets(json, MD_KEY_RENEW_AT, NULL));
+    }
+    else if (APR_STATUS_IS_ENOTIMPL(rv) || APR_STATUS_IS_ENOENT(rv)) {
+        /* not offered by the CA or not for this certificate, do not ask often */
+        next_update = MD_RENEWAL_INFO_UPDATE_MAX;
+    }
+    else {
+        /* keep what we have and try again on the next run */
+        goto leave;
+    }
+    md_json_set_time(now + next_update, json, MD_KEY_NEXT_UPDATE, NULL);
+    rv = md_store_save_json(reg->store, ptemp, MD_SG_ARI, md->name, 
+                            MD_FN_RENEWAL_INFO, json, 0);
+leave:
+    return rv;
+}
+
+apr_status_t md_reg_renewal_info_update(md_reg_t *reg, const md_t *md, apr_table_t *env, 
+                                        md_result_t *result, apr_pool_t *p)
+{
+    return md_util_pool_vdo(run_renewal_info_update, reg, p, md, env, result, NULL);
+}
+
 static apr_status_t run_load_staging(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_list ap)
 {
     md_reg_t *reg = baton;
@@ -1104,7 +1688,7 @@ static apr_status_t run_load_staging(void *baton, apr_pool_t *p, apr_pool_t *pte
     rv = run_init(baton, ptemp, &driver, md, 1, env, result, NULL);
     if (APR_SUCCESS != rv) goto out;
     
-    apr_hash_set(reg->certs, md->name, (apr_ssize_t)strlen(md->name), NULL);
+    certs_drop(reg, md->name, ptemp);
     md_result_activity_setn(result, "preloading staged to tmp");
     rv = driver->proto->preload(driver, MD_SG_TMP, result);
     if (APR_SUCCESS != rv) goto out;
@@ -1149,20 +1733,186 @@ apr_status_t md_reg_freeze_domains(md_reg_t *reg, apr_array_header_t *mds)
     apr_status_t rv = APR_SUCCESS;
     md_t *md;
     const md_pubcert_t *pubcert;
-    int i;
+    int i, j;
     
     assert(!reg->domains_frozen);
     /* prefill the certs cache for all mds */
     for (i = 0; i < mds->nelts; ++i) {
         md = APR_ARRAY_IDX(mds, i, md_t*);
-        rv = md_reg_get_pubcert(&pubcert, reg, md, reg->p);
-        if (APR_SUCCESS != rv && !APR_STATUS_IS_ENOENT(rv)) goto leave;
+        for (j = 0; j < md_cert_count(md); ++j) {
+            rv = md_reg_get_pubcert(&pubcert, reg, md, j, reg->p);
+            if (APR_SUCCESS != rv && !APR_STATUS_IS_ENOENT(rv)) goto leave;
+        }
     }
     reg->domains_frozen = 1;
 leave:
     return rv;
 }
 
+/**************************************************************************************************/
+/* key pool */
+
+#define KEYPOOL_PKEY_PATTERN     "privkey-*.pem"
+
+/* Keys are pooled by what md_pkey_gen() makes of a spec, e.g. "rsa-2048" */
+static const char *keypool_name(const md_pkey_spec_t *spec, apr_pool_t *p)
+{
+    if (!spec || MD_PKEY_TYPE_DEFAULT == spec->type) {
+        return apr_psprintf(p, "rsa-%d", MD_PKEY_RSA_BITS_DEF);
+    }
+    else if (MD_PKEY_TYPE_RSA == spec->type) {
+        return apr_psprintf(p, "rsa-%u", spec->params.rsa.bits);
+    }
+    return md_pkey_spec_name(spec);
+}
+
+typedef struct {
+    apr_pool_t *p;
+    apr_array_header_t *entries;
+} keypool_ctx;
+
+static int keypool_collect(void *baton, const char *name, const char *aspect,
+                           md_store_vtype_t vtype, void *value, apr_pool_t *ptemp)
+{
+    keypool_ctx *ctx = baton;
+    
+    (void)vtype;
+    (void)value;
+    (void)ptemp;
+    APR_ARRAY_PUSH(ctx->entries, const char*) = apr_pstrdup(ctx->p, aspect? aspect : name);
+    return 1;
+}
+
+/* The files in the pool for name. Listed as text, as a single key that can not 
+ * be loaded would end an iteration as MD_SV_PKEY. */
+static apr_array_header_t *keypool_list(md_reg_t *reg, const char *name, apr_pool_t *p)
+{
+    keypool_ctx ctx;
+    
+    ctx.p = p;
+    ctx.entries = apr_array_make(p, 5, sizeof(const char*));
+    md_store_iter(keypool_collect, &ctx, reg->store, p, MD_SG_KEYPOOL, name, 
+                  KEYPOOL_PKEY_PATTERN, MD_SV_TEXT);
+    return ctx.entries;
+}
+
+/* Load a pooled key. One that can not be loaded, e.g. encrypted with the key of
+ * another store, will never be of use and is removed. */
+static apr_status_t keypool_load(md_pkey_t **ppkey, md_reg_t *reg, const char *name, 
+                                 const char *aspect, apr_pool_t *p)
+{
+    apr_status_t rv;
+    
+    rv = md_store_load(reg->store, MD_SG_KEYPOOL, name, aspect, MD_SV_PKEY, (void**)ppkey, p);
+    if (APR_SUCCESS != rv && !APR_STATUS_IS_ENOENT(rv)) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, 
+                      "%s: unable to load key %s from pool, removing it", name, aspect);
+        md_store_remove(reg->store, MD_SG_KEYPOOL, name, aspect, p, 1);
+    }
+    return rv;
+}
+
+apr_status_t md_reg_pkey_get(md_pkey_t **ppkey, md_reg_t *reg, 
+                             md_pkey_spec_t *spec, apr_pool_t *p)
+{
+    const char *name = keypool_name(spec, p), *aspect;
+    apr_array_header_t *aspects;
+    md_pkey_t *pkey;
+    apr_status_t rv;
+    int i;
+    
+    aspects = keypool_list(reg, name, p);
+    for (i = 0; i < aspects->nelts; ++i) {
+        aspect = APR_ARRAY_IDX(aspects, i, const char*);
+        if (APR_SUCCESS != keypool_load(&pkey, reg, name, aspect, p)) continue;
+        /* Others sharing the store may have found the same key, the one
+         * removing it from the pool gets to use it. */
+        rv = md_store_remove(reg->store, MD_SG_KEYPOOL, name, aspect, p, 0);
+        if (APR_SUCCESS == rv) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "%s: took key %s from pool", 
+                          name, aspect);
+            *ppkey = pkey;
+            return APR_SUCCESS;
+        }
+        else if (!APR_STATUS_IS_ENOENT(rv)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "%s: removing key %s from pool", 
+                          name, aspect);
+            break;
+        }
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "%s: no key in pool, generating", name);
+    return md_pkey_gen(ppkey, p, spec);
+}
+
+apr_status_t md_reg_keypool_fill(md_reg_t *reg, md_pkey_spec_t *spec, int depth, 
+                                 int max, int *pgenerated, apr_pool_t *p)
+{
+    const char *name = keypool_name(spec, p), *aspect;
+    apr_array_header_t *aspects;
+    md_pkey_t *pkey;
+    apr_pool_t *ptemp;
+    apr_status_t rv = APR_SUCCESS;
+    int i, count = 0, generated = 0;
+    
+    /* only keys that can be loaded count */
+    aspects = keypool_list(reg, name, p);
+    for (i = 0; i < aspects->nelts && count < depth; ++i) {
+        if (!MD_OK(apr_pool_create(&ptemp, p))) goto leave;
+        if (APR_SUCCESS == keypool_load(&pkey, reg, name, 
+                                        APR_ARRAY_IDX(aspects, i, const char*), ptemp)) {
+            ++count;
+        }
+        apr_pool_destroy(ptemp);
+    }
+    rv = APR_SUCCESS;
+    for (; count < depth && generated < max; ++count) {
+        if (!MD_OK(apr_pool_create(&ptemp, p))) break;
+        aspect = apr_psprintf(ptemp, "privkey-%" APR_TIME_T_FMT ".pem", apr_time_now());
+        if (MD_OK(md_pkey_gen(&pkey, ptemp, spec))) {
+            rv = md_store_save(reg->store, ptemp, MD_SG_KEYPOOL, name, aspect, 
+                               MD_SV_PKEY, pkey, 1);
+        }
+        apr_pool_destroy(ptemp);
+        if (APR_SUCCESS != rv) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "%s: adding key to pool", name);
+            break;
+        }
+        ++generated;
+    }
+    if (generated) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "%s: added %d keys to pool", 
+                      name, generated);
+    }
+leave:
+    if (pgenerated) *pgenerated = generated;
+    return rv;
+}
+
+apr_status_t md_reg_keypool_prune(md_reg_t *reg, apr_array_header_t *specs, apr_pool_t *p)
+{
+    apr_array_header_t *names;
+    keypool_ctx ctx;
+    const char *name;
+    int i, j;
+    
+    ctx.p = p;
+    ctx.entries = apr_array_make(p, 5, sizeof(const char*));
+    md_store_iter_names(keypool_collect, &ctx, reg->store, p, MD_SG_KEYPOOL, "*");
+    names = apr_array_make(p, specs->nelts, sizeof(const char*));
+    for (j = 0; j < specs->nelts; ++j) {
+        APR_ARRAY_PUSH(names, const char*) = 
+            keypool_name(APR_ARRAY_IDX(specs, j, md_pkey_spec_t*), p);
+    }
+    for (i = 0; i < ctx.entries->nelts; ++i) {
+        name = APR_ARRAY_IDX(ctx.entries, i, const char*);
+        if (md_array_str_index(names, name, 0, 1) >= 0) continue;
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, 0, p, "%s: keys no longer used, "
+                      "removing them from the pool", name);
+        md_store_purge(reg->store, p, MD_SG_KEYPOOL, name);
+    }
+    return APR_SUCCESS;
+}
+
 void md_reg_set_renew_window_default(md_reg_t *reg, md_timeslice_t *renew_window)
 {
     *reg->renew_window = *renew_window;
@@ -20,8 +20,11 @@
 struct apr_hash_t;
 struct apr_array_header_t;
 struct md_pkey_t;
+struct md_pkey_spec_t;
 struct md_cert_t;
 struct md_result_t;
+struct md_timeperiod_t;
+struct md_json_t;
 
 #include "md_store.h"
 
@@ -39,6 +42,23 @@ apr_status_t md_reg_create(md_reg_t **preg, apr_pool_t *pm, md_store_t *store,
 
 md_store_t *md_reg_store_get(md_reg_t *reg);
 
+/**
+ * A memo of what a registry learned about its MDs, meant to outlive the registry
+ * so that the next one (e.g. after a graceful restart) can skip re-reading and 
+ * re-parsing store items for MDs whose configuration and store files did not change.
+ */
+typedef struct md_reg_memo_t md_reg_memo_t;
+
+/**
+ * Create an empty memo, living as long as the pool.
+ */
+apr_status_t md_reg_memo_create(md_reg_memo_t **pmemo, apr_pool_t *p);
+
+/**
+ * Have the registry use and update the memo. The memo's pool must outlive the registry.
+ */
+void md_reg_set_memo(md_reg_t *reg, md_reg_memo_t *memo);
+
 apr_status_t md_reg_set_props(md_reg_t *reg, apr_pool_t *p, int can_http, int can_https);
 
 /**
@@ -109,18 +129,20 @@ apr_status_t md_reg_update(md_reg_t *reg, apr_pool_t *p,
 
 /**
  * Get the chain of public certificates of the managed domain md, starting with the cert
- * of the domain and going up the issuers. Returns APR_ENOENT when not available. 
+ * of the domain and going up the issuers. An MD has one certificate for each of its
+ * private key specs, i selects which one, 0 being the primary. 
+ * Returns APR_ENOENT when not available. 
  */
 apr_status_t md_reg_get_pubcert(const md_pubcert_t **ppubcert, md_reg_t *reg, 
-                                const md_t *md, apr_pool_t *p);
+                                const md_t *md, int i, apr_pool_t *p);
 
 /**
- * Get the filenames of private key and pubcert of the MD - if they exist.
+ * Get the filenames of the i-th private key and pubcert of the MD - if they exist.
  * @return APR_ENOENT if one or both do not exist.
  */
 apr_status_t md_reg_get_cred_files(const char **pkeyfile, const char **pcertfile,
                                    md_reg_t *reg, md_store_group_t group, 
-                                   const md_t *md, apr_pool_t *p);
+                                   const md_t *md, int i, apr_pool_t *p);
 
 /**
  * Synchronise the give master mds with the store.
@@ -132,6 +154,14 @@ apr_status_t md_reg_sync_start(md_reg_t *reg, apr_array_header_t *master_mds, ap
  */
 apr_status_t md_reg_sync_finish(md_reg_t *reg, md_t *md, apr_pool_t *p, apr_pool_t *ptemp);
 
+/**
+ * Load the certificates of the given MDs into the registry cache, reading and
+ * parsing them on up to max_threads threads. The results are added in the order
+ * of the MDs, the same as with md_reg_get_pubcert() one by one.
+ */
+apr_status_t md_reg_load_pubcerts(md_reg_t *reg, apr_array_header_t *mds, int max_threads, 
+                                  apr_pool_t *p);
+
 
 apr_status_t md_reg_remove(md_reg_t *reg, apr_pool_t *p, const char *name, int archive);
 
@@ -168,10 +198,27 @@ int md_reg_should_renew(md_reg_t *reg, const md_t *md, apr_pool_t *p);
 
 /**
  * Return the timestamp when the certificate should be renewed. A value of 0
- * indicates that that renewal is not configured (see renew_mode).
+ * indicates that that renewal is not configured (see renew_mode). When the CA
+ * suggested a renewal window for the certificate, a time inside it is returned.
  */
 apr_time_t md_reg_renew_at(md_reg_t *reg, const md_t *md, apr_pool_t *p);
 
+/**
+ * Get the renewal information from the CA stored for the current certificate 
+ * of the MD, NULL if there is none.
+ */
+struct md_json_t *md_reg_get_renewal_info(md_reg_t *reg, const md_t *md, apr_pool_t *p);
+
+/**
+ * Ask the CA when it would like the current certificate of the MD renewed, if
+ * the information stored from the last time is due for an update. The answer
+ * is kept in the store for md_reg_renew_at().
+ * @return APR_SUCCESS when up to date, APR_ENOENT when the MD has no certificate
+ */
+apr_status_t md_reg_renewal_info_update(md_reg_t *reg, const md_t *md, 
+                                        struct apr_table_t *env, 
+                                        struct md_result_t *result, apr_pool_t *p);
+
 /**
  * Return if a warning should be issued about the certificate expiration. 
  * This applies the configured warn window to the remaining lifetime of the 
@@ -212,6 +259,12 @@ typedef apr_status_t md_proto_renew_cb(md_proto_driver_t *driver, struct md_resu
 typedef apr_status_t md_proto_init_preload_cb(md_proto_driver_t *driver, struct md_result_t *result);
 typedef apr_status_t md_proto_preload_cb(md_proto_driver_t *driver, 
                                          md_store_group_t group, struct md_result_t *result);
+typedef apr_status_t md_proto_renewal_info_cb(md_proto_driver_t *driver, 
+                                              const struct md_cert_t *cert,
+                                              struct md_timeperiod_t *pwindow,
+                                              const char **pexplanation,
+                                              apr_interval_time_t *pnext_update,
+                                              struct md_result_t *result);
 
 struct md_proto_t {
     const char *protocol;
@@ -219,6 +272,7 @@ struct md_proto_t {
     md_proto_renew_cb *renew;
     md_proto_init_preload_cb *init_preload;
     md_proto_preload_cb *preload;
+    md_proto_renewal_info_cb *renewal_info;   /* optional */
 };
 
 /**
@@ -233,7 +287,9 @@ apr_status_t md_reg_test_init(md_reg_t *reg, const md_t *md, struct apr_table_t
 /**
  * Obtain new credentials for the given managed domain in STAGING.
  *
- * @return APR_SUCCESS if new credentials have been staged successfully
+ * @return APR_SUCCESS if new credentials have been staged successfully,
+ *         APR_EAGAIN if the CA is not done yet and the renewal is to be resumed
+ *         at result->ready_at
  */
 apr_status_t md_reg_renew(md_reg_t *reg, const md_t *md, 
                           struct apr_table_t *env, int reset, 
@@ -251,6 +307,28 @@ apr_status_t md_reg_renew(md_reg_t *reg, const md_t *md,
 apr_status_t md_reg_load_staging(md_reg_t *reg, const md_t *md, struct apr_table_t *env, 
                                  struct md_result_t *result, apr_pool_t *p);
 
+/**
+ * Get a new private key for the spec. It is taken out of the key pool in the
+ * store, if the pool has one. Otherwise it is generated right away.
+ */
+apr_status_t md_reg_pkey_get(struct md_pkey_t **ppkey, md_reg_t *reg, 
+                             struct md_pkey_spec_t *spec, apr_pool_t *p);
+
+/**
+ * Generate keys for the spec until the key pool holds depth of them.
+ * @param max generate at most this many keys in this call
+ * @param pgenerated on return, the number of keys added, may be NULL
+ */
+apr_status_t md_reg_keypool_fill(md_reg_t *reg, struct md_pkey_spec_t *spec, int depth, 
+                                 int max, int *pgenerated, apr_pool_t *p);
+
+/**
+ * Remove the pooled keys of all specs but the given ones.
+ * @param specs the md_pkey_spec_t* still in use, NULL for the default spec
+ */
+apr_status_t md_reg_keypool_prune(md_reg_t *reg, struct apr_array_header_t *specs, 
+                                  apr_pool_t *p);
+
 void md_reg_set_renew_window_default(md_reg_t *reg, md_timeslice_t *renew_window);
 void md_reg_set_warn_window_default(md_reg_t *reg, md_timeslice_t *warn_window);
 
@@ -19,6 +19,7 @@
 
 struct md_json_t;
 struct md_t;
+struct md_http_stats_t;
 
 typedef struct md_result_t md_result_t;
 
@@ -33,6 +34,8 @@ struct md_result_t {
     const struct md_json_t *subproblems;
     const char *activity;
     apr_time_t ready_at;
+    struct md_http_stats_t *http_stats; /* collects timings of http requests made, or NULL */
+    int polls;                          /* times the CA was asked for progress */
     md_result_change_cb *on_change;
     void *on_change_data;
 };
@@ -26,6 +26,7 @@
 #include "md_json.h"
 #include "md.h"
 #include "md_crypt.h"
+#include "md_http.h"
 #include "md_log.h"
 #include "md_ocsp.h"
 #include "md_store.h"
@@ -39,20 +40,20 @@
 /**************************************************************************************************/
 /* certificate status information */
 
-static apr_status_t status_get_cert_json(md_json_t **pjson, const md_cert_t *cert, apr_pool_t *p)
+static apr_status_t status_get_cert_json(md_json_t **pjson, const md_cert_t *cert, 
+                                         const md_cert_meta_t *meta, apr_pool_t *p)
 {
-    const char *finger;
     apr_status_t rv = APR_SUCCESS;
     md_timeperiod_t valid;
     md_json_t *json;
     
     json = md_json_create(p);
-    valid.start = md_cert_get_not_before(cert);
-    valid.end = md_cert_get_not_after(cert);
+    if (!meta && APR_SUCCESS != (rv = md_cert_get_meta(&meta, cert, p))) goto leave;
+    valid.start = meta->not_before;
+    valid.end = meta->not_after;
     md_json_set_timeperiod(&valid, json, MD_KEY_VALID, NULL);
-    md_json_sets(md_cert_get_serial_number(cert, p), json, MD_KEY_SERIAL, NULL);
-    if (APR_SUCCESS != (rv = md_cert_to_sha256_fingerprint(&finger, cert, p))) goto leave;
-    md_json_sets(finger, json, MD_KEY_SHA256_FINGERPRINT, NULL);
+    md_json_sets(meta->serial, json, MD_KEY_SERIAL, NULL);
+    md_json_sets(meta->sha256_fingerprint, json, MD_KEY_SHA256_FINGERPRINT, NULL);
 
 #if MD_STATUS_WITH_SCTS
     do {
@@ -97,7 +98,8 @@ static apr_status_t get_staging_cert_json(md_json_t **pjson, apr_pool_t *p,
     md_cert_t *cert;
     apr_status_t rv = APR_SUCCESS;
     
-    rv = md_pubcert_load(md_reg_store_get(reg), MD_SG_STAGING, md->name, &certs, p);
+    rv = md_pubcert_load(md_reg_store_get(reg), MD_SG_STAGING, md->name, 
+                         md_pkeys_spec_get(md->pks, 0), &certs, p);
     if (APR_STATUS_IS_ENOENT(rv)) {
         rv = APR_SUCCESS;
         goto leave;
@@ -106,7 +108,7 @@ static apr_status_t get_staging_cert_json(md_json_t **pjson, apr_pool_t *p,
         goto leave;
     }
     cert = APR_ARRAY_IDX(certs, 0, md_cert_t *);
-    rv = status_get_cert_json(&json, cert, p);
+    rv = status_get_cert_json(&json, cert, NULL, p);
 leave:
     *pjson = (APR_SUCCESS == rv)? json : NULL;
     return rv;
@@ -128,7 +130,7 @@ static apr_status_t status_get_md_json(md_json_t **pjson, const md_t *md,
                                        int with_logs, apr_pool_t *p)
 {
     md_json_t *mdj, *jobj, *certj;
-    int renew;
+    int renew, i;
     const md_pubcert_t *pubcert;
     const md_cert_t *cert = NULL;
     md_ocsp_cert_stat_t cert_stat;
@@ -137,9 +139,21 @@ static apr_status_t status_get_md_json(md_json_t **pjson, const md_t *md,
     apr_time_t renew_at;
 
     mdj = md_to_json(md, p);
-    if (APR_SUCCESS == md_reg_get_pubcert(&pubcert, reg, md, p)) {
+    if (md_cert_count(md) > 1) {
+        /* all certificates, by the type of their key */
+        for (i = 0; i < md_cert_count(md); ++i) {
+            if (APR_SUCCESS == md_reg_get_pubcert(&pubcert, reg, md, i, p)
+                && APR_SUCCESS == status_get_cert_json(&certj, 
+                                    APR_ARRAY_IDX(pubcert->certs, 0, const md_cert_t*),
+                                    pubcert->meta, p)) {
+                md_json_setj(certj, mdj, MD_KEY_CERTS, 
+                             md_pkey_spec_name(md_pkeys_spec_get(md->pks, i)), NULL);
+            }
+        }
+    }
+    if (APR_SUCCESS == md_reg_get_pubcert(&pubcert, reg, md, 0, p)) {
         cert = APR_ARRAY_IDX(pubcert->certs, 0, const md_cert_t*);
-        if (APR_SUCCESS != (rv = status_get_cert_json(&certj, cert, p))) goto leave;
+        if (APR_SUCCESS != (rv = status_get_cert_json(&certj, cert, pubcert->meta, p))) goto leave;
         if (md->stapling && ocsp) {
             rv = md_ocsp_get_meta(&cert_stat, &ocsp_valid, ocsp, cert, p, md);
             if (APR_SUCCESS == rv) {
@@ -152,6 +166,9 @@ static apr_status_t status_get_md_json(md_json_t **pjson, const md_t *md,
                 md_json_setj(jobj, certj, MD_KEY_OCSP, MD_KEY_RENEWAL, NULL);
             }
         }
+        if ((jobj = md_reg_get_renewal_info(reg, md, p))) {
+            md_json_setj(jobj, certj, MD_KEY_RENEWAL_INFO, NULL);
+        }
         md_json_setj(certj, mdj, MD_KEY_CERT, NULL);
 
         renew_at = md_reg_renew_at(reg, md, p);
@@ -247,6 +264,8 @@ static void md_job_from_json(md_job_t *job, md_json_t *json, apr_pool_t *p)
         job->last_result = md_result_from_json(md_json_getcj(json, MD_KEY_LAST, NULL), p);
     }
     job->log = md_json_getj(json, MD_KEY_LOG, NULL);
+    job->http_timing = md_json_getj(json, MD_KEY_HTTP_TIMING, NULL);
+    job->polls = (int)md_json_getl(json, MD_KEY_POLLS, NULL);
 }
 
 static void job_to_json(md_json_t *json, const md_job_t *job, 
@@ -275,6 +294,8 @@ static void job_to_json(md_json_t *json, const md_job_t *job,
         md_json_setj(md_result_to_json(result, p), json, MD_KEY_LAST, NULL);
     }
     if (job->log) md_json_setj(job->log, json, MD_KEY_LOG, NULL);
+    if (job->http_timing) md_json_setj(job->http_timing, json, MD_KEY_HTTP_TIMING, NULL);
+    if (job->polls) md_json_setl(job->polls, json, MD_KEY_POLLS, NULL);
 }
 
 apr_status_t md_job_load(md_job_t *job)
@@ -474,6 +495,7 @@ void md_job_start_run(md_job_t *job, md_result_t *result, md_store_t *store)
     job->fatal_error = 0;
     job->last_run = apr_time_now();
     job_observation_start(job, result, store);
+    result->http_stats = md_http_stats_create(result->p);
     md_job_log_append(job, "starting", NULL, NULL);
 }
 
@@ -491,8 +513,21 @@ apr_time_t md_job_delay_on_errors(int err_count)
     return delay;
 }
 
+static void job_http_timing_update(md_job_t *job, md_result_t *result)
+{
+    md_http_stats_t *stats = result->http_stats;
+    
+    result->http_stats = NULL;
+    if (!stats || md_http_stats_count(stats) == 0) return;
+    job->http_timing = md_http_stats_to_json(stats, job->p);
+    md_job_log_append(job, "http-timing", NULL, 
+                      apr_psprintf(job->p, "%d requests", md_http_stats_count(stats)));
+}
+
 void md_job_end_run(md_job_t *job, md_result_t *result)
 {
+    job_http_timing_update(job, result);
+    job->polls += result->polls;
     if (APR_SUCCESS == result->status) {
         job->finished = 1;
         job->valid_from = result->ready_at;
@@ -500,10 +535,19 @@ void md_job_end_run(md_job_t *job, md_result_t *result)
         job->dirty = 1;
         md_job_log_append(job, "finished", NULL, NULL);
     }
+    else if (APR_STATUS_IS_EAGAIN(result->status) && result->ready_at) {
+        /* waiting on the CA, not an error. Resume when asked to. */
+        job->dirty = 1;
+        job->next_run = result->ready_at;
+    }
     else {
         ++job->error_runs;
         job->dirty = 1;
         job->next_run = apr_time_now() + md_job_delay_on_errors(job->error_runs);
+        if (result->ready_at > job->next_run) {
+            /* the CA asked us to stay away for longer */
+            job->next_run = result->ready_at;
+        }
     }
     job_observation_end(job);
 }
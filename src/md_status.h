@@ -65,6 +65,8 @@ struct md_job_t {
     md_json_t *log;        /* array of log objects with minimum fields
                               MD_KEY_WHEN (timestamp) and MD_KEY_TYPE (string) */
     apr_size_t max_log;    /* max number of log entries, new ones replace oldest */
+    md_json_t *http_timing;/* http request timings per endpoint of the last run or NULL */
+    int polls;             /* times the CA was asked for progress, over all runs */
     int dirty;
     struct md_result_t *observing;
     
@@ -24,8 +24,22 @@
 #include <apr_file_io.h>
 #include <apr_fnmatch.h>
 #include <apr_hash.h>
+#include <apr_network_io.h>
 #include <apr_strings.h>
 
+/* getpid for *NIX */
+#if APR_HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+/* getpid for Windows */
+#if APR_HAVE_PROCESS_H
+#include <process.h>
+#endif
+
 #include "md.h"
 #include "md_crypt.h"
 #include "md_log.h"
@@ -56,6 +70,9 @@ static const char *GROUP_NAME[] = {
     "archive",
     "tmp",
     "ocsp",
+    "locks",
+    "ari",
+    "keypool",
     NULL
 };
 
@@ -168,6 +185,91 @@ apr_status_t md_store_rename(md_store_t *store, apr_pool_t *p,
     return store->rename(store, p, group, name, to);
 }
 
+/**************************************************************************************************/
+/* change journal */
+
+static const char *OP_NAME[] = {
+    "save",
+    "remove",
+    "purge",
+    "move",
+    NULL
+};
+
+const char *md_store_op_name(md_store_op_t op)
+{
+    if ((unsigned int)op < sizeof(OP_NAME)/sizeof(OP_NAME[0]) - 1) {
+        return OP_NAME[op];
+    }
+    return "unknown";
+}
+
+apr_status_t md_store_changes(md_store_t *store, apr_pool_t *p, apr_uint64_t since,
+                              md_store_change_cb *cb, void *baton, apr_uint64_t *plast_seq)
+{
+    *plast_seq = since;
+    if (store->changes) {
+        return store->changes(store, p, since, cb, baton, plast_seq);
+    }
+    return APR_ENOTIMPL;
+}
+
+/**************************************************************************************************/
+/* leases */
+
+apr_status_t md_store_lease_acquire(md_store_lease_t **please, md_store_t *store, apr_pool_t *p,
+                                    const char *name, const char *purpose, const char *owner,
+                                    apr_interval_time_t duration)
+{
+    md_store_lease_t *lease;
+    apr_status_t rv = APR_ENOTIMPL;
+    
+    lease = apr_pcalloc(p, sizeof(*lease));
+    lease->name = name;
+    lease->purpose = purpose;
+    lease->owner = owner;
+    if (store->lease) {
+        rv = store->lease(store, p, MD_SL_ACQUIRE, lease, duration);
+    }
+    *please = (APR_SUCCESS == rv || APR_STATUS_IS_EBUSY(rv))? lease : NULL;
+    return rv;
+}
+
+apr_status_t md_store_lease_renew(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease, 
+                                  apr_interval_time_t duration)
+{
+    if (store->lease) {
+        return store->lease(store, p, MD_SL_RENEW, lease, duration);
+    }
+    return APR_ENOTIMPL;
+}
+
+apr_status_t md_store_lease_check(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease)
+{
+    if (store->lease) {
+        return store->lease(store, p, MD_SL_CHECK, lease, 0);
+    }
+    return APR_ENOTIMPL;
+}
+
+apr_status_t md_store_lease_release(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease)
+{
+    if (store->lease) {
+        return store->lease(store, p, MD_SL_RELEASE, lease, 0);
+    }
+    return APR_ENOTIMPL;
+}
+
+const char *md_store_lease_owner(apr_pool_t *p)
+{
+    char hostname[APRMAXHOSTLEN+1];
+    
+    if (APR_SUCCESS != apr_gethostname(hostname, sizeof(hostname), p)) {
+        apr_cpystrn(hostname, "localhost", sizeof(hostname));
+    }
+    return apr_psprintf(p, "%s:%d", hostname, (int)getpid());
+}
+
 /**************************************************************************************************/
 /* convenience */
 
@@ -254,29 +356,73 @@ typedef struct {
     apr_array_header_t *mds;
 } md_load_ctx;
 
+static int is_default_spec(const md_pkey_spec_t *spec)
+{
+    return !spec || MD_PKEY_TYPE_DEFAULT == spec->type || MD_PKEY_TYPE_RSA == spec->type;
+}
+
+const char *md_pkey_filename(const md_pkey_spec_t *spec, apr_pool_t *p)
+{
+    if (is_default_spec(spec)) return MD_FN_PRIVKEY;
+    return apr_psprintf(p, "privkey.%s.pem", md_pkey_spec_name(spec));
+}
+
+const char *md_chain_filename(const md_pkey_spec_t *spec, apr_pool_t *p)
+{
+    if (is_default_spec(spec)) return MD_FN_PUBCERT;
+    return apr_psprintf(p, "pubcert.%s.pem", md_pkey_spec_name(spec));
+}
+
+static int has_prefix_suffix(const char *s, const char *prefix, const char *suffix)
+{
+    apr_size_t slen = strlen(s), plen = strlen(prefix), xlen = strlen(suffix);
+    
+    return slen >= plen + xlen && !strncmp(s, prefix, plen) 
+        && !strcmp(s + slen - xlen, suffix);
+}
+
+int md_is_pkey_filename(const char *aspect)
+{
+    return aspect && (!strcmp(MD_FN_PRIVKEY, aspect) 
+                      || has_prefix_suffix(aspect, "privkey.", ".pem"));
+}
+
+int md_is_chain_filename(const char *aspect)
+{
+    return aspect && (!strcmp(MD_FN_PUBCERT, aspect) 
+                      || has_prefix_suffix(aspect, "pubcert.", ".pem"));
+}
+
 apr_status_t md_pkey_load(md_store_t *store, md_store_group_t group, const char *name, 
-                          md_pkey_t **ppkey, apr_pool_t *p)
+                          const md_pkey_spec_t *spec, md_pkey_t **ppkey, apr_pool_t *p)
 {
-    return md_store_load(store, group, name, MD_FN_PRIVKEY, MD_SV_PKEY, (void**)ppkey, p);
+    return md_store_load(store, group, name, md_pkey_filename(spec, p), 
+                         MD_SV_PKEY, (void**)ppkey, p);
 }
 
-apr_status_t md_pkey_save(md_store_t *store, apr_pool_t *p, md_store_group_t group, const char *name, 
+apr_status_t md_pkey_save(md_store_t *store, apr_pool_t *p, md_store_group_t group, 
+                          const char *name, const md_pkey_spec_t *spec, 
                           struct md_pkey_t *pkey, int create)
 {
-    return md_store_save(store, p, group, name, MD_FN_PRIVKEY, MD_SV_PKEY, pkey, create);
+    return md_store_save(store, p, group, name, md_pkey_filename(spec, p), 
+                         MD_SV_PKEY, pkey, create);
 }
 
 apr_status_t md_pubcert_load(md_store_t *store, md_store_group_t group, const char *name, 
+                             const md_pkey_spec_t *spec,
                              struct apr_array_header_t **ppubcert, apr_pool_t *p)
 {
-    return md_store_load(store, group, name, MD_FN_PUBCERT, MD_SV_CHAIN, (void**)ppubcert, p);
+    return md_store_load(store, group, name, md_chain_filename(spec, p), 
+                         MD_SV_CHAIN, (void**)ppubcert, p);
 }
 
 apr_status_t md_pubcert_save(md_store_t *store, apr_pool_t *p, 
                              md_store_group_t group, const char *name, 
+                             const md_pkey_spec_t *spec,
                              struct apr_array_header_t *pubcert, int create)
 {
-    return md_store_save(store, p, group, name, MD_FN_PUBCERT, MD_SV_CHAIN, pubcert, create);
+    return md_store_save(store, p, group, name, md_chain_filename(spec, p), 
+                         MD_SV_CHAIN, pubcert, create);
 }
 
 typedef struct {
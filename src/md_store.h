@@ -20,6 +20,7 @@
 struct apr_array_header_t;
 struct md_cert_t;
 struct md_pkey_t;
+struct md_pkey_spec_t;
 
 const char *md_store_group_name(unsigned int group);
 
@@ -67,6 +68,9 @@ typedef enum {
     MD_SG_ARCHIVE,      /* Archived live sets of a domain */
     MD_SG_TMP,          /* temporary domain storage */
     MD_SG_OCSP,         /* OCSP stapling related domain data */
+    MD_SG_LOCKS,        /* leases on tasks shared by several servers */
+    MD_SG_ARI,          /* renewal information from the CA on current certificates */
+    MD_SG_KEYPOOL,      /* private keys generated ahead of time, by key spec */
     MD_SG_COUNT,        /* number of storage groups, used in setups */
 } md_store_group_t;
 
@@ -76,6 +80,8 @@ typedef enum {
 #define MD_FN_PUBCERT           "pubcert.pem"
 #define MD_FN_CERT              "cert.pem"
 #define MD_FN_HTTPD_JSON        "httpd.json"
+#define MD_FN_RENEWAL_INFO      "renewal-info.json"
+#define MD_FN_JOURNAL           "journal.log"
 
 #define MD_FN_FALLBACK_PKEY     "fallback-privkey.pem"
 #define MD_FN_FALLBACK_CERT     "fallback-cert.pem"
@@ -197,6 +203,121 @@ apr_status_t md_store_iter_names(md_store_inspect *inspect, void *baton, md_stor
 apr_time_t md_store_get_modified(md_store_t *store, md_store_group_t group,  
                                  const char *name, const char *aspect, apr_pool_t *p);
 
+/**************************************************************************************************/
+/* change journal */
+
+/**
+ * A store may keep an append-only journal of all mutations. Each change
+ * carries a sequence number that is strictly increasing for the lifetime
+ * of the journal. Consumers remember the last sequence number they have
+ * seen and later ask only for the changes since then, instead of re-scanning
+ * the store.
+ */
+typedef enum {
+    MD_SJ_SAVE,         /* value at group/name/aspect was written */
+    MD_SJ_REMOVE,       /* value at group/name/aspect was removed */
+    MD_SJ_PURGE,        /* everything at group/name was removed */
+    MD_SJ_MOVE,         /* group/name was newly populated by a move or rename */
+} md_store_op_t;
+
+const char *md_store_op_name(md_store_op_t op);
+
+typedef struct md_store_change_t md_store_change_t;
+struct md_store_change_t {
+    apr_uint64_t seq;               /* sequence number of the change, > 0 */
+    apr_time_t when;                /* time the change was recorded */
+    md_store_op_t op;               /* kind of change */
+    md_store_group_t group;         /* group affected */
+    const char *name;               /* name affected, NULL for group level */
+    const char *aspect;             /* aspect affected or NULL for all of name */
+};
+
+/**
+ * Callback for changes in the journal. Values allocated from ptemp disappear
+ * after the call returned. If this function returns 0, the iteration is aborted. 
+ */
+typedef int md_store_change_cb(void *baton, const md_store_change_t *change, 
+                               apr_pool_t *ptemp);
+
+/**
+ * Invoke cb, in order, for all changes recorded after sequence number since.
+ * Pass since == 0 to get all changes the journal holds.
+ * @param plast_seq  on return, the sequence number of the last change seen or
+ *                   since, if there were none. The cursor for the next call.
+ * @return APR_ENOTIMPL if the store keeps no journal, APR_EINVAL if since does
+ *         not denote a change in the journal (e.g. the journal was reset)
+ */
+apr_status_t md_store_changes(md_store_t *store, apr_pool_t *p, apr_uint64_t since,
+                              md_store_change_cb *cb, void *baton, apr_uint64_t *plast_seq);
+
+/**************************************************************************************************/
+/* leases */
+
+/**
+ * A lease gives its owner the exclusive right to perform a certain task, e.g.
+ * renewing the certificate of a MD, for a limited time. When several servers
+ * share a store, a lease makes sure only one of them is busy with it. 
+ * 
+ * Each time a lease is acquired, its token increases. An owner that took
+ * too long may find its lease taken over by someone else. Before making 
+ * its results visible, an owner checks that the token is still the current 
+ * one (fencing).
+ */
+typedef struct md_store_lease_t md_store_lease_t;
+struct md_store_lease_t {
+    const char *name;               /* name the lease is on, e.g. the MD name */
+    const char *purpose;            /* the task the lease is for, e.g. "renew" */
+    const char *owner;              /* who holds the lease */
+    apr_uint64_t token;             /* fencing token, increases with every acquisition */
+    apr_time_t expires;             /* when the lease ends, 0 when released */
+};
+
+typedef enum {
+    MD_SL_ACQUIRE,      /* get the lease if nobody else holds it */
+    MD_SL_RENEW,        /* extend a lease still held */
+    MD_SL_CHECK,        /* verify that a lease is still held */
+    MD_SL_RELEASE,      /* give up a lease held */
+} md_store_lease_op_t;
+
+/**
+ * Get a lease on name for purpose, valid for the given duration. An owner may
+ * re-acquire a lease it already holds.
+ * @param please    on success, the lease acquired. On APR_EBUSY, the lease
+ *                  currently held by someone else.
+ * @return APR_EBUSY if another owner holds an unexpired lease, APR_ENOTIMPL
+ *         if the store does not support leases.
+ */
+apr_status_t md_store_lease_acquire(md_store_lease_t **please, md_store_t *store, apr_pool_t *p,
+                                    const char *name, const char *purpose, const char *owner,
+                                    apr_interval_time_t duration);
+
+/**
+ * Extend a lease held for the given duration from now on.
+ * @return APR_EBUSY if the lease is no longer held by its owner.
+ */
+apr_status_t md_store_lease_renew(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease, 
+                                  apr_interval_time_t duration);
+
+/**
+ * Check that the lease is still held, e.g. it has not expired and no one
+ * else has acquired it in the meantime.
+ * @return APR_EBUSY if the lease is no longer held by its owner.
+ */
+apr_status_t md_store_lease_check(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease);
+
+/**
+ * Give up a lease, so that others may acquire it right away. Does nothing
+ * if the lease has been taken over already.
+ */
+apr_status_t md_store_lease_release(md_store_t *store, apr_pool_t *p, md_store_lease_t *lease);
+
+/**
+ * Make an owner identifier for this process, unique among the servers that 
+ * share a store.
+ */
+const char *md_store_lease_owner(apr_pool_t *p);
+
+
 
 
 /**************************************************************************************************/
@@ -218,15 +339,36 @@ apr_status_t md_store_md_iter(md_store_md_inspect *inspect, void *baton, md_stor
                               apr_pool_t *p, md_store_group_t group, const char *pattern);
 
 
-apr_status_t md_pkey_load(md_store_t *store, md_store_group_t group, 
-                          const char *name, struct md_pkey_t **ppkey, apr_pool_t *p);
+/**
+ * The file names for the private key and certificate chain of a key spec. 
+ * RSA (and the default) use MD_FN_PRIVKEY and MD_FN_PUBCERT, other key types
+ * have their name inserted, e.g. "privkey.secp256r1.pem".
+ */
+const char *md_pkey_filename(const struct md_pkey_spec_t *spec, apr_pool_t *p);
+const char *md_chain_filename(const struct md_pkey_spec_t *spec, apr_pool_t *p);
+
+/**
+ * If the aspect is the file name of a private key, for any key spec.
+ */
+int md_is_pkey_filename(const char *aspect);
+/**
+ * If the aspect is the file name of a certificate chain, for any key spec.
+ */
+int md_is_chain_filename(const char *aspect);
+
+apr_status_t md_pkey_load(md_store_t *store, md_store_group_t group, const char *name, 
+                          const struct md_pkey_spec_t *spec, struct md_pkey_t **ppkey, 
+                          apr_pool_t *p);
 apr_status_t md_pkey_save(md_store_t *store, apr_pool_t *p, md_store_group_t group, 
-                          const char *name, struct md_pkey_t *pkey, int create);
+                          const char *name, const struct md_pkey_spec_t *spec, 
+                          struct md_pkey_t *pkey, int create);
 
 apr_status_t md_pubcert_load(md_store_t *store, md_store_group_t group, const char *name, 
+                             const struct md_pkey_spec_t *spec,
                              struct apr_array_header_t **ppubcert, apr_pool_t *p);
 apr_status_t md_pubcert_save(md_store_t *store, apr_pool_t *p, 
                              md_store_group_t group, const char *name, 
+                             const struct md_pkey_spec_t *spec,
                              struct apr_array_header_t *pubcert, int create);
 
 /**************************************************************************************************/
@@ -275,6 +417,13 @@ typedef apr_status_t md_store_remove_nms_cb(md_store_t *store, apr_pool_t *p,
                                             apr_time_t modified, md_store_group_t group, 
                                             const char *name, const char *aspect);
 
+typedef apr_status_t md_store_changes_cb(md_store_t *store, apr_pool_t *p, apr_uint64_t since,
+                                         md_store_change_cb *cb, void *baton, 
+                                         apr_uint64_t *plast_seq);
+
+typedef apr_status_t md_store_lease_cb(md_store_t *store, apr_pool_t *p, md_store_lease_op_t op,
+                                       md_store_lease_t *lease, apr_interval_time_t duration);
+
 struct md_store_t {
     md_store_save_cb *save;
     md_store_load_cb *load;
@@ -288,6 +437,8 @@ struct md_store_t {
     md_store_is_newer_cb *is_newer;
     md_store_get_modified_cb *get_modified;
     md_store_remove_nms_cb *remove_nms;
+    md_store_changes_cb *changes;
+    md_store_lease_cb *lease;
 };
 
 
@@ -25,6 +25,7 @@
 #include <apr_fnmatch.h>
 #include <apr_hash.h>
 #include <apr_strings.h>
+#include <apr_thread_mutex.h>
 
 #include "md.h"
 #include "md_crypt.h"
@@ -48,12 +49,14 @@ typedef struct {
 typedef struct md_store_fs_t md_store_fs_t;
 struct md_store_fs_t {
     md_store_t s;
+    apr_pool_t *p;          /* pool the store lives in */
     
     const char *base;       /* base directory of store */
     perms_t def_perms;
     perms_t group_perms[MD_SG_COUNT];
     md_store_fs_cb *event_cb;
     void *event_baton;
+    apr_thread_mutex_t *journal_mutex; /* file locks do not serialize our threads */
     
     md_data_t key;
     int plain_pkey[MD_SG_COUNT];
@@ -65,6 +68,7 @@ struct md_store_fs_t {
 #define FS_STORE(store)     (md_store_fs_t*)(((char*)store)-offsetof(md_store_fs_t, s))
 #define FS_STORE_JSON       "md_store.json"
 #define FS_STORE_KLEN       48
+#define FS_STORE_JOURNAL    MD_FN_JOURNAL
 
 static apr_status_t fs_load(md_store_t *store, md_store_group_t group, 
                             const char *name, const char *aspect,  
@@ -100,6 +104,10 @@ static int fs_is_newer(md_store_t *store, md_store_group_t group1, md_store_grou
 
 static apr_time_t fs_get_modified(md_store_t *store, md_store_group_t group,  
                                   const char *name, const char *aspect, apr_pool_t *p);
+static apr_status_t fs_changes(md_store_t *store, apr_pool_t *p, apr_uint64_t since,
+                               md_store_change_cb *cb, void *baton, apr_uint64_t *plast_seq);
+static apr_status_t fs_lease(md_store_t *store, apr_pool_t *p, md_store_lease_op_t op,
+                             md_store_lease_t *lease, apr_interval_time_t duration);
 
 static apr_status_t init_store_file(md_store_fs_t *s_fs, const char *fname, 
                                     apr_pool_t *p, apr_pool_t *ptemp)
@@ -279,6 +287,7 @@ apr_status_t md_store_fs_init(md_store_t **pstore, apr_pool_t *p, const char *pa
     apr_status_t rv = APR_SUCCESS;
     
     s_fs = apr_pcalloc(p, sizeof(*s_fs));
+    s_fs->p = p;
 
     s_fs->s.load = fs_load;
     s_fs->s.save = fs_save;
@@ -292,6 +301,8 @@ apr_status_t md_store_fs_init(md_store_t **pstore, apr_pool_t *p, const char *pa
     s_fs->s.is_newer = fs_is_newer;
     s_fs->s.get_modified = fs_get_modified;
     s_fs->s.remove_nms = fs_remove_nms;
+    s_fs->s.changes = fs_changes;
+    s_fs->s.lease = fs_lease;
     
     /* by default, everything is only readable by the current user */ 
     s_fs->def_perms.dir = MD_FPROT_D_UONLY;
@@ -309,9 +320,22 @@ apr_status_t md_store_fs_init(md_store_t **pstore, apr_pool_t *p, const char *pa
     /* OCSP data is readable by all, no secrets involved */ 
     s_fs->group_perms[MD_SG_OCSP].dir = MD_FPROT_D_UALL_WREAD;
     s_fs->group_perms[MD_SG_OCSP].file = MD_FPROT_F_UALL_WREAD;
+    /* leases are taken by the watchdog in httpd child processes */ 
+    s_fs->group_perms[MD_SG_LOCKS].dir = MD_FPROT_D_UALL_WREAD;
+    s_fs->group_perms[MD_SG_LOCKS].file = MD_FPROT_F_UALL_WREAD;
+    /* renewal information is fetched by the watchdog, no secrets involved */ 
+    s_fs->group_perms[MD_SG_ARI].dir = MD_FPROT_D_UALL_WREAD;
+    s_fs->group_perms[MD_SG_ARI].file = MD_FPROT_F_UALL_WREAD;
+    /* the key pool is filled by the watchdog, keys are encrypted as in staging */ 
+    s_fs->group_perms[MD_SG_KEYPOOL].dir = MD_FPROT_D_UALL_WREAD;
+    s_fs->group_perms[MD_SG_KEYPOOL].file = MD_FPROT_F_UALL_WREAD;
 
     s_fs->base = apr_pstrdup(p, path);
     
+    if (APR_SUCCESS != (rv = apr_thread_mutex_create(&s_fs->journal_mutex, 
+                                                     APR_THREAD_MUTEX_DEFAULT, p))) {
+        goto leave;
+    }
     if (APR_STATUS_IS_ENOENT(rv = md_util_is_dir(s_fs->base, p))
         && MD_OK(apr_dir_make_recursive(s_fs->base, s_fs->def_perms.dir, p))) {
         rv = apr_file_perms_set(s_fs->base, MD_FPROT_D_UALL_WREAD);
@@ -323,6 +347,7 @@ apr_status_t md_store_fs_init(md_store_t **pstore, apr_pool_t *p, const char *pa
     if ((APR_SUCCESS != rv) || !MD_OK(md_util_pool_vdo(setup_store_file, s_fs, p, NULL))) {
         md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "init fs store at %s", path);
     }
+leave:
     *pstore = (rv == APR_SUCCESS)? &(s_fs->s) : NULL;
     return rv;
 }
@@ -468,6 +493,282 @@ static apr_status_t pfs_load(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_l
     return rv;
 }
 
+/**************************************************************************************************/
+/* change journal */
+
+/* The journal is a text file at the top of the store. It starts with a header
+ *   #journal <base>
+ * followed by one line per change:
+ *   <seq> <time> <op> <group> <name> <aspect>
+ * where missing names/aspects are written as '-'. The sequence number of a
+ * change is its offset in the file plus base plus 1. This keeps it strictly 
+ * increasing among all processes appending under the file lock and lets readers 
+ * seek directly to the position of the last change they have seen. When the
+ * journal is reset, base advances past all sequence numbers handed out before. */
+
+#define JOURNAL_HEADER      "#journal"
+
+static apr_status_t journal_open(apr_file_t **pf, md_store_fs_t *s_fs, apr_int32_t flags, 
+                                 apr_pool_t *p)
+{
+    const char *fname;
+    apr_status_t rv;
+    
+    if (!MD_OK(md_util_path_merge(&fname, p, s_fs->base, FS_STORE_JOURNAL, NULL))) goto leave;
+    rv = apr_file_open(pf, fname, flags, MD_FPROT_F_UALL_WREAD, p);
+    if (APR_STATUS_IS_ENOENT(rv)
+        && MD_OK(apr_file_open(pf, fname, flags|APR_FOPEN_CREATE, MD_FPROT_F_UALL_WREAD, p))) {
+        /* journal is read by child processes, see md_util_fcreatex() for umask woes */
+        rv = apr_file_perms_set(fname, MD_FPROT_F_UALL_WREAD);
+        if (APR_STATUS_IS_ENOTIMPL(rv)) {
+            rv = APR_SUCCESS;
+        }
+    }
+leave:
+    return rv;
+}
+
+static apr_status_t journal_header_read(apr_uint64_t *pbase, apr_size_t *plen, apr_file_t *f)
+{
+    char buffer[128];
+    apr_status_t rv;
+    
+    if (APR_SUCCESS != (rv = apr_file_gets(buffer, sizeof(buffer), f))) return rv;
+    if (strncmp(JOURNAL_HEADER " ", buffer, sizeof(JOURNAL_HEADER))) return APR_EINVAL;
+    *pbase = (apr_uint64_t)apr_strtoi64(buffer + sizeof(JOURNAL_HEADER), NULL, 10);
+    *plen = strlen(buffer);
+    return APR_SUCCESS;
+}
+
+static apr_status_t journal_header_write(apr_file_t *f, apr_uint64_t base, 
+                                         apr_off_t *poffset, apr_pool_t *p)
+{
+    const char *line;
+    apr_size_t len;
+    apr_status_t rv;
+    
+    line = apr_psprintf(p, JOURNAL_HEADER " %" APR_UINT64_T_FMT "\n", base);
+    len = strlen(line);
+    rv = apr_file_write_full(f, line, len, &len);
+    *poffset = (apr_off_t)len;
+    return rv;
+}
+
+/* Get base and end offset of a journal locked for writing, give it a header if empty. */
+static apr_status_t journal_end(apr_uint64_t *pbase, apr_off_t *poffset, 
+                                apr_file_t *f, apr_pool_t *p)
+{
+    apr_off_t offset = 0;
+    apr_size_t hlen;
+    apr_status_t rv;
+    
+    *pbase = 0;
+    *poffset = 0;
+    if (!MD_OK(apr_file_seek(f, APR_END, poffset))) goto leave;
+    if (*poffset == 0) {
+        rv = journal_header_write(f, 0, poffset, p);
+    }
+    else if (MD_OK(apr_file_seek(f, APR_SET, &offset))) {
+        rv = journal_header_read(pbase, &hlen, f);
+    }
+leave:
+    return rv;
+}
+
+static void journal_append(md_store_fs_t *s_fs, md_store_op_t op, md_store_group_t group, 
+                           const char *name, const char *aspect, apr_pool_t *p)
+{
+    const char *line;
+    apr_file_t *f;
+    apr_uint64_t base;
+    apr_off_t offset;
+    apr_size_t len;
+    apr_status_t rv;
+    
+    apr_thread_mutex_lock(s_fs->journal_mutex);
+    if (!MD_OK(journal_open(&f, s_fs, APR_FOPEN_READ|APR_FOPEN_WRITE|APR_FOPEN_APPEND, p))) {
+        goto unlock;
+    }
+    if (MD_OK(apr_file_lock(f, APR_FLOCK_EXCLUSIVE))) {
+        if (MD_OK(journal_end(&base, &offset, f, p))) {
+            line = apr_psprintf(p, "%" APR_UINT64_T_FMT " %" APR_TIME_T_FMT " %s %s %s %s\n", 
+                                base + (apr_uint64_t)offset + 1, apr_time_now(), 
+                                md_store_op_name(op), md_store_group_name(group), 
+                                name? name : "-", aspect? aspect : "-");
+            len = strlen(line);
+            rv = apr_file_write_full(f, line, len, &len);
+        }
+        apr_file_unlock(f);
+    }
+    apr_file_close(f);
+unlock:
+    apr_thread_mutex_unlock(s_fs->journal_mutex);
+    /* a failing journal must never fail the store operation itself */
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "journal %s %s/%s/%s", 
+                      md_store_op_name(op), md_store_group_name(group), 
+                      name? name : "-", aspect? aspect : "-");
+    }
+}
+
+apr_status_t md_store_fs_journal_reset(md_store_t *store, apr_pool_t *p)
+{
+    md_store_fs_t *s_fs = FS_STORE(store);
+    apr_file_t *f;
+    apr_uint64_t base;
+    apr_off_t end, offset = 0;
+    apr_status_t rv;
+    
+    apr_thread_mutex_lock(s_fs->journal_mutex);
+    if (!MD_OK(journal_open(&f, s_fs, APR_FOPEN_READ|APR_FOPEN_WRITE, p))) goto unlock;
+    if (MD_OK(apr_file_lock(f, APR_FLOCK_EXCLUSIVE))) {
+        if (MD_OK(journal_end(&base, &end, f, p))
+            && MD_OK(apr_file_trunc(f, 0))
+            && MD_OK(apr_file_seek(f, APR_SET, &offset))) {
+            /* all sequence numbers handed out so far lie below the new base */
+            rv = journal_header_write(f, base + (apr_uint64_t)end, &offset, p);
+        }
+        apr_file_unlock(f);
+    }
+    apr_file_close(f);
+unlock:
+    apr_thread_mutex_unlock(s_fs->journal_mutex);
+    if (APR_SUCCESS != rv) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, rv, p, "reset journal in %s", s_fs->base);
+    }
+    return rv;
+}
+
+static apr_status_t journal_parse(md_store_change_t *change, char *line, apr_pool_t *p)
+{
+    char *tok, *last;
+    unsigned int i;
+    
+    (void)p;
+    memset(change, 0, sizeof(*change));
+    if (!(tok = apr_strtok(line, " \r\n", &last))) return APR_EINVAL;
+    change->seq = (apr_uint64_t)apr_strtoi64(tok, NULL, 10);
+    if (!(tok = apr_strtok(NULL, " \r\n", &last))) return APR_EINVAL;
+    change->when = (apr_time_t)apr_strtoi64(tok, NULL, 10);
+    
+    if (!(tok = apr_strtok(NULL, " \r\n", &last))) return APR_EINVAL;
+    for (i = MD_SJ_SAVE; i <= MD_SJ_MOVE; ++i) {
+        if (!strcmp(tok, md_store_op_name((md_store_op_t)i))) break;
+    }
+    if (i > MD_SJ_MOVE) return APR_EINVAL;
+    change->op = (md_store_op_t)i;
+    
+    if (!(tok = apr_strtok(NULL, " \r\n", &last))) return APR_EINVAL;
+    for (i = MD_SG_NONE; i < MD_SG_COUNT; ++i) {
+        if (!strcmp(tok, md_store_group_name(i))) break;
+    }
+    if (i >= MD_SG_COUNT) return APR_EINVAL;
+    change->group = (md_store_group_t)i;
+    
+    if (!(tok = apr_strtok(NULL, " \r\n", &last))) return APR_EINVAL;
+    change->name = strcmp("-", tok)? tok : NULL;
+    if (!(tok = apr_strtok(NULL, " \r\n", &last))) return APR_EINVAL;
+    change->aspect = strcmp("-", tok)? tok : NULL;
+    
+    return (change->seq > 0)? APR_SUCCESS : APR_EINVAL;
+}
+
+static apr_status_t pfs_changes(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_list ap)
+{
+    md_store_fs_t *s_fs = baton;
+    md_store_change_cb *cb;
+    md_store_change_t change;
+    apr_uint64_t since, base, *plast_seq;
+    const char *fname;
+    apr_file_t *f;
+    apr_off_t offset;
+    apr_size_t hlen;
+    apr_pool_t *pline;
+    void *cb_baton;
+    char buffer[4 * 1024];
+    apr_status_t rv;
+    
+    (void)p;
+    since = va_arg(ap, apr_uint64_t);
+    cb = va_arg(ap, md_store_change_cb *);
+    cb_baton = va_arg(ap, void *);
+    plast_seq = va_arg(ap, apr_uint64_t *);
+    
+    if (!MD_OK(md_util_path_merge(&fname, ptemp, s_fs->base, FS_STORE_JOURNAL, NULL))) goto leave;
+    rv = apr_file_open(&f, fname, APR_FOPEN_READ|APR_FOPEN_BUFFERED, 0, ptemp);
+    if (APR_STATUS_IS_ENOENT(rv)) {
+        /* no changes recorded so far, but we know that */
+        rv = (since > 0)? APR_EINVAL : APR_SUCCESS;
+        goto leave;
+    }
+    else if (APR_SUCCESS != rv) goto leave;
+    
+    apr_pool_create(&pline, ptemp);
+    if (!MD_OK(apr_file_lock(f, APR_FLOCK_SHARED))) goto close;
+    
+    rv = journal_header_read(&base, &hlen, f);
+    if (APR_STATUS_IS_EOF(rv)) {
+        /* created, but nothing written yet */
+        rv = (since > 0)? APR_EINVAL : APR_SUCCESS;
+        goto unlock;
+    }
+    else if (APR_SUCCESS != rv) goto unlock;
+    
+    if (since > 0) {
+        /* position on the last change seen, it needs to be there */
+        if (since <= base + hlen) {
+            /* seen before the journal was reset */
+            rv = APR_EINVAL;
+            goto unlock;
+        }
+        offset = (apr_off_t)(since - base - 1);
+        if (!MD_OK(apr_file_seek(f, APR_SET, &offset))
+            || !MD_OK(apr_file_gets(buffer, sizeof(buffer), f))
+            || !MD_OK(journal_parse(&change, buffer, pline))) {
+            rv = APR_EINVAL;
+            goto unlock;
+        }
+        if (change.seq != since) {
+            rv = APR_EINVAL;
+            goto unlock;
+        }
+    }
+    
+    while (APR_SUCCESS == (rv = apr_file_gets(buffer, sizeof(buffer), f))) {
+        apr_pool_clear(pline);
+        if (APR_SUCCESS != journal_parse(&change, buffer, pline)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, ptemp, 
+                          "journal %s: skipping unparsable line after %" APR_UINT64_T_FMT, 
+                          fname, *plast_seq);
+            continue;
+        }
+        *plast_seq = change.seq;
+        if (!cb(cb_baton, &change, pline)) {
+            break;
+        }
+    }
+    if (APR_STATUS_IS_EOF(rv)) {
+        rv = APR_SUCCESS;
+    }
+unlock:
+    apr_file_unlock(f);
+close:
+    apr_file_close(f);
+    apr_pool_destroy(pline);
+leave:
+    return rv;
+}
+
+static apr_status_t fs_changes(md_store_t *store, apr_pool_t *p, apr_uint64_t since,
+                               md_store_change_cb *cb, void *baton, apr_uint64_t *plast_seq)
+{
+    md_store_fs_t *s_fs = FS_STORE(store);
+    return md_util_pool_vdo(pfs_changes, s_fs, p, since, cb, baton, plast_seq, NULL);
+}
+
+/**************************************************************************************************/
+/* events */
+
 static apr_status_t dispatch(md_store_fs_t *s_fs, md_store_fs_ev_t ev, unsigned int group, 
                              const char *fname, apr_filetype_e ftype, apr_pool_t *p)
 {
@@ -641,6 +942,7 @@ static apr_status_t pfs_save(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_l
         }
         if (APR_SUCCESS == rv) {
             rv = dispatch(s_fs, MD_S_FS_EV_CREATED, group, fpath, APR_REG, p);
+            journal_append(s_fs, MD_SJ_SAVE, group, name, aspect, ptemp);
         }
     }
     return rv;
@@ -676,7 +978,10 @@ static apr_status_t pfs_remove(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va
         }
     
         rv = apr_file_remove(fpath, ptemp);
-        if (APR_ENOENT == rv && force) {
+        if (APR_SUCCESS == rv) {
+            journal_append(s_fs, MD_SJ_REMOVE, group, name, aspect, ptemp);
+        }
+        else if (APR_ENOENT == rv && force) {
             rv = APR_SUCCESS;
         }
     }
@@ -724,6 +1029,9 @@ static apr_status_t pfs_purge(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_
     if (MD_OK(md_util_path_merge(&dir, ptemp, s_fs->base, groupname, name, NULL))) {
         /* Remove all files in dir, there should be no sub-dirs */
         rv = md_util_rm_recursive(dir, ptemp, 1);
+        if (APR_SUCCESS == rv) {
+            journal_append(s_fs, MD_SJ_PURGE, group, name, NULL, ptemp);
+        }
     }
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, rv, ptemp, "purge %s/%s (%s)", groupname, name, dir);
     return APR_SUCCESS;
@@ -860,7 +1168,9 @@ static apr_status_t remove_nms_file(void *baton, apr_pool_t *p, apr_pool_t *ptem
     if (inf.mtime >= ctx->ts) goto leave;
 
     md_log_perror(MD_LOG_MARK, MD_LOG_TRACE3, 0, ptemp, "remove_nms file: %s/%s", dir, name);
-    rv = apr_file_remove(fname, ptemp);
+    if (APR_SUCCESS == (rv = apr_file_remove(fname, ptemp))) {
+        journal_append(ctx->s_fs, MD_SJ_REMOVE, ctx->group, ctx->dirname, name, ptemp);
+    }
 
 leave:
     return rv;
@@ -1008,6 +1318,10 @@ static apr_status_t pfs_move(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_l
             apr_file_rename(narch_dir, to_dir, ptemp);
             goto out;
         }
+        journal_append(s_fs, MD_SJ_MOVE, MD_SG_ARCHIVE, 
+                       apr_filepath_name_get(narch_dir), NULL, ptemp);
+        journal_append(s_fs, MD_SJ_PURGE, from, name, NULL, ptemp);
+        journal_append(s_fs, MD_SJ_MOVE, to, name, NULL, ptemp);
         if (MD_OK(dispatch(s_fs, MD_S_FS_EV_MOVED, to, to_dir, APR_DIR, ptemp))) {
             rv = dispatch(s_fs, MD_S_FS_EV_MOVED, MD_SG_ARCHIVE, narch_dir, APR_DIR, ptemp);
         }
@@ -1018,6 +1332,8 @@ static apr_status_t pfs_move(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_l
                           from_dir, to_dir);
             goto out;
         }
+        journal_append(s_fs, MD_SJ_PURGE, from, name, NULL, ptemp);
+        journal_append(s_fs, MD_SJ_MOVE, to, name, NULL, ptemp);
     }
     else {
         md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, ptemp, "target is no dir: %s", to_dir);
@@ -1060,6 +1376,8 @@ static apr_status_t pfs_rename(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va
                       from_dir, to_dir);
         goto out;
     }
+    journal_append(s_fs, MD_SJ_PURGE, group, from, NULL, ptemp);
+    journal_append(s_fs, MD_SJ_MOVE, group, to, NULL, ptemp);
 out:
     return rv;
 }
@@ -1070,3 +1388,493 @@ static apr_status_t fs_rename(md_store_t *store, apr_pool_t *p,
     md_store_fs_t *s_fs = FS_STORE(store);
     return md_util_pool_vdo(pfs_rename, s_fs, p, group, from, to, NULL);
 }
+
+/**************************************************************************************************/
+/* leases */
+
+/* A lease is a small JSON file LOCKS/<name>/<purpose>.lease with owner, token and
+ * expiry. It is read and rewritten while holding a lock on the file itself. 
+ * Those are fcntl() locks on most platforms, which also work on NFS. The file 
+ * is never removed, so the token keeps increasing for all who share the store. */
+
+#define FS_LEASE_MAX_LEN    (16 * 1024)
+
+static apr_status_t lease_read(md_json_t **pjson, int *pcreated, apr_file_t *f, apr_pool_t *p)
+{
+    apr_finfo_t info;
+    char *buffer;
+    apr_size_t len;
+    apr_status_t rv;
+    
+    *pjson = NULL;
+    *pcreated = 0;
+    if (!MD_OK(apr_file_info_get(&info, APR_FINFO_SIZE, f))) goto leave;
+    if (info.size <= 0) {
+        /* new lease file */
+        *pjson = md_json_create(p);
+        *pcreated = 1;
+        goto leave;
+    }
+    if (info.size > FS_LEASE_MAX_LEN) {
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    len = (apr_size_t)info.size;
+    buffer = apr_palloc(p, len);
+    if (MD_OK(apr_file_read_full(f, buffer, len, &len))) {
+        rv = md_json_readd(pjson, p, buffer, len);
+    }
+leave:
+    return rv;
+}
+
+static apr_status_t lease_write(md_json_t *json, apr_file_t *f, apr_pool_t *p)
+{
+    const char *data;
+    apr_off_t offset = 0;
+    apr_size_t len;
+    apr_status_t rv;
+    
+    data = md_json_writep(json, p, MD_JSON_FMT_INDENT);
+    if (!data) return APR_EINVAL;
+    len = strlen(data);
+    if (MD_OK(apr_file_trunc(f, 0)) 
+        && MD_OK(apr_file_seek(f, APR_SET, &offset))) {
+        rv = apr_file_write_full(f, data, len, &len);
+    }
+    return rv;
+}
+
+static apr_status_t pfs_lease(void *baton, apr_pool_t *p, apr_pool_t *ptemp, va_list ap)
+{
+    md_store_fs_t *s_fs = baton;
+    md_store_lease_t *lease;
+    md_store_lease_op_t op;
+    apr_interval_time_t duration;
+    const char *dir, *fpath, *owner;
+    md_json_t *json;
+    apr_file_t *f;
+    apr_uint64_t token;
+    apr_time_t expires, now;
+    int held, created;
+    apr_status_t rv;
+    
+    op = (md_store_lease_op_t)va_arg(ap, int);
+    lease = va_arg(ap, md_store_lease_t*);
+    duration = va_arg(ap, apr_interval_time_t);
+    
+    if (!MD_OK(mk_group_dir(&dir, s_fs, MD_SG_LOCKS, lease->name, ptemp))
+        || !MD_OK(md_util_path_merge(&fpath, ptemp, dir, 
+                                     apr_pstrcat(ptemp, lease->purpose, ".lease", NULL), NULL))
+        || !MD_OK(apr_file_open(&f, fpath, APR_FOPEN_READ|APR_FOPEN_WRITE|APR_FOPEN_CREATE, 
+                                gperms(s_fs, MD_SG_LOCKS)->file, ptemp))) {
+        goto leave;
+    }
+    if (!MD_OK(apr_file_lock(f, APR_FLOCK_EXCLUSIVE))) goto close;
+    if (!MD_OK(lease_read(&json, &created, f, ptemp))) goto unlock;
+    
+    now = apr_time_now();
+    owner = md_json_gets(json, MD_KEY_OWNER, NULL);
+    token = (apr_uint64_t)md_json_getl(json, MD_KEY_TOKEN, NULL);
+    expires = md_json_get_time(json, MD_KEY_EXPIRES, NULL);
+    /* still held by the one asking? */
+    held = (owner && !strcmp(owner, lease->owner) && token == lease->token && expires > now);
+    
+    switch (op) {
+        case MD_SL_ACQUIRE:
+            if (expires > now && owner && strcmp(owner, lease->owner)) {
+                /* someone else has it, tell the caller who and for how long */
+                lease->owner = apr_pstrdup(p, owner);
+                lease->token = token;
+                lease->expires = expires;
+                rv = APR_EBUSY;
+                goto unlock;
+            }
+            lease->token = token + 1;
+            lease->expires = now + duration;
+            break;
+        case MD_SL_RENEW:
+            if (!held) {
+                rv = APR_EBUSY;
+                goto unlock;
+            }
+            lease->expires = now + duration;
+            break;
+        case MD_SL_CHECK:
+            rv = held? APR_SUCCESS : APR_EBUSY;
+            goto unlock;
+        case MD_SL_RELEASE:
+            if (!held) {
+                /* expired or taken over already, nothing to give up */
+                rv = APR_SUCCESS;
+                goto unlock;
+            }
+            lease->expires = 0;
+            break;
+        default:
+            rv = APR_EINVAL;
+            goto unlock;
+    }
+    
+    json = md_json_create(ptemp);
+    md_json_sets(lease->owner, json, MD_KEY_OWNER, NULL);
+    md_json_setl((long)lease->token, json, MD_KEY_TOKEN, NULL);
+    if (lease->expires > 0) {
+        md_json_set_time(lease->expires, json, MD_KEY_EXPIRES, NULL);
+    }
+    if (MD_OK(lease_write(json, f, ptemp)) && created) {
+        rv = dispatch(s_fs, MD_S_FS_EV_CREATED, MD_SG_LOCKS, fpath, APR_REG, ptemp);
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE1, rv, ptemp, "lease %s/%s: token %" 
+                  APR_UINT64_T_FMT " %s by %s", lease->name, lease->purpose, lease->token, 
+                  (lease->expires > 0)? "held" : "released", lease->owner);
+unlock:
+    apr_file_unlock(f);
+close:
+    apr_file_close(f);
+leave:
+    return rv;
+}
+
+static apr_status_t fs_lease(md_store_t *store, apr_pool_t *p, md_store_lease_op_t op,
+                             md_store_lease_t *lease, apr_interval_time_t duration)
+{
+    md_store_fs_t *s_fs = FS_STORE(store);
+    
+    if (!lease->name || !lease->purpose || !lease->owner) return APR_EINVAL;
+    return md_util_pool_vdo(pfs_lease, s_fs, p, (int)op, lease, duration, NULL);
+}
+
+/**************************************************************************************************/
+/* export/import */
+
+/* An archive is a stream of entries, each a text header line followed by the
+ * raw file content and a newline:
+ *   md-store-archive <version>
+ *   F <group> <name> <aspect> <length> <sha256-hex>
+ *   <length bytes>
+ *   ...
+ *   E <number of entries>
+ * The store file with the key for encrypted private keys is always the first
+ * entry. Entries are checked against their digest before they are written. */
+ 
+#define FS_ARCH_MAGIC       "md-store-archive"
+#define FS_ARCH_VERSION     1
+#define FS_ARCH_MAX_ENTRY   (1024 * 1024)
+
+typedef struct {
+    md_store_fs_t *s_fs;
+    apr_file_t *f;
+    md_store_group_t group;
+    int count;
+} arch_ctx;
+
+static apr_status_t read_fdata(md_data_t *data, const char *fpath, apr_pool_t *p)
+{
+    apr_file_t *f;
+    apr_finfo_t info;
+    char *buffer;
+    apr_status_t rv;
+    
+    if (   MD_OK(apr_stat(&info, fpath, APR_FINFO_SIZE, p))
+        && MD_OK(apr_file_open(&f, fpath, APR_FOPEN_READ|APR_FOPEN_BINARY, 0, p))) {
+        data->len = (apr_size_t)info.size;
+        buffer = apr_pcalloc(p, data->len + 1);
+        rv = apr_file_read_full(f, buffer, data->len, &data->len);
+        data->data = buffer;
+        apr_file_close(f);
+    }
+    return rv;
+}
+
+static apr_status_t arch_write_entry(arch_ctx *ctx, md_store_group_t group, const char *name, 
+                                     const char *aspect, const char *fpath, apr_pool_t *p)
+{
+    md_data_t data;
+    const char *hex, *header;
+    apr_size_t len;
+    apr_status_t rv;
+    
+    if (   MD_OK(read_fdata(&data, fpath, p))
+        && MD_OK(md_crypt_sha256_digest_hex(&hex, p, &data))) {
+        header = apr_psprintf(p, "F %s %s %s %" APR_SIZE_T_FMT " %s\n", 
+                              md_store_group_name(group), name? name : "-", aspect, 
+                              data.len, hex);
+        len = strlen(header);
+        if (   MD_OK(apr_file_write_full(ctx->f, header, len, &len))
+            && MD_OK(apr_file_write_full(ctx->f, data.data, data.len, &len))) {
+            len = 1;
+            rv = apr_file_write_full(ctx->f, "\n", len, &len);
+            ++ctx->count;
+        }
+    }
+    md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, rv, p, "export %s/%s/%s", 
+                  md_store_group_name(group), name? name : "-", aspect);
+    return rv;
+}
+
+static apr_status_t exp_file(void *baton, apr_pool_t *p, apr_pool_t *ptemp, 
+                             const char *dir, const char *name, apr_filetype_e ftype)
+{
+    arch_ctx *ctx = baton;
+    const char *fpath;
+    apr_pool_t *pentry;
+    apr_size_t nlen;
+    apr_status_t rv;
+    
+    (void)p;
+    nlen = strlen(name);
+    if (APR_REG != ftype || (nlen > 4 && !strcmp(".tmp", name + nlen - 4))) {
+        return APR_SUCCESS;
+    }
+    apr_pool_create(&pentry, ptemp);
+    if (MD_OK(md_util_path_merge(&fpath, pentry, dir, name, NULL))) {
+        rv = arch_write_entry(ctx, ctx->group, apr_filepath_name_get(dir), name, fpath, pentry);
+    }
+    apr_pool_destroy(pentry);
+    return rv;
+}
+
+apr_status_t md_store_fs_export(md_store_t *store, apr_file_t *out, 
+                                apr_array_header_t *groups, const char *pattern, 
+                                int *pcount, apr_pool_t *p)
+{
+    md_store_fs_t *s_fs = FS_STORE(store);
+    arch_ctx ctx;
+    const char *fpath, *line;
+    apr_size_t len;
+    int i;
+    apr_status_t rv;
+    
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.s_fs = s_fs;
+    ctx.f = out;
+    if (!pattern) pattern = "*";
+    
+    line = apr_psprintf(p, "%s %d\n", FS_ARCH_MAGIC, FS_ARCH_VERSION);
+    len = strlen(line);
+    if (   !MD_OK(apr_file_write_full(out, line, len, &len))
+        || !MD_OK(md_util_path_merge(&fpath, p, s_fs->base, FS_STORE_JSON, NULL))
+        || !MD_OK(arch_write_entry(&ctx, MD_SG_NONE, NULL, FS_STORE_JSON, fpath, p))) {
+        goto leave;
+    }
+    
+    for (i = 0; i < groups->nelts; ++i) {
+        ctx.group = (md_store_group_t)APR_ARRAY_IDX(groups, i, int);
+        if (MD_SG_NONE == ctx.group) continue;
+        rv = md_util_files_do(exp_file, &ctx, p, s_fs->base, 
+                              md_store_group_name(ctx.group), pattern, "*", NULL);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            rv = APR_SUCCESS;
+        }
+        else if (APR_SUCCESS != rv) {
+            goto leave;
+        }
+    }
+    
+    line = apr_psprintf(p, "E %d\n", ctx.count);
+    len = strlen(line);
+    if (MD_OK(apr_file_write_full(out, line, len, &len))) {
+        rv = apr_file_flush(out);
+    }
+leave:
+    if (pcount) *pcount = ctx.count;
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "exported %d entries from store %s", 
+                  ctx.count, s_fs->base);
+    return rv;
+}
+
+static int is_safe_segment(const char *s)
+{
+    return s && *s && strcmp(".", s) && strcmp("..", s) 
+        && !strchr(s, '/') && !strchr(s, '\\');
+}
+
+static int is_pkey_aspect(const char *aspect)
+{
+    return md_is_pkey_filename(aspect) || !strcmp(MD_FN_FALLBACK_PKEY, aspect);
+}
+
+static apr_status_t write_data(void *baton, struct apr_file_t *f, apr_pool_t *p)
+{
+    md_data_t *data = baton;
+    apr_size_t len = data->len;
+    
+    (void)p;
+    return apr_file_write_full(f, data->data, len, &len);
+}
+
+static apr_status_t has_entries(void *baton, apr_pool_t *p, apr_pool_t *ptemp, 
+                                const char *dir, const char *name, apr_filetype_e ftype)
+{
+    (void)baton; (void)p; (void)ptemp; (void)dir; (void)name; (void)ftype;
+    return APR_EEXIST;
+}
+
+static apr_status_t imp_store_json(md_store_fs_t *s_fs, const md_data_t *data, 
+                                   int force, apr_pool_t *p)
+{
+    md_json_t *json;
+    const char *key64, *fpath;
+    md_data_t key;
+    md_store_group_t g;
+    apr_status_t rv;
+    
+    if (!MD_OK(md_json_readd(&json, p, data->data, data->len))) goto leave;
+    if (md_json_getn(json, MD_KEY_STORE, MD_KEY_VERSION, NULL) > MD_STORE_VERSION) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: store version too new");
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    key64 = md_json_gets(json, MD_KEY_KEY, NULL);
+    if (!key64 || md_util_base64url_decode(&key, key64, p) != FS_STORE_KLEN) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: store key missing or invalid");
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    if (key.len == s_fs->key.len && !memcmp(key.data, s_fs->key.data, key.len)) {
+        /* same origin, nothing to do */
+        goto leave;
+    }
+    
+    /* Encrypted keys in the target store become unreadable with another store key */
+    for (g = MD_SG_ACCOUNTS; g < MD_SG_COUNT && !force; ++g) {
+        rv = md_util_files_do(has_entries, s_fs, p, s_fs->base, md_store_group_name(g), "*", NULL);
+        if (APR_STATUS_IS_EEXIST(rv)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: archive comes from another "
+                          "store and %s is not empty. Import into an empty store or "
+                          "force it, which makes existing encrypted keys unreadable.", s_fs->base);
+            goto leave;
+        }
+    }
+    
+    if (MD_OK(md_util_path_merge(&fpath, p, s_fs->base, FS_STORE_JSON, NULL))
+        && MD_OK(md_util_freplace(fpath, MD_FPROT_F_UONLY, p, write_data, (void*)data))) {
+        md_data_assign_pcopy(&s_fs->key, &key, s_fs->p);
+    }
+leave:
+    return rv;
+}
+
+static apr_status_t imp_entry(md_store_fs_t *s_fs, md_store_group_t group, const char *name, 
+                              const char *aspect, md_data_t *data, apr_pool_t *p)
+{
+    const char *gdir, *dir, *fpath;
+    const perms_t *perms;
+    apr_fileperms_t fperms;
+    apr_status_t rv;
+    
+    perms = gperms(s_fs, group);
+    fperms = (s_fs->plain_pkey[group] && is_pkey_aspect(aspect))? MD_FPROT_F_UONLY : perms->file;
+    if (   MD_OK(mk_group_dir(&gdir, s_fs, group, NULL, p)) 
+        && MD_OK(mk_group_dir(&dir, s_fs, group, name, p))
+        && MD_OK(md_util_path_merge(&fpath, p, dir, aspect, NULL))
+        && MD_OK(md_util_freplace(fpath, fperms, p, write_data, data))
+        && MD_OK(dispatch(s_fs, MD_S_FS_EV_CREATED, group, fpath, APR_REG, p))) {
+        journal_append(s_fs, MD_SJ_SAVE, group, name, aspect, p);
+    }
+    return rv;
+}
+
+apr_status_t md_store_fs_import(md_store_t *store, apr_file_t *in, int force, 
+                                int *pcount, apr_pool_t *p)
+{
+    md_store_fs_t *s_fs = FS_STORE(store);
+    apr_pool_t *pentry;
+    md_store_group_t group;
+    char line[1024], *tok, *last, *gname, *name, *aspect, *hex, *buffer;
+    const char *digest;
+    md_data_t data;
+    apr_int64_t len;
+    apr_size_t nread;
+    int count = 0;
+    apr_status_t rv;
+    
+    apr_pool_create(&pentry, p);
+    if (!MD_OK(apr_file_gets(line, sizeof(line), in))) goto leave;
+    tok = apr_strtok(line, " \r\n", &last);
+    if (!tok || strcmp(FS_ARCH_MAGIC, tok) 
+        || !(tok = apr_strtok(NULL, " \r\n", &last)) || atoi(tok) != FS_ARCH_VERSION) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: not a store archive (version %d)", 
+                      FS_ARCH_VERSION);
+        rv = APR_EINVAL;
+        goto leave;
+    }
+    
+    while (MD_OK(apr_file_gets(line, sizeof(line), in))) {
+        apr_pool_clear(pentry);
+        rv = APR_EINVAL;
+        tok = apr_strtok(line, " \r\n", &last);
+        if (tok && !strcmp("E", tok)) {
+            tok = apr_strtok(NULL, " \r\n", &last);
+            if (!tok || atoi(tok) != count) {
+                md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: archive has %s entries, "
+                              "but %d were read", tok? tok : "?", count);
+                goto leave;
+            }
+            rv = APR_SUCCESS;
+            goto leave;
+        }
+        if (!tok || strcmp("F", tok)
+            || !(gname = apr_strtok(NULL, " \r\n", &last))
+            || !(name = apr_strtok(NULL, " \r\n", &last))
+            || !(aspect = apr_strtok(NULL, " \r\n", &last))
+            || !(tok = apr_strtok(NULL, " \r\n", &last))
+            || !(hex = apr_strtok(NULL, " \r\n", &last))) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: malformed entry after %d", count);
+            goto leave;
+        }
+        for (group = MD_SG_NONE; group < MD_SG_COUNT; ++group) {
+            if (!strcmp(gname, md_store_group_name(group))) break;
+        }
+        len = apr_atoi64(tok);
+        if (group >= MD_SG_COUNT || len < 0 || len > FS_ARCH_MAX_ENTRY
+            || !is_safe_segment(name) || !is_safe_segment(aspect)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: invalid entry %s/%s/%s", 
+                          gname, name, aspect);
+            goto leave;
+        }
+        
+        buffer = apr_pcalloc(pentry, (apr_size_t)len + 1);
+        if (!MD_OK(apr_file_read_full(in, buffer, (apr_size_t)len, &nread))
+            || !MD_OK(apr_file_read_full(in, line, 1, &nread)) || line[0] != '\n') {
+            md_log_perror(MD_LOG_MARK, MD_LOG_ERR, rv, p, "import: truncated entry %s/%s/%s", 
+                          gname, name, aspect);
+            rv = APR_EINVAL;
+            goto leave;
+        }
+        data.data = buffer;
+        data.len = (apr_size_t)len;
+        if (!MD_OK(md_crypt_sha256_digest_hex(&digest, pentry, &data))) goto leave;
+        if (strcmp(digest, hex)) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: digest mismatch on %s/%s/%s", 
+                          gname, name, aspect);
+            rv = APR_EINVAL;
+            goto leave;
+        }
+        
+        if (MD_SG_NONE == group) {
+            if (strcmp(FS_STORE_JSON, aspect)) {
+                md_log_perror(MD_LOG_MARK, MD_LOG_WARNING, 0, p, "import: skipping %s", aspect);
+                continue;
+            }
+            rv = imp_store_json(s_fs, &data, force, pentry);
+        }
+        else {
+            rv = imp_entry(s_fs, group, name, aspect, &data, pentry);
+        }
+        if (APR_SUCCESS != rv) goto leave;
+        md_log_perror(MD_LOG_MARK, MD_LOG_TRACE2, 0, p, "import %s/%s/%s", gname, name, aspect);
+        ++count;
+    }
+    if (APR_STATUS_IS_EOF(rv)) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_ERR, 0, p, "import: archive ends without trailer");
+        rv = APR_EINCOMPLETE;
+    }
+leave:
+    apr_pool_destroy(pentry);
+    if (pcount) *pcount = count;
+    md_log_perror(MD_LOG_MARK, MD_LOG_DEBUG, rv, p, "imported %d entries into store %s", 
+                  count, s_fs->base);
+    return rv;
+}
@@ -50,6 +50,13 @@ apr_status_t md_store_fs_group_perms_set(struct md_store_t *store,
                                          apr_fileperms_t file_perms,
                                          apr_fileperms_t dir_perms);
 
+/**
+ * Drop all changes recorded in the journal (see md_store_changes()), creating 
+ * it if it does not exist yet. Sequence numbers of later changes continue above 
+ * all numbers handed out before, so consumers holding an old one start afresh.
+ */
+apr_status_t md_store_fs_journal_reset(struct md_store_t *store, apr_pool_t *p);
+
 typedef enum {
     MD_S_FS_EV_CREATED,
     MD_S_FS_EV_MOVED,
@@ -62,4 +69,23 @@ typedef apr_status_t md_store_fs_cb(void *baton, struct md_store_t *store,
                                     
 apr_status_t md_store_fs_set_event_cb(struct md_store_t *store, md_store_fs_cb *cb, void *baton);
 
+/**
+ * Write the contents of the store into a single archive stream. The store's key
+ * file is always included, so encrypted private keys remain readable after import.
+ * @param groups    array of md_store_group_t (as int) to export
+ * @param pattern   names to export (apr_fnmatch), NULL for all
+ * @param pcount    if not NULL, the number of entries written
+ */
+apr_status_t md_store_fs_export(struct md_store_t *store, struct apr_file_t *out, 
+                                struct apr_array_header_t *groups, const char *pattern, 
+                                int *pcount, apr_pool_t *p);
+
+/**
+ * Read an archive written by md_store_fs_export() into the store, verifying every
+ * entry against its digest before it is written. An archive from another store
+ * (with a different key) is only imported into an empty store, unless force != 0.
+ */
+apr_status_t md_store_fs_import(struct md_store_t *store, struct apr_file_t *in, int force, 
+                                int *pcount, apr_pool_t *p);
+
 #endif /* mod_md_md_store_fs_h */
@@ -15,6 +15,7 @@
  */
  
 #include <stdio.h>
+#include <string.h>
 
 #include <apr_lib.h>
 #include <apr_strings.h>
@@ -61,6 +62,69 @@ char *md_timeperiod_print(apr_pool_t *p, const md_timeperiod_t *period)
     return apr_pstrcat(p, tstart, " - ", tend, NULL);
 }
 
+static int parse_digits(const char **ps, int n)
+{
+    const char *s = *ps;
+    int i, v = 0;
+    
+    for (i = 0; i < n; ++i) {
+        if (!apr_isdigit(s[i])) return -1;
+        v = v * 10 + (s[i] - '0');
+    }
+    *ps = s + n;
+    return v;
+}
+
+apr_time_t md_time_parse_rfc3339(const char *s)
+{
+    apr_time_exp_t t;
+    apr_time_t time;
+    int offset = 0, sign;
+    
+    if (!s) return 0;
+    memset(&t, 0, sizeof(t));
+    if ((t.tm_year = parse_digits(&s, 4)) < 0 || *s++ != '-'
+        || (t.tm_mon = parse_digits(&s, 2)) < 1 || *s++ != '-'
+        || (t.tm_mday = parse_digits(&s, 2)) < 1) {
+        return 0;
+    }
+    if (*s != 'T' && *s != 't' && *s != ' ') return 0;
+    ++s;
+    if ((t.tm_hour = parse_digits(&s, 2)) < 0 || *s++ != ':'
+        || (t.tm_min = parse_digits(&s, 2)) < 0 || *s++ != ':'
+        || (t.tm_sec = parse_digits(&s, 2)) < 0) {
+        return 0;
+    }
+    if (*s == '.') {
+        int scale = 100000;
+        for (++s; apr_isdigit(*s); ++s) {
+            t.tm_usec += (*s - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (*s == 'Z' || *s == 'z') {
+        ++s;
+    }
+    else if (*s == '+' || *s == '-') {
+        int hours, mins;
+        
+        sign = (*s++ == '-')? -1 : 1;
+        if ((hours = parse_digits(&s, 2)) < 0 || *s++ != ':' 
+            || (mins = parse_digits(&s, 2)) < 0) {
+            return 0;
+        }
+        offset = sign * (hours * 60 + mins) * 60;
+    }
+    else {
+        return 0;
+    }
+    if (*s) return 0;
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    if (APR_SUCCESS != apr_time_exp_gmt_get(&time, &t)) return 0;
+    return time - apr_time_from_sec(offset);
+}
+
 static const char *duration_print(apr_pool_t *p, int roughly, apr_interval_time_t duration)
 {
     const char *s = "", *sep = "";
@@ -38,6 +38,12 @@ apr_interval_time_t md_timeperiod_remaining(const md_timeperiod_t *period, apr_t
 
 char *md_timeperiod_print(apr_pool_t *p, const md_timeperiod_t *period);
 
+/**
+ * Parse a RFC 3339 timestamp as used by ACME, e.g. "2024-03-01T12:00:00Z",
+ * with optional fractional seconds and numeric offset. 0 if not parseable.
+ */
+apr_time_t md_time_parse_rfc3339(const char *s);
+
 /**
  * Print a human readable form of the give duration in days/hours/min/sec 
  */
@@ -15,14 +15,17 @@
  */
  
 #include <assert.h>
+#include <signal.h>
 #include <stdio.h>
 
 #include <apr_lib.h>
+#include <apr_general.h>
 #include <apr_strings.h>
 #include <apr_portable.h>
 #include <apr_file_info.h>
 #include <apr_fnmatch.h>
 #include <apr_tables.h>
+#include <apr_thread_mutex.h>
 #include <apr_uri.h>
 
 #include "md.h"
@@ -964,6 +967,40 @@ apr_status_t md_util_abs_http_uri_check(apr_pool_t *p, const char *uri, const ch
 
 /* try and retry for a while **********************************************************************/
 
+static apr_uint32_t jitter_rand(void)
+{
+    apr_uint32_t r;
+    
+#if APR_HAS_RANDOM
+    if (APR_SUCCESS == apr_generate_random_bytes((unsigned char*)&r, sizeof(r))) {
+        return r;
+    }
+#endif
+    /* the microseconds are random enough for spreading polls */
+    r = (apr_uint32_t)apr_time_now();
+    return r;
+}
+
+apr_interval_time_t md_util_jitter_delay(apr_interval_time_t base, apr_interval_time_t prev,
+                                         apr_interval_time_t cap)
+{
+    apr_interval_time_t delay = base;
+    
+    if (prev * 3 > base) {
+        delay = base + (apr_interval_time_t)(jitter_rand() % (apr_uint64_t)(prev * 3 - base));
+    }
+    return (cap > 0 && delay > cap)? cap : delay;
+}
+
+apr_interval_time_t md_util_random_duration(apr_interval_time_t max)
+{
+    apr_uint64_t r;
+    
+    if (max <= 0) return 0;
+    r = ((apr_uint64_t)jitter_rand() << 32) | jitter_rand();
+    return (apr_interval_time_t)(r % (apr_uint64_t)max);
+}
+
 apr_status_t md_util_try(md_util_try_fn *fn, void *baton, int ignore_errs, 
                          apr_interval_time_t timeout, apr_interval_time_t start_delay, 
                          apr_interval_time_t max_delay, int backoff)
@@ -971,13 +1008,14 @@ apr_status_t md_util_try(md_util_try_fn *fn, void *baton, int ignore_errs,
     apr_status_t rv;
     apr_time_t now = apr_time_now();
     apr_time_t giveup = now + timeout;
-    apr_interval_time_t nap_duration = start_delay? start_delay : apr_time_from_msec(100);
+    apr_interval_time_t nap_start = start_delay? start_delay : apr_time_from_msec(100);
     apr_interval_time_t nap_max = max_delay? max_delay : apr_time_from_sec(10);
-    apr_interval_time_t left;
+    apr_interval_time_t nap_duration = 0, nap, suggested, left;
     int i = 0;
     
     while (1) {
-        if (APR_SUCCESS == (rv = fn(baton, i++))) {
+        suggested = 0;
+        if (APR_SUCCESS == (rv = fn(baton, i++, &suggested))) {
             break;
         }
         else if (!APR_STATUS_IS_EAGAIN(rv) && !ignore_errs) {
@@ -990,18 +1028,20 @@ apr_status_t md_util_try(md_util_try_fn *fn, void *baton, int ignore_errs,
             break;
         }
         
-        left = giveup - now;
-        if (nap_duration > left) {
-            nap_duration = left;
+        if (!nap_duration || !backoff) {
+            nap_duration = (nap_start > nap_max)? nap_max : nap_start;
         }
-        if (nap_duration > nap_max) {
-            nap_duration = nap_max;
+        else {
+            nap_duration = md_util_jitter_delay(nap_start, nap_duration, nap_max);
         }
+        /* the server knows best when it makes sense to ask again */
+        nap = (suggested > 0)? suggested : nap_duration;
         
-        apr_sleep(nap_duration);
-        if (backoff) {
-            nap_duration *= 2;
-        } 
+        left = giveup - now;
+        if (nap > left) {
+            nap = left;
+        }
+        apr_sleep(nap);
     }
     return rv;
 }
@@ -1046,6 +1086,241 @@ out:
     return rv;
 }
 
+#ifdef SIGKILL
+#define MD_EXEC_SIGKILL     SIGKILL
+#else
+#define MD_EXEC_SIGKILL     SIGTERM
+#endif
+
+#define MD_EXEC_OUTPUT_MAX  4096
+
+typedef struct exec_cmd_t exec_cmd_t;
+struct exec_cmd_t {
+    exec_cmd_t *next;               /* when ended, awaiting its callback */
+    apr_pool_t *p;
+    const char **argv;
+    md_util_exec_done_cb *cb;
+    void *baton;
+    apr_proc_t proc;
+    apr_file_t *out;                /* stdout+stderr of the command */
+    apr_time_t started;             /* 0 while queued */
+    apr_status_t rv;
+    int exit_code;
+};
+
+struct md_util_exec_pool_t {
+    apr_pool_t *p;
+    apr_thread_mutex_t *mutex;
+    int max_running;
+    apr_interval_time_t timeout;
+    apr_array_header_t *cmds;       /* exec_cmd_t*, queued and running */
+    int running;
+};
+
+apr_status_t md_util_exec_pool_create(md_util_exec_pool_t **pexec, apr_pool_t *p, 
+                                      int max_running, apr_interval_time_t timeout)
+{
+    md_util_exec_pool_t *exec;
+    apr_allocator_t *allocator;
+    apr_status_t rv;
+    
+    *pexec = NULL;
+    exec = apr_pcalloc(p, sizeof(*exec));
+    exec->max_running = (max_running > 0)? max_running : 1;
+    exec->timeout = timeout;
+    /* Own allocator, as commands are added and reaped from other threads than
+     * the one that created us. All access is under the mutex. */
+    if (!MD_OK(apr_allocator_create(&allocator))) goto leave;
+    if (!MD_OK(apr_pool_create_ex(&exec->p, p, NULL, allocator))) {
+        apr_allocator_destroy(allocator);
+        goto leave;
+    }
+    apr_allocator_owner_set(allocator, exec->p);
+    apr_pool_tag(exec->p, "md_util_exec");
+    if (!MD_OK(apr_thread_mutex_create(&exec->mutex, APR_THREAD_MUTEX_DEFAULT, exec->p))) {
+        goto leave;
+    }
+    exec->cmds = apr_array_make(exec->p, 5, sizeof(exec_cmd_t*));
+    *pexec = exec;
+leave:
+    return rv;
+}
+
+static apr_status_t exec_cmd_launch(exec_cmd_t *cmd)
+{
+    apr_procattr_t *procattr;
+    const char *tmpdir;
+    char *fname;
+    apr_status_t rv;
+    
+    /* Output goes to a file, not a pipe, so the command never blocks on us
+     * not reading. It is removed when closed. */
+    if (   MD_OK(apr_temp_dir_get(&tmpdir, cmd->p))
+        && MD_OK(apr_filepath_merge(&fname, tmpdir, "md-cmd-XXXXXX", 0, cmd->p))
+        && MD_OK(apr_file_mktemp(&cmd->out, fname, APR_FOPEN_CREATE|APR_FOPEN_READ
+                                 |APR_FOPEN_WRITE|APR_FOPEN_EXCL|APR_FOPEN_DELONCLOSE, 
+                                 cmd->p))
+        && MD_OK(apr_procattr_create(&procattr, cmd->p))
+        && MD_OK(apr_procattr_io_set(procattr, APR_NO_FILE, APR_NO_PIPE, APR_NO_PIPE))
+        && MD_OK(apr_procattr_child_out_set(procattr, cmd->out, NULL))
+        && MD_OK(apr_procattr_child_err_set(procattr, cmd->out, NULL))
+        && MD_OK(apr_procattr_cmdtype_set(procattr, APR_PROGRAM))
+        && MD_OK(apr_proc_create(&cmd->proc, cmd->argv[0], cmd->argv, NULL, procattr, cmd->p))) {
+        cmd->started = apr_time_now();
+    }
+    return rv;
+}
+
+static const char *exec_cmd_output(exec_cmd_t *cmd)
+{
+    char *buffer;
+    apr_size_t len = MD_EXEC_OUTPUT_MAX;
+    apr_off_t offset = 0;
+    
+    buffer = apr_pcalloc(cmd->p, len + 1);
+    if (APR_SUCCESS != apr_file_seek(cmd->out, APR_SET, &offset)) return "";
+    /* EOF before len bytes is the normal case, len then has the amount read */
+    apr_file_read_full(cmd->out, buffer, len, &len);
+    buffer[len] = '\0';
+    while (len > 0 && apr_isspace(buffer[len-1])) buffer[--len] = '\0';
+    return buffer;
+}
+
+/* Check on a running command, return != 0 when it has ended. */
+static int exec_cmd_check(md_util_exec_pool_t *exec, exec_cmd_t *cmd, apr_time_t now)
+{
+    apr_exit_why_e ewhy;
+    apr_status_t rv;
+    
+    rv = apr_proc_wait(&cmd->proc, &cmd->exit_code, &ewhy, APR_NOWAIT);
+    if (APR_STATUS_IS_CHILD_NOTDONE(rv)) {
+        if (!exec->timeout || now < cmd->started + exec->timeout) return 0;
+        apr_proc_kill(&cmd->proc, MD_EXEC_SIGKILL);
+        apr_proc_wait(&cmd->proc, &cmd->exit_code, &ewhy, APR_WAIT);
+        cmd->rv = APR_TIMEUP;
+    }
+    else if (APR_STATUS_IS_CHILD_DONE(rv)) {
+        /* let's not dwell on exit stati, but core should signal something's bad */
+        cmd->rv = (cmd->exit_code > 127 || APR_PROC_SIGNAL_CORE == ewhy)?
+                  APR_EINCOMPLETE : APR_SUCCESS;
+    }
+    else {
+        cmd->rv = rv;
+    }
+    return 1;
+}
+
+static int exec_cmd_is(exec_cmd_t *cmd, const char * const *argv)
+{
+    int i;
+    
+    for (i = 0; argv[i] && cmd->argv[i]; ++i) {
+        if (strcmp(argv[i], cmd->argv[i])) return 0;
+    }
+    return !argv[i] && !cmd->argv[i];
+}
+
+apr_status_t md_util_exec_start(md_util_exec_pool_t *exec, const char * const *argv, 
+                                md_util_exec_done_cb *cb, void *baton)
+{
+    exec_cmd_t *cmd;
+    apr_pool_t *p;
+    int i, n;
+    apr_status_t rv;
+    
+    apr_thread_mutex_lock(exec->mutex);
+    for (i = 0; i < exec->cmds->nelts; ++i) {
+        if (exec_cmd_is(APR_ARRAY_IDX(exec->cmds, i, exec_cmd_t*), argv)) {
+            /* the same command is queued or running already */
+            rv = APR_EEXIST;
+            goto leave;
+        }
+    }
+    if (!MD_OK(apr_pool_create(&p, exec->p))) goto leave;
+    apr_pool_tag(p, "md_util_exec_cmd");
+    cmd = apr_pcalloc(p, sizeof(*cmd));
+    cmd->p = p;
+    cmd->cb = cb;
+    cmd->baton = baton;
+    for (n = 0; argv[n]; ++n);
+    cmd->argv = apr_pcalloc(p, (apr_size_t)(n + 1) * sizeof(const char*));
+    for (i = 0; i < n; ++i) cmd->argv[i] = apr_pstrdup(p, argv[i]);
+    APR_ARRAY_PUSH(exec->cmds, exec_cmd_t*) = cmd;
+    
+    if (exec->running < exec->max_running) {
+        if (APR_SUCCESS == (cmd->rv = exec_cmd_launch(cmd))) ++exec->running;
+        /* else reported in the next poll */
+    }
+leave:
+    apr_thread_mutex_unlock(exec->mutex);
+    return rv;
+}
+
+int md_util_exec_poll(md_util_exec_pool_t *exec)
+{
+    exec_cmd_t *cmd, *ended = NULL, **pnext = &ended;
+    apr_time_t now = apr_time_now();
+    const char *output;
+    int i, pending;
+    
+    apr_thread_mutex_lock(exec->mutex);
+    /* reap first, so the slots of ended commands are available below */
+    for (i = 0; i < exec->cmds->nelts; ++i) {
+        cmd = APR_ARRAY_IDX(exec->cmds, i, exec_cmd_t*);
+        if (cmd->started) {
+            if (!exec_cmd_check(exec, cmd, now)) continue;
+            --exec->running;
+        }
+        else if (APR_SUCCESS == cmd->rv) {
+            continue;
+        }
+        *pnext = cmd;
+        pnext = &cmd->next;
+        md_array_remove_at(exec->cmds, i--);
+    }
+    for (i = 0; i < exec->cmds->nelts && exec->running < exec->max_running; ++i) {
+        cmd = APR_ARRAY_IDX(exec->cmds, i, exec_cmd_t*);
+        if (cmd->started) continue;
+        if (APR_SUCCESS == (cmd->rv = exec_cmd_launch(cmd))) {
+            ++exec->running;
+            continue;
+        }
+        *pnext = cmd;
+        pnext = &cmd->next;
+        md_array_remove_at(exec->cmds, i--);
+    }
+    apr_thread_mutex_unlock(exec->mutex);
+    
+    /* Callbacks run outside the lock, they may start new commands. */
+    while (ended) {
+        cmd = ended;
+        ended = cmd->next;
+        output = cmd->started? exec_cmd_output(cmd) : "";
+        if (*output) {
+            md_log_perror(MD_LOG_MARK, MD_LOG_INFO, 0, cmd->p, "cmd(%s) output: %s", 
+                          cmd->argv[0], output);
+        }
+        if (cmd->cb) {
+            cmd->cb(cmd->baton, cmd->argv, cmd->rv, cmd->exit_code, output, cmd->p);
+        }
+        if (cmd->out) apr_file_close(cmd->out);
+        apr_thread_mutex_lock(exec->mutex);
+        apr_pool_destroy(cmd->p);
+        apr_thread_mutex_unlock(exec->mutex);
+    }
+    apr_thread_mutex_lock(exec->mutex);
+    pending = exec->cmds->nelts;
+    apr_thread_mutex_unlock(exec->mutex);
+    return pending;
+}
+
+void md_util_exec_wait(md_util_exec_pool_t *exec)
+{
+    while (md_util_exec_poll(exec) > 0) {
+        apr_sleep(apr_time_from_msec(100));
+    }
+}
+
 /* base64 url encoding ****************************************************************************/
 
 #define N6 (unsigned int)-1
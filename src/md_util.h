@@ -103,6 +103,56 @@ int md_array_str_add_missing(struct apr_array_header_t *dest,
 apr_status_t md_util_exec(apr_pool_t *p, const char *cmd, const char * const *argv,
                           int *exit_code);
 
+/**
+ * Runs commands in the background, at most a fixed number at a time. Commands
+ * are started and reaped in md_util_exec_poll(), which also invokes their
+ * completion callbacks. Nothing blocks on a running command.
+ */
+typedef struct md_util_exec_pool_t md_util_exec_pool_t;
+
+/**
+ * Called when a command has ended.
+ * @param baton     as given to md_util_exec_start()
+ * @param argv      the command line that was run
+ * @param rv        APR_SUCCESS or the reason the command failed: APR_TIMEUP when 
+ *                  it was killed after the timeout, APR_EINCOMPLETE on abnormal exit
+ * @param exit_code the exit code of the command
+ * @param output    what the command wrote to stdout and stderr, maybe truncated
+ * @param p         pool for temporary use, destroyed after the callback returns
+ */
+typedef void md_util_exec_done_cb(void *baton, const char * const *argv, apr_status_t rv, 
+                                  int exit_code, const char *output, apr_pool_t *p);
+
+/**
+ * Create a pool for running commands.
+ * @param max_running   max number of commands running at the same time
+ * @param timeout       commands running longer get killed, 0 for no limit
+ */
+apr_status_t md_util_exec_pool_create(md_util_exec_pool_t **pexec, apr_pool_t *p, 
+                                      int max_running, apr_interval_time_t timeout);
+
+/**
+ * Queue a command. It is started now when a slot is free, otherwise in a later poll.
+ * The argv is copied, the baton needs to stay valid until the callback 
+ * was invoked.
+ * @return APR_EEXIST when a command with the same argv is still queued or running,
+ *         it is not added again then
+ */
+apr_status_t md_util_exec_start(md_util_exec_pool_t *exec, const char * const *argv, 
+                                md_util_exec_done_cb *cb, void *baton);
+
+/**
+ * Reap ended commands, kill the ones exceeding the timeout, start queued 
+ * ones and invoke the callbacks of all that ended.
+ * @return the number of commands still queued or running
+ */
+int md_util_exec_poll(md_util_exec_pool_t *exec);
+
+/**
+ * Poll until all commands have ended.
+ */
+void md_util_exec_wait(md_util_exec_pool_t *exec);
+
 /**************************************************************************************************/
 /* dns name check */
 
@@ -210,10 +260,34 @@ const char *md_link_find_relation(const struct apr_table_t *headers,
 /**************************************************************************************************/
 /* retry logic */
 
-typedef apr_status_t md_util_try_fn(void *baton, int i);
+/**
+ * Called for attempt i, starting at 0. When the function knows how long to wait
+ * before the next attempt, e.g. from a Retry-After header, it sets *pdelay which 
+ * is 0 on entry.
+ */
+typedef apr_status_t md_util_try_fn(void *baton, int i, apr_interval_time_t *pdelay);
 
+/**
+ * Call fn until it succeeds, fails (unless errors are ignored) or timeout passes.
+ * Between attempts, sleep the delay suggested by fn or, when there is none, 
+ * start_delay (default 100ms). With backoff, following delays use decorrelated 
+ * jitter up to max_delay (default 10s), see md_util_jitter_delay().
+ */
 apr_status_t md_util_try(md_util_try_fn *fn, void *baton, int ignore_errs,  
                          apr_interval_time_t timeout, apr_interval_time_t start_delay, 
                          apr_interval_time_t max_delay, int backoff);
 
+/**
+ * Next delay of a backoff with decorrelated jitter: random between base and
+ * three times the previous delay, but not more than cap. This grows about
+ * exponentially while keeping many clients from polling in lock step.
+ */
+apr_interval_time_t md_util_jitter_delay(apr_interval_time_t base, apr_interval_time_t prev,
+                                         apr_interval_time_t cap);
+
+/**
+ * A random duration between 0 and max, e.g. to pick a time inside a window.
+ */
+apr_interval_time_t md_util_random_duration(apr_interval_time_t max);
+
 #endif /* md_util_h */
@@ -148,13 +148,115 @@ static notify_rate notify_rates[] = {
     { "ocsp-errored", apr_time_from_sec(MD_SECS_PER_HOUR) }, /* once per hour */
 };
 
+/* Notification commands run in the background, the job they are about is
+ * updated from the store when they are done. The job instance that triggered 
+ * them may be long gone by then. */
+typedef struct {
+    md_mod_conf_t *mc;
+    md_store_t *store;
+    md_store_group_t group;
+    md_util_exec_pool_t *cmds;
+} notify_ctx_t;
+
+static notify_ctx_t *notify_ctx_make(md_mod_conf_t *mc, md_store_t *store, 
+                                     md_store_group_t group, md_util_exec_pool_t *cmds, 
+                                     apr_pool_t *p)
+{
+    notify_ctx_t *ctx = apr_pcalloc(p, sizeof(*ctx));
+    
+    ctx->mc = mc;
+    ctx->store = store;
+    ctx->group = group;
+    ctx->cmds = cmds;
+    return ctx;
+}
+
+/* Add to the log of the job in the store and, when a command failed, make
+ * that the job's last result. */
+static void notify_job_log(notify_ctx_t *ctx, const char *mdomain, const char *type, 
+                           const char *status, md_result_t *failure, apr_pool_t *p)
+{
+    md_job_t *job;
+    
+    job = md_job_make(p, ctx->store, ctx->group, mdomain);
+    md_job_load(job);
+    md_job_log_append(job, type, status, failure? failure->detail : NULL);
+    md_job_save(job, failure, p);
+}
+
+static void message_cmd_done(void *baton, const char * const *argv, apr_status_t rv, 
+                             int exit_code, const char *output, apr_pool_t *p)
+{
+    notify_ctx_t *ctx = baton;
+    const char *mdomain, *reason;
+    md_result_t *result;
+    int argc;
+    
+    /* the command line ends with: <reason> <mdomain> */
+    for (argc = 0; argv[argc]; ++argc);
+    mdomain = argv[argc-1];
+    reason = argv[argc-2];
+    if (APR_SUCCESS == rv && exit_code) rv = APR_EGENERAL;
+    if (APR_SUCCESS != rv) {
+        result = md_result_md_make(p, mdomain);
+        md_result_problem_printf(result, rv, MD_RESULT_LOG_ID(APLOGNO(10109)), 
+                                 "MDMessageCmd %s failed with exit code %d%s%s", 
+                                 ctx->mc->message_cmd, exit_code, 
+                                 *output? ": " : ".", output);
+        md_result_log(result, MD_LOG_ERR);
+        notify_job_log(ctx, mdomain, "message-error", reason, result, p);
+        return;
+    }
+    notify_job_log(ctx, mdomain, apr_psprintf(p, "message-%s", reason), NULL, NULL, p);
+}
+
+static apr_status_t message_cmd_start(notify_ctx_t *ctx, const char *reason, 
+                                      const char *mdomain, apr_pool_t *p)
+{
+    const char * const *argv;
+    const char *cmdline;
+    
+    cmdline = apr_psprintf(p, "%s %s %s", ctx->mc->message_cmd, reason, mdomain); 
+    apr_tokenize_to_argv(cmdline, (char***)&argv, p);
+    return md_util_exec_start(ctx->cmds, argv, message_cmd_done, ctx);
+}
+
+static void notify_cmd_done(void *baton, const char * const *argv, apr_status_t rv, 
+                            int exit_code, const char *output, apr_pool_t *p)
+{
+    notify_ctx_t *ctx = baton;
+    const char *mdomain;
+    md_result_t *result;
+    int argc;
+    
+    /* the command line ends with: <mdomain> */
+    for (argc = 0; argv[argc]; ++argc);
+    mdomain = argv[argc-1];
+    if (APR_SUCCESS == rv && exit_code) rv = APR_EGENERAL;
+    if (APR_SUCCESS != rv) {
+        result = md_result_md_make(p, mdomain);
+        md_result_problem_printf(result, rv, MD_RESULT_LOG_ID(APLOGNO(10108)), 
+                                 "MDNotifyCmd %s failed with exit code %d%s%s", 
+                                 ctx->mc->notify_cmd, exit_code, 
+                                 *output? ": " : ".", output);
+        md_result_log(result, MD_LOG_ERR);
+        notify_job_log(ctx, mdomain, "notify-error", result->problem, result, p);
+        return;
+    }
+    if (ctx->mc->message_cmd) {
+        rv = message_cmd_start(ctx, "renewed", mdomain, p);
+        if (APR_SUCCESS == rv || APR_STATUS_IS_EEXIST(rv)) return;
+    }
+    notify_job_log(ctx, mdomain, "message-renewed", NULL, NULL, p);
+}
+
 static apr_status_t notify(md_job_t *job, const char *reason, 
                            md_result_t *result, apr_pool_t *p, void *baton)
 {
-    md_mod_conf_t *mc = baton;
+    notify_ctx_t *ctx = baton;
+    md_mod_conf_t *mc = ctx->mc;
     const char * const *argv;
     const char *cmdline;
-    int exit_code;
     apr_status_t rv = APR_SUCCESS;
     apr_time_t min_interim = 0;
     md_timeperiod_t since_last;
@@ -178,42 +280,32 @@ static apr_status_t notify(md_job_t *job, const char *reason,
     }
     
     if (!strcmp("renewed", reason)) {
+        md_log_perror(MD_LOG_MARK, MD_LOG_NOTICE, 0, p, APLOGNO(10059) 
+                     "The Managed Domain %s has been setup and changes "
+                     "will be activated on next (graceful) server restart.", job->mdomain);
         if (mc->notify_cmd) {
+            /* MDMessageCmd follows when this one succeeded */
             cmdline = apr_psprintf(p, "%s %s", mc->notify_cmd, job->mdomain); 
             apr_tokenize_to_argv(cmdline, (char***)&argv, p);
-            rv = md_util_exec(p, argv[0], argv, &exit_code);
-            
-            if (APR_SUCCESS == rv && exit_code) rv = APR_EGENERAL;
-            if (APR_SUCCESS != rv) {
-                md_result_problem_printf(result, rv, MD_RESULT_LOG_ID(APLOGNO(10108)), 
-                                         "MDNotifyCmd %s failed with exit code %d.", 
-                                         mc->notify_cmd, exit_code);
-                md_result_log(result, MD_LOG_ERR);
-                md_job_log_append(job, "notify-error", result->problem, result->detail);
-                return rv;
-            }
+            rv = md_util_exec_start(ctx->cmds, argv, notify_cmd_done, ctx);
+            goto leave;
         }
-        md_log_perror(MD_LOG_MARK, MD_LOG_NOTICE, 0, p, APLOGNO(10059) 
-                     "The Managed Domain %s has been setup and changes "
-                     "will be activated on next (graceful) server restart.", job->mdomain);
     }
     if (mc->message_cmd) {
-        cmdline = apr_psprintf(p, "%s %s %s", mc->message_cmd, reason, job->mdomain); 
-        apr_tokenize_to_argv(cmdline, (char***)&argv, p);
-        rv = md_util_exec(p, argv[0], argv, &exit_code);
-        
-        if (APR_SUCCESS == rv && exit_code) rv = APR_EGENERAL;
-        if (APR_SUCCESS != rv) {
-            md_result_problem_printf(result, rv, MD_RESULT_LOG_ID(APLOGNO(10109)), 
-                                     "MDMessageCmd %s failed with exit code %d.", 
-                                     mc->message_cmd, exit_code);
-            md_result_log(result, MD_LOG_ERR);
-            md_job_log_append(job, "message-error", reason, result->detail);
-            return rv;
-        }
+        rv = message_cmd_start(ctx, reason, job->mdomain, p);
+        goto leave;
     }
     md_job_log_append(job, log_msg_reason, NULL, NULL);
-    return APR_SUCCESS;
+leave:
+    if (APR_STATUS_IS_EEXIST(rv)) {
+        /* the command for this is still running, it logs when done */
+        rv = APR_SUCCESS;
+    }
+    if (APR_SUCCESS != rv) {
+        md_result_problem_printf(result, rv, NULL, "unable to run the command for %s", reason);
+        md_result_log(result, MD_LOG_ERR);
+    }
+    return rv;
 }
 
 /**************************************************************************************************/
@@ -231,14 +323,17 @@ static apr_status_t store_file_ev(void *baton, struct md_store_t *store,
     ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, s, "store event=%d on %s %s (group %d)", 
                  ev, (ftype == APR_DIR)? "dir" : "file", fname, group);
                  
-    /* Directories in group CHALLENGES, STAGING and OCSP are written to 
-     * under a different user. Give her ownership. 
+    /* Directories in group CHALLENGES, STAGING, OCSP, LOCKS, ARI and KEYPOOL are 
+     * written to under a different user. Give her ownership. 
      */
     if (ftype == APR_DIR) {
         switch (group) {
             case MD_SG_CHALLENGES:
             case MD_SG_STAGING:
             case MD_SG_OCSP:
+            case MD_SG_LOCKS:
+            case MD_SG_ARI:
+            case MD_SG_KEYPOOL:
                 rv = md_make_worker_accessible(fname, p);
                 if (APR_ENOTIMPL != rv) {
                     return rv;
@@ -248,6 +343,13 @@ static apr_status_t store_file_ev(void *baton, struct md_store_t *store,
                 break;
         }
     }
+    else if (group == MD_SG_LOCKS) {
+        /* Leases may be taken by us before the watchdog renews or releases them. */
+        rv = md_make_worker_accessible(fname, p);
+        if (APR_ENOTIMPL != rv) {
+            return rv;
+        }
+    }
     return APR_SUCCESS;
 }
 
@@ -267,7 +369,7 @@ static apr_status_t check_group_dir(md_store_t *store, md_store_group_t group,
 static apr_status_t setup_store(md_store_t **pstore, md_mod_conf_t *mc, 
                                 apr_pool_t *p, server_rec *s)
 {
-    const char *base_dir;
+    const char *base_dir, *fname;
     apr_status_t rv;
     
     base_dir = ap_server_root_relative(p, mc->base_dir);
@@ -282,12 +384,28 @@ static apr_status_t setup_store(md_store_t **pstore, md_mod_conf_t *mc,
         || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_STAGING, p, s))
         || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_ACCOUNTS, p, s))
         || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_OCSP, p, s))
+        || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_LOCKS, p, s))
+        || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_ARI, p, s))
+        || APR_SUCCESS != (rv = check_group_dir(*pstore, MD_SG_KEYPOOL, p, s))
         ) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10047) 
                      "setup challenges directory");
         goto leave;
     }
     
+    /* Start each configuration with an empty change journal, so it does not 
+     * grow forever. The watchdog appends to it under a different user. */
+    if (APR_SUCCESS == md_store_fs_journal_reset(*pstore, p)
+        && APR_SUCCESS == md_store_get_fname(&fname, *pstore, MD_SG_NONE, NULL, 
+                                             MD_FN_JOURNAL, p)) {
+        rv = md_make_worker_accessible(fname, p);
+        if (APR_ENOTIMPL == rv) rv = APR_SUCCESS;
+        if (APR_SUCCESS != rv) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, "setup store journal %s", fname);
+            rv = APR_SUCCESS;
+        }
+    }
+    
 leave:
     return rv;
 }
@@ -326,9 +444,8 @@ static void merge_srv_config(md_t *md, md_srv_conf_t *base_sc, apr_pool_t *p)
     if (!md->ca_challenges && md->sc->ca_challenges) {
         md->ca_challenges = apr_array_copy(p, md->sc->ca_challenges);
     }        
-    if (!md->pkey_spec) {
-        md->pkey_spec = md->sc->pkey_spec;
-        
+    if (!md->pks) {
+        md->pks = md_pkeys_spec_clone(p, md->sc->pks);
     }
     if (md->require_https < 0) {
         md->require_https = md_config_geti(md->sc, MD_CONFIG_REQUIRE_HTTPS);
@@ -673,6 +790,12 @@ static void load_staged_data(md_mod_conf_t *mc, server_rec *s, apr_pool_t *p)
     for (i = 0; i < mc->mds->nelts; ++i) {
         md = APR_ARRAY_IDX(mc->mds, i, md_t *);
         result = md_result_md_make(p, md->name);
+        if (md_renew_leased_elsewhere(mc, md, s, p)) {
+            /* the renewal has been taken over, the staged set may not be complete */
+            ap_log_error( APLOG_MARK, APLOG_INFO, 0, s, 
+                         "%s: renewal driven elsewhere, not activating staged set", md->name);
+            continue;
+        }
         if (APR_SUCCESS == (rv = md_reg_load_staging(mc->reg, md, mc->env, result, p))) {
             ap_log_error( APLOG_MARK, APLOG_INFO, rv, s, APLOGNO(10068) 
                          "%s: staged set activated", md->name);
@@ -797,6 +920,8 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
 {
     void *data = NULL;
     const char *mod_md_init_key = "mod_md_init_counter";
+    const char *mod_md_memo_key = "mod_md_reg_memo";
+    md_reg_memo_t *memo;
     md_srv_conf_t *sc;
     md_mod_conf_t *mc;
     apr_status_t rv = APR_SUCCESS;
@@ -833,13 +958,39 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
     sc = md_config_get(s);
     mc = sc->mc;
     mc->dry_run = dry_run;
+    md_http_set_http2_default(mc->http2);
+    md_acme_limit_set(MD_ACME_LIMIT_ORDERS, mc->limit_orders);
+    md_acme_limit_set(MD_ACME_LIMIT_ACCOUNTS, mc->limit_accounts);
+    md_acme_limit_set(MD_ACME_LIMIT_FAILED_AUTHZ, mc->limit_failed_authz);
 
     if (APR_SUCCESS != (rv = setup_store(&store, mc, p, s))
         || APR_SUCCESS != (rv = md_reg_create(&mc->reg, p, store, mc->proxy_url))) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10072) "setup md registry");
         goto leave;
     }
-    md_reg_set_notify_cb(mc->reg, notify, mc);
+    md_acme_limits_store_set(store);
+    
+    if (APR_SUCCESS != (rv = md_util_exec_pool_create(&mc->cmds, p, mc->cmd_parallel, 
+                                                      mc->cmd_timeout))
+        || APR_SUCCESS != (rv = md_util_exec_pool_create(&mc->ocsp_cmds, p, mc->cmd_parallel,
+                                                         mc->cmd_timeout))) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "setup command runner");
+        goto leave;
+    }
+    md_reg_set_notify_cb(mc->reg, notify, notify_ctx_make(mc, store, MD_SG_STAGING, 
+                                                          mc->cmds, p));
+    if (!dry_run) {
+        /* The memo lives in the process pool, so a graceful restart finds 
+         * what the previous configuration already had loaded. */
+        data = NULL;
+        apr_pool_userdata_get(&data, mod_md_memo_key, s->process->pool);
+        if (data == NULL && APR_SUCCESS == md_reg_memo_create(&memo, s->process->pool)) {
+            apr_pool_userdata_set(memo, mod_md_memo_key, apr_pool_cleanup_null, 
+                                  s->process->pool);
+            data = memo;
+        }
+        if (data) md_reg_set_memo(mc->reg, data);
+    }
 
     /* renew on 30% remaining /*/
     rv = md_ocsp_reg_make(&mc->ocsp, p, store, mc->ocsp_renew_window,
@@ -848,7 +999,8 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10196) "setup ocsp registry");
         goto leave;
     }
-    md_ocsp_set_notify_cb(mc->ocsp, notify, mc);
+    md_ocsp_set_notify_cb(mc->ocsp, notify, notify_ctx_make(mc, store, MD_SG_OCSP, 
+                                                            mc->ocsp_cmds, p));
     
     init_ssl();
 
@@ -885,20 +1037,25 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
     }
     /*5*/
     load_staged_data(mc, s, p);
+    /* Commands started for the staged data need to end here, before we fork. */
+    md_util_exec_wait(mc->cmds);
 leave:
     return rv;
 }
 
+/* Number of threads loading certificates at startup, if we cannot tell the cpus */
+#define MD_INIT_THREADS_DEF     4
+#define MD_INIT_THREADS_MAX     32
+
 static apr_status_t md_post_config_after_ssl(apr_pool_t *p, apr_pool_t *plog,
                                              apr_pool_t *ptemp, server_rec *s)
 {
     md_srv_conf_t *sc;
     apr_status_t rv = APR_SUCCESS;
     md_mod_conf_t *mc;
-    int watched, i;
+    int watched, threads, i;
     md_t *md;
 
-    (void)ptemp;
     (void)plog;
     sc = md_config_get(s);
 
@@ -911,6 +1068,15 @@ static apr_status_t md_post_config_after_ssl(apr_pool_t *p, apr_pool_t *plog,
         goto leave;
     }
     apr_array_clear(mc->unused_names);
+    /* Reading and parsing the certificates is the expensive part when there are 
+     * many MDs. Do that in parallel, the loop below then finds them in the cache. */
+    threads = md_os_cpu_count();
+    if (threads <= 0) threads = MD_INIT_THREADS_DEF;
+    else if (threads > MD_INIT_THREADS_MAX) threads = MD_INIT_THREADS_MAX;
+    if (APR_SUCCESS != (rv = md_reg_load_pubcerts(mc->reg, mc->mds, threads, ptemp))) {
+        ap_log_error( APLOG_MARK, APLOG_ERR, rv, s, "loading certificates");
+        goto leave;
+    }
     for (i = 0; i < mc->mds->nelts; ++i) {
         md = APR_ARRAY_IDX(mc->mds, i, md_t *);
 
@@ -1014,9 +1180,10 @@ static int md_protocol_switch(conn_rec *c, request_rec *r, server_rec *s,
 /**************************************************************************************************/
 /* Access API to other httpd components */
 
-static apr_status_t setup_fallback_cert(md_store_t *store, const md_t *md, 
+static apr_status_t setup_fallback_cert(md_reg_t *reg, const md_t *md, 
                                         server_rec *s, apr_pool_t *p)
 {
+    md_store_t *store = md_reg_store_get(reg);
     md_pkey_t *pkey;
     md_cert_t *cert;
     md_pkey_spec_t spec;
@@ -1025,7 +1192,7 @@ static apr_status_t setup_fallback_cert(md_store_t *store, const md_t *md,
     spec.type = MD_PKEY_TYPE_RSA;
     spec.params.rsa.bits = MD_PKEY_RSA_BITS_DEF;
     
-    if (APR_SUCCESS != (rv = md_pkey_gen(&pkey, p, &spec))
+    if (APR_SUCCESS != (rv = md_reg_pkey_get(&pkey, reg, &spec, p))
         || APR_SUCCESS != (rv = md_store_save(store, p, MD_SG_DOMAINS, md->name, 
                                 MD_FN_FALLBACK_PKEY, MD_SV_PKEY, (void*)pkey, 0))
         || APR_SUCCESS != (rv = md_cert_self_sign(&cert, "Apache Managed Domain Fallback", 
@@ -1038,20 +1205,20 @@ static apr_status_t setup_fallback_cert(md_store_t *store, const md_t *md,
     return rv;
 }
 
-static apr_status_t get_certificate(server_rec *s, apr_pool_t *p, int fallback,
-                                    const char **pcertfile, const char **pkeyfile)
+static apr_status_t get_certificates(server_rec *s, apr_pool_t *p, int fallback,
+                                     apr_array_header_t *cert_files, 
+                                     apr_array_header_t *key_files)
 {
     apr_status_t rv = APR_ENOENT;    
     md_srv_conf_t *sc;
     md_reg_t *reg;
     md_store_t *store;
     const md_t *md;
+    const char *keyfile, *certfile;
+    int i, found = 0;
     
-    *pkeyfile = NULL;
-    *pcertfile = NULL;
-
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10113)
-                 "get_certificate called for vhost %s.", s->server_hostname);
+                 "get_certificates called for vhost %s.", s->server_hostname);
 
     sc = md_config_get(s);
     if (!sc) {
@@ -1083,8 +1250,26 @@ static apr_status_t get_certificate(server_rec *s, apr_pool_t *p, int fallback,
     }
     md = APR_ARRAY_IDX(sc->assigned, 0, const md_t*);
     
-    rv = md_reg_get_cred_files(pkeyfile, pcertfile, reg, MD_SG_DOMAINS, md, p);
-    if (APR_STATUS_IS_ENOENT(rv)) {
+    /* Hand out the certificates we have, one per key type. mod_ssl picks the
+     * one a client supports. Missing ones are still being obtained. */
+    for (i = 0; i < md_cert_count(md); ++i) {
+        rv = md_reg_get_cred_files(&keyfile, &certfile, reg, MD_SG_DOMAINS, md, i, p);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            continue;
+        }
+        else if (APR_SUCCESS != rv) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10110) 
+                         "retrieving credentials for MD %s", md->name);
+            return rv;
+        }
+        if (!fallback) {
+            APR_ARRAY_PUSH(cert_files, const char*) = certfile;
+            APR_ARRAY_PUSH(key_files, const char*) = keyfile;
+        }
+        ++found;
+    }
+    
+    if (!found) {
         if (fallback) {
             /* Provide temporary, self-signed certificate as fallback, so that
              * clients do not get obscure TLS handshake errors or will see a fallback
@@ -1092,41 +1277,41 @@ static apr_status_t get_certificate(server_rec *s, apr_pool_t *p, int fallback,
             store = md_reg_store_get(reg);
             assert(store);    
             
-            md_store_get_fname(pkeyfile, store, MD_SG_DOMAINS, md->name, MD_FN_FALLBACK_PKEY, p);
-            md_store_get_fname(pcertfile, store, MD_SG_DOMAINS, md->name, MD_FN_FALLBACK_CERT, p);
-            if (!md_file_exists(*pkeyfile, p) || !md_file_exists(*pcertfile, p)) { 
-                if (APR_SUCCESS != (rv = setup_fallback_cert(store, md, s, p))) {
+            md_store_get_fname(&keyfile, store, MD_SG_DOMAINS, md->name, MD_FN_FALLBACK_PKEY, p);
+            md_store_get_fname(&certfile, store, MD_SG_DOMAINS, md->name, MD_FN_FALLBACK_CERT, p);
+            if (!md_file_exists(keyfile, p) || !md_file_exists(certfile, p)) { 
+                if (APR_SUCCESS != (rv = setup_fallback_cert(reg, md, s, p))) {
                     return rv;
                 }
             }
+            APR_ARRAY_PUSH(cert_files, const char*) = certfile;
+            APR_ARRAY_PUSH(key_files, const char*) = keyfile;
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10116)  
                          "%s: providing fallback certificate for server %s", 
                          md->name, s->server_hostname);
             return APR_EAGAIN;
         }
-    }
-    else if (APR_SUCCESS != rv) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10110) 
-                     "retrieving credentials for MD %s", md->name);
-        return rv;
+        return APR_ENOENT;
     }
     
-    ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(10077) 
-                 "%s[state=%d]: providing certificate for server %s", 
-                 md->name, md->state, s->server_hostname);
-    return rv;
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10077) 
+                 "%s[state=%d]: providing %d certificate(s) for server %s", 
+                 md->name, md->state, found, s->server_hostname);
+    return APR_SUCCESS;
 }
 
 static int md_add_cert_files(server_rec *s, apr_pool_t *p,
                              apr_array_header_t *cert_files, 
                              apr_array_header_t *key_files)
 {
-    const char *certfile, *keyfile;
+    apr_array_header_t *md_certs, *md_keys;
     apr_status_t rv;
     
     ap_log_error(APLOG_MARK, APLOG_TRACE1, 0, s, "hook ssl_add_cert_files for %s",
                  s->server_hostname);
-    rv = get_certificate(s, p, 0, &certfile, &keyfile);
+    md_certs = apr_array_make(p, 2, sizeof(const char*));
+    md_keys = apr_array_make(p, 2, sizeof(const char*));
+    rv = get_certificates(s, p, 0, md_certs, md_keys);
     if (APR_SUCCESS == rv) {
         if (!apr_is_empty_array(cert_files)) {
             ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10084)
@@ -1135,8 +1320,8 @@ static int md_add_cert_files(server_rec *s, apr_pool_t *p,
                          "for it (most likely via SSLCertificateFile).", 
                          s->server_hostname);
         } 
-        APR_ARRAY_PUSH(cert_files, const char*) = certfile;
-        APR_ARRAY_PUSH(key_files, const char*) = keyfile;
+        apr_array_cat(cert_files, md_certs);
+        apr_array_cat(key_files, md_keys);
         return DONE;
     }
     return DECLINED;
@@ -1146,15 +1331,12 @@ static int md_add_fallback_cert_files(server_rec *s, apr_pool_t *p,
                                       apr_array_header_t *cert_files, 
                                       apr_array_header_t *key_files)
 {
-    const char *certfile, *keyfile;
     apr_status_t rv;
     
     ap_log_error(APLOG_MARK, APLOG_TRACE1, 0, s, "hook ssl_add_fallback_cert_files for %s",
                  s->server_hostname);
-    rv = get_certificate(s, p, 1, &certfile, &keyfile);
+    rv = get_certificates(s, p, 1, cert_files, key_files);
     if (APR_EAGAIN == rv) {
-        APR_ARRAY_PUSH(cert_files, const char*) = certfile;
-        APR_ARRAY_PUSH(key_files, const char*) = keyfile;
         return DONE;
     }
     return DECLINED;
@@ -60,6 +60,13 @@ static md_mod_conf_t defmc = {
     MD_DEFAULT_BASE_DIR,
 #endif
     NULL,                      /* proxy url for outgoing http */
+    1,                         /* use HTTP/2 where supported */
+    MD_RENEW_PARALLEL_DEF,     /* renewals in parallel */
+    MD_RENEW_PARALLEL_CA_DEF,  /* renewals in parallel per CA */
+    0,                         /* new orders per hour, unlimited */
+    0,                         /* new accounts per hour, unlimited */
+    0,                         /* failed validations per hour, unlimited */
+    MD_KEYPOOL_DEPTH_DEF,      /* keys generated ahead of time */
     NULL,                      /* md_reg_t */
     NULL,                      /* md_ocsp_reg_t */
     80,                        /* local http: port */
@@ -73,6 +80,10 @@ static md_mod_conf_t defmc = {
     NULL,                      /* init errors hash */
     NULL,                      /* notify cmd */
     NULL,                      /* message cmd */
+    MD_CMD_PARALLEL_DEF,       /* commands running in parallel */
+    MD_CMD_TIMEOUT_DEF,        /* command timeout */
+    NULL,                      /* renewal command runner */
+    NULL,                      /* ocsp command runner */
     NULL,                      /* env table */
     0,                         /* dry_run flag */
     1,                         /* server_status_enabled */
@@ -152,7 +163,7 @@ static void srv_conf_props_clear(md_srv_conf_t *sc)
     sc->require_https = MD_REQUIRE_UNSET;
     sc->renew_mode = DEF_VAL;
     sc->must_staple = DEF_VAL;
-    sc->pkey_spec = NULL;
+    sc->pks = NULL;
     sc->renew_window = NULL;
     sc->warn_window = NULL;
     sc->ca_url = NULL;
@@ -169,7 +180,7 @@ static void srv_conf_props_copy(md_srv_conf_t *to, const md_srv_conf_t *from)
     to->require_https = from->require_https;
     to->renew_mode = from->renew_mode;
     to->must_staple = from->must_staple;
-    to->pkey_spec = from->pkey_spec;
+    to->pks = from->pks;
     to->warn_window = from->warn_window;
     to->renew_window = from->renew_window;
     to->ca_url = from->ca_url;
@@ -186,7 +197,7 @@ static void srv_conf_props_apply(md_t *md, const md_srv_conf_t *from, apr_pool_t
     if (from->transitive != DEF_VAL) md->transitive = from->transitive;
     if (from->renew_mode != DEF_VAL) md->renew_mode = from->renew_mode;
     if (from->must_staple != DEF_VAL) md->must_staple = from->must_staple;
-    if (from->pkey_spec) md->pkey_spec = from->pkey_spec;
+    if (from->pks) md->pks = md_pkeys_spec_clone(p, from->pks);
     if (from->renew_window) md->renew_window = from->renew_window;
     if (from->warn_window) md->warn_window = from->warn_window;
     if (from->ca_url) md->ca_url = from->ca_url;
@@ -224,7 +235,7 @@ static void *md_config_merge(apr_pool_t *pool, void *basev, void *addv)
     nsc->require_https = (add->require_https != MD_REQUIRE_UNSET)? add->require_https : base->require_https;
     nsc->renew_mode = (add->renew_mode != DEF_VAL)? add->renew_mode : base->renew_mode;
     nsc->must_staple = (add->must_staple != DEF_VAL)? add->must_staple : base->must_staple;
-    nsc->pkey_spec = add->pkey_spec? add->pkey_spec : base->pkey_spec;
+    nsc->pks = add->pks? add->pks : base->pks;
     nsc->renew_window = add->renew_window? add->renew_window : base->renew_window;
     nsc->warn_window = add->warn_window? add->warn_window : base->warn_window;
 
@@ -643,6 +654,97 @@ static const char *md_config_set_proxy(cmd_parms *cmd, void *arg, const char *va
     return NULL;
 }
 
+static const char *md_config_set_http2(cmd_parms *cmd, void *dc, const char *value)
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    const char *err;
+
+    (void)dc;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    return set_on_off(&sc->mc->http2, value, cmd->pool);
+}
+
+static const char *md_config_set_renew_parallel(cmd_parms *cmd, void *dc, 
+                                                const char *v1, const char *v2)
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    const char *err;
+    int n, n_ca;
+
+    (void)dc;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    n = (int)apr_atoi64(v1);
+    n_ca = v2? (int)apr_atoi64(v2) : n;
+    if (n < 1 || n > 256) {
+        return "number of parallel renewals must be between 1 and 256";
+    }
+    if (n_ca < 1) {
+        return "number of parallel renewals per CA must be at least 1";
+    }
+    sc->mc->renew_parallel = n;
+    sc->mc->renew_parallel_ca = (n_ca > n)? n : n_ca;
+    return NULL;
+}
+
+static const char *md_config_set_keypool(cmd_parms *cmd, void *dc, const char *value)
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    const char *err;
+    int n;
+
+    (void)dc;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    n = (int)apr_atoi64(value);
+    if (!apr_isdigit(value[0]) || n < 0 || n > MD_KEYPOOL_DEPTH_MAX) {
+        return apr_psprintf(cmd->pool, "number of pooled keys must be between 0 and %d",
+                            MD_KEYPOOL_DEPTH_MAX);
+    }
+    sc->mc->keypool_depth = n;
+    return NULL;
+}
+
+static const char *md_config_set_rate_limits(cmd_parms *cmd, void *dc, 
+                                             int argc, char *const argv[])
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    const char *err, *sep;
+    int i, n, *plimit;
+
+    (void)dc;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    for (i = 0; i < argc; ++i) {
+        if (!(sep = strchr(argv[i], '='))) {
+            return apr_pstrcat(cmd->pool, "expected name=number, not: ", argv[i], NULL);
+        }
+        if (!strncmp("orders=", argv[i], (apr_size_t)(sep - argv[i] + 1))) {
+            plimit = &sc->mc->limit_orders;
+        }
+        else if (!strncmp("accounts=", argv[i], (apr_size_t)(sep - argv[i] + 1))) {
+            plimit = &sc->mc->limit_accounts;
+        }
+        else if (!strncmp("failed-validations=", argv[i], (apr_size_t)(sep - argv[i] + 1))) {
+            plimit = &sc->mc->limit_failed_authz;
+        }
+        else {
+            return apr_pstrcat(cmd->pool, "unknown rate limit: ", argv[i], NULL);
+        }
+        n = (int)apr_atoi64(sep + 1);
+        if (n < 0) {
+            return apr_pstrcat(cmd->pool, "rate limit must not be negative: ", argv[i], NULL);
+        }
+        *plimit = n;
+    }
+    return NULL;
+}
+
 static const char *md_config_set_store_dir(cmd_parms *cmd, void *arg, const char *value)
 {
     md_srv_conf_t *sc = md_config_get(cmd->server);
@@ -750,8 +852,10 @@ static const char *md_config_set_pkeys(cmd_parms *cmd, void *dc,
                                        int argc, char *const argv[])
 {
     md_srv_conf_t *config = md_config_get(cmd->server);
-    const char *err, *ptype;
+    md_pkey_spec_t *spec = NULL;
+    const char *err, *ptype, *curve;
     apr_int64_t bits;
+    int i;
     
     (void)dc;
     if ((err = md_conf_check_location(cmd, MD_LOC_ALL))) {
@@ -761,42 +865,73 @@ static const char *md_config_set_pkeys(cmd_parms *cmd, void *dc,
         return "needs to specify the private key type";
     }
     
-    ptype = argv[0];
-    if (!apr_strnatcasecmp("Default", ptype)) {
-        if (argc > 1) {
-            return "type 'Default' takes no parameter";
-        }
-        if (!config->pkey_spec) {
-            config->pkey_spec = apr_pcalloc(cmd->pool, sizeof(*config->pkey_spec));
+    /* Several types may be given, e.g. "RSA 3072 EC P-256", and a certificate
+     * is obtained for each. A number following RSA is its size in bits, 
+     * a name following EC is its curve. */
+    config->pks = md_pkeys_spec_make(cmd->pool);
+    for (i = 0; i < argc; ++i) {
+        ptype = argv[i];
+        if (!apr_strnatcasecmp("Default", ptype)) {
+            if (argc > 1) {
+                return "type 'Default' takes no parameter";
+            }
+            spec = apr_pcalloc(cmd->pool, sizeof(*spec));
+            spec->type = MD_PKEY_TYPE_DEFAULT;
         }
-        config->pkey_spec->type = MD_PKEY_TYPE_DEFAULT;
-        return NULL;
-    }
-    else if (!apr_strnatcasecmp("RSA", ptype)) {
-        if (argc == 1) {
+        else if (!apr_strnatcasecmp("RSA", ptype)) {
             bits = MD_PKEY_RSA_BITS_DEF;
+            if (i+1 < argc && apr_isdigit(argv[i+1][0])) {
+                bits = (int)apr_atoi64(argv[++i]);
+                if (bits < MD_PKEY_RSA_BITS_MIN || bits >= INT_MAX) {
+                    return apr_psprintf(cmd->pool, "must be %d or higher in order to be considered "
+                    "safe. Too large a value will slow down everything. Larger then 4096 probably does "
+                    "not make sense unless quantum cryptography really changes spin.", 
+                    MD_PKEY_RSA_BITS_MIN);
+                }
+            }
+            spec = apr_pcalloc(cmd->pool, sizeof(*spec));
+            spec->type = MD_PKEY_TYPE_RSA;
+            spec->params.rsa.bits = (unsigned int)bits;
+        }
+        else if (!apr_strnatcasecmp("EC", ptype)) {
+            curve = MD_PKEY_EC_CURVE_DEF;
+            if (i+1 < argc && apr_strnatcasecmp("RSA", argv[i+1]) 
+                && apr_strnatcasecmp("Ed25519", argv[i+1])) {
+                if (!(curve = md_pkey_ec_curve_name(argv[++i]))) {
+                    return apr_pstrcat(cmd->pool, "unsupported curve \"", argv[i], 
+                                       "\", use P-256 or P-384", NULL);
+                }
+            }
+            spec = apr_pcalloc(cmd->pool, sizeof(*spec));
+            spec->type = MD_PKEY_TYPE_EC;
+            spec->params.ec.curve = curve;
+        }
+        else if (!apr_strnatcasecmp("Ed25519", ptype)) {
+            spec = apr_pcalloc(cmd->pool, sizeof(*spec));
+            spec->type = MD_PKEY_TYPE_ED25519;
         }
-        else if (argc == 2) {
-            bits = (int)apr_atoi64(argv[1]);
-            if (bits < MD_PKEY_RSA_BITS_MIN || bits >= INT_MAX) {
-                return apr_psprintf(cmd->pool, "must be %d or higher in order to be considered "
-                "safe. Too large a value will slow down everything. Larger then 4096 probably does "
-                "not make sense unless quantum cryptography really changes spin.", 
-                MD_PKEY_RSA_BITS_MIN);
+        else if (spec) {
+            /* something we do not know, following a complete type */
+            switch (spec->type) {
+                case MD_PKEY_TYPE_RSA:
+                    return "key type 'RSA' has only one optional parameter, the number of bits";
+                case MD_PKEY_TYPE_EC:
+                    return "key type 'EC' has only one optional parameter, the curve";
+                default:
+                    return "type 'Ed25519' takes no parameter";
             }
         }
         else {
-            return "key type 'RSA' has only one optional parameter, the number of bits";
+            return apr_pstrcat(cmd->pool, "unsupported private key type \"", ptype, "\"", NULL);
         }
-
-        if (!config->pkey_spec) {
-            config->pkey_spec = apr_pcalloc(cmd->pool, sizeof(*config->pkey_spec));
+        
+        /* The certificates are stored by key type, one of each is all we can have */
+        if (md_pkeys_spec_contains_type(config->pks, spec->type)) {
+            return apr_pstrcat(cmd->pool, "key type \"", ptype, "\" is given more than once", NULL);
         }
-        config->pkey_spec->type = MD_PKEY_TYPE_RSA;
-        config->pkey_spec->params.rsa.bits = (unsigned int)bits;
-        return NULL;
+        md_pkeys_spec_add(config->pks, spec);
     }
-    return apr_pstrcat(cmd->pool, "unsupported private key type \"", ptype, "\"", NULL);
+    return NULL;
 }
 
 static const char *md_config_set_notify_cmd(cmd_parms *cmd, void *mconfig, const char *arg)
@@ -825,6 +960,42 @@ static const char *md_config_set_msg_cmd(cmd_parms *cmd, void *mconfig, const ch
     return NULL;
 }
 
+static const char *md_config_set_cmd_limits(cmd_parms *cmd, void *dc, 
+                                            int argc, char *const argv[])
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    apr_interval_time_t timeout;
+    const char *err, *sep;
+    int i, n;
+
+    (void)dc;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    for (i = 0; i < argc; ++i) {
+        if (!(sep = strchr(argv[i], '='))) {
+            return apr_pstrcat(cmd->pool, "expected name=value, not: ", argv[i], NULL);
+        }
+        if (!strncmp("parallel=", argv[i], (apr_size_t)(sep - argv[i] + 1))) {
+            n = (int)apr_atoi64(sep + 1);
+            if (n < 1 || n > 256) {
+                return "number of parallel commands must be between 1 and 256";
+            }
+            sc->mc->cmd_parallel = n;
+        }
+        else if (!strncmp("timeout=", argv[i], (apr_size_t)(sep - argv[i] + 1))) {
+            if (md_duration_parse(&timeout, sep + 1, "s") != APR_SUCCESS) {
+                return apr_pstrcat(cmd->pool, "unrecognized duration format: ", argv[i], NULL);
+            }
+            sc->mc->cmd_timeout = timeout;
+        }
+        else {
+            return apr_pstrcat(cmd->pool, "unknown command limit: ", argv[i], NULL);
+        }
+    }
+    return NULL;
+}
+
 static const char *md_config_set_dns01_cmd(cmd_parms *cmd, void *mconfig, const char *arg)
 {
     md_srv_conf_t *sc = md_config_get(cmd->server);
@@ -838,6 +1009,28 @@ static const char *md_config_set_dns01_cmd(cmd_parms *cmd, void *mconfig, const
     return NULL;
 }
 
+static const char *md_config_set_dns01_batch(cmd_parms *cmd, void *mconfig, const char *value)
+{
+    md_srv_conf_t *sc = md_config_get(cmd->server);
+    const char *err;
+    int batch;
+
+    (void)mconfig;
+    if ((err = md_conf_check_location(cmd, MD_LOC_NOT_MD))) {
+        return err;
+    }
+    if ((err = set_on_off(&batch, value, cmd->pool))) {
+        return err;
+    }
+    if (batch) {
+        apr_table_setn(sc->mc->env, MD_KEY_CMD_DNS01_BATCH, "on");
+    }
+    else {
+        apr_table_unset(sc->mc->env, MD_KEY_CMD_DNS01_BATCH);
+    }
+    return NULL;
+}
+
 static const char *md_config_set_cert_file(cmd_parms *cmd, void *mconfig, const char *arg)
 {
     md_srv_conf_t *sc = md_config_get(cmd->server);
@@ -983,9 +1176,21 @@ const command_rec md_cmds[] = {
                   "internet. Use 80:- to indicate that port 80 is not reachable from "
                   "the outside."),
     AP_INIT_TAKE_ARGV("MDPrivateKeys", md_config_set_pkeys, NULL, RSRC_CONF, 
-                  "set the type and parameters for private key generation"),
+                  "set the types and parameters for private key generation, one certificate is "
+                  "obtained for each: RSA [bits], EC [curve] and/or Ed25519"),
     AP_INIT_TAKE1("MDHttpProxy", md_config_set_proxy, NULL, RSRC_CONF, 
                   "URL of a HTTP(S) proxy to use for outgoing connections"),
+    AP_INIT_TAKE1("MDHttp2", md_config_set_http2, NULL, RSRC_CONF, 
+                  "On to use HTTP/2 for outgoing connections to servers supporting it."),
+    AP_INIT_TAKE12("MDRenewParallel", md_config_set_renew_parallel, NULL, RSRC_CONF, 
+                  "Max number of certificate renewals running in parallel, optionally "
+                  "followed by the max number of those using the same CA."),
+    AP_INIT_TAKE1("MDKeyPool", md_config_set_keypool, NULL, RSRC_CONF, 
+                  "Number of private keys of each type in use to generate ahead of time, "
+                  "so that renewals need not wait on it. 0 disables the pool."),
+    AP_INIT_TAKE_ARGV("MDRateLimits", md_config_set_rate_limits, NULL, RSRC_CONF, 
+                  "New orders, new accounts and failed validations allowed per hour and CA, "
+                  "given as orders=n accounts=n failed-validations=n. 0 means no limit."),
     AP_INIT_TAKE1("MDStoreDir", md_config_set_store_dir, NULL, RSRC_CONF, 
                   "the directory for file system storage of managed domain data."),
     AP_INIT_TAKE1("MDRenewWindow", md_config_set_renew_window, NULL, RSRC_CONF, 
@@ -998,6 +1203,8 @@ const command_rec md_cmds[] = {
                   "Allow managing of base server outside virtual hosts."),
     AP_INIT_RAW_ARGS("MDChallengeDns01", md_config_set_dns01_cmd, NULL, RSRC_CONF, 
                   "Set the command for setup/teardown of dns-01 challenges"),
+    AP_INIT_TAKE1("MDChallengeDns01Batch", md_config_set_dns01_batch, NULL, RSRC_CONF, 
+                  "Set up/tear down all dns-01 challenges of an order with one command call"),
     AP_INIT_TAKE1("MDCertificateFile", md_config_set_cert_file, NULL, RSRC_CONF, 
                   "set the static certificate (chain) file to use for this domain."),
     AP_INIT_TAKE1("MDCertificateKeyFile", md_config_set_key_file, NULL, RSRC_CONF, 
@@ -1010,6 +1217,9 @@ const command_rec md_cmds[] = {
                   "When less time remains for a certificate, send our/log a warning (defaults to days)"),
     AP_INIT_RAW_ARGS("MDMessageCmd", md_config_set_msg_cmd, NULL, RSRC_CONF, 
                   "Set the command run when a message about a domain is issued."),
+    AP_INIT_TAKE_ARGV("MDCmdLimits", md_config_set_cmd_limits, NULL, RSRC_CONF, 
+                  "How many MDNotifyCmd/MDMessageCmd run at the same time and how long they "
+                  "may take, given as parallel=n timeout=duration. A timeout of 0 means none."),
     AP_INIT_TAKE1("MDStapling", md_config_set_stapling, NULL, RSRC_CONF, 
                   "Enable/Disable OCSP Stapling for this/all Managed Domain(s)."),
     AP_INIT_TAKE1("MDStapleOthers", md_config_set_staple_others, NULL, RSRC_CONF, 
@@ -21,7 +21,16 @@ struct apr_hash_t;
 struct md_store_t;
 struct md_reg_t;
 struct md_ocsp_reg_t;
-struct md_pkey_spec_t;
+struct md_pkeys_spec_t;
+
+#define MD_RENEW_PARALLEL_DEF       4
+#define MD_RENEW_PARALLEL_CA_DEF    2
+#define MD_CMD_PARALLEL_DEF         4
+#define MD_KEYPOOL_DEPTH_DEF        1
+#define MD_KEYPOOL_DEPTH_MAX        100
+#define MD_CMD_TIMEOUT_DEF          apr_time_from_sec(5 * 60)
+/* how often a watchdog looks after commands it has running */
+#define MD_CMD_POLL_INTERVAL        apr_time_from_sec(1)
 
 typedef enum {
     MD_CONFIG_CA_URL,
@@ -46,6 +55,13 @@ struct md_mod_conf_t {
     apr_array_header_t *mds;           /* all md_t* defined in the config, shared */
     const char *base_dir;              /* base dir for store */
     const char *proxy_url;             /* proxy url to use (or NULL) */
+    int http2;                         /* use HTTP/2 with servers that support it */
+    int renew_parallel;                /* max number of renewals running in parallel */
+    int renew_parallel_ca;             /* max number of those talking to the same CA */
+    int limit_orders;                  /* new orders per hour and CA, 0 for unlimited */
+    int limit_accounts;                /* new accounts per hour and CA, 0 for unlimited */
+    int limit_failed_authz;            /* failed validations per hour and CA, 0 for unlimited */
+    int keypool_depth;                 /* keys to generate ahead of time per key spec */
     struct md_reg_t *reg;              /* md registry instance */
     struct md_ocsp_reg_t *ocsp;        /* ocsp status registry */
 
@@ -61,6 +77,10 @@ struct md_mod_conf_t {
 
     const char *notify_cmd;            /* notification command to execute on signup/renew */
     const char *message_cmd;           /* message command to execute on signup/renew/warnings */
+    int cmd_parallel;                  /* max number of notify/message commands running */
+    apr_interval_time_t cmd_timeout;   /* commands running longer get killed, 0 for never */
+    struct md_util_exec_pool_t *cmds;  /* runs commands for renewal jobs */
+    struct md_util_exec_pool_t *ocsp_cmds; /* runs commands for ocsp jobs */
     struct apr_table_t *env;           /* environment for operation */
     int dry_run;                       /* != 0 iff config dry run */
     int server_status_enabled;         /* if module should add to server-status handler */
@@ -80,7 +100,7 @@ typedef struct md_srv_conf_t {
     md_require_t require_https;        /* If MDs require https: access */
     int renew_mode;                    /* mode of obtaining credentials */
     int must_staple;                   /* certificates should set the OCSP Must Staple extension */
-    struct md_pkey_spec_t *pkey_spec;  /* specification for generating private keys */
+    struct md_pkeys_spec_t *pks;       /* specification for generating private keys */
     md_timeslice_t *renew_window; /* time before expiration that starts renewal */
     md_timeslice_t *warn_window;  /* time before expiration that warning are sent out */
     
@@ -19,6 +19,9 @@
 #include <apr_hash.h>
 #include <apr_strings.h>
 #include <apr_date.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_pool.h>
 
 #include <httpd.h>
 #include <http_core.h>
@@ -55,6 +58,10 @@
 
 #define MD_RENEW_WATCHDOG_NAME   "_md_renew_"
 
+/* How long a server may drive a renewal before others sharing the store take over. */
+#define MD_RENEW_LEASE_DURATION  apr_time_from_sec(15 * 60)
+#define MD_RENEW_LEASE           "renew"
+
 static APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
 static APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
 static APR_OPTIONAL_FN_TYPE(ap_watchdog_set_callback_interval) *wd_set_interval;
@@ -64,19 +71,91 @@ struct md_renew_ctx_t {
     server_rec *s;
     md_mod_conf_t *mc;
     ap_watchdog_t *watchdog;
+    const char *lease_owner;
+    apr_time_t regular_at;          /* next run for jobs without a next_run of their own */
     
     apr_array_header_t *jobs;
 };
 
-static void process_drive_job(md_renew_ctx_t *dctx, md_job_t *job, apr_pool_t *ptemp)
-{
+typedef enum {
+    MD_DRIVE_TODO,                  /* not looked at yet */
+    MD_DRIVE_RUNNING,               /* renewal running in a worker */
+    MD_DRIVE_DONE,                  /* renewal done, job needs update */
+    MD_DRIVE_FINISHED,              /* job updated and saved */
+} md_drive_state_t;
+
+typedef struct {
+    md_renew_ctx_t *dctx;
+    md_job_t *job;
     const md_t *md;
-    md_result_t *result = NULL;
+    const char *ca;                 /* CA the renewal talks to, for per CA limits */
+    apr_time_t expires;             /* end of current certificate, 0 if there is none */
+    apr_pool_t *p;                  /* own pool with own allocator, usable in a worker */
+    md_result_t *result;
+    md_store_lease_t *lease;
+    apr_time_t lease_renew_at;      /* when to renew the lease while the renewal runs */
+    md_result_change_cb *on_change; /* result observer the lease renewal chains to */
+    void *on_change_data;
+    md_drive_state_t state;
+    int renewed;                    /* a renewal was run for the task */
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *done;
+#endif
+} drive_task_t;
+
+static apr_time_t next_run_default(void)
+{
+    /* we'd like to run at least twice a day by default */
+    return apr_time_now() + apr_time_from_sec(MD_SECS_PER_DAY / 2);
+}
+
+static void drive_task_leave(drive_task_t *task)
+{
+    md_renew_ctx_t *dctx = task->dctx;
+    md_job_t *job = task->job;
+    apr_status_t rv;
+    
+    if (job->dirty && task->result) {
+        rv = md_job_save(job, task->result, task->p);
+        ap_log_error(APLOG_MARK, APLOG_TRACE1, rv, dctx->s, "%s: saving job props", job->mdomain);
+    }
+    if (task->lease) {
+        md_store_lease_release(md_reg_store_get(dctx->mc->reg), task->p, task->lease);
+        task->lease = NULL;
+    }
+}
+
+static void drive_task_expiry(drive_task_t *task)
+{
+    md_renew_ctx_t *dctx = task->dctx;
+    md_job_t *job = task->job;
+    
+    if (!job->finished && md_reg_should_warn(dctx->mc->reg, task->md, dctx->p)) {
+        ap_log_error( APLOG_MARK, APLOG_TRACE1, 0, dctx->s,
+                     "md(%s): warn about expiration", task->md->name);
+        md_job_start_run(job, task->result, md_reg_store_get(dctx->mc->reg));
+        if (APR_SUCCESS == md_job_notify(job, "expiring", task->result)) {
+            md_result_set(task->result, APR_SUCCESS, NULL);
+        }
+        md_job_end_run(job, task->result);
+    }
+}
+
+/* Prepare the job for driving, in the watchdog thread. Returns != 0 when a renewal
+ * is to be run, otherwise the job has been handled completely. */
+static int drive_task_start(drive_task_t *task)
+{
+    md_renew_ctx_t *dctx = task->dctx;
+    md_job_t *job = task->job;
+    const md_t *md = task->md;
+    md_store_t *store = md_reg_store_get(dctx->mc->reg);
+    apr_time_t renew_at;
     apr_status_t rv;
     
     md_job_load(job);
     /* Evaluate again on loaded value. Values will change when watchdog switches child process */
-    if (apr_time_now() < job->next_run) return;
+    if (apr_time_now() < job->next_run) return 0;
     
     job->next_run = 0;
     if (job->finished && job->notified) {
@@ -84,11 +163,10 @@ static void process_drive_job(md_renew_ctx_t *dctx, md_job_t *job, apr_pool_t *p
         goto leave;
     }
     
-    md = md_get_by_name(dctx->mc->mds, job->mdomain);
-    AP_DEBUG_ASSERT(md);
-
-    result = md_result_md_make(ptemp, md->name);
-    if (job->last_result) md_result_assign(result, job->last_result);
+    task->result = md_result_md_make(task->p, md->name);
+    if (job->last_result) md_result_assign(task->result, job->last_result);
+    /* a delay only means something to the run that asked for it */
+    task->result->ready_at = 0;
     
     if (md->state == MD_S_MISSING_INFORMATION) {
         /* Missing information, this will not change until configuration
@@ -107,53 +185,376 @@ static void process_drive_job(md_renew_ctx_t *dctx, md_job_t *job, apr_pool_t *p
         ap_log_error( APLOG_MARK, APLOG_DEBUG, 0, dctx->s, APLOGNO(10052) 
                      "md(%s): state=%d, driving", job->mdomain, md->state);
 
+        /* The CA may want the certificate renewed at another time than we would. */
+        rv = md_reg_renewal_info_update(dctx->mc->reg, md, dctx->mc->env, 
+                                        md_result_md_make(task->p, md->name), task->p);
+        if (APR_SUCCESS != rv && !APR_STATUS_IS_ENOENT(rv)) {
+            ap_log_error( APLOG_MARK, APLOG_DEBUG, rv, dctx->s, 
+                         "md(%s): unable to update renewal information from CA", job->mdomain);
+        }
+        
         if (!md_reg_should_renew(dctx->mc->reg, md, dctx->p)) {
             ap_log_error( APLOG_MARK, APLOG_DEBUG, 0, dctx->s, APLOGNO(10053) 
                          "md(%s): no need to renew", job->mdomain);
+            /* Come back in time if renewal is due before our next regular run. */
+            renew_at = md_reg_renew_at(dctx->mc->reg, md, task->p);
+            if (renew_at && renew_at < next_run_default()) {
+                job->next_run = renew_at;
+            }
             goto expiry;
         }
     
-        md_job_start_run(job, result, md_reg_store_get(dctx->mc->reg)); 
-        md_reg_renew(dctx->mc->reg, md, dctx->mc->env, 0, result, ptemp);
-        md_job_end_run(job, result);
-        
-        if (APR_SUCCESS == result->status) {
-            /* Finished jobs might take a while before the results become valid.
-             * If that is in the future, request to run then */
-            if (apr_time_now() < result->ready_at) {
-                md_job_retry_at(job, result->ready_at);
-                goto leave;
-            }
-            
-            if (!job->notified) md_job_notify(job, "renewed", result);
+        /* Other servers sharing our store may be driving this already. */
+        rv = md_store_lease_acquire(&task->lease, store, task->p, md->name, MD_RENEW_LEASE, 
+                                    dctx->lease_owner, MD_RENEW_LEASE_DURATION);
+        if (APR_STATUS_IS_EBUSY(rv)) {
+            ap_log_error( APLOG_MARK, APLOG_DEBUG, 0, dctx->s, 
+                         "md(%s): renewal driven by %s, look again at %s", job->mdomain, 
+                         task->lease->owner, 
+                         md_duration_print(task->p, task->lease->expires - apr_time_now()));
+            /* Not ours to save, the lease holder updates the job in the store. */
+            job->next_run = task->lease->expires;
+            task->lease = NULL;
+            return 0;
         }
-        else {
-            ap_log_error( APLOG_MARK, APLOG_ERR, result->status, dctx->s, APLOGNO(10056) 
-                         "processing %s: %s", job->mdomain, result->detail);
-            md_job_log_append(job, "renewal-error", result->problem, result->detail);
-            md_job_holler(job, "errored");
-            ap_log_error(APLOG_MARK, APLOG_INFO, 0, dctx->s, APLOGNO(10057) 
-                         "%s: encountered error for the %d. time, next run in %s",
-                         job->mdomain, job->error_runs, 
-                         md_duration_print(ptemp, job->next_run - apr_time_now()));
+        else if (APR_SUCCESS != rv && !APR_STATUS_IS_ENOTIMPL(rv)) {
+            ap_log_error( APLOG_MARK, APLOG_WARNING, rv, dctx->s, 
+                         "md(%s): unable to get renewal lease, driving anyway", job->mdomain);
         }
+        
+        md_job_start_run(job, task->result, store); 
+        return 1;
     }
 
 expiry:
-    if (!job->finished && md_reg_should_warn(dctx->mc->reg, md, dctx->p)) {
-        ap_log_error( APLOG_MARK, APLOG_TRACE1, 0, dctx->s,
-                     "md(%s): warn about expiration", md->name);
-        md_job_start_run(job, result, md_reg_store_get(dctx->mc->reg));
-        if (APR_SUCCESS == md_job_notify(job, "expiring", result)) {
-            md_result_set(result, APR_SUCCESS, NULL);
+    drive_task_expiry(task);
+leave:
+    drive_task_leave(task);
+    return 0;
+}
+
+/* Run the renewal itself. This is the part that talks to the CA and may
+ * run in a worker thread, touching only the task and its job. */
+static void drive_task_progress(md_result_t *result, void *data)
+{
+    drive_task_t *task = data;
+    md_renew_ctx_t *dctx = task->dctx;
+    apr_status_t rv;
+    
+    if (task->on_change) task->on_change(result, task->on_change_data);
+    if (task->lease && apr_time_now() >= task->lease_renew_at) {
+        /* A renewal may take longer than the lease lasts, keep it while we make progress. */
+        task->lease_renew_at = apr_time_now() + MD_RENEW_LEASE_DURATION / 3;
+        rv = md_store_lease_renew(md_reg_store_get(dctx->mc->reg), task->p, task->lease, 
+                                  MD_RENEW_LEASE_DURATION);
+        if (APR_SUCCESS != rv) {
+            ap_log_error( APLOG_MARK, APLOG_WARNING, rv, dctx->s, 
+                         "md(%s): unable to renew the renewal lease", task->md->name);
         }
-        md_job_end_run(job, result);
     }
+}
+
+static void drive_task_renew(drive_task_t *task)
+{
+    md_renew_ctx_t *dctx = task->dctx;
+    md_result_t *result = task->result;
+    
+    if (task->lease) {
+        task->on_change = result->on_change;
+        task->on_change_data = result->on_change_data;
+        task->lease_renew_at = apr_time_now() + MD_RENEW_LEASE_DURATION / 3;
+        md_result_on_change(result, drive_task_progress, task);
+    }
+    md_reg_renew(dctx->mc->reg, task->md, dctx->mc->env, 0, result, task->p);
+    if (task->lease) {
+        md_result_on_change(result, task->on_change, task->on_change_data);
+    }
+    task->renewed = 1;
+}
 
+/* Update the job with the renewal result, in the watchdog thread. */
+static void drive_task_finish(drive_task_t *task)
+{
+    md_renew_ctx_t *dctx = task->dctx;
+    md_job_t *job = task->job;
+    md_result_t *result = task->result;
+    md_store_t *store = md_reg_store_get(dctx->mc->reg);
+    
+    if (task->lease && APR_STATUS_IS_EBUSY(md_store_lease_check(store, task->p, task->lease))) {
+        /* We took too long and another server has taken over. Its results
+         * are the ones that count, ours must not overwrite them. */
+        ap_log_error( APLOG_MARK, APLOG_WARNING, 0, dctx->s, 
+                     "md(%s): renewal lease expired, leaving the result to others", 
+                     job->mdomain);
+        job->dirty = 0;
+        job->next_run = apr_time_now() + MD_RENEW_LEASE_DURATION;
+        task->lease = NULL;
+        goto leave;
+    }
+    md_job_end_run(job, result);
+    
+    if (APR_SUCCESS == result->status) {
+        /* Finished jobs might take a while before the results become valid.
+         * If that is in the future, request to run then */
+        if (apr_time_now() < result->ready_at) {
+            md_job_retry_at(job, result->ready_at);
+            goto leave;
+        }
+        
+        if (!job->notified) md_job_notify(job, "renewed", result);
+    }
+    else if (APR_STATUS_IS_EAGAIN(result->status) && result->ready_at) {
+        /* the renewal waits on the CA and is resumed when the next poll is due */
+        ap_log_error( APLOG_MARK, APLOG_DEBUG, 0, dctx->s, 
+                     "md(%s): %s", job->mdomain, result->detail);
+        goto leave;
+    }
+    else {
+        ap_log_error( APLOG_MARK, APLOG_ERR, result->status, dctx->s, APLOGNO(10056) 
+                     "processing %s: %s", job->mdomain, result->detail);
+        md_job_log_append(job, "renewal-error", result->problem, result->detail);
+        md_job_holler(job, "errored");
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, dctx->s, APLOGNO(10057) 
+                     "%s: encountered error for the %d. time, next run in %s",
+                     job->mdomain, job->error_runs, 
+                     md_duration_print(task->p, job->next_run - apr_time_now()));
+    }
+    drive_task_expiry(task);
 leave:
-    if (job->dirty && result) {
-        rv = md_job_save(job, result, ptemp);
-        ap_log_error(APLOG_MARK, APLOG_TRACE1, rv, dctx->s, "%s: saving job props", job->mdomain);
+    drive_task_leave(task);
+}
+
+static void drive_task_serial(drive_task_t *task)
+{
+    if (drive_task_start(task)) {
+        drive_task_renew(task);
+        drive_task_finish(task);
+    }
+    task->state = MD_DRIVE_FINISHED;
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC drive_task_exec(apr_thread_t *thread, void *data)
+{
+    drive_task_t *task = data;
+    
+    (void)thread;
+    drive_task_renew(task);
+    apr_thread_mutex_lock(task->mutex);
+    task->state = MD_DRIVE_DONE;
+    apr_thread_cond_signal(task->done);
+    apr_thread_mutex_unlock(task->mutex);
+    return NULL;
+}
+
+static int *ca_running(apr_hash_t *per_ca, const char *ca, apr_pool_t *p)
+{
+    int *count = apr_hash_get(per_ca, ca, APR_HASH_KEY_STRING);
+    
+    if (!count) {
+        count = apr_pcalloc(p, sizeof(*count));
+        apr_hash_set(per_ca, ca, APR_HASH_KEY_STRING, count);
+    }
+    return count;
+}
+
+/* Drive the tasks with renewals running in up to mc->renew_parallel worker threads,
+ * at most mc->renew_parallel_ca of them against the same CA. Starting tasks and 
+ * updating jobs with their results happens here in the watchdog thread, one at a time, 
+ * so job state, notifications and saving are not affected by the parallelism. 
+ * Tasks are only started when a worker is available, not to hold leases while waiting. */
+static apr_status_t drive_tasks_parallel(md_renew_ctx_t *dctx, apr_array_header_t *tasks, 
+                                         apr_pool_t *ptemp)
+{
+    apr_thread_pool_t *tpool;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *done;
+    apr_hash_t *per_ca;
+    drive_task_t *task;
+    int i, running = 0, finished = 0, progress, renew, *count;
+    apr_status_t rv;
+    
+    if (!MD_OK(apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, ptemp))
+        || !MD_OK(apr_thread_cond_create(&done, ptemp))
+        || !MD_OK(apr_thread_pool_create(&tpool, 0, (apr_size_t)dctx->mc->renew_parallel, 
+                                         ptemp))) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, dctx->s, 
+                     "unable to setup parallel renewals, driving one at a time");
+        return rv;
+    }
+    per_ca = apr_hash_make(ptemp);
+    
+    apr_thread_mutex_lock(mutex);
+    while (finished < tasks->nelts) {
+        progress = 0;
+        for (i = 0; i < tasks->nelts; ++i) {
+            task = APR_ARRAY_IDX(tasks, i, drive_task_t*);
+            count = ca_running(per_ca, task->ca, ptemp);
+            switch (task->state) {
+                case MD_DRIVE_DONE:
+                    --running;
+                    --(*count);
+                    apr_thread_mutex_unlock(mutex);
+                    drive_task_finish(task);
+                    apr_thread_mutex_lock(mutex);
+                    task->state = MD_DRIVE_FINISHED;
+                    ++finished;
+                    progress = 1;
+                    break;
+                case MD_DRIVE_TODO:
+                    if (running >= dctx->mc->renew_parallel
+                        || *count >= dctx->mc->renew_parallel_ca) {
+                        break;
+                    }
+                    apr_thread_mutex_unlock(mutex);
+                    renew = drive_task_start(task);
+                    apr_thread_mutex_lock(mutex);
+                    progress = 1;
+                    if (!renew) {
+                        task->state = MD_DRIVE_FINISHED;
+                        ++finished;
+                        break;
+                    }
+                    task->mutex = mutex;
+                    task->done = done;
+                    task->state = MD_DRIVE_RUNNING;
+                    ++running;
+                    ++(*count);
+                    if (APR_SUCCESS != apr_thread_pool_push(tpool, drive_task_exec, task, 
+                                                            APR_THREAD_TASK_PRIORITY_NORMAL, 
+                                                            NULL)) {
+                        /* no worker to be had, renew right here */
+                        apr_thread_mutex_unlock(mutex);
+                        drive_task_renew(task);
+                        apr_thread_mutex_lock(mutex);
+                        task->state = MD_DRIVE_DONE;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (!progress) {
+            /* all remaining tasks are running or wait for a free slot */
+            apr_thread_cond_wait(done, mutex);
+        }
+    }
+    apr_thread_mutex_unlock(mutex);
+    apr_thread_pool_destroy(tpool);
+    return APR_SUCCESS;
+}
+#endif
+
+/* Order tasks by urgency: MDs without a certificate first, then the ones expiring
+ * soonest. These get the CA's rate limit budget before the others. */
+static int drive_task_cmp(const void *v1, const void *v2)
+{
+    const drive_task_t *t1 = *(const drive_task_t * const *)v1;
+    const drive_task_t *t2 = *(const drive_task_t * const *)v2;
+
+    if (t1->expires == t2->expires) return strcmp(t1->md->name, t2->md->name);
+    return (t1->expires < t2->expires)? -1 : 1;
+}
+
+/* Drive all jobs that are due, returns the number of renewals run. */
+static int drive_jobs(md_renew_ctx_t *dctx, apr_pool_t *ptemp)
+{
+    const md_pubcert_t *pub;
+    apr_array_header_t *tasks;
+    apr_allocator_t *allocator;
+    drive_task_t *task;
+    md_job_t *job;
+    int i, renewed = 0;
+    
+    tasks = apr_array_make(ptemp, dctx->jobs->nelts, sizeof(drive_task_t*));
+    for (i = 0; i < dctx->jobs->nelts; ++i) {
+        job = APR_ARRAY_IDX(dctx->jobs, i, md_job_t *);
+        if (apr_time_now() < job->next_run) continue;
+        /* A run early to poll commands is not one of the regular runs. */
+        if (!job->next_run && apr_time_now() < dctx->regular_at) continue;
+        
+        task = apr_pcalloc(ptemp, sizeof(*task));
+        task->dctx = dctx;
+        task->job = job;
+        task->md = md_get_by_name(dctx->mc->mds, job->mdomain);
+        AP_DEBUG_ASSERT(task->md);
+        task->ca = task->md->ca_url? task->md->ca_url : "";
+        if (APR_SUCCESS == md_reg_get_pubcert(&pub, dctx->mc->reg, task->md, 0, ptemp)
+            && pub->meta) {
+            task->expires = pub->meta->not_after;
+        }
+        task->state = MD_DRIVE_TODO;
+        /* Created here as pools are not thread-safe. Renewals running in a worker
+         * allocate from it exclusively. */
+        if (APR_SUCCESS != apr_allocator_create(&allocator)) continue;
+        if (APR_SUCCESS != apr_pool_create_ex(&task->p, ptemp, NULL, allocator)) {
+            apr_allocator_destroy(allocator);
+            continue;
+        }
+        apr_allocator_owner_set(allocator, task->p);
+        apr_pool_tag(task->p, "md_drive_task");
+        APR_ARRAY_PUSH(tasks, drive_task_t*) = task;
+    }
+    if (tasks->nelts > 1) {
+        qsort(tasks->elts, (size_t)tasks->nelts, sizeof(drive_task_t*), drive_task_cmp);
+    }
+    
+#if APR_HAS_THREADS
+    if (dctx->mc->renew_parallel > 1 && tasks->nelts > 1
+        && APR_SUCCESS == drive_tasks_parallel(dctx, tasks, ptemp)) {
+        goto leave;
+    }
+#endif
+    for (i = 0; i < tasks->nelts; ++i) {
+        drive_task_serial(APR_ARRAY_IDX(tasks, i, drive_task_t*));
+    }
+#if APR_HAS_THREADS
+leave:
+#endif
+    for (i = 0; i < tasks->nelts; ++i) {
+        task = APR_ARRAY_IDX(tasks, i, drive_task_t*);
+        if (task->renewed) ++renewed;
+        apr_pool_destroy(task->p);
+    }
+    return renewed;
+}
+
+/* Generate private keys ahead of time for all key specs of the MDs we drive and
+ * for fallback certificates, so renewals find them in the pool. This runs in the
+ * watchdog, so only one key per spec is added each time. The pool fills up over
+ * several idle runs. */
+static void keypool_fill(md_renew_ctx_t *dctx, apr_pool_t *ptemp)
+{
+    apr_array_header_t *specs;
+    md_pkey_spec_t *spec;
+    const md_t *md;
+    md_job_t *job;
+    int i, j, k, generated, total = 0;
+    
+    specs = apr_array_make(ptemp, 5, sizeof(md_pkey_spec_t*));
+    /* the default spec, as used for fallback certificates */
+    APR_ARRAY_PUSH(specs, md_pkey_spec_t*) = NULL;
+    for (i = 0; i < dctx->jobs->nelts; ++i) {
+        job = APR_ARRAY_IDX(dctx->jobs, i, md_job_t *);
+        md = md_get_by_name(dctx->mc->mds, job->mdomain);
+        if (!md || !md_will_renew_cert(md)) continue;
+        for (j = 0; j < md_pkeys_spec_count(md->pks); ++j) {
+            spec = md_pkeys_spec_get(md->pks, j);
+            for (k = 0; k < specs->nelts; ++k) {
+                if (md_pkey_spec_eq(spec, APR_ARRAY_IDX(specs, k, md_pkey_spec_t*))) break;
+            }
+            if (k >= specs->nelts) APR_ARRAY_PUSH(specs, md_pkey_spec_t*) = spec;
+        }
+    }
+    md_reg_keypool_prune(dctx->mc->reg, specs, ptemp);
+    for (i = 0; i < specs->nelts; ++i) {
+        spec = APR_ARRAY_IDX(specs, i, md_pkey_spec_t*);
+        md_reg_keypool_fill(dctx->mc->reg, spec, dctx->mc->keypool_depth, 1, &generated, ptemp);
+        total += generated;
+    }
+    if (total) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, dctx->s, 
+                     "md watchdog added %d keys to the key pool", total);
     }
 }
 
@@ -168,18 +569,12 @@ int md_will_renew_cert(const md_t *md)
     return 1;
 }
 
-static apr_time_t next_run_default(void)
-{
-    /* we'd like to run at least twice a day by default */
-    return apr_time_now() + apr_time_from_sec(MD_SECS_PER_DAY / 2);
-}
-
 static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
 {
     md_renew_ctx_t *dctx = baton;
     md_job_t *job;
     apr_time_t next_run, wait_time;
-    int i;
+    int i, renewed;
     
     /* mod_watchdog invoked us as a single thread inside the whole server (on this machine).
      * This might be a repeated run inside the same child (mod_watchdog keeps affinity as
@@ -195,22 +590,30 @@ static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, dctx->s, APLOGNO(10055)
                          "md watchdog run, auto drive %d mds", dctx->jobs->nelts);
                          
-            /* Process all drive jobs. They will update their next_run property
-             * and we schedule ourself at the earliest of all. A job may specify 0
+            /* Process all drive jobs, renewals in parallel as configured. They will 
+             * update their next_run property and we schedule ourself at the earliest of all. A job may specify 0
              * as next_run to indicate that it wants to participate in the normal
              * regular runs. */
+            md_util_exec_poll(dctx->mc->cmds);
+            renewed = drive_jobs(dctx, ptemp);
+            if (!renewed && dctx->mc->keypool_depth > 0) {
+                /* an idle run, generate the keys future renewals will need */
+                keypool_fill(dctx, ptemp);
+            }
+            
             next_run = next_run_default();
             for (i = 0; i < dctx->jobs->nelts; ++i) {
                 job = APR_ARRAY_IDX(dctx->jobs, i, md_job_t *);
-                
-                if (apr_time_now() >= job->next_run) {
-                    process_drive_job(dctx, job, ptemp);
-                }
-                
                 if (job->next_run && job->next_run < next_run) {
                     next_run = job->next_run;
                 }
             }
+            dctx->regular_at = next_run;
+            /* Notification commands run in the background, come back to look after them. */
+            if (md_util_exec_poll(dctx->mc->cmds) > 0 
+                && next_run > apr_time_now() + MD_CMD_POLL_INTERVAL) {
+                next_run = apr_time_now() + MD_CMD_POLL_INTERVAL;
+            }
 
             wait_time = next_run - apr_time_now();
             if (APLOGdebug(dctx->s)) {
@@ -223,17 +626,52 @@ static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
         case AP_WATCHDOG_STATE_STOPPING:
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, dctx->s, APLOGNO(10058)
                          "md watchdog stopping");
+            if (md_util_exec_poll(dctx->mc->cmds) > 0) {
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, dctx->s, 
+                             "md watchdog leaves notification commands running");
+            }
             break;
     }
     
     return APR_SUCCESS;
 }
 
+static int leased_elsewhere(md_store_t *store, const md_t *md, const char *owner, 
+                            server_rec *s, apr_pool_t *p)
+{
+    md_store_lease_t *lease;
+    apr_status_t rv;
+    
+    /* Another server sharing our store might be driving the renewal right now.
+     * Probe by taking the lease and giving it back immediately. */
+    rv = md_store_lease_acquire(&lease, store, p, md->name, MD_RENEW_LEASE, 
+                                owner, MD_RENEW_LEASE_DURATION);
+    if (APR_STATUS_IS_EBUSY(rv)) {
+        ap_log_error( APLOG_MARK, APLOG_DEBUG, 0, s, 
+                     "md(%s): renewal driven by %s", md->name, lease->owner);
+        return 1;
+    }
+    else if (APR_SUCCESS == rv) {
+        md_store_lease_release(store, p, lease);
+    }
+    return 0;
+}
+
+static int renewal_leased_elsewhere(md_renew_ctx_t *dctx, const md_t *md, apr_pool_t *p)
+{
+    return leased_elsewhere(md_reg_store_get(dctx->mc->reg), md, dctx->lease_owner, dctx->s, p);
+}
+
+int md_renew_leased_elsewhere(md_mod_conf_t *mc, const md_t *md, server_rec *s, apr_pool_t *p)
+{
+    return leased_elsewhere(md_reg_store_get(mc->reg), md, md_store_lease_owner(p), s, p);
+}
+
 apr_status_t md_renew_start_watching(md_mod_conf_t *mc, server_rec *s, apr_pool_t *p)
 {
     apr_allocator_t *allocator;
     md_renew_ctx_t *dctx;
-    apr_pool_t *dctxp;
+    apr_pool_t *dctxp, *jobp;
     apr_status_t rv;
     md_t *md;
     md_job_t *job;
@@ -286,19 +724,32 @@ apr_status_t md_renew_start_watching(md_mod_conf_t *mc, server_rec *s, apr_pool_
     dctx->p = dctxp;
     dctx->s = s;
     dctx->mc = mc;
+    dctx->lease_owner = md_store_lease_owner(dctxp);
     
     dctx->jobs = apr_array_make(dctx->p, mc->mds->nelts, sizeof(md_job_t *));
     for (i = 0; i < mc->mds->nelts; ++i) {
         md = APR_ARRAY_IDX(mc->mds, i, md_t*);
         if (!md || !md->watched) continue;
         
-        job = md_reg_job_make(mc->reg, md->name, p);
+        /* Jobs get their own pool with own allocator, as renewals running in 
+         * parallel worker threads record their progress there. */
+        apr_allocator_create(&allocator);
+        apr_allocator_max_free_set(allocator, 1);
+        rv = apr_pool_create_ex(&jobp, dctxp, NULL, allocator);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "md_renew_watchdog: create job pool");
+            return rv;
+        }
+        apr_allocator_owner_set(allocator, jobp);
+        apr_pool_tag(jobp, "md_renew_job");
+        
+        job = md_reg_job_make(mc->reg, md->name, jobp);
         APR_ARRAY_PUSH(dctx->jobs, md_job_t*) = job;
         ap_log_error( APLOG_MARK, APLOG_TRACE1, 0, dctx->s,  
                      "md(%s): state=%d, created drive job", md->name, md->state);
         
         md_job_load(job);
-        if (job->error_runs) {
+        if (job->error_runs && !renewal_leased_elsewhere(dctx, md, p)) {
             /* Server has just restarted. If we encounter an MD job with errors
              * on a previous driving, we purge its STAGING area.
              * This will reset the driving for the MD. It may run into the same
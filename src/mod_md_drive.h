@@ -29,6 +29,13 @@ int md_will_renew_cert(const md_t *md);
  */
 apr_status_t md_renew_start_watching(struct md_mod_conf_t *mc, server_rec *s, apr_pool_t *p);
 
+/**
+ * Return != 0 if another server sharing the store holds the renewal lease
+ * for the MD, e.g. is writing its STAGING area right now.
+ */
+int md_renew_leased_elsewhere(struct md_mod_conf_t *mc, const md_t *md, 
+                              server_rec *s, apr_pool_t *p);
+
 
 
 
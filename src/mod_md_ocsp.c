@@ -149,7 +149,13 @@ static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
              * regular runs. */
             next_run = next_run_default();
             
+            md_util_exec_poll(octx->mc->ocsp_cmds);
             md_ocsp_renew(octx->mc->ocsp, octx->p, ptemp, &next_run);
+            /* Notification commands run in the background, come back to look after them. */
+            if (md_util_exec_poll(octx->mc->ocsp_cmds) > 0 
+                && next_run > apr_time_now() + MD_CMD_POLL_INTERVAL) {
+                next_run = apr_time_now() + MD_CMD_POLL_INTERVAL;
+            }
             
             wait_time = next_run - apr_time_now();
             if (APLOGdebug(octx->s)) {
@@ -163,6 +169,10 @@ static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
         case AP_WATCHDOG_STATE_STOPPING:
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, octx->s, APLOGNO(10200)
                          "md ocsp watchdog stopping");
+            if (md_util_exec_poll(octx->mc->ocsp_cmds) > 0) {
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, octx->s, 
+                             "md ocsp watchdog leaves notification commands running");
+            }
             break;
     }
     
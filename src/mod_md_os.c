@@ -89,3 +89,16 @@ apr_status_t md_server_graceful(apr_pool_t *p, server_rec *s)
 
 #endif
 
+int md_os_cpu_count(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0)? (int)n : 0;
+#elif defined(WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    return 0;
+#endif
+}
@@ -34,4 +34,9 @@ apr_status_t md_make_worker_accessible(const char *fname, apr_pool_t *p);
  */
 apr_status_t md_server_graceful(apr_pool_t *p, server_rec *s);
 
+/**
+ * Get the number of processors online. Returns 0 if that cannot be determined. 
+ */
+int md_os_cpu_count(void);
+
 #endif /* mod_md_md_os_h */
@@ -16,6 +16,9 @@ import sys
 import time
 import OpenSSL
 
+from cryptography.hazmat.primitives.asymmetric import ec
+from cryptography.hazmat.primitives.asymmetric import rsa
+
 from datetime import datetime
 from datetime import tzinfo
 from datetime import timedelta
@@ -66,8 +69,12 @@ class CertUtil(object):
             OpenSSL.crypto.dump_privatekey(OpenSSL.crypto.FILETYPE_PEM, k).decode('utf-8'))
 
     @classmethod
-    def load_server_cert( cls, hostIP, hostPort, hostName ):
+    def load_server_cert( cls, hostIP, hostPort, hostName, ciphers=None ):
         ctx = OpenSSL.SSL.Context(OpenSSL.SSL.SSLv23_METHOD)
+        if ciphers:
+            # TLSv1.2 ciphers select the type of certificate key, TLSv1.3 ones do not
+            ctx.set_options(OpenSSL.SSL.OP_NO_TLSv1_3)
+            ctx.set_cipher_list(ciphers.encode('utf-8'))
         s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         connection = OpenSSL.SSL.Connection(ctx, s)
         connection.connect((hostIP, int(hostPort)))
@@ -118,6 +125,14 @@ class CertUtil(object):
     def get_key_length(self):
         return self.cert.get_pubkey().bits()
 
+    def get_key_type(self):
+        key = self.cert.get_pubkey().to_cryptography_key()
+        if isinstance(key, rsa.RSAPublicKey):
+            return "RSA"
+        elif isinstance(key, ec.EllipticCurvePublicKey):
+            return "EC"
+        return None
+
     def get_san_list(self):
         text = OpenSSL.crypto.dump_certificate(OpenSSL.crypto.FILETYPE_TEXT, self.cert).decode("utf-8")
         m = re.search(r"X509v3 Subject Alternative Name:\s*(.*)", text)
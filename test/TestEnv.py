@@ -525,8 +525,9 @@ class TestEnv:
         return result['http_status']
 
     @classmethod
-    def get_cert(cls, domain):
-        return CertUtil.load_server_cert(TestEnv.HTTPD_HOST, TestEnv.HTTPS_PORT, domain)
+    def get_cert(cls, domain, ciphers=None):
+        return CertUtil.load_server_cert(TestEnv.HTTPD_HOST, TestEnv.HTTPS_PORT, domain, 
+                                         ciphers=ciphers)
 
     @classmethod
     def get_meta(cls, domain, path, useHTTPS=True):
@@ -123,6 +123,9 @@ include "conf/proxy.conf"
     def add_dns01_cmd(self, cmd):
         self._add_line("  MDChallengeDns01 %s\n" % cmd)
 
+    def add_dns01_batch(self, mode):
+        self._add_line("  MDChallengeDns01Batch %s\n" % mode)
+
     def add_vhost(self, domains, port=None, docRoot="htdocs"):
         self.start_vhost(domains, port=port, docRoot=docRoot)
         self.end_vhost()
@@ -27,6 +27,21 @@ def teardown( domain ):
     return run([ curl, "-s", "-X", "POST", 
         "-d", "{\"host\":\"_acme-challenge.%s.\"}" % (domain),
         "%s/clear-txt" % (challtestsrv)])
+
+def setup_batch( pairs ):
+    # a wildcard and its base domain share one name with two records
+    rv = teardown_batch( list(set([ d for (d, c) in pairs ])) )
+    for (domain, challenge) in pairs:
+        rv = rv or run([ curl, "-s", "-X", "POST", 
+            "-d", "{\"host\":\"_acme-challenge.%s.\", \"value\":\"%s\"}" % (domain, challenge),
+            "%s/set-txt" % (challtestsrv)])
+    return rv
+
+def teardown_batch( domains ):
+    rv = 0
+    for domain in domains:
+        rv = rv or teardown( domain )
+    return rv
     
     
 def main(argv):
@@ -42,6 +57,16 @@ def main(argv):
                 sys.stderr.write("wrong number of arguments: dns01.py teardown <domain>")
                 sys.exit(1)
             rv = teardown(argv[2])
+        elif argv[1] == 'setup-batch':
+            if len(argv) < 4 or len(argv) % 2 != 0:
+                sys.stderr.write("wrong number of arguments: dns01.py setup-batch <domain> <challenge>...")
+                sys.exit(2)
+            rv = setup_batch(list(zip(argv[2::2], argv[3::2])))
+        elif argv[1] == 'teardown-batch':
+            if len(argv) < 3:
+                sys.stderr.write("wrong number of arguments: dns01.py teardown-batch <domain>...")
+                sys.exit(1)
+            rv = teardown_batch(argv[2:])
         else:
             sys.stderr.write("unknown option %s" % (argv[1]))
             sys.exit(2)
@@ -2,8 +2,10 @@
 
 import copy
 import json
+import os
 import re
 import shutil
+import subprocess
 import sys
 import time
 import pytest
@@ -229,3 +231,108 @@ class TestStore:
         assert TestEnv.a2md( [ "store", "add", dns1 ] )['rv'] == 0
         assert TestEnv.a2md( [ "store", "update", dns1, "domains" ] )['rv'] == 1
 
+
+    # test case: store changes are journaled
+    def test_000_500(self):
+        dns = "test000-500.com"
+        jout = TestEnv.a2md( [ "store", "changes" ] )['jout']
+        assert jout['output'] == []
+        assert TestEnv.a2md( [ "store", "add", dns ] )['rv'] == 0
+        jout = TestEnv.a2md( [ "store", "changes" ] )['jout']
+        assert len(jout['output']) == 1
+        TestEnv.check_json_contains( jout['output'][0], {
+            "op": "save",
+            "group": "domains",
+            "name": dns,
+            "aspect": "md.json"
+        })
+        assert jout['last'] == jout['output'][0]['seq']
+
+    # test case: store changes since a sequence number
+    def test_000_501(self):
+        dns = "test000-501.com"
+        assert TestEnv.a2md( [ "store", "add", dns ] )['rv'] == 0
+        last = TestEnv.a2md( [ "store", "changes" ] )['jout']['last']
+        assert TestEnv.a2md( [ "store", "remove", dns ] )['rv'] == 0
+        jout = TestEnv.a2md( [ "store", "changes", "%d" % last ] )['jout']
+        assert len(jout['output']) == 1
+        assert jout['output'][0]['op'] == "remove"
+        assert jout['last'] > last
+        # nothing new since the last change
+        jout = TestEnv.a2md( [ "store", "changes", "%d" % jout['last'] ] )['jout']
+        assert jout['output'] == []
+        # a sequence number not in the journal
+        assert TestEnv.a2md( [ "store", "changes", "%d" % (last + 1) ] )['rv'] == 1
+
+    # test case: export a store and import it into an empty one
+    def test_000_600(self):
+        dns1 = [ "test000-600.com", "test000-600a.com" ]
+        dns2 = [ "test000-600b.com" ]
+        assert TestEnv.a2md( [ "store", "add" ] + dns1 )['rv'] == 0
+        assert TestEnv.a2md( [ "store", "add" ] + dns2 )['rv'] == 0
+        jout1 = TestEnv.a2md( [ "store", "list" ] )['jout']
+        archive = os.path.join(TestEnv.GEN_DIR, "test000-600.arch")
+        jout = TestEnv.a2md( [ "store", "export", archive ] )['jout']
+        assert jout['entries'] == 3
+        TestEnv.purge_store()
+        jout = TestEnv.a2md( [ "store", "import", archive ] )['jout']
+        assert jout['entries'] == 3
+        assert TestEnv.a2md( [ "store", "list" ] )['jout'] == jout1
+
+    # test case: export selected names only, reject a corrupted archive
+    def test_000_601(self):
+        assert TestEnv.a2md( [ "store", "add", "test000-601.com" ] )['rv'] == 0
+        assert TestEnv.a2md( [ "store", "add", "test000-601b.com" ] )['rv'] == 0
+        archive = os.path.join(TestEnv.GEN_DIR, "test000-601.arch")
+        jout = TestEnv.a2md( [ "store", "export", "-g", "domains", archive, "test000-601b*" ] )['jout']
+        assert jout['entries'] == 2
+        with open(archive, "r") as fd:
+            data = fd.read()
+        with open(archive, "w") as fd:
+            fd.write(data.replace("test000-601b.com\"", "test000-601c.com\""))
+        TestEnv.purge_store()
+        assert TestEnv.a2md( [ "store", "import", archive ] )['rv'] == 1
+
+    # test case: leases are exclusive, tokens increase with every acquisition
+    def test_000_700(self):
+        name = "test000-700.com"
+        jout = TestEnv.a2md( [ "store", "lease", name, "renew", "node1" ] )['jout']
+        TestEnv.check_json_contains( jout['output'][0], {
+            "name": name,
+            "owner": "node1",
+            "token": 1
+        })
+        # held by node1, node2 is refused and told about it
+        r = TestEnv.a2md( [ "store", "lease", name, "renew", "node2" ] )
+        assert r['rv'] == 1
+        assert r['jout']['output'][0]['owner'] == "node1"
+        # other purposes are independent
+        assert TestEnv.a2md( [ "store", "lease", name, "ocsp", "node2" ] )['rv'] == 0
+        # releasing with an old token does nothing
+        assert TestEnv.a2md( [ "store", "release", name, "renew", "node1", "0" ] )['rv'] == 0
+        assert TestEnv.a2md( [ "store", "lease", name, "renew", "node2" ] )['rv'] == 1
+        assert TestEnv.a2md( [ "store", "release", name, "renew", "node1", "1" ] )['rv'] == 0
+        jout = TestEnv.a2md( [ "store", "lease", name, "renew", "node2" ] )['jout']
+        assert jout['output'][0]['owner'] == "node2"
+        assert jout['output'][0]['token'] == 2
+
+    # test case: expired leases can be taken over
+    def test_000_701(self):
+        name = "test000-701.com"
+        assert TestEnv.a2md( [ "store", "lease", name, "renew", "node1", "1" ] )['rv'] == 0
+        assert TestEnv.a2md( [ "store", "lease", name, "renew", "node2" ] )['rv'] == 1
+        time.sleep(2)
+        jout = TestEnv.a2md( [ "store", "lease", name, "renew", "node2" ] )['jout']
+        assert jout['output'][0]['owner'] == "node2"
+        assert jout['output'][0]['token'] == 2
+
+    # test case: of many processes racing for a lease, exactly one gets it
+    def test_000_702(self):
+        name = "test000-702.com"
+        procs = [ subprocess.Popen( TestEnv._a2md_args + [ "store", "lease", name, "renew", 
+                                    "node%d" % i ], stdout=subprocess.DEVNULL, 
+                                    stderr=subprocess.DEVNULL ) for i in range(10) ]
+        rvs = [ p.wait() for p in procs ]
+        assert rvs.count(0) == 1
+        jout = TestEnv.a2md( [ "store", "lease", name, "renew", "node%d" % rvs.index(0) ] )['jout']
+        assert jout['output'][0]['token'] == 2
@@ -239,6 +239,13 @@ class TestConf:
             MDPrivateKeys RSA 2048
             MDPrivateKeys RSA 3072
             MDPrivateKeys RSA 4096
+            MDPrivateKeys EC
+            MDPrivateKeys EC P-256
+            MDPrivateKeys EC secp384r1
+            MDPrivateKeys Ed25519
+            MDPrivateKeys RSA 3072 EC P-256
+            MDPrivateKeys EC RSA
+            MDPrivateKeys EC Ed25519 RSA 4096
             """).install()
         assert TestEnv.apache_restart() == 0
         assert (0, 0) == TestEnv.httpd_error_log_count()
@@ -248,7 +255,12 @@ class TestConf:
         ("MDPrivateKeys Def", "unsupported private key type"), 
         ("MDPrivateKeys", "needs to specify the private key type"), 
         ("MDPrivateKeys RSA 1024", "must be 2048 or higher"), 
-        ("MDPrivateKeys RSA 2048 bla", "key type 'RSA' has only one optional parameter") ])
+        ("MDPrivateKeys RSA 2048 bla", "key type 'RSA' has only one optional parameter"),
+        ("MDPrivateKeys EC P-999", "unsupported curve"),
+        ("MDPrivateKeys EC P-256 bla", "key type 'EC' has only one optional parameter"),
+        ("MDPrivateKeys Ed25519 1", "type 'Ed25519' takes no parameter"),
+        ("MDPrivateKeys Default RSA", "type 'Default' takes no parameter"),
+        ("MDPrivateKeys RSA EC RSA 4096", "is given more than once") ])
     def test_300_016(self, line, expErrMsg):
         HttpdConf( text=line ).install()
         assert TestEnv.apache_restart() == 1
@@ -335,3 +347,36 @@ class TestConf:
             """).install()
         assert TestEnv.apache_restart() == 1
 
+
+    # test case: valid and invalid key pool depths
+    @pytest.mark.parametrize("line,expErrMsg", [ 
+        ("MDKeyPool 0", None), 
+        ("MDKeyPool 5", None), 
+        ("MDKeyPool -1", "must be between 0 and 100"), 
+        ("MDKeyPool 101", "must be between 0 and 100"), 
+        ("MDKeyPool many", "must be between 0 and 100") ])
+    def test_300_023(self, line, expErrMsg):
+        HttpdConf( text=line ).install()
+        if expErrMsg:
+            assert TestEnv.apache_restart() == 1
+            assert expErrMsg in TestEnv.apachectl_stderr
+        else:
+            assert TestEnv.apache_restart() == 0
+
+    # test case: valid and invalid parallel renewals
+    @pytest.mark.parametrize("line,expErrMsg", [ 
+        ("MDRenewParallel 1", None), 
+        ("MDRenewParallel 4 1", None), 
+        ("MDRenewParallel 2 8", None), 
+        ("MDRenewParallel 0", "must be between 1 and 256"), 
+        ("MDRenewParallel 257", "must be between 1 and 256"), 
+        ("MDRenewParallel many", "must be between 1 and 256"), 
+        ("MDRenewParallel 4 0", "per CA must be at least 1"), 
+        ("MDRenewParallel 4 2 1", "takes one or two arguments") ])
+    def test_300_024(self, line, expErrMsg):
+        HttpdConf( text=line ).install()
+        if expErrMsg:
+            assert TestEnv.apache_restart() == 1
+            assert expErrMsg in TestEnv.apachectl_stderr
+        else:
+            assert TestEnv.apache_restart() == 0
@@ -310,6 +310,18 @@ class TestConf:
             "bits": 4096
         }
 
+    # test case: set several key types, one certificate for each
+    def test_310_120a(self):
+        HttpdConf(text="""
+            MDPrivateKeys RSA 3072 EC P-256
+            MDomain testdomain.org www.testdomain.org mail.testdomain.org
+            """).install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.a2md(["list"])['jout']['output'][0]['privkey'] == [
+            { "type": "RSA", "bits": 3072 },
+            { "type": "EC", "curve": "P-256" }
+        ]
+
     # test case: require HTTPS
     def test_310_121(self):
         HttpdConf(text="""
@@ -811,3 +823,26 @@ class TestConf:
         TestEnv.clear_store()
         TestEnv.set_store_dir_default()
 
+
+    # test case: unchanged MDs are not rewritten on restart, changed ones are
+    def test_310_600(self):
+        conf = """
+            MDomain testdomain.org www.testdomain.org mail.testdomain.org
+            """
+        HttpdConf(text=conf).install()
+        assert TestEnv.apache_restart() == 0
+        md_file = TestEnv.store_domain_file("testdomain.org", "md.json")
+        hash1 = TestEnv.a2md([ "list", "testdomain.org" ])['jout']['output'][0]['config-hash']
+        mtime1 = os.path.getmtime(md_file)
+        # same configuration, md.json stays as it is
+        assert TestEnv.apache_restart() == 0
+        assert os.path.getmtime(md_file) == mtime1
+        assert TestEnv.a2md([ "list", "testdomain.org" ])['jout']['output'][0]['config-hash'] == hash1
+        # changed configuration, gets a new hash
+        HttpdConf(text="""
+            <MDomainSet testdomain.org www.testdomain.org mail.testdomain.org>
+                MDRenewWindow 20d
+            </MDomainSet>
+            """).install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.a2md([ "list", "testdomain.org" ])['jout']['output'][0]['config-hash'] != hash1
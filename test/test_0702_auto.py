@@ -638,6 +638,94 @@ class TestAutov2:
         assert stat["proto"]["acme-tls/1"] == [ domain ]
         assert TestEnv.await_completion( [ domain ] )
 
+    # test case: several MDs renewed in parallel workers, one at a time against
+    # the CA, each result recorded and notified exactly once
+    def test_702_060(self):
+        domain = self.test_domain
+        mcmd = "%s/message.py" % TestEnv.TESTROOT
+        mlog = "%s/message.log" % TestEnv.GEN_DIR
+        if os.path.isfile(mlog):
+            os.remove(mlog)
+        names = [ "%s-%s" % (c, domain) for c in "abcd" ]
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_line( "MDRenewParallel 4 1" )
+        conf.add_message_cmd( "%s %s" % (mcmd, mlog) )
+        conf.add_drive_mode( "auto" )
+        for name in names:
+            conf.add_md( [ name, "www." + name ] )
+            conf.add_vhost( [ name, "www." + name ] )
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.await_completion( list(names), restart=False )
+        # the message commands run in the background
+        time.sleep(3)
+        for name in names:
+            with open(TestEnv.store_staged_file( name, 'job.json')) as f:
+                job = json.load(f)
+            assert job["finished"] == True
+            assert job["last"]["status"] == 0
+            types = [ e["type"] for e in job["log"]["entries"] ]
+            assert 1 == types.count("message-renewed")
+        nlines = [ l.strip() for l in open(mlog).readlines() ]
+        assert len(names) == len(nlines)
+        for name in names:
+            assert ("['%s', '%s', 'renewed', '%s']" % (mcmd, mlog, name)) in nlines
+        # activate and check all are served
+        assert TestEnv.apache_restart() == 0
+        for name in names:
+            TestEnv.check_md_complete( name )
+            cert = TestEnv.get_cert( name )
+            assert name in cert.get_san_list()
+
+    # test case: a MD with a RSA and an EC key gets a certificate for each, 
+    # stored in their own files and both handed to mod_ssl
+    def test_702_070(self):
+        domain = self.test_domain
+        domains = [ domain, "www." + domain ]
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_drive_mode( "auto" )
+        conf.add_line( "MDPrivateKeys RSA 2048 EC P-256" )
+        conf.add_md( domains )
+        conf.add_vhost( domains )
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.await_completion( [ domain ], restart=False )
+        # both pairs are staged, each certificate from its own order
+        files = { "rsa": ("privkey.pem", "pubcert.pem"),
+                  "secp256r1": ("privkey.secp256r1.pem", "pubcert.secp256r1.pem") }
+        serials = []
+        for name, (pkey_file, cert_file) in files.items():
+            cert = CertUtil( TestEnv.store_staged_file(domain, cert_file) )
+            cert.validate_cert_matches_priv_key( TestEnv.store_staged_file(domain, pkey_file) )
+            assert set(domains) == set(cert.get_san_list())
+            serials.append(cert.get_serial())
+        assert serials[0] != serials[1]
+        # activation copies all pairs to domains
+        assert TestEnv.apache_restart() == 0
+        TestEnv.check_md_complete( domain )
+        for name, (pkey_file, cert_file) in files.items():
+            cert = CertUtil( TestEnv.store_domain_file(domain, cert_file) )
+            cert.validate_cert_matches_priv_key( TestEnv.store_domain_file(domain, pkey_file) )
+        assert CertUtil( TestEnv.store_domain_file(domain, "pubcert.pem") ).get_key_type() == "RSA"
+        assert CertUtil( TestEnv.store_domain_file(domain, "pubcert.secp256r1.pem") 
+                       ).get_key_type() == "EC"
+        # the status lists all certificates by their key
+        stat = TestEnv.get_md_status( domain )
+        assert "rsa" in stat["certs"]
+        assert "secp256r1" in stat["certs"]
+        assert stat["certs"]["rsa"]["serial"] != stat["certs"]["secp256r1"]["serial"]
+        # a client gets the certificate for the key type it supports
+        cert = TestEnv.get_cert( domain, ciphers="ECDHE-ECDSA-AES128-GCM-SHA256" )
+        assert cert.get_key_type() == "EC"
+        assert cert.get_serial() == CertUtil( TestEnv.store_domain_file(
+            domain, "pubcert.secp256r1.pem") ).get_serial()
+        cert = TestEnv.get_cert( domain, ciphers="ECDHE-RSA-AES128-GCM-SHA256" )
+        assert cert.get_key_type() == "RSA"
+        assert cert.get_serial() == CertUtil( TestEnv.store_domain_file(
+            domain, "pubcert.pem") ).get_serial()
+
     # --------- _utils_ ---------
 
     def _write_res_file(self, docRoot, name, content):
@@ -261,4 +261,34 @@ class TestWildcard:
         for domain in [ domain, dwild ]:
             assert domain in altnames
 
+    #-----------------------------------------------------------------------------------------------
+    # test case: wildcard and other names with dns-01 records set up in one batch
+    #
+    def test_720_007(self):
+        dns01cmd = ("%s/dns01.py" % TestEnv.TESTROOT)
 
+        domain = self.test_domain
+        dwild = "*." + domain
+        domain2 = "www." + domain
+        domains = [ domain, dwild, domain2 ]
+        
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_ca_challenges( [ "dns-01" ] )
+        conf.add_dns01_cmd( dns01cmd )
+        conf.add_dns01_batch( "on" )
+        conf.add_md( domains )
+        conf.add_vhost(domains)
+        conf.install()
+
+        # restart, check that md is in store
+        assert TestEnv.apache_restart() == 0
+        TestEnv.check_md( domains )
+        # await drive completion
+        assert TestEnv.await_completion( [ domain ] )
+        TestEnv.check_md_complete(domain)
+        # check: SSL is running OK
+        certA = TestEnv.get_cert(domain)
+        altnames = certA.get_san_list()
+        for domain in domains:
+            assert domain in altnames
@@ -58,6 +58,8 @@ class TestNotify:
             """ % (command, args))
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         assert stat["renewal"]["last"]["problem"] == "urn:org:apache:httpd:log:AH10108:"
 
@@ -71,6 +73,8 @@ class TestNotify:
             """ % (command, args))
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         assert stat["renewal"]["last"]["problem"] == "urn:org:apache:httpd:log:AH10108:"
 
@@ -84,6 +88,8 @@ class TestNotify:
             """ % (command, args))
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         assert stat["renewal"]["last"]["status"] == 0
         nlines = open(TestNotify.notify_log).readlines()
@@ -102,6 +108,8 @@ class TestNotify:
             """ % (command, args, extra_arg))
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         assert stat["renewal"]["last"]["status"] == 0
         nlines = open(TestNotify.notify_log).readlines()
@@ -125,6 +133,7 @@ class TestNotify:
         conf.install()
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ md1, md2 ], restart=False )
+        time.sleep(2)
         stat = TestEnv.get_md_status(md1)
         assert stat["renewal"]["last"]["status"] == 0
         stat = TestEnv.get_md_status(md2)
@@ -58,6 +58,8 @@ class TestMessage:
         conf.install()
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         # this command should have failed and logged an error
         assert stat["renewal"]["last"]["problem"] == "urn:org:apache:httpd:log:AH10109:"
@@ -76,6 +78,8 @@ class TestMessage:
         conf.install()
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         # this command should have failed and logged an error
         assert stat["renewal"]["last"]["problem"] == "urn:org:apache:httpd:log:AH10109:"
@@ -93,6 +97,8 @@ class TestMessage:
         conf.install()
         assert TestEnv.apache_restart() == 0
         assert TestEnv.await_completion( [ domain ], restart=False )
+        # the command runs in the background
+        time.sleep(2)
         stat = TestEnv.get_md_status(domain)
         # this command did not fail and logged itself the correct information
         assert stat["renewal"]["last"]["status"] == 0
@@ -275,3 +281,58 @@ class TestMessage:
 
     
 
+    # test: a message command that does not end in time is killed, the
+    #       renewal watchdog is not held up by it
+    def test_901_031(self):
+        domain = self.test_domain
+        domains = [ domain, "www." + domain ]
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_md( domains )
+        conf.add_vhost(domains)
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.await_completion( [ domain ] )
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_message_cmd( "/bin/sh -c 'sleep 30'" )
+        conf.add_line("MDCmdLimits parallel=2 timeout=2s")
+        conf.add_md( domains )
+        conf.add_line("""
+            MDWarnWindow 100d
+            """)
+        conf.add_vhost(domains)
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        time.sleep(5)
+        with open(TestEnv.store_staged_file( domain, 'job.json')) as f:
+            job = json.load(f)
+            assert job["last"]["problem"] == "urn:org:apache:httpd:log:AH10109:"
+            assert job["log"]["entries"][0]["type"] == "message-error"
+
+    # test: a message command that runs longer than the watchdog looks after
+    #       commands is started only once
+    def test_901_032(self):
+        domain = self.test_domain
+        domains = [ domain, "www." + domain ]
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_md( domains )
+        conf.add_vhost(domains)
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        assert TestEnv.await_completion( [ domain ] )
+        conf = HttpdConf()
+        conf.add_admin( "admin@not-forbidden.org" )
+        conf.add_message_cmd( "/bin/sh -c 'sleep 3; echo \"$0 $1\" >> %s'" % (self.mlog) )
+        conf.add_md( domains )
+        conf.add_line("""
+            MDWarnWindow 100d
+            """)
+        conf.add_vhost(domains)
+        conf.install()
+        assert TestEnv.apache_restart() == 0
+        time.sleep(8)
+        nlines = open(self.mlog).readlines()
+        assert 1 == len(nlines)
+        assert ("expiring %s" % (domain)) == nlines[0].strip()
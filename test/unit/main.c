@@ -22,6 +22,10 @@ static Suite *main_test_suite(void)
 
     suite_add_tcase(suite, md_json_test_case());
     suite_add_tcase(suite, md_util_test_case());
+    suite_add_tcase(suite, md_http_mock_test_case());
+    suite_add_tcase(suite, md_acme_test_case());
+    suite_add_tcase(suite, md_jws_test_case());
+    suite_add_tcase(suite, md_reg_test_case());
 
     return suite;
 }
@@ -42,3 +42,7 @@
 
 TCase *md_json_test_case(void);
 TCase *md_util_test_case(void);
+TCase *md_http_mock_test_case(void);
+TCase *md_acme_test_case(void);
+TCase *md_jws_test_case(void);
+TCase *md_reg_test_case(void);
@@ -0,0 +1,501 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apr_buckets.h>
+#include <apr_file_io.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_time.h>
+
+#include "test_common.h"
+#include "md.h"
+#include "md_acme.h"
+#include "md_acme_acct.h"
+#include "md_acme_authz.h"
+#include "md_acme_order.h"
+#include "md_crypt.h"
+#include "md_http.h"
+#include "md_http_mock.h"
+#include "md_json.h"
+#include "md_result.h"
+#include "md_store.h"
+#include "md_store_fs.h"
+#include "md_time.h"
+#include "md_util.h"
+
+#define CA_URL      "https://ca.example/directory"
+
+static const char *Directory =
+    "{\"newAccount\":\"https://ca.example/acme/new-acct\","
+    "\"newNonce\":\"https://ca.example/acme/new-nonce\","
+    "\"newOrder\":\"https://ca.example/acme/new-order\","
+    "\"revokeCert\":\"https://ca.example/acme/revoke-cert\","
+    "\"keyChange\":\"https://ca.example/acme/key-change\","
+    "\"renewalInfo\":\"https://ca.example/acme/renewal-info\"}";
+
+/* leaf with the authority key identifier and serial of the RFC 9773 example */
+static const char *AriCert =
+    "MIIBfTCCASKgAwIBAgIFAIdlQyEwCgYIKoZIzj0EAwIwEjEQMA4GA1UEAwwHVGVz"
+    "dCBDQTAeFw0yNjEwMTkwMTMyMjBaFw0zNjEwMTYwMTMyMjBaMBQxEjAQBgNVBAMM"
+    "CWEuZXhhbXBsZTBZMBMGByqGSM49AgEGCCqGSM49AwEHA0IABKNfeTn0S4v3sFcH"
+    "hFTdb8b7-JtSqmjr2UP7Xg_yHapOwozJqub1fze1WKpgyiegwa9dEoywZgnpmYQM"
+    "9CeMa8ijYzBhMAkGA1UdEwQCMAAwHwYDVR0jBBgwFoAUaYhba4dGQEHhs3uEe6Cu"
+    "LN4ByNQwFAYDVR0RBA0wC4IJYS5leGFtcGxlMB0GA1UdDgQWBBQ7fjOUgBmJnIVP"
+    "MOODM3DkkWGLIzAKBggqhkjOPQQDAgNJADBGAiEA6JlEuVS6BvuO_N_ct8UMHLaU"
+    "bE6DjsEL8gXoq8PiTZcCIQCZxGV1atN1tMe7XciL_dqqetihiO0k4m_m4tIUyhzy"
+    "Cg";
+
+/*
+ * Helpers
+ */
+
+typedef struct {
+    int fetched;
+    int revalidated;
+} dir_server_t;
+
+static apr_status_t serve_directory(md_http_response_t *res,
+                                    const md_http_request_t *req, void *baton)
+{
+    dir_server_t *server = baton;
+    const char *etag = req->headers? apr_table_get(req->headers, "If-None-Match") : NULL;
+
+    apr_table_setn(res->headers, "ETag", "\"v1\"");
+    if (etag && !strcmp("\"v1\"", etag)) {
+        ++server->revalidated;
+        res->status = 304;
+        return APR_SUCCESS;
+    }
+    ++server->fetched;
+    res->status = 200;
+    apr_table_setn(res->headers, "Content-Type", "application/json");
+    return apr_brigade_write(res->body, NULL, NULL, Directory, strlen(Directory));
+}
+
+static md_acme_t *acme_setup(apr_pool_t *p)
+{
+    md_acme_t *acme;
+    md_result_t *result = md_result_make(p, APR_SUCCESS);
+
+    ck_assert_int_eq(APR_SUCCESS, md_acme_create(&acme, p, CA_URL, NULL));
+    ck_assert_int_eq(APR_SUCCESS, md_acme_setup(acme, result));
+    ck_assert_int_eq(MD_ACME_VERSION_2, acme->version);
+    return acme;
+}
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+static md_http_mock_t *g_mock;
+static dir_server_t g_server;
+
+static void md_acme_setup_fixture(void)
+{
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+    md_acme_init(g_pool, "test", 0);
+    md_acme_dir_cache_clear();
+    memset(&g_server, 0, sizeof(g_server));
+    md_http_mock_create(&g_mock, g_pool);
+    md_http_mock_add_cb(g_mock, "GET", CA_URL, serve_directory, &g_server);
+    md_http_use_implementation(md_http_mock_get_impl(g_mock));
+}
+
+static void md_acme_teardown_fixture(void)
+{
+    md_acme_set_dir_cache_ttl(apr_time_from_sec(60*60));
+    md_acme_limit_set(MD_ACME_LIMIT_ORDERS, 0);
+    md_acme_limit_set(MD_ACME_LIMIT_FAILED_AUTHZ, 0);
+    md_acme_limits_clear();
+    md_acme_limits_store_set(NULL);
+    apr_pool_destroy(g_pool);
+}
+
+/*
+ * Tests
+ */
+START_TEST(acme_dir_cached)
+{
+    md_acme_t *acme;
+    int i;
+
+    for (i = 0; i < 5; ++i) {
+        acme = acme_setup(g_pool);
+    }
+    ck_assert_str_eq("https://ca.example/acme/new-order", acme->api.v2.new_order);
+    ck_assert_int_eq(1, g_server.fetched);
+    ck_assert_int_eq(1, md_http_mock_count(g_mock));
+}
+END_TEST
+
+START_TEST(acme_dir_revalidated)
+{
+    md_acme_t *acme;
+
+    md_acme_set_dir_cache_ttl(1);
+    acme_setup(g_pool);
+    apr_sleep(apr_time_from_msec(1));
+    acme = acme_setup(g_pool);
+    ck_assert_str_eq("https://ca.example/acme/new-nonce", acme->api.v2.new_nonce);
+    ck_assert_int_eq(1, g_server.fetched);
+    ck_assert_int_eq(1, g_server.revalidated);
+}
+END_TEST
+
+START_TEST(acme_dir_uncached)
+{
+    md_acme_set_dir_cache_ttl(0);
+    acme_setup(g_pool);
+    acme_setup(g_pool);
+    ck_assert_int_eq(2, g_server.fetched);
+    ck_assert_int_eq(0, g_server.revalidated);
+}
+END_TEST
+
+START_TEST(acme_nonces_shared)
+{
+    md_acme_t *acme1, *acme2;
+    int before;
+
+    md_http_mock_set_nonces(g_mock, 1);
+    md_acme_create(&acme2, g_pool, CA_URL, NULL);
+    before = md_acme_nonce_count(acme2);
+    acme1 = acme_setup(g_pool);
+    /* the directory response came with a nonce, available to all */
+    ck_assert_int_eq(before + 1, md_acme_nonce_count(acme1));
+    ck_assert_int_eq(before + 1, md_acme_nonce_count(acme2));
+}
+END_TEST
+
+static apr_status_t count_json(md_acme_t *acme, apr_pool_t *p, const apr_table_t *headers, 
+                               md_json_t *jbody, void *baton)
+{
+    int *pcount = baton;
+    
+    (void)acme;
+    (void)p;
+    (void)headers;
+    (void)jbody;
+    ++(*pcount);
+    return APR_SUCCESS;
+}
+
+static void acct_setup(md_acme_t *acme)
+{
+    md_pkey_spec_t spec;
+    
+    md_crypt_init(g_pool);
+    acme->acct = apr_pcalloc(g_pool, sizeof(*acme->acct));
+    acme->acct->url = "https://ca.example/acme/acct/1";
+    spec.type = MD_PKEY_TYPE_RSA;
+    spec.params.rsa.bits = 2048;
+    ck_assert_int_eq(APR_SUCCESS, md_pkey_gen(&acme->acct_key, g_pool, &spec));
+}
+
+START_TEST(acme_nonce_pool_empty)
+{
+    md_acme_t *acme;
+    apr_table_t *headers, *nonce_headers;
+    int count = 0;
+
+    headers = apr_table_make(g_pool, 1);
+    apr_table_setn(headers, "Content-Type", "application/json");
+    md_http_mock_add(g_mock, "POST", "https://ca.example/acme/order/1", 200, headers, "{}", 2);
+    nonce_headers = apr_table_make(g_pool, 1);
+    apr_table_setn(nonce_headers, "Replay-Nonce", "fresh-nonce");
+    md_http_mock_add(g_mock, "HEAD", "https://ca.example/acme/new-nonce", 200, 
+                     nonce_headers, NULL, 0);
+    
+    /* the directory came without a nonce, the POST-as-GET needs to fetch one */
+    acme = acme_setup(g_pool);
+    ck_assert_int_eq(0, md_acme_nonce_count(acme));
+    acct_setup(acme);
+    ck_assert_int_eq(APR_SUCCESS, md_acme_GET(acme, "https://ca.example/acme/order/1", 
+                                              NULL, count_json, NULL, NULL, &count));
+    ck_assert_int_eq(1, count);
+}
+END_TEST
+
+START_TEST(acme_authz_parallel)
+{
+    md_acme_t *acme;
+    apr_array_header_t *urls, *authzs;
+    apr_table_t *headers;
+    const char *authz = "{\"status\":\"pending\","
+                        "\"identifier\":{\"type\":\"dns\",\"value\":\"a.example\"}}";
+    apr_time_t start, duration;
+    int i;
+
+    headers = apr_table_make(g_pool, 1);
+    apr_table_setn(headers, "Content-Type", "application/json");
+    md_http_mock_add(g_mock, "POST", "https://ca.example/acme/authz/*", 200, headers,
+                     authz, strlen(authz));
+    md_http_mock_add(g_mock, "HEAD", "https://ca.example/acme/new-nonce", 200, NULL, NULL, 0);
+    md_http_mock_set_nonces(g_mock, 1);
+    
+    acme = acme_setup(g_pool);
+    acct_setup(acme);
+    
+    urls = apr_array_make(g_pool, 16, sizeof(const char*));
+    for (i = 0; i < 16; ++i) {
+        APR_ARRAY_PUSH(urls, const char*) = apr_psprintf(g_pool, 
+                                                         "https://ca.example/acme/authz/%d", i);
+    }
+    md_http_mock_set_latency(g_mock, apr_time_from_msec(50));
+    start = apr_time_now();
+    ck_assert_int_eq(APR_SUCCESS, md_acme_authz_retrieve_all(&authzs, acme, urls, g_pool));
+    duration = apr_time_now() - start;
+    
+    ck_assert_int_eq(16, authzs->nelts);
+    for (i = 0; i < authzs->nelts; ++i) {
+        md_acme_authz_t *a = APR_ARRAY_IDX(authzs, i, md_acme_authz_t*);
+        ck_assert_int_eq(MD_ACME_AUTHZ_S_PENDING, a->state);
+        ck_assert_str_eq(APR_ARRAY_IDX(urls, i, const char*), a->url);
+    }
+    /* 16 requests, MD_ACME_MAX_PARALLEL in flight, nonces for the first batch */
+    ck_assert(duration < apr_time_from_msec(16 * 50 / 2));
+}
+END_TEST
+
+START_TEST(acme_authz_notify_all)
+{
+    md_acme_t *acme;
+    md_store_t *store;
+    md_acme_authz_t *authz;
+    md_result_t *result;
+    apr_array_header_t *authzs, *challenges;
+    apr_table_t *headers, *nonce_headers;
+    const char *tmp, *dir, *token;
+    const char *cha = "{\"status\":\"pending\"}";
+    int i, count;
+
+    headers = apr_table_make(g_pool, 1);
+    apr_table_setn(headers, "Content-Type", "application/json");
+    md_http_mock_add(g_mock, "POST", "https://ca.example/acme/chall/*", 200, headers,
+                     cha, strlen(cha));
+    nonce_headers = apr_table_make(g_pool, 1);
+    apr_table_setn(nonce_headers, "Replay-Nonce", "fresh-nonce");
+    md_http_mock_add(g_mock, "HEAD", "https://ca.example/acme/new-nonce", 200, 
+                     nonce_headers, NULL, 0);
+
+    ck_assert_int_eq(APR_SUCCESS, apr_temp_dir_get(&tmp, g_pool));
+    dir = apr_psprintf(g_pool, "%s/md-unit-%d", tmp, (int)getpid());
+    ck_assert_int_eq(APR_SUCCESS, md_store_fs_init(&store, g_pool, dir));
+    
+    acme = acme_setup(g_pool);
+    acct_setup(acme);
+    
+    challenges = apr_array_make(g_pool, 1, sizeof(const char*));
+    APR_ARRAY_PUSH(challenges, const char*) = MD_AUTHZ_TYPE_HTTP01;
+    authzs = apr_array_make(g_pool, 8, sizeof(md_acme_authz_t*));
+    for (i = 0; i < 8; ++i) {
+        authz = md_acme_authz_create(g_pool);
+        authz->domain = apr_psprintf(g_pool, "%d.example", i);
+        authz->url = apr_psprintf(g_pool, "https://ca.example/acme/authz/%d", i);
+        authz->resource = md_json_create_s(g_pool, apr_psprintf(g_pool, 
+            "{\"status\":\"pending\",\"challenges\":[{\"type\":\"http-01\","
+            "\"url\":\"https://ca.example/acme/chall/%d\",\"token\":\"tok-%d\"}]}", i, i));
+        result = md_result_make(g_pool, APR_SUCCESS);
+        ck_assert_int_eq(APR_SUCCESS, md_acme_authz_setup(authz, acme, store, challenges, NULL, 
+                                                          NULL, NULL, g_pool, &token, result));
+        APR_ARRAY_PUSH(authzs, md_acme_authz_t*) = authz;
+    }
+    
+    /* no nonces in the responses, the first batch prefetches, the rest fetches */
+    ck_assert_int_eq(APR_SUCCESS, md_acme_authz_notify_all(acme, authzs, g_pool));
+    /* every challenge was told once and needs no more telling */
+    count = md_http_mock_count(g_mock);
+    ck_assert_int_eq(APR_SUCCESS, md_acme_authz_notify_all(acme, authzs, g_pool));
+    ck_assert_int_eq(count, md_http_mock_count(g_mock));
+    
+    md_util_rm_recursive(dir, g_pool, 5);
+}
+END_TEST
+
+START_TEST(acme_order_poll_later)
+{
+    md_acme_order_t *order;
+    apr_time_t next, start;
+    apr_interval_time_t prev = 0, delay;
+    int i;
+    
+    order = md_acme_order_create(g_pool);
+    for (i = 0; i < 8; ++i) {
+        start = apr_time_now();
+        ck_assert_int_eq(APR_EAGAIN, md_acme_order_poll_later(order, MD_ACME_ORDER_WAIT_AUTHZS,
+                                                              apr_time_from_sec(60), 0, &next));
+        delay = next - start;
+        /* first after 1 sec, then with jitter up to 10 */
+        ck_assert(delay >= apr_time_from_sec(1));
+        ck_assert(delay <= apr_time_from_sec(10) + apr_time_from_msec(100));
+        if (!prev) ck_assert(delay < apr_time_from_msec(1100));
+        prev = delay;
+    }
+    ck_assert_int_eq(8, order->polls);
+    
+    /* a Retry-After from the CA wins */
+    start = apr_time_now();
+    md_acme_order_poll_later(order, MD_ACME_ORDER_WAIT_AUTHZS, apr_time_from_sec(60), 
+                             apr_time_from_sec(30), &next);
+    ck_assert(next >= start + apr_time_from_sec(30));
+    
+    /* waiting for something else starts afresh */
+    start = apr_time_now();
+    md_acme_order_poll_later(order, MD_ACME_ORDER_WAIT_VALID, apr_time_from_sec(60), 0, &next);
+    ck_assert(next < start + apr_time_from_sec(2));
+    ck_assert_int_eq(1, order->polls);
+    
+    /* and the wait survives a trip through the store */
+    order = md_acme_order_from_json(md_acme_order_to_json(order, g_pool), g_pool);
+    ck_assert_int_eq(MD_ACME_ORDER_WAIT_VALID, order->wait);
+    ck_assert_int_eq(1, order->polls);
+    ck_assert_int_eq(apr_time_from_sec(1), order->delay);
+    
+    order->wait_since -= apr_time_from_sec(61);
+    ck_assert_int_eq(APR_TIMEUP, md_acme_order_poll_later(order, MD_ACME_ORDER_WAIT_VALID,
+                                                          apr_time_from_sec(60), 0, &next));
+    ck_assert_int_eq(MD_ACME_ORDER_WAIT_NONE, order->wait);
+}
+END_TEST
+
+START_TEST(acme_limit_orders)
+{
+    md_acme_t *acme, *other;
+    apr_time_t start, at;
+    int i;
+    
+    md_acme_limits_clear();
+    md_acme_create(&acme, g_pool, CA_URL, NULL);
+    md_acme_create(&other, g_pool, "https://other.example/directory", NULL);
+    
+    /* unlimited by default */
+    for (i = 0; i < 100; ++i) {
+        ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1));
+    }
+    
+    md_acme_limit_set(MD_ACME_LIMIT_ORDERS, 6);
+    for (i = 0; i < 6; ++i) {
+        ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1));
+    }
+    start = apr_time_now();
+    at = md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1);
+    /* one order refills every 10 minutes */
+    ck_assert(at > start);
+    ck_assert(at <= start + apr_time_from_sec(10 * 60) + apr_time_from_sec(1));
+    /* budgets are per CA */
+    ck_assert_int_eq(0, md_acme_limit_check(other, MD_ACME_LIMIT_ORDERS, 1));
+    
+    /* failed validations only count when they happen */
+    md_acme_limit_set(MD_ACME_LIMIT_FAILED_AUTHZ, 2);
+    ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_FAILED_AUTHZ, 0));
+    md_acme_limit_count(acme, MD_ACME_LIMIT_FAILED_AUTHZ);
+    ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_FAILED_AUTHZ, 0));
+    md_acme_limit_count(acme, MD_ACME_LIMIT_FAILED_AUTHZ);
+    ck_assert(md_acme_limit_check(acme, MD_ACME_LIMIT_FAILED_AUTHZ, 0) > start);
+    
+    md_acme_limits_clear();
+    ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1));
+}
+END_TEST
+
+START_TEST(acme_limit_stored)
+{
+    md_acme_t *acme;
+    md_store_t *store;
+    const char *tmp, *dir;
+    int i;
+    
+    ck_assert_int_eq(APR_SUCCESS, apr_temp_dir_get(&tmp, g_pool));
+    dir = apr_psprintf(g_pool, "%s/md-unit-%d", tmp, (int)getpid());
+    ck_assert_int_eq(APR_SUCCESS, md_store_fs_init(&store, g_pool, dir));
+    md_acme_limits_store_set(store);
+    md_acme_create(&acme, g_pool, CA_URL, NULL);
+    
+    md_acme_limit_set(MD_ACME_LIMIT_ORDERS, 3);
+    for (i = 0; i < 3; ++i) {
+        ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1));
+    }
+    /* a restart forgets what the process knew, the store remembers */
+    md_acme_limits_clear();
+    ck_assert(md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1) > apr_time_now());
+    /* a changed limit starts with a full budget */
+    md_acme_limit_set(MD_ACME_LIMIT_ORDERS, 4);
+    ck_assert_int_eq(0, md_acme_limit_check(acme, MD_ACME_LIMIT_ORDERS, 1));
+    
+    md_util_rm_recursive(dir, g_pool, 5);
+}
+END_TEST
+
+START_TEST(acme_renewal_info)
+{
+    md_acme_t *acme;
+    md_cert_t *cert;
+    md_timeperiod_t window;
+    apr_table_t *headers;
+    const char *id, *explanation;
+    const char *info = "{\"suggestedWindow\":{\"start\":\"2025-01-02T04:00:00Z\","
+                       "\"end\":\"2025-01-03T05:30:00.5+01:30\"},"
+                       "\"explanationURL\":\"https://ca.example/why\"}";
+    
+    md_crypt_init(g_pool);
+    ck_assert_int_eq(APR_SUCCESS, md_cert_from_base64url(&cert, AriCert, g_pool));
+    ck_assert_int_eq(APR_SUCCESS, md_cert_get_ari_id(&id, cert, g_pool));
+    ck_assert_str_eq("aYhba4dGQEHhs3uEe6CuLN4ByNQ.AIdlQyE", id);
+    
+    headers = apr_table_make(g_pool, 2);
+    apr_table_setn(headers, "Content-Type", "application/json");
+    apr_table_setn(headers, "Retry-After", "21600");
+    md_http_mock_add(g_mock, "GET", apr_pstrcat(g_pool, "https://ca.example/acme/renewal-info/",
+                                                id, NULL), 200, headers, info, strlen(info));
+    
+    acme = acme_setup(g_pool);
+    ck_assert_int_eq(APR_SUCCESS, md_acme_get_renewal_info(&window, &explanation, acme, 
+                                                           cert, g_pool));
+    ck_assert_int_eq(apr_time_from_sec(1735790400), window.start);
+    ck_assert_int_eq(apr_time_from_sec(1735876800) + apr_time_from_msec(500), window.end);
+    ck_assert_str_eq("https://ca.example/why", explanation);
+    ck_assert(md_acme_retry_after(acme) > apr_time_from_sec(21600 - 60));
+    
+    ck_assert_int_eq(0, md_time_parse_rfc3339("2025-01-02 04:00:00"));
+    ck_assert_int_eq(0, md_time_parse_rfc3339("2025-01-02T04:00Z"));
+}
+END_TEST
+
+TCase *md_acme_test_case(void)
+{
+    TCase *testcase = tcase_create("md_acme");
+
+    tcase_add_checked_fixture(testcase, md_acme_setup_fixture, md_acme_teardown_fixture);
+
+    tcase_add_test(testcase, acme_dir_cached);
+    tcase_add_test(testcase, acme_dir_revalidated);
+    tcase_add_test(testcase, acme_dir_uncached);
+    tcase_add_test(testcase, acme_nonces_shared);
+    tcase_add_test(testcase, acme_nonce_pool_empty);
+    tcase_add_test(testcase, acme_authz_parallel);
+    tcase_add_test(testcase, acme_authz_notify_all);
+    tcase_add_test(testcase, acme_order_poll_later);
+    tcase_add_test(testcase, acme_limit_orders);
+    tcase_add_test(testcase, acme_limit_stored);
+    tcase_add_test(testcase, acme_renewal_info);
+
+    return testcase;
+}
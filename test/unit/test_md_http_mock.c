@@ -0,0 +1,222 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <apr_buckets.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_time.h>
+
+#include "test_common.h"
+#include "md_http.h"
+#include "md_http_mock.h"
+
+/*
+ * Helpers
+ */
+
+typedef struct {
+    int status;
+    const char *body;
+    const char *nonce;
+    int count;
+} result_t;
+
+static apr_status_t on_response(const md_http_response_t *res, void *baton)
+{
+    result_t *result = baton;
+    char buffer[256];
+    apr_size_t len = sizeof(buffer) - 1;
+    
+    result->status = res->status;
+    apr_brigade_flatten(res->body, buffer, &len);
+    buffer[len] = '\0';
+    result->body = apr_pstrdup(md_http_get_pool(res->req->http), buffer);
+    result->nonce = apr_table_get(res->headers, "Replay-Nonce");
+    ++result->count;
+    return APR_SUCCESS;
+}
+
+static md_http_t *http_make(apr_pool_t *p, md_http_mock_t *mock)
+{
+    md_http_t *http;
+    
+    md_http_use_implementation(md_http_mock_get_impl(mock));
+    ck_assert_int_eq(APR_SUCCESS, md_http_create(&http, p, "test", NULL));
+    return http;
+}
+
+typedef struct {
+    md_http_t *http;
+    const char *url;
+    int todo;
+    result_t *result;
+    int max_in_flight;
+} multi_ctx_t;
+
+static apr_status_t next_req(md_http_request_t **preq, void *baton, 
+                             md_http_t *http, int in_flight)
+{
+    multi_ctx_t *ctx = baton;
+    md_http_request_t *req;
+    apr_status_t rv;
+    
+    if (in_flight > ctx->max_in_flight) ctx->max_in_flight = in_flight;
+    if (ctx->todo <= 0) return APR_ENOENT;
+    if (APR_SUCCESS != (rv = md_http_GET_create(&req, http, ctx->url, NULL))) return rv;
+    md_http_set_on_response_cb(req, on_response, ctx->result);
+    --ctx->todo;
+    *preq = req;
+    return APR_SUCCESS;
+}
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+
+static void md_http_mock_setup(void)
+{
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+}
+
+static void md_http_mock_teardown(void)
+{
+    apr_pool_destroy(g_pool);
+}
+
+/*
+ * Tests
+ */
+START_TEST(http_mock_sequence)
+{
+    md_http_mock_t *mock;
+    md_http_t *http;
+    result_t result;
+    const char *url = "https://ca.example/acme/order/1";
+    
+    md_http_mock_create(&mock, g_pool);
+    md_http_mock_add(mock, "GET", url, 200, NULL, "pending", 7);
+    md_http_mock_add(mock, "GET", url, 200, NULL, "valid", 5);
+    http = http_make(g_pool, mock);
+    
+    memset(&result, 0, sizeof(result));
+    ck_assert_int_eq(APR_SUCCESS, md_http_GET_perform(http, url, NULL, on_response, &result));
+    ck_assert_str_eq("pending", result.body);
+    ck_assert_int_eq(APR_SUCCESS, md_http_GET_perform(http, url, NULL, on_response, &result));
+    ck_assert_str_eq("valid", result.body);
+    /* the last one repeats */
+    ck_assert_int_eq(APR_SUCCESS, md_http_GET_perform(http, url, NULL, on_response, &result));
+    ck_assert_str_eq("valid", result.body);
+    ck_assert_int_eq(3, md_http_mock_count(mock));
+}
+END_TEST
+
+START_TEST(http_mock_match)
+{
+    md_http_mock_t *mock;
+    md_http_t *http;
+    result_t result;
+    
+    md_http_mock_create(&mock, g_pool);
+    md_http_mock_add(mock, "GET", "https://ca.example/*", 200, NULL, "any", 3);
+    md_http_mock_add(mock, "GET", "https://ca.example/cert/*", 200, NULL, "cert", 4);
+    md_http_mock_add(mock, "GET", "https://ca.example/directory", 200, NULL, "dir", 3);
+    md_http_mock_set_nonces(mock, 1);
+    http = http_make(g_pool, mock);
+    
+    memset(&result, 0, sizeof(result));
+    md_http_GET_perform(http, "https://ca.example/directory", NULL, on_response, &result);
+    ck_assert_str_eq("dir", result.body);
+    ck_assert_ptr_nonnull(result.nonce);
+    md_http_GET_perform(http, "https://ca.example/cert/17", NULL, on_response, &result);
+    ck_assert_str_eq("cert", result.body);
+    md_http_GET_perform(http, "https://ca.example/authz/3", NULL, on_response, &result);
+    ck_assert_str_eq("any", result.body);
+    md_http_GET_perform(http, "https://other.example/", NULL, on_response, &result);
+    ck_assert_int_eq(404, result.status);
+}
+END_TEST
+
+START_TEST(http_mock_failures)
+{
+    md_http_mock_t *mock;
+    md_http_t *http;
+    result_t result;
+    const char *url = "https://ocsp.example/";
+    
+    md_http_mock_create(&mock, g_pool);
+    md_http_mock_add(mock, "GET", url, 200, NULL, "ok", 2);
+    md_http_mock_add_error(mock, "GET", "https://down.example/", APR_ECONNREFUSED);
+    md_http_mock_set_failures(mock, 2, APR_TIMEUP);
+    http = http_make(g_pool, mock);
+    
+    memset(&result, 0, sizeof(result));
+    ck_assert_int_eq(APR_SUCCESS, md_http_GET_perform(http, url, NULL, on_response, &result));
+    ck_assert_int_eq(APR_TIMEUP, md_http_GET_perform(http, url, NULL, on_response, &result));
+    ck_assert_int_eq(APR_ECONNREFUSED, 
+                     md_http_GET_perform(http, "https://down.example/", NULL, 
+                                         on_response, &result));
+    ck_assert_int_eq(1, result.count);
+}
+END_TEST
+
+START_TEST(http_mock_multi_latency)
+{
+    md_http_mock_t *mock;
+    md_http_t *http;
+    result_t result;
+    multi_ctx_t ctx;
+    apr_time_t start, duration;
+    
+    md_http_mock_create(&mock, g_pool);
+    md_http_mock_add(mock, "GET", "https://ocsp.example/*", 200, NULL, "ok", 2);
+    md_http_mock_set_latency(mock, apr_time_from_msec(50));
+    http = http_make(g_pool, mock);
+    
+    memset(&result, 0, sizeof(result));
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.url = "https://ocsp.example/q";
+    ctx.todo = 10;
+    ctx.result = &result;
+    start = apr_time_now();
+    md_http_multi_perform(http, next_req, &ctx);
+    duration = apr_time_now() - start;
+    
+    ck_assert_int_eq(10, result.count);
+    ck_assert_int_eq(10, ctx.max_in_flight);
+    /* all in flight at the same time, they do not add up */
+    ck_assert(duration >= apr_time_from_msec(50));
+    ck_assert(duration < apr_time_from_msec(250));
+}
+END_TEST
+
+TCase *md_http_mock_test_case(void)
+{
+    TCase *testcase = tcase_create("md_http_mock");
+
+    tcase_add_checked_fixture(testcase, md_http_mock_setup, md_http_mock_teardown);
+
+    tcase_add_test(testcase, http_mock_sequence);
+    tcase_add_test(testcase, http_mock_match);
+    tcase_add_test(testcase, http_mock_failures);
+    tcase_add_test(testcase, http_mock_multi_latency);
+
+    return testcase;
+}
@@ -0,0 +1,427 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <apr_strings.h>
+#include <apr_tables.h>
+
+#include "test_common.h"
+#include "md_json.h"
+#include "md_crypt.h"
+#include "md_jws.h"
+#include "md_util.h"
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+
+static void jws_setup(void)
+{
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+    md_crypt_init(g_pool);
+}
+
+static void jws_teardown(void)
+{
+    apr_pool_destroy(g_pool);
+}
+
+/*
+ * Helpers
+ */
+
+static md_pkey_t *gen_key(md_pkey_type_t type)
+{
+    md_pkey_spec_t spec;
+    md_pkey_t *pkey;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.type = type;
+    switch (type) {
+        case MD_PKEY_TYPE_RSA:
+            spec.params.rsa.bits = 2048;
+            break;
+        case MD_PKEY_TYPE_EC:
+            spec.params.ec.curve = MD_PKEY_EC_CURVE_DEF;
+            break;
+        default:
+            break;
+    }
+    ck_assert_int_eq(md_pkey_gen(&pkey, g_pool, &spec), APR_SUCCESS);
+    return pkey;
+}
+
+static md_pkey_t *gen_ec_key(const char *curve)
+{
+    md_pkey_spec_t spec;
+    md_pkey_t *pkey;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.type = MD_PKEY_TYPE_EC;
+    spec.params.ec.curve = curve;
+    ck_assert_int_eq(md_pkey_gen(&pkey, g_pool, &spec), APR_SUCCESS);
+    return pkey;
+}
+
+static md_json_t *sign_msg(md_pkey_t *pkey)
+{
+    md_json_t *msg;
+    md_data_t payload;
+
+    MD_DATA_SET_STR(&payload, "{\"test\":\"payload\"}");
+    ck_assert_int_eq(md_jws_sign(&msg, g_pool, &payload, apr_table_make(g_pool, 5),
+                                 pkey, NULL), APR_SUCCESS);
+    return msg;
+}
+
+static md_json_t *msg_protected(md_json_t *msg)
+{
+    md_data_t prot;
+    md_json_t *json;
+
+    ck_assert(md_util_base64url_decode(&prot, md_json_gets(msg, "protected", NULL), g_pool) > 0);
+    ck_assert_int_eq(md_json_readd(&json, g_pool, prot.data, prot.len), APR_SUCCESS);
+    return json;
+}
+
+static const char *msg_signing_input(md_json_t *msg)
+{
+    return apr_psprintf(g_pool, "%s.%s", md_json_gets(msg, "protected", NULL),
+                        md_json_gets(msg, "payload", NULL));
+}
+
+/*
+ * Tests
+ */
+
+START_TEST(jws_es256_signature_verifies)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_EC);
+    md_json_t *msg = sign_msg(pkey), *prot = msg_protected(msg);
+    md_data_t sig;
+    const char *input = msg_signing_input(msg);
+    ECDSA_SIG *esig;
+    unsigned char *der = NULL;
+    EVP_MD_CTX *ctx;
+    int der_len;
+
+    ck_assert_str_eq(md_json_gets(prot, "alg", NULL), "ES256");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "kty", NULL), "EC");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "crv", NULL), "P-256");
+    ck_assert_ptr_ne(md_json_gets(prot, "jwk", "x", NULL), NULL);
+    ck_assert_ptr_ne(md_json_gets(prot, "jwk", "y", NULL), NULL);
+
+    /* JWS carries R || S, each padded to the field size */
+    ck_assert_uint_eq(md_util_base64url_decode(&sig, md_json_gets(msg, "signature", NULL),
+                                               g_pool), 64);
+    esig = ECDSA_SIG_new();
+    ECDSA_SIG_set0(esig, BN_bin2bn((const unsigned char*)sig.data, 32, NULL),
+                   BN_bin2bn((const unsigned char*)sig.data + 32, 32, NULL));
+    der_len = i2d_ECDSA_SIG(esig, &der);
+    ck_assert_int_gt(der_len, 0);
+
+    ctx = EVP_MD_CTX_new();
+    ck_assert_int_eq(EVP_DigestVerifyInit(ctx, NULL, EVP_sha256(), NULL,
+                                          md_pkey_get_EVP_PKEY(pkey)), 1);
+    ck_assert_int_eq(EVP_DigestVerifyUpdate(ctx, input, strlen(input)), 1);
+    ck_assert_int_eq(EVP_DigestVerifyFinal(ctx, der, (size_t)der_len), 1);
+
+    EVP_MD_CTX_free(ctx);
+    OPENSSL_free(der);
+    ECDSA_SIG_free(esig);
+    md_pkey_free(pkey);
+}
+END_TEST
+
+START_TEST(jws_es384_signature_verifies)
+{
+    md_pkey_t *pkey = gen_ec_key("P-384");
+    md_json_t *msg = sign_msg(pkey), *prot = msg_protected(msg);
+    md_data_t sig, coord;
+    const char *input = msg_signing_input(msg), *x64, *y64;
+    ECDSA_SIG *esig;
+    unsigned char *der = NULL;
+    EVP_MD_CTX *ctx;
+    int der_len;
+
+    ck_assert_str_eq(md_json_gets(prot, "alg", NULL), "ES384");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "kty", NULL), "EC");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "crv", NULL), "P-384");
+    ck_assert_str_eq(md_pkey_get_ec_curve(pkey), "P-384");
+
+    /* coordinates are padded to the field size of 48 bytes */
+    ck_assert_int_eq(md_pkey_get_ec_xy64(&x64, &y64, pkey, g_pool), APR_SUCCESS);
+    ck_assert_uint_eq(md_util_base64url_decode(&coord, x64, g_pool), 48);
+    ck_assert_uint_eq(md_util_base64url_decode(&coord, y64, g_pool), 48);
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "x", NULL), x64);
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "y", NULL), y64);
+
+    /* R || S, each padded to 48 bytes, over a SHA-384 digest */
+    ck_assert_uint_eq(md_util_base64url_decode(&sig, md_json_gets(msg, "signature", NULL),
+                                               g_pool), 96);
+    esig = ECDSA_SIG_new();
+    ECDSA_SIG_set0(esig, BN_bin2bn((const unsigned char*)sig.data, 48, NULL),
+                   BN_bin2bn((const unsigned char*)sig.data + 48, 48, NULL));
+    der_len = i2d_ECDSA_SIG(esig, &der);
+    ck_assert_int_gt(der_len, 0);
+
+    ctx = EVP_MD_CTX_new();
+    ck_assert_int_eq(EVP_DigestVerifyInit(ctx, NULL, EVP_sha384(), NULL,
+                                          md_pkey_get_EVP_PKEY(pkey)), 1);
+    ck_assert_int_eq(EVP_DigestVerifyUpdate(ctx, input, strlen(input)), 1);
+    ck_assert_int_eq(EVP_DigestVerifyFinal(ctx, der, (size_t)der_len), 1);
+
+    EVP_MD_CTX_free(ctx);
+    OPENSSL_free(der);
+    ECDSA_SIG_free(esig);
+    md_pkey_free(pkey);
+}
+END_TEST
+
+START_TEST(jws_rsa_thumbprint_unchanged)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_RSA);
+    md_json_t *prot = msg_protected(sign_msg(pkey));
+    const char *thumb, *expected, *s;
+    md_data_t data;
+
+    ck_assert_str_eq(md_json_gets(prot, "alg", NULL), "RS256");
+
+    /* RFC 7638 form, as accounts have always computed it */
+    s = apr_psprintf(g_pool, "{\"e\":\"%s\",\"kty\":\"RSA\",\"n\":\"%s\"}",
+                     md_pkey_get_rsa_e64(pkey, g_pool), md_pkey_get_rsa_n64(pkey, g_pool));
+    MD_DATA_SET_STR(&data, s);
+    ck_assert_int_eq(md_crypt_sha256_digest64(&expected, g_pool, &data), APR_SUCCESS);
+    ck_assert_int_eq(md_jws_pkey_thumb(&thumb, g_pool, pkey), APR_SUCCESS);
+    ck_assert_str_eq(thumb, expected);
+
+    md_pkey_free(pkey);
+}
+END_TEST
+
+START_TEST(jws_ec_thumbprint_members)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_EC);
+    const char *thumb, *expected, *s, *x64, *y64;
+    md_data_t data;
+
+    ck_assert_int_eq(md_pkey_get_ec_xy64(&x64, &y64, pkey, g_pool), APR_SUCCESS);
+    s = apr_psprintf(g_pool, "{\"crv\":\"P-256\",\"kty\":\"EC\",\"x\":\"%s\",\"y\":\"%s\"}",
+                     x64, y64);
+    MD_DATA_SET_STR(&data, s);
+    ck_assert_int_eq(md_crypt_sha256_digest64(&expected, g_pool, &data), APR_SUCCESS);
+    ck_assert_int_eq(md_jws_pkey_thumb(&thumb, g_pool, pkey), APR_SUCCESS);
+    ck_assert_str_eq(thumb, expected);
+
+    md_pkey_free(pkey);
+}
+END_TEST
+
+/* The JWS the former md_json based serialisation produced for the key and headers */
+static const char *golden_jws(md_pkey_t *pkey, const char *prot, md_data_t *payload)
+{
+    const char *prot64, *pay64, *sign64, *sign;
+    md_data_t data;
+
+    MD_DATA_SET_STR(&data, prot);
+    prot64 = md_util_base64url_encode(&data, g_pool);
+    pay64 = md_util_base64url_encode(payload, g_pool);
+    sign = apr_psprintf(g_pool, "%s.%s", prot64, pay64);
+    ck_assert_int_eq(md_crypt_sign64(&sign64, pkey, g_pool, sign, strlen(sign)), APR_SUCCESS);
+    return apr_psprintf(g_pool, "{\"payload\":\"%s\",\"protected\":\"%s\",\"signature\":\"%s\"}",
+                        pay64, prot64, sign64);
+}
+
+static const char *msg_compact(md_json_t *msg)
+{
+    return apr_psprintf(g_pool, "{\"payload\":\"%s\",\"protected\":\"%s\",\"signature\":\"%s\"}",
+                        md_json_gets(msg, "payload", NULL), md_json_gets(msg, "protected", NULL),
+                        md_json_gets(msg, "signature", NULL));
+}
+
+START_TEST(jws_key_sign_golden)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_RSA);
+    md_jws_key_t *key;
+    md_json_t *msg;
+    apr_table_t *hdrs = apr_table_make(g_pool, 5);
+    const char *thumb, *expected;
+    md_data_t payload, prot;
+
+    /* RSA signatures are deterministic, the whole message can be compared */
+    apr_table_setn(hdrs, "nonce", "abc123");
+    apr_table_setn(hdrs, "url", "https://ca.example/new-order");
+    MD_DATA_SET_STR(&payload, "{\"test\":\"payload\"}");
+    ck_assert_int_eq(md_jws_key_make(&key, g_pool, pkey), APR_SUCCESS);
+
+    expected = apr_psprintf(g_pool, "{\"alg\":\"RS256\",\"jwk\":{\"e\":\"%s\",\"kty\":\"RSA\","
+                            "\"n\":\"%s\"},\"nonce\":\"abc123\","
+                            "\"url\":\"https://ca.example/new-order\"}",
+                            md_pkey_get_rsa_e64(pkey, g_pool), md_pkey_get_rsa_n64(pkey, g_pool));
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key, NULL), APR_SUCCESS);
+    ck_assert(md_util_base64url_decode(&prot, md_json_gets(msg, "protected", NULL), g_pool) > 0);
+    ck_assert_str_eq(apr_pstrndup(g_pool, prot.data, prot.len), expected);
+    ck_assert_str_eq(msg_compact(msg), golden_jws(pkey, expected, &payload));
+    /* a reused key gives the same message again */
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key, NULL), APR_SUCCESS);
+    ck_assert_str_eq(msg_compact(msg), golden_jws(pkey, expected, &payload));
+
+    expected = "{\"alg\":\"RS256\",\"kid\":\"https://ca.example/acct/1\","
+               "\"nonce\":\"abc123\",\"url\":\"https://ca.example/new-order\"}";
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key,
+                                     "https://ca.example/acct/1"), APR_SUCCESS);
+    ck_assert_str_eq(msg_compact(msg), golden_jws(pkey, expected, &payload));
+
+    ck_assert_int_eq(md_jws_pkey_thumb(&thumb, g_pool, pkey), APR_SUCCESS);
+    ck_assert_str_eq(key->thumb64, thumb);
+    md_pkey_free(pkey);
+}
+END_TEST
+
+START_TEST(jws_key_sign_kid_header)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_EC);
+    md_jws_key_t *key;
+    md_json_t *msg, *prot;
+    apr_table_t *hdrs = apr_table_make(g_pool, 5);
+    md_data_t payload;
+
+    apr_table_setn(hdrs, "nonce", "n\"1\\");
+    MD_DATA_SET_STR(&payload, "");
+    ck_assert_int_eq(md_jws_key_make(&key, g_pool, pkey), APR_SUCCESS);
+
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key,
+                                     "https://ca.example/acct/1"), APR_SUCCESS);
+    prot = msg_protected(msg);
+    ck_assert_str_eq(md_json_gets(prot, "alg", NULL), "ES256");
+    ck_assert_str_eq(md_json_gets(prot, "kid", NULL), "https://ca.example/acct/1");
+    ck_assert_str_eq(md_json_gets(prot, "nonce", NULL), "n\"1\\");
+    ck_assert(!md_json_has_key(prot, "jwk", NULL));
+
+    /* another account with the same key */
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key,
+                                     "https://ca.example/acct/2"), APR_SUCCESS);
+    ck_assert_str_eq(md_json_gets(msg_protected(msg), "kid", NULL), "https://ca.example/acct/2");
+
+    ck_assert_int_eq(md_jws_key_sign(&msg, g_pool, &payload, hdrs, key, NULL), APR_SUCCESS);
+    prot = msg_protected(msg);
+    ck_assert(!md_json_has_key(prot, "kid", NULL));
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "kty", NULL), "EC");
+    md_pkey_free(pkey);
+}
+END_TEST
+
+/* A CSR and a self signed certificate made with the key verify with it */
+static void cert_req_roundtrip(md_pkey_t *pkey)
+{
+    apr_array_header_t *domains = apr_array_make(g_pool, 2, sizeof(const char*));
+    const char *csr64;
+    const unsigned char *der;
+    md_data_t data;
+    X509_REQ *req;
+    md_cert_t *cert;
+
+    APR_ARRAY_PUSH(domains, const char*) = "example.org";
+    APR_ARRAY_PUSH(domains, const char*) = "www.example.org";
+    ck_assert_int_eq(md_cert_req_create(&csr64, "example.org", domains, 0, pkey, g_pool),
+                     APR_SUCCESS);
+    ck_assert(md_util_base64url_decode(&data, csr64, g_pool) > 0);
+    der = (const unsigned char*)data.data;
+    req = d2i_X509_REQ(NULL, &der, (long)data.len);
+    ck_assert_ptr_nonnull(req);
+    ck_assert_int_eq(X509_REQ_verify(req, md_pkey_get_EVP_PKEY(pkey)), 1);
+    X509_REQ_free(req);
+
+    ck_assert_int_eq(md_cert_self_sign(&cert, "example.org", domains, pkey,
+                                       apr_time_from_sec(3600), g_pool), APR_SUCCESS);
+    ck_assert_int_eq(X509_verify(md_cert_get_X509(cert), md_pkey_get_EVP_PKEY(pkey)), 1);
+    ck_assert(md_cert_covers_domain(cert, "www.example.org"));
+}
+
+START_TEST(jws_ec_cert_req_roundtrip)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_EC);
+
+    cert_req_roundtrip(pkey);
+    md_pkey_free(pkey);
+}
+END_TEST
+
+#ifdef NID_ED25519
+START_TEST(jws_ed25519_cert_req_roundtrip)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_ED25519);
+
+    /* Ed25519 signs without a separate digest */
+    cert_req_roundtrip(pkey);
+    md_pkey_free(pkey);
+}
+END_TEST
+
+START_TEST(jws_eddsa_signature_verifies)
+{
+    md_pkey_t *pkey = gen_key(MD_PKEY_TYPE_ED25519);
+    md_json_t *msg = sign_msg(pkey), *prot = msg_protected(msg);
+    md_data_t sig;
+    const char *input = msg_signing_input(msg);
+    EVP_MD_CTX *ctx;
+
+    ck_assert_str_eq(md_json_gets(prot, "alg", NULL), "EdDSA");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "kty", NULL), "OKP");
+    ck_assert_str_eq(md_json_gets(prot, "jwk", "crv", NULL), "Ed25519");
+
+    ck_assert_uint_eq(md_util_base64url_decode(&sig, md_json_gets(msg, "signature", NULL),
+                                               g_pool), 64);
+    ctx = EVP_MD_CTX_new();
+    ck_assert_int_eq(EVP_DigestVerifyInit(ctx, NULL, NULL, NULL,
+                                          md_pkey_get_EVP_PKEY(pkey)), 1);
+    ck_assert_int_eq(EVP_DigestVerify(ctx, (const unsigned char*)sig.data, sig.len,
+                                      (const unsigned char*)input, strlen(input)), 1);
+    EVP_MD_CTX_free(ctx);
+    md_pkey_free(pkey);
+}
+END_TEST
+#endif
+
+TCase *md_jws_test_case(void)
+{
+    TCase *testcase = tcase_create("md_jws");
+
+    tcase_add_checked_fixture(testcase, jws_setup, jws_teardown);
+
+    tcase_add_test(testcase, jws_es256_signature_verifies);
+    tcase_add_test(testcase, jws_es384_signature_verifies);
+    tcase_add_test(testcase, jws_rsa_thumbprint_unchanged);
+    tcase_add_test(testcase, jws_ec_thumbprint_members);
+    tcase_add_test(testcase, jws_key_sign_golden);
+    tcase_add_test(testcase, jws_key_sign_kid_header);
+    tcase_add_test(testcase, jws_ec_cert_req_roundtrip);
+#ifdef NID_ED25519
+    tcase_add_test(testcase, jws_ed25519_cert_req_roundtrip);
+    tcase_add_test(testcase, jws_eddsa_signature_verifies);
+#endif
+
+    return testcase;
+}
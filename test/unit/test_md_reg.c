@@ -0,0 +1,203 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apr_file_io.h>
+#include <apr_hash.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+
+#include "test_common.h"
+#include "md.h"
+#include "md_crypt.h"
+#include "md_reg.h"
+#include "md_store.h"
+#include "md_store_fs.h"
+#include "md_util.h"
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+static const char *g_dir;
+static md_reg_t *g_reg;
+
+static void md_reg_setup(void)
+{
+    md_store_t *store;
+    const char *tmp;
+
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+    md_crypt_init(g_pool);
+    ck_assert_int_eq(APR_SUCCESS, apr_temp_dir_get(&tmp, g_pool));
+    g_dir = apr_psprintf(g_pool, "%s/md-unit-reg-%d", tmp, (int)getpid());
+    ck_assert_int_eq(APR_SUCCESS, md_store_fs_init(&store, g_pool, g_dir));
+    ck_assert_int_eq(APR_SUCCESS, md_reg_create(&g_reg, g_pool, store, NULL));
+}
+
+static void md_reg_teardown(void)
+{
+    md_util_rm_recursive(g_dir, g_pool, 5);
+    apr_pool_destroy(g_pool);
+}
+
+/*
+ * Helpers
+ */
+
+/* collects the public x coordinate of all keys in the pool */
+static int collect_pooled(void *baton, const char *name, const char *aspect,
+                          md_store_vtype_t vtype, void *value, apr_pool_t *ptemp)
+{
+    apr_hash_t *pooled = baton;
+    const char *x64, *y64;
+
+    (void)name;
+    (void)aspect;
+    (void)vtype;
+    ck_assert_int_eq(APR_SUCCESS, md_pkey_get_ec_xy64(&x64, &y64, value, ptemp));
+    x64 = apr_pstrdup(g_pool, x64);
+    apr_hash_set(pooled, x64, APR_HASH_KEY_STRING, x64);
+    return 1;
+}
+
+static apr_hash_t *pooled_keys(void)
+{
+    apr_hash_t *pooled = apr_hash_make(g_pool);
+
+    md_store_iter(collect_pooled, pooled, md_reg_store_get(g_reg), g_pool,
+                  MD_SG_KEYPOOL, "*", "privkey-*.pem", MD_SV_PKEY);
+    return pooled;
+}
+
+/*
+ * Tests
+ */
+
+START_TEST(keypool_fill_take)
+{
+    md_pkey_spec_t spec;
+    md_pkey_t *pkey;
+    apr_hash_t *pooled;
+    const char *x64, *y64;
+    int generated;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.type = MD_PKEY_TYPE_EC;
+    spec.params.ec.curve = MD_PKEY_EC_CURVE_DEF;
+
+    /* filling adds at most max keys per call, until depth is reached */
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 2, 1, &generated, g_pool));
+    ck_assert_int_eq(1, generated);
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 2, 5, &generated, g_pool));
+    ck_assert_int_eq(1, generated);
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 2, 5, &generated, g_pool));
+    ck_assert_int_eq(0, generated);
+    pooled = pooled_keys();
+    ck_assert_int_eq(2, apr_hash_count(pooled));
+
+    /* taking a key gives one from the pool and removes it there */
+    ck_assert_int_eq(APR_SUCCESS, md_reg_pkey_get(&pkey, g_reg, &spec, g_pool));
+    ck_assert_int_eq(APR_SUCCESS, md_pkey_get_ec_xy64(&x64, &y64, pkey, g_pool));
+    ck_assert_ptr_nonnull(apr_hash_get(pooled, x64, APR_HASH_KEY_STRING));
+    ck_assert_int_eq(1, apr_hash_count(pooled_keys()));
+    ck_assert(!apr_hash_get(pooled_keys(), x64, APR_HASH_KEY_STRING));
+
+    ck_assert_int_eq(APR_SUCCESS, md_reg_pkey_get(&pkey, g_reg, &spec, g_pool));
+    ck_assert_int_eq(0, apr_hash_count(pooled_keys()));
+
+    /* an empty pool generates a fresh key */
+    ck_assert_int_eq(APR_SUCCESS, md_reg_pkey_get(&pkey, g_reg, &spec, g_pool));
+    ck_assert_int_eq(MD_PKEY_TYPE_EC, md_pkey_get_type(pkey));
+    ck_assert_int_eq(APR_SUCCESS, md_pkey_get_ec_xy64(&x64, &y64, pkey, g_pool));
+    ck_assert(!apr_hash_get(pooled, x64, APR_HASH_KEY_STRING));
+    ck_assert_int_eq(0, apr_hash_count(pooled_keys()));
+}
+END_TEST
+
+static int count_names(void *baton, const char *name, const char *aspect,
+                       md_store_vtype_t vtype, void *value, apr_pool_t *ptemp)
+{
+    (void)name;
+    (void)aspect;
+    (void)vtype;
+    (void)value;
+    (void)ptemp;
+    ++(*(int*)baton);
+    return 1;
+}
+
+START_TEST(keypool_unreadable_prune)
+{
+    md_store_t *store = md_reg_store_get(g_reg);
+    md_pkey_spec_t spec;
+    md_pkey_t *pkey;
+    apr_array_header_t *specs;
+    int generated, count;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.type = MD_PKEY_TYPE_EC;
+    spec.params.ec.curve = MD_PKEY_EC_CURVE_DEF;
+
+    /* a key that can not be loaded, as after an import from another store */
+    ck_assert_int_eq(APR_SUCCESS, md_store_save(store, g_pool, MD_SG_KEYPOOL, 
+                                                md_pkey_spec_name(&spec), "privkey-1.pem", 
+                                                MD_SV_TEXT, (void*)"not a key", 0));
+    /* it does not count and is removed */
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 1, 1, &generated, g_pool));
+    ck_assert_int_eq(1, generated);
+    ck_assert_int_eq(1, apr_hash_count(pooled_keys()));
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 1, 1, &generated, g_pool));
+    ck_assert_int_eq(0, generated);
+
+    /* taking keys steps over the ones that can not be loaded */
+    ck_assert_int_eq(APR_SUCCESS, md_store_save(store, g_pool, MD_SG_KEYPOOL, 
+                                                md_pkey_spec_name(&spec), "privkey-0.pem", 
+                                                MD_SV_TEXT, (void*)"not a key", 0));
+    ck_assert_int_eq(APR_SUCCESS, md_reg_pkey_get(&pkey, g_reg, &spec, g_pool));
+    ck_assert_int_eq(MD_PKEY_TYPE_EC, md_pkey_get_type(pkey));
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 1, 0, &generated, g_pool));
+    ck_assert_int_eq(0, apr_hash_count(pooled_keys()));
+
+    /* pools of specs no longer in use are removed */
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_fill(g_reg, &spec, 1, 1, &generated, g_pool));
+    ck_assert_int_eq(APR_SUCCESS, md_store_save(store, g_pool, MD_SG_KEYPOOL, "rsa-3072", 
+                                                "privkey-1.pem", MD_SV_TEXT, (void*)"x", 0));
+    specs = apr_array_make(g_pool, 1, sizeof(md_pkey_spec_t*));
+    APR_ARRAY_PUSH(specs, md_pkey_spec_t*) = &spec;
+    ck_assert_int_eq(APR_SUCCESS, md_reg_keypool_prune(g_reg, specs, g_pool));
+    count = 0;
+    md_store_iter_names(count_names, &count, store, g_pool, MD_SG_KEYPOOL, "*");
+    ck_assert_int_eq(1, count);
+    ck_assert_int_eq(1, apr_hash_count(pooled_keys()));
+}
+END_TEST
+
+TCase *md_reg_test_case(void)
+{
+    TCase *testcase = tcase_create("md_reg");
+
+    tcase_add_checked_fixture(testcase, md_reg_setup, md_reg_teardown);
+
+    tcase_add_test(testcase, keypool_fill_take);
+    tcase_add_test(testcase, keypool_unreadable_prune);
+
+    return testcase;
+}
@@ -13,6 +13,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <apr_strings.h>
 
 #include "test_common.h"
 #include "md_util.h"
@@ -99,6 +102,133 @@ START_TEST(base64_md_util_largetrip)
 }
 END_TEST
 
+START_TEST(jitter_md_util_bounds)
+{
+    apr_interval_time_t base = apr_time_from_msec(100), cap = apr_time_from_sec(10);
+    apr_interval_time_t prev = base, delay;
+    int i;
+    
+    for (i = 0; i < 100; ++i) {
+        delay = md_util_jitter_delay(base, prev, cap);
+        ck_assert(delay >= base);
+        ck_assert(delay <= cap);
+        ck_assert(delay <= prev * 3);
+        prev = delay;
+    }
+    ck_assert_int_eq(base, md_util_jitter_delay(base, 0, cap));
+    ck_assert_int_eq(cap, md_util_jitter_delay(cap * 2, cap, cap));
+}
+END_TEST
+
+typedef struct {
+    int calls;
+    apr_interval_time_t suggest;
+} try_ctx_t;
+
+static apr_status_t try_twice(void *baton, int i, apr_interval_time_t *pdelay)
+{
+    try_ctx_t *ctx = baton;
+    
+    ++ctx->calls;
+    *pdelay = ctx->suggest;
+    return (i < 1)? APR_EAGAIN : APR_SUCCESS;
+}
+
+START_TEST(try_md_util_suggested_delay)
+{
+    try_ctx_t ctx;
+    apr_time_t start;
+    
+    ctx.calls = 0;
+    ctx.suggest = apr_time_from_msec(300);
+    start = apr_time_now();
+    ck_assert_int_eq(APR_SUCCESS, md_util_try(try_twice, &ctx, 0, apr_time_from_sec(5), 
+                                              0, 0, 1));
+    ck_assert_int_eq(2, ctx.calls);
+    /* the suggestion is followed, not the 100ms default */
+    ck_assert(apr_time_now() - start >= apr_time_from_msec(300));
+}
+END_TEST
+
+typedef struct {
+    int calls;
+    apr_status_t rv;
+    int exit_code;
+    const char *output;
+} exec_ctx_t;
+
+static void exec_done(void *baton, const char * const *argv, apr_status_t rv, 
+                      int exit_code, const char *output, apr_pool_t *p)
+{
+    exec_ctx_t *ctx = baton;
+    
+    (void)argv;
+    (void)p;
+    ++ctx->calls;
+    ctx->rv = rv;
+    ctx->exit_code = exit_code;
+    ctx->output = apr_pstrdup(g_pool, output);
+}
+
+START_TEST(exec_md_util_pool)
+{
+    const char *argv_exit[] = { "/bin/sh", "-c", "echo hello; exit 3", NULL };
+    const char *argv_hang[] = { "/bin/sh", "-c", "sleep 10", NULL };
+    md_util_exec_pool_t *exec;
+    exec_ctx_t ctx1, ctx2;
+    apr_time_t start;
+    
+    memset(&ctx1, 0, sizeof(ctx1));
+    memset(&ctx2, 0, sizeof(ctx2));
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_pool_create(&exec, g_pool, 1, 
+                                                           apr_time_from_msec(500)));
+    start = apr_time_now();
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_start(exec, argv_exit, exec_done, &ctx1));
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_start(exec, argv_hang, exec_done, &ctx2));
+    /* starting does not wait and the second one waits for a free slot */
+    ck_assert_int_eq(0, ctx1.calls);
+    ck_assert_int_eq(2, md_util_exec_poll(exec) + ctx1.calls);
+    md_util_exec_wait(exec);
+    
+    ck_assert_int_eq(1, ctx1.calls);
+    ck_assert_int_eq(APR_SUCCESS, ctx1.rv);
+    ck_assert_int_eq(3, ctx1.exit_code);
+    ck_assert_str_eq("hello", ctx1.output);
+    /* the second one got killed */
+    ck_assert_int_eq(1, ctx2.calls);
+    ck_assert_int_eq(APR_TIMEUP, ctx2.rv);
+    ck_assert(apr_time_now() - start < apr_time_from_sec(5));
+}
+END_TEST
+
+START_TEST(exec_md_util_once)
+{
+    const char *argv_slow[] = { "/bin/sh", "-c", "sleep 2; exit 0", NULL };
+    const char *argv_other[] = { "/bin/sh", "-c", "sleep 2; exit 1", NULL };
+    md_util_exec_pool_t *exec;
+    exec_ctx_t ctx1, ctx2;
+    apr_time_t end;
+    
+    memset(&ctx1, 0, sizeof(ctx1));
+    memset(&ctx2, 0, sizeof(ctx2));
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_pool_create(&exec, g_pool, 2, 0));
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_start(exec, argv_slow, exec_done, &ctx1));
+    ck_assert_int_eq(APR_SUCCESS, md_util_exec_start(exec, argv_other, exec_done, &ctx2));
+    /* asking for it again while it runs, as a watchdog polling more often would */
+    end = apr_time_now() + apr_time_from_sec(4);
+    while (!ctx1.calls && apr_time_now() < end) {
+        ck_assert_int_eq(APR_EEXIST, md_util_exec_start(exec, argv_slow, exec_done, &ctx1));
+        md_util_exec_poll(exec);
+        apr_sleep(apr_time_from_msec(250));
+    }
+    md_util_exec_wait(exec);
+    ck_assert_int_eq(1, ctx1.calls);
+    ck_assert_int_eq(0, ctx1.exit_code);
+    ck_assert_int_eq(1, ctx2.calls);
+    ck_assert_int_eq(1, ctx2.exit_code);
+}
+END_TEST
+
 TCase *md_util_test_case(void)
 {
     TCase *testcase = tcase_create("md_util");
@@ -107,6 +237,10 @@ TCase *md_util_test_case(void)
 
     tcase_add_test(testcase, base64_md_util_roundtrip);
     tcase_add_test(testcase, base64_md_util_largetrip);
+    tcase_add_test(testcase, jitter_md_util_bounds);
+    tcase_add_test(testcase, try_md_util_suggested_delay);
+    tcase_add_test(testcase, exec_md_util_pool);
+    tcase_add_test(testcase, exec_md_util_once);
 
     return testcase;
 }